@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# sequential write and read throughput for a range of block sizes;
+# run it on a ceph-fuse mount and a kernel mount to compare the two
+
+set -e
+
+size_mb=${SEQ_THROUGHPUT_SIZE_MB:-1024}
+file=seq_throughput.$$
+
+for bs in 4k 64k 128k 1M 4M; do
+    count=$(( size_mb * 1024 * 1024 / $(numfmt --from=iec ${bs^^}) ))
+    echo "== block size $bs"
+    dd if=/dev/zero of=$file bs=$bs count=$count conv=fsync 2>&1 | tail -1
+    # drop the page cache so the read goes through the client
+    sudo sh -c 'echo 3 > /proc/sys/vm/drop_caches'
+    dd if=$file of=/dev/null bs=$bs 2>&1 | tail -1
+    rm -f $file
+done
@@ -244,6 +244,10 @@ Client::Client(Messenger *m, MonClient *mc, Objecter *objecter_)
     interrupt_finisher(m->cct),
     remount_finisher(m->cct),
     objecter_finisher(m->cct),
+    aio_finisher(m->cct, "Client::aio_finisher", "client_aio_fin"),
+    aio_tp(m->cct, "Client::aio_tp", "client_aio", m->cct->_conf->client_aio_threads,
+	   "client_aio_threads"),
+    aio_wq(NULL), aio_in_flight(0),
     tick_event(NULL),
     messenger(m), monclient(mc),
     objecter(objecter_),
@@ -293,6 +297,8 @@ Client::Client(Messenger *m, MonClient *mc, Objecter *objecter_)
 				  true));
   objecter_finisher.start();
   filer.reset(new Filer(objecter, &objecter_finisher));
+  aio_wq = new ContextWQ("Client::aio_wq", 0, &aio_tp);
+  aio_finisher.start();
 }
 
 
@@ -301,6 +307,7 @@ Client::~Client()
   assert(!client_lock.is_locked());
 
   tear_down_cache();
+  delete aio_wq;
 }
 
 void Client::tear_down_cache()
@@ -468,12 +475,24 @@ int Client::init()
 
 void Client::_finish_init()
 {
+  aio_tp.start();
+
   client_lock.Lock();
   // logger
   PerfCountersBuilder plb(cct, "client", l_c_first, l_c_last);
   plb.add_time_avg(l_c_reply, "reply", "Latency of receiving a reply on metadata request");
   plb.add_time_avg(l_c_lat, "lat", "Latency of processing a metadata request");
   plb.add_time_avg(l_c_wrlat, "wrlat", "Latency of a file data write operation");
+  plb.add_u64_counter(l_c_dentry_hit, "dentry_hit",
+		      "Lookups answered from a cached dentry");
+  plb.add_u64_counter(l_c_dentry_neg_hit, "dentry_neg_hit",
+		      "Lookups answered ENOENT without asking the MDS");
+  plb.add_u64_counter(l_c_readdir_cached, "readdir_cached",
+		      "Readdir calls served from the dentry cache");
+  plb.add_u64_counter(l_c_aio_fast, "aio_fast",
+		      "Async I/O submitted without a worker thread");
+  plb.add_u64_counter(l_c_aio_queued, "aio_queued",
+		      "Async I/O handed to a worker thread");
   logger.reset(plb.create_perf_counters());
   cct->get_perfcounters_collection()->add(logger.get());
 
@@ -571,6 +590,11 @@ void Client::shutdown()
     remount_finisher.stop();
   }
 
+  aio_wq->drain();
+  aio_tp.stop();
+  aio_finisher.wait_for_empty();
+  aio_finisher.stop();
+
   objectcacher->stop();  // outside of client_lock! this does a join.
 
   client_lock.Lock();
@@ -1320,7 +1344,12 @@ Inode* Client::insert_trace(MetaRequest *request, MetaSession *session)
 	  unlink(dn, true, true);  // keep dir, dentry
 	}
       }
-      if (dlease.duration_ms > 0) {
+      // keep a null dentry if it is covered by a dentry lease, or by
+      // the dir's Fs cap: the MDS revokes Fs before the name can appear,
+      // and a later grant bumps shared_gen, invalidating it
+      if (dlease.duration_ms > 0 ||
+	  (cct->_conf->client_cache_negative_dentries &&
+	   diri->caps_issued_mask(CEPH_CAP_FILE_SHARED))) {
 	if (!dn) {
 	  Dir *dir = diri->open_dir();
 	  dn = link(dir, dname, NULL, NULL);
@@ -5729,6 +5758,11 @@ void Client::unmount()
   ldout(cct, 2) << "unmounting" << dendl;
   unmounting = true;
 
+  while (aio_in_flight > 0) {
+    ldout(cct, 10) << "waiting on " << aio_in_flight << " async ios" << dendl;
+    mount_cond.Wait(client_lock);
+  }
+
   while (!mds_requests.empty()) {
     ldout(cct, 10) << "waiting on " << mds_requests.size() << " requests" << dendl;
     mount_cond.Wait(client_lock);
@@ -6026,6 +6060,7 @@ int Client::_lookup(Inode *dir, const string& dname, int mask, InodeRef *target,
 	if (!dn->inode && (dir->flags & I_COMPLETE)) {
 	  ldout(cct, 10) << "_lookup concluded ENOENT locally for "
 			 << *dir << " dn '" << dname << "'" << dendl;
+	  logger->inc(l_c_dentry_neg_hit);
 	  return -ENOENT;
 	}
       }
@@ -6037,6 +6072,7 @@ int Client::_lookup(Inode *dir, const string& dname, int mask, InodeRef *target,
     if (dir->caps_issued_mask(CEPH_CAP_FILE_SHARED) &&
 	(dir->flags & I_COMPLETE)) {
       ldout(cct, 10) << "_lookup concluded ENOENT locally for " << *dir << " dn '" << dname << "'" << dendl;
+      logger->inc(l_c_dentry_neg_hit);
       return -ENOENT;
     }
   }
@@ -6047,8 +6083,10 @@ int Client::_lookup(Inode *dir, const string& dname, int mask, InodeRef *target,
  hit_dn:
   if (dn->inode) {
     *target = dn->inode;
+    logger->inc(l_c_dentry_hit);
   } else {
     r = -ENOENT;
+    logger->inc(l_c_dentry_neg_hit);
   }
   touch_dn(dn);
 
@@ -7598,8 +7636,10 @@ int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p,
       dirp->inode->is_complete_and_ordered() &&
       dirp->inode->caps_issued_mask(CEPH_CAP_FILE_SHARED)) {
     int err = _readdir_cache_cb(dirp, cb, p, caps, getref);
-    if (err != -EAGAIN)
+    if (err != -EAGAIN) {
+      logger->inc(l_c_readdir_cached);
       return err;
+    }
   }
 
   while (1) {
@@ -8618,6 +8658,14 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
     delete onfinish;
   }
 
+  _readahead(f, off, len);
+  return r;
+}
+
+void Client::_readahead(Fh *f, uint64_t off, uint64_t len)
+{
+  Inode *in = f->inode.get();
+
   if(f->readahead.get_min_readahead_size() > 0) {
     pair<uint64_t, uint64_t> readahead_extent = f->readahead.update(off, len, in->size);
     if (readahead_extent.second > 0) {
@@ -8636,8 +8684,6 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
       }
     }
   }
-
-  return r;
 }
 
 int Client::_read_sync(Fh *f, uint64_t off, uint64_t len, bufferlist *bl,
@@ -8741,7 +8787,14 @@ int Client::write(int fd, const char *buf, loff_t size, loff_t offset)
   if (fh->flags & O_PATH)
     return -EBADF;
 #endif
-  int r = _write(fh, offset, size, buf, NULL, 0);
+  if (size < 0)
+    return -EINVAL;
+
+  // copy into fresh buffer (since our write may be resub, async)
+  bufferlist bl;
+  if (size > 0)
+    bl.append(buf, size);
+  int r = _write(fh, offset, bl);
   ldout(cct, 3) << "write(" << fd << ", \"...\", " << size << ", " << offset << ") = " << r << dendl;
   return r;
 }
@@ -8771,7 +8824,13 @@ int Client::_preadv_pwritev(int fd, const struct iovec *iov, unsigned iovcnt, in
         totallen += iov[i].iov_len;
     }
     if (write) {
-        int w = _write(fh, offset, totallen, NULL, iov, iovcnt);
+        // copy into fresh buffer (since our write may be resub, async)
+        bufferlist bl;
+        for (unsigned i = 0; i < iovcnt; i++) {
+            if (iov[i].iov_len > 0)
+                bl.append((const char *)iov[i].iov_base, iov[i].iov_len);
+        }
+        int w = _write(fh, offset, bl);
         ldout(cct, 3) << "pwritev(" << fd << ", \"...\", " << totallen << ", " << offset << ") = " << w << dendl;
         return w;
     } else {
@@ -8800,9 +8859,9 @@ int Client::_preadv_pwritev(int fd, const struct iovec *iov, unsigned iovcnt, in
     }
 }
 
-int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
-                  const struct iovec *iov, int iovcnt)
+int Client::_write(Fh *f, int64_t offset, bufferlist& bl)
 {
+  uint64_t size = bl.length();
   if ((uint64_t)(offset+size) > mdsmap->get_max_filesize()) //too large!
     return -EFBIG;
 
@@ -8859,19 +8918,6 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
     assert(in->inline_version > 0);
   }
 
-  // copy into fresh buffer (since our write may be resub, async)
-  bufferlist bl;
-  if (buf) {
-    if (size > 0)
-      bl.append(buf, size);
-  } else if (iov){
-    for (int i = 0; i < iovcnt; i++) {
-      if (iov[i].iov_len > 0) {
-        bl.append((const char *)iov[i].iov_base, iov[i].iov_len);
-      }
-    }
-  }
-
   utime_t lat;
   uint64_t totalwritten;
   int have;
@@ -12250,6 +12296,19 @@ int Client::ll_commit_blocks(Inode *in,
 
 int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
 {
+  if (len < 0)
+    return -EINVAL;
+
+  bufferlist bl;
+  if (len > 0)
+    bl.append(data, len);
+  return ll_write(fh, off, bl);
+}
+
+int Client::ll_write(Fh *fh, loff_t off, bufferlist& bl)
+{
+  loff_t len = bl.length();
+
   Mutex::Locker lock(client_lock);
   ldout(cct, 3) << "ll_write " << fh << " " << fh->inode->ino << " " << off <<
     "~" << len << dendl;
@@ -12258,12 +12317,196 @@ int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
   tout(cct) << off << std::endl;
   tout(cct) << len << std::endl;
 
-  int r = _write(fh, off, len, data, NULL, 0);
+  int r = _write(fh, off, bl);
   ldout(cct, 3) << "ll_write " << fh << " " << off << "~" << len << " = " << r
 		<< dendl;
   return r;
 }
 
+// async I/O
+//
+// Ops that can be carried out without waiting for the MDS are submitted
+// right away from the caller's thread: cached getattrs, buffered writes
+// and reads through the ObjectCacher, whose misses complete from the
+// ObjectCacher's own callbacks.  Everything else runs the synchronous
+// path on aio_wq.  Either way onfinish is completed by aio_finisher,
+// outside of client_lock.
+
+void Client::_aio_finish(Context *onfinish, int r)
+{
+  assert(client_lock.is_locked_by_me());
+  assert(aio_in_flight > 0);
+  if (--aio_in_flight == 0 && unmounting)
+    mount_cond.Signal();
+  aio_finisher.queue(onfinish, r);
+}
+
+int Client::ll_aio_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl,
+			Context *onfinish)
+{
+  if (off < 0 || len < 0)
+    return -EINVAL;
+
+  Mutex::Locker lock(client_lock);
+  ldout(cct, 3) << "ll_aio_read " << fh << " " << fh->inode->ino << " " << off
+		<< "~" << len << dendl;
+
+  const md_config_t *conf = cct->_conf;
+  Inode *in = fh->inode.get();
+  ++aio_in_flight;
+
+  if ((fh->mode & CEPH_FILE_MODE_RD) &&
+      conf->client_oc && !conf->client_debug_force_sync_read &&
+      !(fh->flags & (O_DIRECT | O_RSYNC)) &&
+      in->inline_version == CEPH_INLINE_NONE &&
+      _aio_caps_ready(in, CEPH_CAP_FILE_RD | CEPH_CAP_FILE_CACHE)) {
+    logger->inc(l_c_aio_fast);
+    int have;
+    int r = get_caps(in, CEPH_CAP_FILE_RD, CEPH_CAP_FILE_CACHE, &have, -1);
+    if (r < 0) {
+      _aio_finish(onfinish, r);
+      return 0;
+    }
+    if ((uint64_t)off >= in->size || len == 0) {
+      put_cap_ref(in, CEPH_CAP_FILE_RD);
+      _aio_finish(onfinish, 0);
+      return 0;
+    }
+    if ((uint64_t)(off + len) > in->size)
+      len = in->size - off;
+
+    // completed by the ObjectCacher with client_lock held
+    InodeRef ref(in);
+    Context *onread = new FunctionContext(
+      [this, ref, bl, onfinish](int r) {
+	put_cap_ref(ref.get(), CEPH_CAP_FILE_RD | CEPH_CAP_FILE_CACHE);
+	_aio_finish(onfinish, r < 0 ? r : bl->length());
+      });
+    r = objectcacher->file_read(&in->oset, &in->layout, in->snapid,
+				off, len, bl, 0, onread);
+    if (r == 0) {
+      get_cap_ref(in, CEPH_CAP_FILE_CACHE);
+    } else {
+      // it was cached.
+      delete onread;
+      put_cap_ref(in, CEPH_CAP_FILE_RD);
+      _aio_finish(onfinish, r < 0 ? r : bl->length());
+    }
+    _readahead(fh, off, len);
+    return 0;
+  }
+
+  logger->inc(l_c_aio_queued);
+  fh->get();
+  aio_wq->queue(new FunctionContext(
+    [this, fh, off, len, bl, onfinish](int) {
+      Mutex::Locker lock(client_lock);
+      int r = _read(fh, off, len, bl);
+      _put_fh(fh);
+      _aio_finish(onfinish, r);
+    }));
+  return 0;
+}
+
+int Client::ll_aio_write(Fh *fh, loff_t off, loff_t len, const char *data,
+			 Context *onfinish)
+{
+  if (off < 0 || len < 0)
+    return -EINVAL;
+
+  bufferlist bl;
+  if (len > 0)
+    bl.append(data, len);
+
+  Mutex::Locker lock(client_lock);
+  ldout(cct, 3) << "ll_aio_write " << fh << " " << fh->inode->ino << " " << off
+		<< "~" << len << dendl;
+
+  Inode *in = fh->inode.get();
+  ++aio_in_flight;
+
+  // a buffered write only blocks if the ObjectCacher has to throttle
+  // on dirty data, which is what we want
+  if ((fh->mode & CEPH_FILE_MODE_WR) &&
+      cct->_conf->client_oc &&
+      !(fh->flags & (O_DIRECT | O_SYNC | O_DSYNC)) &&
+      in->inline_version == CEPH_INLINE_NONE &&
+      !(in->mode & S_ISUID) &&
+      (in->mode & (S_ISGID | S_IXGRP)) != (S_ISGID | S_IXGRP) &&
+      in->cap_snaps.empty() &&
+      (uint64_t)(off + len) <= in->max_size &&
+      _aio_caps_ready(in, CEPH_CAP_FILE_WR | CEPH_CAP_FILE_BUFFER |
+		      CEPH_CAP_AUTH_SHARED)) {
+    logger->inc(l_c_aio_fast);
+    int r = _write(fh, off, bl);
+    _aio_finish(onfinish, r);
+    return 0;
+  }
+
+  logger->inc(l_c_aio_queued);
+  fh->get();
+  aio_wq->queue(new FunctionContext(
+    [this, fh, off, bl, onfinish](int) mutable {
+      Mutex::Locker lock(client_lock);
+      int r = _write(fh, off, bl);
+      _put_fh(fh);
+      _aio_finish(onfinish, r);
+    }));
+  return 0;
+}
+
+int Client::ll_aio_fsync(Fh *fh, bool syncdataonly, Context *onfinish)
+{
+  Mutex::Locker lock(client_lock);
+  ldout(cct, 3) << "ll_aio_fsync " << fh << " " << fh->inode->ino << dendl;
+
+  ++aio_in_flight;
+  logger->inc(l_c_aio_queued);
+  fh->get();
+  aio_wq->queue(new FunctionContext(
+    [this, fh, syncdataonly, onfinish](int) {
+      Mutex::Locker lock(client_lock);
+      int r = _fsync(fh, syncdataonly);
+      if (r) {
+	// If we're returning an error, clear it from the FH
+	fh->take_async_err();
+      }
+      _put_fh(fh);
+      _aio_finish(onfinish, r);
+    }));
+  return 0;
+}
+
+int Client::ll_aio_getattrx(Inode *in, struct ceph_statx *stx,
+			    unsigned int want, unsigned int flags,
+			    const UserPerm& perms, Context *onfinish)
+{
+  Mutex::Locker lock(client_lock);
+  ldout(cct, 3) << "ll_aio_getattrx " << _get_vino(in) << dendl;
+
+  unsigned mask = statx_to_mask(flags, want);
+  ++aio_in_flight;
+
+  if (!mask || in->caps_issued_mask(mask)) {
+    logger->inc(l_c_aio_fast);
+    fill_statx(in, mask, stx);
+    _aio_finish(onfinish, 0);
+    return 0;
+  }
+
+  logger->inc(l_c_aio_queued);
+  InodeRef ref(in);
+  aio_wq->queue(new FunctionContext(
+    [this, ref, stx, mask, perms, onfinish](int) {
+      Mutex::Locker lock(client_lock);
+      int r = _ll_getattr(ref.get(), mask, perms);
+      if (r == 0)
+	fill_statx(ref.get(), mask, stx);
+      _aio_finish(onfinish, r);
+    }));
+  return 0;
+}
+
 int Client::ll_flush(Fh *fh)
 {
   Mutex::Locker lock(client_lock);
@@ -13051,6 +13294,22 @@ int Client::check_pool_perm(Inode *in, int need)
   return 0;
 }
 
+bool Client::_aio_caps_ready(Inode *in, int need)
+{
+  // true if get_caps() for these caps would return without waiting
+  if (cct->_conf->client_check_pool_perm) {
+    auto it = pool_perms.find(make_pair(in->layout.pool_id,
+					in->layout.pool_ns));
+    if (it == pool_perms.end() || it->second == POOL_CHECKING)
+      return false;
+  }
+  if (in->flags & I_CAP_DROPPED)
+    return false;
+  int implemented;
+  int have = in->caps_issued(&implemented);
+  return (have & need) == need && (implemented & ~have & need) == 0;
+}
+
 int Client::_posix_acl_permission(Inode *in, const UserPerm& perms, unsigned want)
 {
   if (acl_type == POSIX_ACL) {
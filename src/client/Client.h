@@ -40,6 +40,7 @@ using std::fstream;
 #include "common/Mutex.h"
 #include "common/Timer.h"
 #include "common/Finisher.h"
+#include "common/WorkQueue.h"
 #include "common/compiler_extensions.h"
 #include "common/cmdparse.h"
 #include "common/CommandTable.h"
@@ -81,6 +82,11 @@ enum {
   l_c_reply,
   l_c_lat,
   l_c_wrlat,
+  l_c_dentry_hit,
+  l_c_dentry_neg_hit,
+  l_c_readdir_cached,
+  l_c_aio_fast,
+  l_c_aio_queued,
   l_c_last,
 };
 
@@ -284,6 +290,13 @@ class Client : public Dispatcher, public md_config_obs_t {
   Finisher remount_finisher;
   Finisher objecter_finisher;
 
+  // async I/O: completions are delivered by aio_finisher, ops that
+  // may block (cap acquisition, sync I/O, fsync) run on aio_wq
+  Finisher aio_finisher;
+  ThreadPool aio_tp;
+  ContextWQ *aio_wq;
+  int aio_in_flight;
+
   Context *tick_event;
   utime_t last_cap_renew;
   void renew_caps();
@@ -765,6 +778,10 @@ private:
 
   int _read_sync(Fh *f, uint64_t off, uint64_t len, bufferlist *bl, bool *checkeof);
   int _read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl);
+  void _readahead(Fh *f, uint64_t off, uint64_t len);
+
+  bool _aio_caps_ready(Inode *in, int need);
+  void _aio_finish(Context *onfinish, int r);
 
   // internal interface
   //   call these with client_lock held!
@@ -825,8 +842,7 @@ private:
 
   loff_t _lseek(Fh *fh, loff_t offset, int whence);
   int _read(Fh *fh, int64_t offset, uint64_t size, bufferlist *bl);
-  int _write(Fh *fh, int64_t offset, uint64_t size, const char *buf,
-          const struct iovec *iov, int iovcnt);
+  int _write(Fh *fh, int64_t offset, bufferlist& bl);
   int _preadv_pwritev(int fd, const struct iovec *iov, unsigned iovcnt, int64_t offset, bool write);
   int _flush(Fh *fh);
   int _fsync(Fh *fh, bool syncdataonly);
@@ -1202,6 +1218,16 @@ public:
 
   int ll_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl);
   int ll_write(Fh *fh, loff_t off, loff_t len, const char *data);
+  int ll_write(Fh *fh, loff_t off, bufferlist& bl);
+  // async variants; onfinish is completed without client_lock held
+  int ll_aio_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl,
+		  Context *onfinish);
+  int ll_aio_write(Fh *fh, loff_t off, loff_t len, const char *data,
+		   Context *onfinish);
+  int ll_aio_fsync(Fh *fh, bool syncdataonly, Context *onfinish);
+  int ll_aio_getattrx(Inode *in, struct ceph_statx *stx, unsigned int want,
+		      unsigned int flags, const UserPerm& perms,
+		      Context *onfinish);
   loff_t ll_lseek(Fh *fh, loff_t offset, int whence);
   int ll_flush(Fh *fh);
   int ll_fsync(Fh *fh, bool syncdataonly);
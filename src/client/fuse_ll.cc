@@ -581,10 +581,42 @@ static void fuse_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
   Fh *fh = reinterpret_cast<Fh*>(fi->fh);
   bufferlist bl;
   int r = cfuse->client->ll_read(fh, off, size, &bl);
-  if (r >= 0)
-    fuse_reply_buf(req, bl.c_str(), bl.length());
-  else
+  if (r < 0) {
     fuse_reply_err(req, -r);
+    return;
+  }
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+  // hand the buffers to fuse as they are instead of flattening the
+  // bufferlist; with FUSE_CAP_SPLICE_WRITE they are spliced into the
+  // fuse device without another copy
+  unsigned n = bl.get_num_buffers();
+  if (n > 0) {
+    struct fuse_bufvec *bufv = (struct fuse_bufvec *)
+      malloc(sizeof(*bufv) + (n - 1) * sizeof(struct fuse_buf));
+    if (bufv) {
+      bufv->count = n;
+      bufv->idx = 0;
+      bufv->off = 0;
+      unsigned i = 0;
+      for (const auto& p : bl.buffers()) {
+	struct fuse_buf &buf = bufv->buf[i++];
+	memset(&buf, 0, sizeof(buf));
+	buf.size = p.length();
+	buf.mem = (void *)p.c_str();
+      }
+      // fuse copies our buffers into its pipe before splicing the pipe
+      // into the device, so those pipe pages may be moved rather than
+      // copied; it only does so if FUSE_CAP_SPLICE_MOVE was granted
+      int flags = 0;
+      if (cfuse->client->cct->_conf->fuse_splice_move)
+	flags |= FUSE_BUF_SPLICE_MOVE;
+      fuse_reply_data(req, bufv, (enum fuse_buf_copy_flags)flags);
+      free(bufv);
+      return;
+    }
+  }
+#endif
+  fuse_reply_buf(req, bl.c_str(), bl.length());
 }
 
 static void fuse_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
@@ -599,6 +631,38 @@ static void fuse_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
     fuse_reply_err(req, -r);
 }
 
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+static void fuse_ll_write_buf(fuse_req_t req, fuse_ino_t ino,
+			      struct fuse_bufvec *in_buf, off_t off,
+			      struct fuse_file_info *fi)
+{
+  CephFuse::Handle *cfuse = fuse_ll_req_prepare(req);
+  Fh *fh = reinterpret_cast<Fh*>(fi->fh);
+
+  // copy straight into a buffer the client can keep, whether the data
+  // sits in fuse's buffer or in the pipe it was spliced into
+  size_t size = fuse_buf_size(in_buf);
+  bufferptr bp = buffer::create_page_aligned(size);
+  struct fuse_bufvec out_buf = FUSE_BUFVEC_INIT(size);
+  out_buf.buf[0].mem = bp.c_str();
+  ssize_t copied = fuse_buf_copy(&out_buf, in_buf,
+				 (enum fuse_buf_copy_flags)0);
+  if (copied < 0) {
+    fuse_reply_err(req, -copied);
+    return;
+  }
+  bufferlist bl;
+  bp.set_length(copied);
+  bl.append(bp);
+
+  int r = cfuse->client->ll_write(fh, off, bl);
+  if (r >= 0)
+    fuse_reply_write(req, r);
+  else
+    fuse_reply_err(req, -r);
+}
+#endif
+
 static void fuse_ll_flush(fuse_req_t req, fuse_ino_t ino,
 			  struct fuse_file_info *fi)
 {
@@ -931,6 +995,19 @@ static void do_init(void *data, fuse_conn_info *conn)
   }
 #endif
 
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+  const md_config_t *conf = client->cct->_conf;
+  if (conf->fuse_splice_read && (conn->capable & FUSE_CAP_SPLICE_READ))
+    conn->want |= FUSE_CAP_SPLICE_READ;
+  if (conf->fuse_splice_write && (conn->capable & FUSE_CAP_SPLICE_WRITE))
+    conn->want |= FUSE_CAP_SPLICE_WRITE;
+  if (conf->fuse_splice_move && (conn->capable & FUSE_CAP_SPLICE_MOVE))
+    conn->want |= FUSE_CAP_SPLICE_MOVE;
+#endif
+  // fuse clamps this to what its request buffers can hold
+  if (client->cct->_conf->fuse_max_write > 0)
+    conn->max_write = client->cct->_conf->fuse_max_write;
+
   if (cfuse->fd_on_success) {
     //cout << "fuse init signaling on fd " << fd_on_success << std::endl;
     // see Preforker::daemonize(), ceph-fuse's parent process expects a `-1`
@@ -995,7 +1072,7 @@ const static struct fuse_lowlevel_ops fuse_ll_oper = {
  poll: 0,
 #endif
 #if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
- write_buf: 0,
+ write_buf: fuse_ll_write_buf,
  retrieve_reply: 0,
  forget_multi: 0,
  flock: fuse_ll_flock,
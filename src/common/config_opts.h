@@ -398,6 +398,7 @@ OPTION(paxos_stash_full_interval, OPT_INT, 25)   // how often (in commits) to st
 OPTION(paxos_max_join_drift, OPT_INT, 10) // max paxos iterations before we must first sync the monitor stores
 OPTION(paxos_propose_interval, OPT_DOUBLE, 1.0)  // gather updates for this long before proposing a map update
 OPTION(paxos_min_wait, OPT_DOUBLE, 0.05)  // min time to gather updates for after period of inactivity
+OPTION(paxos_coalesce_proposals, OPT_BOOL, true)  // fold the pending updates of services waiting to propose into the next paxos round
 OPTION(paxos_min, OPT_INT, 500)       // minimum number of paxos states to keep around
 OPTION(paxos_trim_min, OPT_INT, 250)  // number of extra proposals tolerated before trimming
 OPTION(paxos_trim_max, OPT_INT, 500) // max number of extra proposals to trim at a time
@@ -450,6 +451,7 @@ OPTION(client_oc_max_dirty, OPT_INT, 1024*1024* 100)    // MB * n  (dirty OR tx.
 OPTION(client_oc_target_dirty, OPT_INT, 1024*1024* 8) // target dirty (keep this smallish)
 OPTION(client_oc_max_dirty_age, OPT_DOUBLE, 5.0)      // max age in cache before writeback
 OPTION(client_oc_max_objects, OPT_INT, 1000)      // max objects in cache
+OPTION(client_aio_threads, OPT_INT, 4)      // threads running async I/O that has to block
 OPTION(client_debug_getattr_caps, OPT_BOOL, false) // check if MDS reply contains wanted caps
 OPTION(client_debug_force_sync_read, OPT_BOOL, false)     // always read synchronously (go to osds)
 OPTION(client_debug_inject_tick_delay, OPT_INT, 0) // delay the client tick for a number of seconds
@@ -460,6 +462,7 @@ OPTION(client_metadata, OPT_STR, "")
 OPTION(client_acl_type, OPT_STR, "")
 OPTION(client_permissions, OPT_BOOL, true)
 OPTION(client_dirsize_rbytes, OPT_BOOL, true)
+OPTION(client_cache_negative_dentries, OPT_BOOL, true) // cache ENOENT lookups under the dir's Fs cap
 
 // note: the max amount of "in flight" dirty data is roughly (max - target)
 OPTION(fuse_use_invalidate_cb, OPT_BOOL, true) // use fuse 2.8+ invalidate callback to keep page cache consistent
@@ -467,6 +470,10 @@ OPTION(fuse_disable_pagecache, OPT_BOOL, false)
 OPTION(fuse_allow_other, OPT_BOOL, true)
 OPTION(fuse_default_permissions, OPT_BOOL, false)
 OPTION(fuse_big_writes, OPT_BOOL, true)
+OPTION(fuse_max_write, OPT_INT, 0) // max write size negotiated with fuse, 0 for the fuse default
+OPTION(fuse_splice_read, OPT_BOOL, true) // let fuse splice write payloads to us (FUSE_CAP_SPLICE_READ)
+OPTION(fuse_splice_write, OPT_BOOL, true) // splice read replies into the fuse device (FUSE_CAP_SPLICE_WRITE)
+OPTION(fuse_splice_move, OPT_BOOL, true) // move spliced read reply pages into the fuse device instead of copying them (FUSE_CAP_SPLICE_MOVE, FUSE_BUF_SPLICE_MOVE)
 OPTION(fuse_atomic_o_trunc, OPT_BOOL, true)
 OPTION(fuse_debug, OPT_BOOL, false)
 OPTION(fuse_multithreaded, OPT_BOOL, true)
@@ -503,11 +510,14 @@ OPTION(mds_data, OPT_STR, "/var/lib/ceph/mds/$cluster-$id")
 OPTION(mds_max_file_size, OPT_U64, 1ULL << 40) // Used when creating new CephFS. Change with 'ceph mds set max_file_size <size>' afterwards
 // max xattr kv pairs size for each dir/file
 OPTION(mds_max_xattr_pairs_size, OPT_U32, 64 << 10)
-OPTION(mds_cache_size, OPT_INT, 100000)
+OPTION(mds_cache_size, OPT_INT, 0) // max inodes in cache, 0 = no limit (see mds_cache_memory_limit)
+OPTION(mds_cache_memory_limit, OPT_U64, 1ULL << 30) // target bytes of cache metadata (mds_co mempool), 0 = no limit
+OPTION(mds_cache_reservation, OPT_FLOAT, .05) // keep this fraction of the cache limits free: trim and recall caps above it
 OPTION(mds_cache_mid, OPT_FLOAT, .7)
 OPTION(mds_max_file_recover, OPT_U32, 32)
 OPTION(mds_dir_max_commit_size, OPT_INT, 10) // MB
 OPTION(mds_dir_keys_per_op, OPT_INT, 16384)
+OPTION(mds_readdir_prefetch_frags, OPT_INT, 2) // fetch this many dirfrags ahead of a readdir
 OPTION(mds_decay_halflife, OPT_FLOAT, 5)
 OPTION(mds_beacon_interval, OPT_FLOAT, 4)
 OPTION(mds_beacon_grace, OPT_FLOAT, 15)
@@ -520,7 +530,7 @@ OPTION(mds_recall_state_timeout, OPT_FLOAT, 60)    // detect clients which aren'
 OPTION(mds_freeze_tree_timeout, OPT_FLOAT, 30)    // detecting freeze tree deadlock
 OPTION(mds_session_autoclose, OPT_FLOAT, 300) // autoclose idle session
 OPTION(mds_health_summarize_threshold, OPT_INT, 10) // collapse N-client health metrics to a single 'many'
-OPTION(mds_health_cache_threshold, OPT_FLOAT, 1.5) // warn on cache size if it exceeds mds_cache_size by this factor
+OPTION(mds_health_cache_threshold, OPT_FLOAT, 1.5) // warn on cache size if it exceeds its limits by this factor
 OPTION(mds_reconnect_timeout, OPT_FLOAT, 45)  // seconds to wait for clients during mds restart
 	      //  make it (mds_session_timeout - mds_beacon_grace)
 OPTION(mds_tick_interval, OPT_FLOAT, 5)
@@ -536,6 +546,7 @@ OPTION(mds_log_events_per_segment, OPT_INT, 1024)
 OPTION(mds_log_segment_size, OPT_INT, 0)  // segment size for mds log, default to default file_layout_t
 OPTION(mds_log_max_segments, OPT_U32, 30)
 OPTION(mds_log_max_expiring, OPT_INT, 20)
+OPTION(mds_log_max_inflight_flushes, OPT_INT, 2) // group further journal flushes while this many are in flight; 0 = no limit
 OPTION(mds_bal_export_pin, OPT_BOOL, true)  // allow clients to pin directory trees to ranks
 OPTION(mds_bal_sample_interval, OPT_DOUBLE, 3.0)  // every 3 seconds
 OPTION(mds_bal_replicate_threshold, OPT_FLOAT, 8000)
@@ -561,6 +572,13 @@ OPTION(mds_bal_need_max, OPT_FLOAT, 1.2)
 OPTION(mds_bal_midchunk, OPT_FLOAT, .3)       // any sub bigger than this taken in full
 OPTION(mds_bal_minchunk, OPT_FLOAT, .001)     // never take anything smaller than this
 OPTION(mds_bal_target_decay, OPT_DOUBLE, 10.0) // target decay half-life in MDSMap (2x larger is approx. 2x slower)
+OPTION(mds_bal_heat_recent_halflife, OPT_DOUBLE, 2.0)     // short window of the dirfrag heatmap (seconds)
+OPTION(mds_bal_heat_sustained_halflife, OPT_DOUBLE, 30.0) // long window of the dirfrag heatmap (seconds)
+OPTION(mds_bal_heatmap_max, OPT_INT, 1000)    // track at most this many dirfrags in the heatmap
+OPTION(mds_bal_predict_gain, OPT_FLOAT, .5)   // how far to extrapolate load trends when picking exports; 0 = current load only
+OPTION(mds_bal_migrate_cooldown, OPT_DOUBLE, 30.0) // don't move a subtree again for this many seconds after it moved
+OPTION(mds_bal_max_export_cost, OPT_FLOAT, 0) // max entries moved per unit of load shed by an export; 0 = no limit
+OPTION(mds_bal_max_export_dirs, OPT_INT, 0)   // max subtrees exported per rebalance; 0 = no limit
 OPTION(mds_replay_interval, OPT_FLOAT, 1.0) // time to wait before starting replay again
 OPTION(mds_shutdown_check, OPT_INT, 0)
 OPTION(mds_thrash_exports, OPT_INT, 0)
@@ -615,6 +633,8 @@ OPTION(mds_max_purge_files, OPT_U32, 64)
 OPTION(mds_max_purge_ops, OPT_U32, 8192)
 // Maximum number of concurrent RADOS ops to issue in purging, scaled by PG count
 OPTION(mds_max_purge_ops_per_pg, OPT_FLOAT, 0.5)
+// Back off purging in a pool while deleting a round of objects takes longer than this (seconds); 0 = don't adapt
+OPTION(mds_purge_latency_target, OPT_DOUBLE, 1.0)
 
 OPTION(mds_purge_queue_busy_flush_period, OPT_FLOAT, 1.0)
 
@@ -1335,6 +1355,7 @@ OPTION(rados_tracing, OPT_BOOL, false) // true if LTTng-UST tracepoints should b
 OPTION(rbd_op_threads, OPT_INT, 1)
 OPTION(rbd_op_thread_timeout, OPT_INT, 60)
 OPTION(rbd_non_blocking_aio, OPT_BOOL, true) // process AIO ops from a worker thread to prevent blocking
+OPTION(rbd_direct_dispatch, OPT_BOOL, false) // submit AIO ops from the caller's thread when nothing can make them wait
 OPTION(rbd_cache, OPT_BOOL, true) // whether to enable caching (writeback unless rbd_cache_max_dirty is 0)
 OPTION(rbd_cache_writethrough_until_flush, OPT_BOOL, true) // whether to make writeback caching writethrough until flush is called, to be sure the user of librbd will send flushs so that writeback is safe
 OPTION(rbd_cache_size, OPT_LONGLONG, 32<<20)         // cache size in bytes
@@ -1343,6 +1364,11 @@ OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in by
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
 OPTION(rbd_cache_max_dirty_object, OPT_INT, 0)       // dirty limit for objects - set to 0 for auto calculate from rbd_cache_size
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
+OPTION(rbd_cache_type, OPT_STR, "object") // object (ObjectCacher) or block (sharded, extent based cache)
+OPTION(rbd_cache_shards, OPT_U32, 16) // number of independently locked shards of the block cache
+OPTION(rbd_persistent_cache_path, OPT_STR, "") // local file, block device or directory for a persistent write-back cache log, replaces rbd_cache when set
+OPTION(rbd_persistent_cache_size, OPT_U64, 1ULL << 30) // size of the persistent cache log when it is a file
+OPTION(rbd_persistent_cache_max_writeback_ops, OPT_U32, 16) // maximum number of persistent cache log entries written back concurrently
 OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
@@ -1352,10 +1378,15 @@ OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requ
 OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512 * 1024) // set to 0 to disable readahead
 OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 50 * 1024 * 1024) // how many bytes are read in total before readahead is disabled
 OPTION(rbd_clone_copy_on_read, OPT_BOOL, false)
+OPTION(rbd_flatten_hot_objects, OPT_U64, 1024) // number of objects most recently read from the parent that are tracked and flattened first (0 = disabled)
+OPTION(rbd_flatten_target_latency, OPT_DOUBLE, 0.1) // seconds an object copyup may take before flatten reduces its concurrency (0 = disabled)
+OPTION(rbd_flatten_progress_update_objects, OPT_U64, 256) // number of flattened objects between flatten progress updates in the image metadata (0 = disabled)
 OPTION(rbd_blacklist_on_break_lock, OPT_BOOL, true) // whether to blacklist clients whose lock was broken
 OPTION(rbd_blacklist_expire_seconds, OPT_INT, 0) // number of seconds to blacklist - set to 0 for OSD default
 OPTION(rbd_request_timed_out_seconds, OPT_INT, 30) // number of seconds before maint request times out
 OPTION(rbd_skip_partial_discard, OPT_BOOL, false) // when trying to discard a range inside an object, set to true to skip zeroing the range.
+OPTION(rbd_object_map_batch_updates, OPT_BOOL, true) // coalesce object map updates for contiguous objects issued while a preceding update is in-flight
+OPTION(rbd_object_map_premark_objects, OPT_U64, 0) // number of objects to mark as existing ahead of sequential writes (0 = disabled)
 OPTION(rbd_enable_alloc_hint, OPT_BOOL, true) // when writing a object, it will issue a hint to osd backend to indicate the expected size object need
 OPTION(rbd_tracing, OPT_BOOL, false) // true if LTTng-UST tracepoints should be enabled
 OPTION(rbd_validate_pool, OPT_BOOL, true) // true if empty pools should be validated for RBD compatibility
@@ -1415,6 +1446,7 @@ OPTION(rbd_journal_commit_age, OPT_DOUBLE, 5) // commit time interval, seconds
 OPTION(rbd_journal_object_flush_interval, OPT_INT, 0) // maximum number of pending commits per journal object
 OPTION(rbd_journal_object_flush_bytes, OPT_INT, 0) // maximum number of pending bytes per journal object
 OPTION(rbd_journal_object_flush_age, OPT_DOUBLE, 0) // maximum age (in seconds) for pending commits
+OPTION(rbd_journal_object_max_in_flight_appends, OPT_U64, 0) // maximum number of in-flight appends per journal object (0 = unlimited); further appends are batched
 OPTION(rbd_journal_pool, OPT_STR, "") // pool for journal objects
 OPTION(rbd_journal_max_payload_bytes, OPT_U32, 16384) // maximum journal payload size before splitting
 OPTION(rbd_journal_max_concurrent_object_sets, OPT_INT, 0) // maximum number of object sets a journal client can be behind before it is automatically unregistered
@@ -1425,7 +1457,8 @@ OPTION(rbd_journal_max_concurrent_object_sets, OPT_INT, 0) // maximum number of
 OPTION(rbd_mirror_journal_commit_age, OPT_DOUBLE, 5) // commit time interval, seconds
 OPTION(rbd_mirror_journal_poll_age, OPT_DOUBLE, 5) // maximum age (in seconds) between successive journal polls
 OPTION(rbd_mirror_journal_max_fetch_bytes, OPT_U32, 32768) // maximum bytes to read from each journal data object per fetch
-OPTION(rbd_mirror_sync_point_update_age, OPT_DOUBLE, 30) // number of seconds between each update of the image sync point object number
+OPTION(rbd_mirror_sync_point_update_age, OPT_DOUBLE, 5) // number of seconds between each update of the image sync point object number
+OPTION(rbd_mirror_sync_skip_matching_objects, OPT_BOOL, true) // when resuming an image sync, skip objects whose local content already matches the remote checksum
 OPTION(rbd_mirror_concurrent_image_syncs, OPT_U32, 5) // maximum number of image syncs in parallel
 OPTION(rbd_mirror_pool_replayers_refresh_interval, OPT_INT, 30) // interval to refresh peers in rbd-mirror daemon
 OPTION(rbd_mirror_delete_retry_interval, OPT_DOUBLE, 30) // interval to check and retry the failed requests in deleter
@@ -1681,6 +1714,9 @@ OPTION(mgr_modules, OPT_STR, "rest")  // Which modules to load
 OPTION(mgr_data, OPT_STR, "/var/lib/ceph/mgr/$cluster-$id") // where to find keyring etc
 OPTION(mgr_beacon_period, OPT_INT, 5)  // How frequently to send beacon
 OPTION(mgr_stats_period, OPT_INT, 5) // How frequently to send stats
+OPTION(mgr_stats_history_samples, OPT_INT, 20) // recent perf counter samples kept per counter (at least 1)
+OPTION(mgr_stats_history_coarse_samples, OPT_INT, 60) // older, downsampled samples kept per counter
+OPTION(mgr_stats_history_coarse_interval, OPT_INT, 60) // seconds between downsampled samples
 OPTION(mgr_client_bytes, OPT_U64, 128*1048576) // bytes from clients
 OPTION(mgr_client_messages, OPT_U64, 512)      // messages from clients
 OPTION(mgr_osd_bytes, OPT_U64, 512*1048576)   // bytes from osds
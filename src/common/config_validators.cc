@@ -21,8 +21,9 @@ int validate(md_config_t::option_rbd_default_features_t *,
     {RBD_FEATURE_NAME_DEEP_FLATTEN, RBD_FEATURE_DEEP_FLATTEN},
     {RBD_FEATURE_NAME_JOURNALING, RBD_FEATURE_JOURNALING},
     {RBD_FEATURE_NAME_DATA_POOL, RBD_FEATURE_DATA_POOL},
+    {RBD_FEATURE_NAME_EXTENT_MAP, RBD_FEATURE_EXTENT_MAP},
   };
-  static_assert((RBD_FEATURE_DATA_POOL << 1) > RBD_FEATURES_ALL,
+  static_assert((RBD_FEATURE_EXTENT_MAP << 1) > RBD_FEATURES_ALL,
                 "new RBD feature added");
 
   // convert user-friendly comma delimited feature name list to a bitmask
@@ -326,6 +326,15 @@ public:
     return weak_refs.empty();
   }
 
+  /***
+   * Returns the number of values that are still alive, i.e. cached or
+   * referenced from outside the cache.
+   */
+  size_t get_num_live() {
+    Mutex::Locker l(lock);
+    return weak_refs.size();
+  }
+
   /***
    * Inserts a key if not present, or bumps it to the front of the LRU if
    * it is, and then gives you a reference to the value. If the key already
@@ -16,6 +16,7 @@
  */
 
 #include <errno.h>
+#include <string.h>
 #include <vector>
 #include <algorithm>
 #include <ostream>
@@ -175,6 +176,107 @@ int ErasureCode::decode_chunks(const set<int> &want_to_read,
   assert("ErasureCode::decode_chunks not implemented" == 0);
 }
 
+int ErasureCode::encode_stripes_prepare(const bufferlist &in,
+					unsigned int stripe_width,
+					map<int, bufferlist> &encoded) const
+{
+  if (stripe_width == 0 || in.length() % stripe_width)
+    return -EINVAL;
+  if (in.length() == 0)
+    return 0;
+  unsigned int k = get_data_chunk_count();
+  unsigned int m = get_chunk_count() - k;
+  unsigned chunk_size = get_chunk_size(stripe_width);
+  unsigned stripe_count = in.length() / stripe_width;
+  unsigned shard_size = stripe_count * chunk_size;
+
+  for (unsigned int i = 0; i < k + m; i++) {
+    bufferlist &shard = encoded[chunk_index(i)];
+    shard.push_back(buffer::create_aligned(shard_size, SIMD_ALIGN));
+  }
+
+  // the input is read sequentially, stripe after stripe, and each
+  // data chunk is copied at its offset in the shard it belongs to
+  bufferlist::const_iterator p = in.begin();
+  for (unsigned s = 0; s < stripe_count; s++) {
+    unsigned remainder = stripe_width;
+    for (unsigned int i = 0; i < k; i++) {
+      char *chunk = encoded[chunk_index(i)].c_str() + s * chunk_size;
+      unsigned length = std::min(remainder, chunk_size);
+      p.copy(length, chunk);
+      memset(chunk + length, 0, chunk_size - length);
+      remainder -= length;
+    }
+  }
+  return 0;
+}
+
+int ErasureCode::encode_stripes(const set<int> &want_to_encode,
+				const bufferlist &in,
+				unsigned int stripe_width,
+				map<int, bufferlist> *encoded)
+{
+  int err = encode_stripes_prepare(in, stripe_width, *encoded);
+  if (err)
+    return err;
+  if (encoded->empty())
+    return 0;
+  unsigned chunk_size = get_chunk_size(stripe_width);
+  unsigned stripe_count = in.length() / stripe_width;
+  for (unsigned s = 0; s < stripe_count; s++) {
+    // the chunks of a stripe point into the shards, the coding
+    // chunks are computed in place
+    map<int, bufferlist> stripe;
+    for (map<int, bufferlist>::iterator i = encoded->begin();
+	 i != encoded->end();
+	 ++i) {
+      stripe[i->first].push_back(
+	bufferptr(i->second.front(), s * chunk_size, chunk_size));
+    }
+    err = encode_chunks(want_to_encode, &stripe);
+    if (err)
+      return err;
+  }
+  unsigned int chunk_count = get_chunk_count();
+  for (unsigned int i = 0; i < chunk_count; i++) {
+    if (want_to_encode.count(i) == 0)
+      encoded->erase(i);
+  }
+  return 0;
+}
+
+int ErasureCode::decode_stripes(const set<int> &want_to_read,
+				const map<int, bufferlist> &chunks,
+				unsigned int chunk_size,
+				map<int, bufferlist> *decoded)
+{
+  if (chunks.empty() || chunk_size == 0)
+    return -EINVAL;
+  unsigned shard_size = chunks.begin()->second.length();
+  if (shard_size % chunk_size)
+    return -EINVAL;
+  for (unsigned offset = 0; offset < shard_size; offset += chunk_size) {
+    map<int, bufferlist> stripe;
+    for (map<int, bufferlist>::const_iterator i = chunks.begin();
+	 i != chunks.end();
+	 ++i) {
+      if (i->second.length() != shard_size)
+	return -EINVAL;
+      stripe[i->first].substr_of(i->second, offset, chunk_size);
+    }
+    map<int, bufferlist> stripe_decoded;
+    int r = decode(want_to_read, stripe, &stripe_decoded);
+    if (r)
+      return r;
+    for (map<int, bufferlist>::iterator i = stripe_decoded.begin();
+	 i != stripe_decoded.end();
+	 ++i) {
+      (*decoded)[i->first].claim_append(i->second);
+    }
+  }
+  return 0;
+}
+
 int ErasureCode::parse(const ErasureCodeProfile &profile,
 		       ostream *ss)
 {
@@ -78,6 +78,20 @@ namespace ceph {
                               const map<int, bufferlist> &chunks,
                               map<int, bufferlist> *decoded) override;
 
+    int encode_stripes_prepare(const bufferlist &in,
+                               unsigned int stripe_width,
+                               map<int, bufferlist> &encoded) const;
+
+    int encode_stripes(const set<int> &want_to_encode,
+                       const bufferlist &in,
+                       unsigned int stripe_width,
+                       map<int, bufferlist> *encoded) override;
+
+    int decode_stripes(const set<int> &want_to_read,
+                       const map<int, bufferlist> &chunks,
+                       unsigned int chunk_size,
+                       map<int, bufferlist> *decoded) override;
+
     const vector<int> &get_chunk_mapping() const override;
 
     int to_mapping(const ErasureCodeProfile &profile,
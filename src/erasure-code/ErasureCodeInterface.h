@@ -400,6 +400,60 @@ namespace ceph {
                               const map<int, bufferlist> &chunks,
                               map<int, bufferlist> *decoded) = 0;
 
+    /**
+     * Encode the content of **in**, which is made of a whole number
+     * of stripes of **stripe_width** bytes each, and store the
+     * result in **encoded**. It is equivalent to calling **encode**
+     * once per stripe and concatenating the chunks with the same
+     * index but allows the implementation to prepare the chunks once
+     * and to process all stripes with a single call to its coding
+     * kernel.
+     *
+     * Each buffer in **encoded** is contiguous and contains the
+     * chunks of all stripes, in order. Its length is the number of
+     * stripes multiplied by **get_chunk_size(stripe_width)**.
+     *
+     * The **encoded** map is expected to be a pointer to an empty
+     * map. Unlike **encode**, the content of **encoded** never
+     * references the content of **in**.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] want_to_encode chunk indexes to be encoded
+     * @param [in] in data to be encoded
+     * @param [in] stripe_width size of a stripe in bytes
+     * @param [out] encoded map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_stripes(const set<int> &want_to_encode,
+                               const bufferlist &in,
+                               unsigned int stripe_width,
+                               map<int, bufferlist> *encoded) = 0;
+
+    /**
+     * Decode the **chunks**, each of which is the concatenation of
+     * the chunks of consecutive stripes of **chunk_size** bytes
+     * each, and store at least **want_to_read** chunks in
+     * **decoded**. It is equivalent to calling **decode** once per
+     * stripe and concatenating the chunks with the same index.
+     *
+     * The same requirements as **decode** apply to **want_to_read**,
+     * **chunks** and **decoded**. In addition, the length of all
+     * buffers in **chunks** must be a multiple of **chunk_size**.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] chunks map chunk indexes to chunk data
+     * @param [in] chunk_size size of the chunk of a single stripe
+     * @param [out] decoded map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int decode_stripes(const set<int> &want_to_read,
+                               const map<int, bufferlist> &chunks,
+                               unsigned int chunk_size,
+                               map<int, bufferlist> *decoded) = 0;
+
     /**
      * Return the ordered list of chunks or an empty vector
      * if no remapping is necessary.
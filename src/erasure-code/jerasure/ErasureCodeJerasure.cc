@@ -150,6 +150,44 @@ int ErasureCodeJerasure::decode_chunks(const set<int> &want_to_read,
   return jerasure_decode(erasures, data, coding, blocksize);
 }
 
+// The jerasure codes compute each word (or each packet for the bit
+// matrix techniques) of the coding chunks independently from the
+// others. Since the chunk size is a multiple of the word and packet
+// sizes, the shards made of the concatenated chunks of all stripes
+// are encoded and decoded with a single call to the kernel.
+int ErasureCodeJerasure::encode_stripes(const set<int> &want_to_encode,
+				        const bufferlist &in,
+				        unsigned int stripe_width,
+				        map<int, bufferlist> *encoded)
+{
+  int err = encode_stripes_prepare(in, stripe_width, *encoded);
+  if (err)
+    return err;
+  if (encoded->empty())
+    return 0;
+  err = encode_chunks(want_to_encode, encoded);
+  if (err)
+    return err;
+  for (int i = 0; i < k + m; i++) {
+    if (want_to_encode.count(i) == 0)
+      encoded->erase(i);
+  }
+  return 0;
+}
+
+int ErasureCodeJerasure::decode_stripes(const set<int> &want_to_read,
+				        const map<int, bufferlist> &chunks,
+				        unsigned int chunk_size,
+				        map<int, bufferlist> *decoded)
+{
+  if (chunks.empty() || chunk_size == 0)
+    return -EINVAL;
+  unsigned shard_size = chunks.begin()->second.length();
+  if (shard_size % chunk_size)
+    return -EINVAL;
+  return decode(want_to_read, chunks, decoded);
+}
+
 bool ErasureCodeJerasure::is_prime(int value)
 {
   int prime55[] = {
@@ -72,6 +72,16 @@ public:
 			    const map<int, bufferlist> &chunks,
 			    map<int, bufferlist> *decoded) override;
 
+  int encode_stripes(const set<int> &want_to_encode,
+			     const bufferlist &in,
+			     unsigned int stripe_width,
+			     map<int, bufferlist> *encoded) override;
+
+  int decode_stripes(const set<int> &want_to_read,
+			     const map<int, bufferlist> &chunks,
+			     unsigned int chunk_size,
+			     map<int, bufferlist> *decoded) override;
+
   int init(ErasureCodeProfile &profile, ostream *ss) override;
 
   virtual void jerasure_encode(char **data,
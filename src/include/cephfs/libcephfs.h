@@ -1468,6 +1468,100 @@ int64_t ceph_ll_readv(struct ceph_mount_info *cmount, struct Fh *fh,
 		      const struct iovec *iov, int iovcnt, int64_t off);
 int64_t ceph_ll_writev(struct ceph_mount_info *cmount, struct Fh *fh,
 		       const struct iovec *iov, int iovcnt, int64_t off);
+
+/**
+ * @defgroup libcephfs_h_aio Asynchronous I/O
+ * Low level reads, writes, fsyncs and getattrs that return as soon as
+ * they are submitted.  Their result is reported through a completion,
+ * much like librados aio.  Completion callbacks are called from a
+ * libcephfs thread and must not block.
+ *
+ * @{
+ */
+typedef void *ceph_completion_t;
+typedef void (*ceph_callback_t)(ceph_completion_t cb, void *arg);
+
+/**
+ * Create a completion for an asynchronous operation.
+ *
+ * @param cb_arg argument passed to the callback
+ * @param cb_complete called when the operation completes, may be NULL
+ * @param pc where to store the completion
+ * @returns 0 on success, negative error code on failure
+ */
+int ceph_aio_create_completion(void *cb_arg, ceph_callback_t cb_complete,
+			       ceph_completion_t *pc);
+
+/**
+ * Block until the operation completes.
+ *
+ * @param c the completion
+ * @returns 0
+ */
+int ceph_aio_wait_for_complete(ceph_completion_t c);
+
+/**
+ * @param c the completion
+ * @returns whether the operation has completed
+ */
+int ceph_aio_is_complete(ceph_completion_t c);
+
+/**
+ * Get the result of a completed operation: bytes read or written,
+ * or a negative error code.
+ *
+ * @param c the completion
+ */
+int64_t ceph_aio_get_return_value(ceph_completion_t c);
+
+/**
+ * Release a completion.  The operation it was used for may still be
+ * in flight; the completion is freed once it is done.
+ *
+ * @param c the completion
+ */
+void ceph_aio_release(ceph_completion_t c);
+
+/**
+ * Start an asynchronous read.  buf must stay valid until the
+ * operation completes.
+ *
+ * @returns 0 if the read was submitted, negative error code on failure
+ */
+int ceph_ll_aio_read(struct ceph_mount_info *cmount, struct Fh *fh,
+		     int64_t off, uint64_t len, char *buf,
+		     ceph_completion_t c);
+
+/**
+ * Start an asynchronous write.  data is copied before this returns.
+ *
+ * @returns 0 if the write was submitted, negative error code on failure
+ */
+int ceph_ll_aio_write(struct ceph_mount_info *cmount, struct Fh *fh,
+		      int64_t off, uint64_t len, const char *data,
+		      ceph_completion_t c);
+
+/**
+ * Start an asynchronous fsync.
+ *
+ * @returns 0 if the fsync was submitted, negative error code on failure
+ */
+int ceph_ll_aio_fsync(struct ceph_mount_info *cmount, struct Fh *fh,
+		      int syncdataonly, ceph_completion_t c);
+
+/**
+ * Start an asynchronous getattr.  stx must stay valid until the
+ * operation completes.
+ *
+ * @returns 0 if the getattr was submitted, negative error code on failure
+ */
+int ceph_ll_aio_getattr(struct ceph_mount_info *cmount, struct Inode *in,
+			struct ceph_statx *stx, unsigned int want,
+			unsigned int flags, const UserPerm *perms,
+			ceph_completion_t c);
+
+/** @} aio */
+
 int ceph_ll_close(struct ceph_mount_info *cmount, struct Fh* filehandle);
 int ceph_ll_iclose(struct ceph_mount_info *cmount, struct Inode *in, int mode);
 /**
@@ -147,6 +147,7 @@ namespace mempool {
   f(osd)			      \
   f(osdmap)			      \
   f(osdmap_mapping)		      \
+  f(mds_co)			      \
   f(unittest_1)			      \
   f(unittest_2)
 
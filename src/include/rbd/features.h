@@ -9,6 +9,7 @@
 #define RBD_FEATURE_DEEP_FLATTEN        (1ULL<<5)
 #define RBD_FEATURE_JOURNALING          (1ULL<<6)
 #define RBD_FEATURE_DATA_POOL           (1ULL<<7)
+#define RBD_FEATURE_EXTENT_MAP          (1ULL<<8)
 
 #define RBD_FEATURES_DEFAULT             (RBD_FEATURE_LAYERING | \
                                          RBD_FEATURE_EXCLUSIVE_LOCK | \
@@ -24,6 +25,7 @@
 #define RBD_FEATURE_NAME_DEEP_FLATTEN    "deep-flatten"
 #define RBD_FEATURE_NAME_JOURNALING      "journaling"
 #define RBD_FEATURE_NAME_DATA_POOL       "data-pool"
+#define RBD_FEATURE_NAME_EXTENT_MAP      "extent-map"
 
 /// features that make an image inaccessible for read or write by
 /// clients that don't understand them
@@ -37,7 +39,8 @@
 					 RBD_FEATURE_OBJECT_MAP     | \
                                          RBD_FEATURE_FAST_DIFF      | \
                                          RBD_FEATURE_DEEP_FLATTEN   | \
-                                         RBD_FEATURE_JOURNALING)
+                                         RBD_FEATURE_JOURNALING     | \
+                                         RBD_FEATURE_EXTENT_MAP)
 
 #define RBD_FEATURES_ALL          	(RBD_FEATURE_LAYERING       | \
 					 RBD_FEATURE_STRIPINGV2     | \
@@ -46,7 +49,8 @@
                                          RBD_FEATURE_FAST_DIFF      | \
                                          RBD_FEATURE_DEEP_FLATTEN   | \
                                          RBD_FEATURE_JOURNALING     | \
-                                         RBD_FEATURE_DATA_POOL)
+                                         RBD_FEATURE_DATA_POOL      | \
+                                         RBD_FEATURE_EXTENT_MAP)
 
 /// features that may be dynamically enabled or disabled
 #define RBD_FEATURES_MUTABLE            (RBD_FEATURE_EXCLUSIVE_LOCK | \
@@ -55,13 +59,15 @@
                                          RBD_FEATURE_JOURNALING)
 
 /// features that may be dynamically disabled
-#define RBD_FEATURES_DISABLE_ONLY       (RBD_FEATURE_DEEP_FLATTEN)
+#define RBD_FEATURES_DISABLE_ONLY       (RBD_FEATURE_DEEP_FLATTEN   | \
+                                         RBD_FEATURE_EXTENT_MAP)
 
 /// features that only work when used with a single client
 /// using the image for writes
 #define RBD_FEATURES_SINGLE_CLIENT (RBD_FEATURE_EXCLUSIVE_LOCK | \
                                     RBD_FEATURE_OBJECT_MAP     | \
                                     RBD_FEATURE_FAST_DIFF      | \
-                                    RBD_FEATURE_JOURNALING)
+                                    RBD_FEATURE_JOURNALING     | \
+                                    RBD_FEATURE_EXTENT_MAP)
 
 #endif
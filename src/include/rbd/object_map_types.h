@@ -10,4 +10,8 @@ static const uint8_t OBJECT_EXISTS       = 1;
 static const uint8_t OBJECT_PENDING      = 2;
 static const uint8_t OBJECT_EXISTS_CLEAN = 3;
 
+// extent map chunk states -- the object map class methods operate on them
+static const uint8_t EXTENT_CHANGED      = OBJECT_EXISTS;
+static const uint8_t EXTENT_UNCHANGED    = OBJECT_EXISTS_CLEAN;
+
 #endif // CEPH_RBD_OBJECT_MAP_TYPES_H
@@ -20,6 +20,8 @@
  *   rbd_id.foo              - id of image
  *   rbd_header.<id>         - image metadata
  *   rbd_object_map.<id>     - optional image object map
+ *   rbd_extent_map.<id>     - optional map of chunks written since the
+ *                             last snapshot
  *   rbd_data.<id>.00000000
  *   rbd_data.<id>.00000001
  *   ...                     - data
@@ -27,6 +29,7 @@
 
 #define RBD_HEADER_PREFIX      "rbd_header."
 #define RBD_OBJECT_MAP_PREFIX  "rbd_object_map."
+#define RBD_EXTENT_MAP_PREFIX  "rbd_extent_map."
 #define RBD_DATA_PREFIX        "rbd_data."
 #define RBD_ID_PREFIX          "rbd_id."
 
@@ -22,12 +22,14 @@ ObjectRecorder::ObjectRecorder(librados::IoCtx &ioctx, const std::string &oid,
                                ContextWQ *work_queue, SafeTimer &timer,
                                Mutex &timer_lock, Handler *handler,
                                uint8_t order, uint32_t flush_interval,
-                               uint64_t flush_bytes, double flush_age)
+                               uint64_t flush_bytes, double flush_age,
+                               uint64_t max_in_flight_appends)
   : RefCountedObject(NULL, 0), m_oid(oid), m_object_number(object_number),
     m_cct(NULL), m_op_work_queue(work_queue), m_timer(timer),
     m_timer_lock(timer_lock), m_handler(handler), m_order(order),
     m_soft_max_size(1 << m_order), m_flush_interval(flush_interval),
-    m_flush_bytes(flush_bytes), m_flush_age(flush_age), m_flush_handler(this),
+    m_flush_bytes(flush_bytes), m_flush_age(flush_age),
+    m_max_in_flight_appends(max_in_flight_appends), m_flush_handler(this),
     m_append_task(NULL), m_lock(lock), m_append_tid(0), m_pending_bytes(0),
     m_size(0), m_overflowed(false), m_object_closed(false),
     m_in_flight_flushes(false), m_aio_scheduled(false) {
@@ -41,6 +43,7 @@ ObjectRecorder::~ObjectRecorder() {
   assert(m_append_buffers.empty());
   assert(m_in_flight_tids.empty());
   assert(m_in_flight_appends.empty());
+  assert(m_pending_buffers.empty());
   assert(!m_aio_scheduled);
 }
 
@@ -173,7 +176,8 @@ bool ObjectRecorder::close() {
 
   assert(!m_object_closed);
   m_object_closed = true;
-  return (m_in_flight_tids.empty() && !m_in_flight_flushes && !m_aio_scheduled);
+  return (m_in_flight_tids.empty() && !m_in_flight_flushes &&
+          !m_aio_scheduled && m_pending_buffers.empty());
 }
 
 void ObjectRecorder::handle_append_task() {
@@ -275,6 +279,14 @@ void ObjectRecorder::handle_append_flushed(uint64_t tid, int r) {
 
     m_in_flight_appends.erase(iter);
     m_in_flight_flushes = true;
+
+    // appends held back by the in-flight limit can go out now
+    if (!m_pending_buffers.empty() && !m_aio_scheduled) {
+      m_op_work_queue->queue(new FunctionContext([this] (int r) {
+          send_appends_aio();
+      }));
+      m_aio_scheduled = true;
+    }
     m_lock->Unlock();
   }
 
@@ -318,6 +330,10 @@ void ObjectRecorder::append_overflowed() {
                                   it->second.begin(), it->second.end());
   }
 
+  restart_append_buffers.splice(restart_append_buffers.end(),
+                                m_pending_buffers,
+                                m_pending_buffers.begin(),
+                                m_pending_buffers.end());
   restart_append_buffers.splice(restart_append_buffers.end(),
                                 m_append_buffers,
                                 m_append_buffers.begin(),
@@ -359,6 +375,15 @@ void ObjectRecorder::send_appends_aio() {
   uint64_t append_tid;
   {
     Mutex::Locker locker(*m_lock);
+    if (m_max_in_flight_appends != 0 &&
+        m_in_flight_tids.size() >= m_max_in_flight_appends) {
+      // the next append completion reschedules the pending buffers
+      ldout(m_cct, 20) << __func__ << ": " << m_oid << " delaying "
+                       << m_pending_buffers.size() << " appends" << dendl;
+      m_aio_scheduled = false;
+      return;
+    }
+
     append_tid = m_append_tid++;
     m_in_flight_tids.insert(append_tid);
 
@@ -41,7 +41,8 @@ public:
                  uint64_t object_number, std::shared_ptr<Mutex> lock,
                  ContextWQ *work_queue, SafeTimer &timer, Mutex &timer_lock,
                  Handler *handler, uint8_t order, uint32_t flush_interval,
-                 uint64_t flush_bytes, double flush_age);
+                 uint64_t flush_bytes, double flush_age,
+                 uint64_t max_in_flight_appends);
   ~ObjectRecorder() override;
 
   inline uint64_t get_object_number() const {
@@ -130,6 +131,10 @@ private:
   uint64_t m_flush_bytes;
   double m_flush_age;
 
+  // appends sent while this many ops are in flight are held back and
+  // batched into the next op, so the batch size grows with the load
+  uint64_t m_max_in_flight_appends;
+
   FlushHandler m_flush_handler;
 
   C_AppendTask *m_append_task;
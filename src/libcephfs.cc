@@ -20,6 +20,7 @@
 #include "auth/Crypto.h"
 #include "client/Client.h"
 #include "librados/RadosClient.h"
+#include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/ceph_argparse.h"
 #include "common/common_init.h"
@@ -1550,6 +1551,182 @@ extern "C" int64_t ceph_ll_writev(class ceph_mount_info *cmount,
   return -1; // TODO:  implement
 }
 
+// async I/O
+
+class CephAioCompletion {
+  Mutex lock;
+  Cond cond;
+  int ref;
+  bool complete;
+  int64_t rval;
+  ceph_callback_t callback;
+  void *callback_arg;
+
+public:
+  CephAioCompletion(void *arg, ceph_callback_t cb)
+    : lock("CephAioCompletion::lock"), ref(1), complete(false), rval(0),
+      callback(cb), callback_arg(arg) {}
+
+  void get() {
+    Mutex::Locker l(lock);
+    ++ref;
+  }
+  void put() {
+    lock.Lock();
+    int n = --ref;
+    lock.Unlock();
+    if (!n)
+      delete this;
+  }
+
+  void wait_for_complete() {
+    Mutex::Locker l(lock);
+    while (!complete)
+      cond.Wait(lock);
+  }
+  bool is_complete() {
+    Mutex::Locker l(lock);
+    return complete;
+  }
+  int64_t get_return_value() {
+    Mutex::Locker l(lock);
+    return rval;
+  }
+
+  // the callback runs before waiters are woken up
+  void finish(int64_t r) {
+    lock.Lock();
+    rval = r;
+    lock.Unlock();
+    if (callback)
+      callback(this, callback_arg);
+    lock.Lock();
+    complete = true;
+    cond.SignalAll();
+    lock.Unlock();
+  }
+};
+
+class C_AioComplete : public Context {
+  CephAioCompletion *c;
+public:
+  explicit C_AioComplete(CephAioCompletion *c) : c(c) {
+    c->get();
+  }
+  ~C_AioComplete() override {
+    c->put();
+  }
+  void finish(int r) override {
+    c->finish(r);
+  }
+};
+
+class C_AioReadComplete : public Context {
+  CephAioCompletion *c;
+  char *buf;
+public:
+  bufferlist bl;
+
+  C_AioReadComplete(CephAioCompletion *c, char *buf) : c(c), buf(buf) {
+    c->get();
+  }
+  ~C_AioReadComplete() override {
+    c->put();
+  }
+  void finish(int r) override {
+    // runs without client_lock
+    if (r >= 0) {
+      bl.copy(0, bl.length(), buf);
+      r = bl.length();
+    }
+    c->finish(r);
+  }
+};
+
+extern "C" int ceph_aio_create_completion(void *cb_arg,
+					  ceph_callback_t cb_complete,
+					  ceph_completion_t *pc)
+{
+  *pc = new CephAioCompletion(cb_arg, cb_complete);
+  return 0;
+}
+
+extern "C" int ceph_aio_wait_for_complete(ceph_completion_t c)
+{
+  ((CephAioCompletion*)c)->wait_for_complete();
+  return 0;
+}
+
+extern "C" int ceph_aio_is_complete(ceph_completion_t c)
+{
+  return ((CephAioCompletion*)c)->is_complete();
+}
+
+extern "C" int64_t ceph_aio_get_return_value(ceph_completion_t c)
+{
+  return ((CephAioCompletion*)c)->get_return_value();
+}
+
+extern "C" void ceph_aio_release(ceph_completion_t c)
+{
+  ((CephAioCompletion*)c)->put();
+}
+
+extern "C" int ceph_ll_aio_read(class ceph_mount_info *cmount, Fh *fh,
+				int64_t off, uint64_t len, char *buf,
+				ceph_completion_t c)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  C_AioReadComplete *onfinish = new C_AioReadComplete((CephAioCompletion*)c,
+						      buf);
+  int r = cmount->get_client()->ll_aio_read(fh, off, len, &onfinish->bl,
+					    onfinish);
+  if (r < 0)
+    delete onfinish;
+  return r;
+}
+
+extern "C" int ceph_ll_aio_write(class ceph_mount_info *cmount, Fh *fh,
+				 int64_t off, uint64_t len, const char *data,
+				 ceph_completion_t c)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  C_AioComplete *onfinish = new C_AioComplete((CephAioCompletion*)c);
+  int r = cmount->get_client()->ll_aio_write(fh, off, len, data, onfinish);
+  if (r < 0)
+    delete onfinish;
+  return r;
+}
+
+extern "C" int ceph_ll_aio_fsync(class ceph_mount_info *cmount, Fh *fh,
+				 int syncdataonly, ceph_completion_t c)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  C_AioComplete *onfinish = new C_AioComplete((CephAioCompletion*)c);
+  int r = cmount->get_client()->ll_aio_fsync(fh, syncdataonly, onfinish);
+  if (r < 0)
+    delete onfinish;
+  return r;
+}
+
+extern "C" int ceph_ll_aio_getattr(class ceph_mount_info *cmount,
+				   Inode *in, struct ceph_statx *stx,
+				   unsigned int want, unsigned int flags,
+				   const UserPerm *perms, ceph_completion_t c)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  C_AioComplete *onfinish = new C_AioComplete((CephAioCompletion*)c);
+  int r = cmount->get_client()->ll_aio_getattrx(in, stx, want, flags, *perms,
+						onfinish);
+  if (r < 0)
+    delete onfinish;
+  return r;
+}
+
 extern "C" int ceph_ll_close(class ceph_mount_info *cmount, Fh* fh)
 {
   return (cmount->get_client()->ll_release(fh));
@@ -6,6 +6,7 @@
 #include "librbd/AsyncRequest.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/Utils.h"
+#include <algorithm>
 
 namespace librbd
 {
@@ -19,7 +20,7 @@ AsyncObjectThrottle<T>::AsyncObjectThrottle(
     m_async_request(async_request), m_image_ctx(image_ctx),
     m_context_factory(context_factory), m_ctx(ctx), m_prog_ctx(prog_ctx),
     m_object_no(object_no), m_end_object_no(end_object_no), m_current_ops(0),
-    m_ret(0)
+    m_max_concurrent_ops(0), m_ret(0)
 {
 }
 
@@ -29,6 +30,7 @@ void AsyncObjectThrottle<T>::start_ops(uint64_t max_concurrent) {
   bool complete;
   {
     Mutex::Locker l(m_lock);
+    m_max_concurrent_ops = max_concurrent;
     for (uint64_t i = 0; i < max_concurrent; ++i) {
       start_next_op();
       if (m_ret < 0 && m_current_ops == 0) {
@@ -44,6 +46,13 @@ void AsyncObjectThrottle<T>::start_ops(uint64_t max_concurrent) {
   }
 }
 
+template <typename T>
+void AsyncObjectThrottle<T>::set_max_concurrent_ops(uint64_t max_concurrent) {
+  // takes effect as in-flight ops complete
+  Mutex::Locker locker(m_lock);
+  m_max_concurrent_ops = std::max<uint64_t>(max_concurrent, 1);
+}
+
 template <typename T>
 void AsyncObjectThrottle<T>::finish_op(int r) {
   bool complete;
@@ -55,7 +64,13 @@ void AsyncObjectThrottle<T>::finish_op(int r) {
       m_ret = r;
     }
 
-    start_next_op();
+    while (m_current_ops < m_max_concurrent_ops) {
+      uint64_t current_ops = m_current_ops;
+      start_next_op();
+      if (m_current_ops == current_ops) {
+        break;
+      }
+    }
     complete = (m_current_ops == 0);
   }
   if (complete) {
@@ -55,6 +55,7 @@ public:
 		      uint64_t end_object_no);
 
   void start_ops(uint64_t max_concurrent);
+  void set_max_concurrent_ops(uint64_t max_concurrent);
   void finish_op(int r) override;
 
 private:
@@ -67,6 +68,7 @@ private:
   uint64_t m_object_no;
   uint64_t m_end_object_no;
   uint64_t m_current_ops;
+  uint64_t m_max_concurrent_ops;
   int m_ret;
 
   void start_next_op();
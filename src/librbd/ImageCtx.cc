@@ -1,6 +1,7 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 #include <errno.h>
+#include <algorithm>
 #include <boost/assign/list_of.hpp>
 #include <stddef.h>
 
@@ -25,6 +26,7 @@
 #include "librbd/operation/ResizeRequest.h"
 #include "librbd/Utils.h"
 #include "librbd/LibrbdWriteback.h"
+#include "librbd/cache/ImageCache.h"
 #include "librbd/exclusive_lock/AutomaticPolicy.h"
 #include "librbd/exclusive_lock/StandardPolicy.h"
 #include "librbd/io/AioCompletion.h"
@@ -100,6 +102,19 @@ struct C_FlushCache : public Context {
   }
 };
 
+struct C_FlushImageCache : public Context {
+  ImageCtx *image_ctx;
+  Context *on_safe;
+
+  C_FlushImageCache(ImageCtx *_image_ctx, Context *_on_safe)
+    : image_ctx(_image_ctx), on_safe(_on_safe) {
+  }
+  void finish(int r) override {
+    // write the image cache back to the cluster
+    image_ctx->image_cache->flush(on_safe);
+  }
+};
+
 struct C_ShutDownCache : public Context {
   ImageCtx *image_ctx;
   Context *on_finish;
@@ -163,6 +178,7 @@ struct C_InvalidateCache : public Context {
 } // anonymous namespace
 
   const string ImageCtx::METADATA_CONF_PREFIX = "conf_";
+  const string ImageCtx::METADATA_FLATTEN_OBJECT_NO = "rbd_flatten_object_no";
 
   ImageCtx::ImageCtx(const string &image_name, const string &image_id,
 		     const char *snap, IoCtx& p, bool ro)
@@ -184,6 +200,7 @@ struct C_InvalidateCache : public Context {
       object_map_lock(util::unique_lock_name("librbd::ImageCtx::object_map_lock", this)),
       async_ops_lock(util::unique_lock_name("librbd::ImageCtx::async_ops_lock", this)),
       copyup_list_lock(util::unique_lock_name("librbd::ImageCtx::copyup_list_lock", this)),
+      parent_read_heat_lock(util::unique_lock_name("librbd::ImageCtx::parent_read_heat_lock", this)),
       completed_reqs_lock(util::unique_lock_name("librbd::ImageCtx::completed_reqs_lock", this)),
       extra_read_flags(0),
       old_format(true),
@@ -271,49 +288,61 @@ struct C_InvalidateCache : public Context {
 
     perf_start(pname);
 
-    if (cache) {
-      Mutex::Locker l(cache_lock);
-      ldout(cct, 20) << "enabling caching..." << dendl;
-      writeback_handler = new LibrbdWriteback(this, cache_lock);
-
-      uint64_t init_max_dirty = cache_max_dirty;
-      if (cache_writethrough_until_flush)
-	init_max_dirty = 0;
-      ldout(cct, 20) << "Initial cache settings:"
-		     << " size=" << cache_size
-		     << " num_objects=" << 10
-		     << " max_dirty=" << init_max_dirty
-		     << " target_dirty=" << cache_target_dirty
-		     << " max_dirty_age="
-		     << cache_max_dirty_age << dendl;
-
-      object_cacher = new ObjectCacher(cct, pname, *writeback_handler, cache_lock,
-				       NULL, NULL,
-				       cache_size,
-				       10,  /* reset this in init */
-				       init_max_dirty,
-				       cache_target_dirty,
-				       cache_max_dirty_age,
-				       cache_block_writes_upfront);
-
-      // size object cache appropriately
-      uint64_t obj = cache_max_dirty_object;
-      if (!obj) {
-	obj = MIN(2000, MAX(10, cache_size / 100 / sizeof(ObjectCacher::Object)));
-      }
-      ldout(cct, 10) << " cache bytes " << cache_size
-	<< " -> about " << obj << " objects" << dendl;
-      object_cacher->set_max_objects(obj);
-
-      object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(), 0);
-      object_set->return_enoent = true;
-      object_cacher->start();
+    // the persistent cache takes the place of the in-memory cache on
+    // writable opens of the image head, its writeback must go straight to
+    // the cluster; it and the block cache are set up when the image is
+    // opened
+    if (cache && cache_type != "block" &&
+        (persistent_cache_path.empty() || read_only || !snap_name.empty())) {
+      init_object_cacher();
     }
 
     readahead.set_trigger_requests(readahead_trigger_requests);
     readahead.set_max_readahead_size(readahead_max_bytes);
   }
 
+  void ImageCtx::init_object_cacher() {
+    assert(object_cacher == nullptr);
+
+    Mutex::Locker l(cache_lock);
+    ldout(cct, 20) << "enabling caching..." << dendl;
+    writeback_handler = new LibrbdWriteback(this, cache_lock);
+
+    uint64_t init_max_dirty = cache_max_dirty;
+    if (cache_writethrough_until_flush)
+      init_max_dirty = 0;
+    ldout(cct, 20) << "Initial cache settings:"
+                   << " size=" << cache_size
+                   << " num_objects=" << 10
+                   << " max_dirty=" << init_max_dirty
+                   << " target_dirty=" << cache_target_dirty
+                   << " max_dirty_age="
+                   << cache_max_dirty_age << dendl;
+
+    object_cacher = new ObjectCacher(cct, perfcounter->get_name(),
+                                     *writeback_handler, cache_lock,
+                                     NULL, NULL,
+                                     cache_size,
+                                     10,  /* reset this in init */
+                                     init_max_dirty,
+                                     cache_target_dirty,
+                                     cache_max_dirty_age,
+                                     cache_block_writes_upfront);
+
+    // size object cache appropriately
+    uint64_t obj = cache_max_dirty_object;
+    if (!obj) {
+      obj = MIN(2000, MAX(10, cache_size / 100 / sizeof(ObjectCacher::Object)));
+    }
+    ldout(cct, 10) << " cache bytes " << cache_size
+                   << " -> about " << obj << " objects" << dendl;
+    object_cacher->set_max_objects(obj);
+
+    object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(), 0);
+    object_set->return_enoent = true;
+    object_cacher->start();
+  }
+
   void ImageCtx::shutdown() {
     delete image_watcher;
     image_watcher = nullptr;
@@ -385,6 +414,20 @@ struct C_InvalidateCache : public Context {
     plb.add_u64_counter(l_librbd_readahead, "readahead", "Read ahead");
     plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes", "Data size in read ahead");
     plb.add_u64_counter(l_librbd_invalidate_cache, "invalidate_cache", "Cache invalidates");
+    plb.add_u64_counter(l_librbd_pwl_rd_hit_bytes, "pwl_rd_hit_bytes", "Data read from the persistent cache");
+    plb.add_u64_counter(l_librbd_pwl_rd_miss_bytes, "pwl_rd_miss_bytes", "Data read from the cluster on persistent cache misses");
+    plb.add_u64_counter(l_librbd_pwl_log_sync, "pwl_log_sync", "Persistent cache log syncs");
+    plb.add_time_avg(l_librbd_pwl_log_sync_latency, "pwl_log_sync_latency", "Latency of persistent cache log syncs");
+    plb.add_u64_counter(l_librbd_pwl_log_full, "pwl_log_full", "Writes that waited for persistent cache log space");
+    plb.add_u64_counter(l_librbd_pwl_writeback_bytes, "pwl_writeback_bytes", "Data written back from the persistent cache");
+    plb.add_u64_counter(l_librbd_bc_rd_hit_bytes, "bc_rd_hit_bytes", "Data read from the block cache");
+    plb.add_u64_counter(l_librbd_bc_rd_miss_bytes, "bc_rd_miss_bytes", "Data read from the cluster on block cache misses");
+    plb.add_u64_counter(l_librbd_bc_evict, "bc_evict", "Clean blocks evicted from the block cache");
+    plb.add_u64_counter(l_librbd_bc_dirty_waits, "bc_dirty_waits", "Writes that waited for the block cache dirty limit");
+    plb.add_u64_counter(l_librbd_bc_writeback_ops, "bc_writeback_ops", "Block cache writeback requests");
+    plb.add_u64_counter(l_librbd_bc_writeback_bytes, "bc_writeback_bytes", "Data written back from the block cache");
+    plb.add_u64_counter(l_librbd_aio_direct, "aio_direct", "IO requests submitted from the caller's thread");
+    plb.add_u64_counter(l_librbd_aio_queued, "aio_queued", "IO requests handed to the op thread");
 
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
@@ -710,6 +753,67 @@ struct C_InvalidateCache : public Context {
     return -ENOENT;
   }
 
+  void ImageCtx::record_parent_read(uint64_t object_no)
+  {
+    if (flatten_hot_objects == 0) {
+      return;
+    }
+
+    Mutex::Locker locker(parent_read_heat_lock);
+    auto it = parent_read_heat.find(object_no);
+    if (it != parent_read_heat.end()) {
+      ++it->second;
+      return;
+    }
+
+    if (parent_read_heat.size() >= flatten_hot_objects) {
+      // halve the read counts so objects that are no longer read age out
+      for (it = parent_read_heat.begin(); it != parent_read_heat.end(); ) {
+        it->second >>= 1;
+        if (it->second == 0) {
+          it = parent_read_heat.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      if (parent_read_heat.size() >= flatten_hot_objects) {
+        return;
+      }
+    }
+    parent_read_heat[object_no] = 1;
+  }
+
+  void ImageCtx::get_hot_parent_objects(uint64_t max_objects,
+                                        std::vector<uint64_t> *object_nos)
+  {
+    std::vector<std::pair<uint32_t, uint64_t> > heat;
+    {
+      Mutex::Locker locker(parent_read_heat_lock);
+      heat.reserve(parent_read_heat.size());
+      for (auto &it : parent_read_heat) {
+        heat.emplace_back(it.second, it.first);
+      }
+    }
+
+    // hottest first, ties in object order
+    std::sort(heat.begin(), heat.end(),
+              [](const std::pair<uint32_t, uint64_t> &lhs,
+                 const std::pair<uint32_t, uint64_t> &rhs) {
+                if (lhs.first != rhs.first) {
+                  return lhs.first > rhs.first;
+                }
+                return lhs.second < rhs.second;
+              });
+
+    object_nos->clear();
+    for (auto &it : heat) {
+      if (object_nos->size() >= max_objects) {
+        break;
+      }
+      object_nos->push_back(it.second);
+    }
+  }
+
   void ImageCtx::aio_read_from_cache(object_t o, uint64_t object_no,
 				     bufferlist *bl, size_t len,
 				     uint64_t off, Context *onfinish,
@@ -804,6 +908,10 @@ struct C_InvalidateCache : public Context {
   }
 
   void ImageCtx::invalidate_cache(bool purge_on_error, Context *on_finish) {
+    if (image_cache != nullptr) {
+      image_cache->invalidate(purge_on_error, on_finish);
+      return;
+    }
     if (object_cacher == NULL) {
       op_work_queue->queue(on_finish, 0);
       return;
@@ -824,6 +932,9 @@ struct C_InvalidateCache : public Context {
   }
 
   bool ImageCtx::is_cache_empty() {
+    if (object_cacher == NULL) {
+      return true;
+    }
     Mutex::Locker locker(cache_lock);
     return object_cacher->set_is_empty(object_set);
   }
@@ -885,7 +996,10 @@ struct C_InvalidateCache : public Context {
     // ensure no locks are held when flush is complete
     on_safe = util::create_async_context_callback(*this, on_safe);
 
-    if (object_cacher != NULL) {
+    if (image_cache != nullptr) {
+      // write back the image cache after completing all in-flight AIO ops
+      on_safe = new C_FlushImageCache(this, on_safe);
+    } else if (object_cacher != NULL) {
       // flush cache after completing all in-flight AIO ops
       on_safe = new C_FlushCache(this, on_safe);
     }
@@ -950,6 +1064,7 @@ struct C_InvalidateCache : public Context {
     ldout(cct, 20) << __func__ << dendl;
     std::map<string, bool> configs = boost::assign::map_list_of(
         "rbd_non_blocking_aio", false)(
+        "rbd_direct_dispatch", false)(
         "rbd_cache", false)(
         "rbd_cache_writethrough_until_flush", false)(
         "rbd_cache_size", false)(
@@ -958,6 +1073,8 @@ struct C_InvalidateCache : public Context {
         "rbd_cache_max_dirty_age", false)(
         "rbd_cache_max_dirty_object", false)(
         "rbd_cache_block_writes_upfront", false)(
+        "rbd_cache_type", false)(
+        "rbd_cache_shards", false)(
         "rbd_concurrent_management_ops", false)(
         "rbd_balance_snap_reads", false)(
         "rbd_localize_snap_reads", false)(
@@ -967,6 +1084,9 @@ struct C_InvalidateCache : public Context {
         "rbd_readahead_max_bytes", false)(
         "rbd_readahead_disable_after_bytes", false)(
         "rbd_clone_copy_on_read", false)(
+        "rbd_flatten_hot_objects", false)(
+        "rbd_flatten_target_latency", false)(
+        "rbd_flatten_progress_update_objects", false)(
         "rbd_blacklist_on_break_lock", false)(
         "rbd_blacklist_expire_seconds", false)(
         "rbd_request_timed_out_seconds", false)(
@@ -976,12 +1096,18 @@ struct C_InvalidateCache : public Context {
         "rbd_journal_object_flush_interval", false)(
         "rbd_journal_object_flush_bytes", false)(
         "rbd_journal_object_flush_age", false)(
+        "rbd_journal_object_max_in_flight_appends", false)(
         "rbd_journal_pool", false)(
         "rbd_journal_max_payload_bytes", false)(
         "rbd_journal_max_concurrent_object_sets", false)(
         "rbd_mirroring_resync_after_disconnect", false)(
         "rbd_mirroring_replay_delay", false)(
-        "rbd_skip_partial_discard", false);
+        "rbd_skip_partial_discard", false)(
+        "rbd_object_map_batch_updates", false)(
+        "rbd_object_map_premark_objects", false)(
+        "rbd_persistent_cache_path", false)(
+        "rbd_persistent_cache_size", false)(
+        "rbd_persistent_cache_max_writeback_ops", false);
 
     md_config_t local_config_t;
     std::map<std::string, bufferlist> res;
@@ -1008,6 +1134,7 @@ struct C_InvalidateCache : public Context {
     } while (0);
 
     ASSIGN_OPTION(non_blocking_aio);
+    ASSIGN_OPTION(direct_dispatch);
     ASSIGN_OPTION(cache);
     ASSIGN_OPTION(cache_writethrough_until_flush);
     ASSIGN_OPTION(cache_size);
@@ -1016,6 +1143,8 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(cache_max_dirty_age);
     ASSIGN_OPTION(cache_max_dirty_object);
     ASSIGN_OPTION(cache_block_writes_upfront);
+    ASSIGN_OPTION(cache_type);
+    ASSIGN_OPTION(cache_shards);
     ASSIGN_OPTION(concurrent_management_ops);
     ASSIGN_OPTION(balance_snap_reads);
     ASSIGN_OPTION(localize_snap_reads);
@@ -1025,6 +1154,9 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(readahead_max_bytes);
     ASSIGN_OPTION(readahead_disable_after_bytes);
     ASSIGN_OPTION(clone_copy_on_read);
+    ASSIGN_OPTION(flatten_hot_objects);
+    ASSIGN_OPTION(flatten_target_latency);
+    ASSIGN_OPTION(flatten_progress_update_objects);
     ASSIGN_OPTION(blacklist_on_break_lock);
     ASSIGN_OPTION(blacklist_expire_seconds);
     ASSIGN_OPTION(request_timed_out_seconds);
@@ -1035,12 +1167,18 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(journal_object_flush_interval);
     ASSIGN_OPTION(journal_object_flush_bytes);
     ASSIGN_OPTION(journal_object_flush_age);
+    ASSIGN_OPTION(journal_object_max_in_flight_appends);
     ASSIGN_OPTION(journal_pool);
     ASSIGN_OPTION(journal_max_payload_bytes);
     ASSIGN_OPTION(journal_max_concurrent_object_sets);
     ASSIGN_OPTION(mirroring_resync_after_disconnect);
     ASSIGN_OPTION(mirroring_replay_delay);
     ASSIGN_OPTION(skip_partial_discard);
+    ASSIGN_OPTION(object_map_batch_updates);
+    ASSIGN_OPTION(object_map_premark_objects);
+    ASSIGN_OPTION(persistent_cache_path);
+    ASSIGN_OPTION(persistent_cache_size);
+    ASSIGN_OPTION(persistent_cache_max_writeback_ops);
   }
 
   ExclusiveLock<ImageCtx> *ImageCtx::create_exclusive_lock() {
@@ -110,6 +110,7 @@ namespace librbd {
     RWLock object_map_lock; // protects object map updates and object_map itself
     Mutex async_ops_lock; // protects async_ops and async_requests
     Mutex copyup_list_lock; // protects copyup_waiting_list
+    Mutex parent_read_heat_lock; // protects parent_read_heat
     Mutex completed_reqs_lock; // protects completed_reqs
 
     unsigned extra_read_flags;
@@ -140,6 +141,9 @@ namespace librbd {
 
     std::map<uint64_t, io::CopyupRequest*> copyup_list;
 
+    // object number -> recent reads served by the parent
+    std::map<uint64_t, uint32_t> parent_read_heat;
+
     xlist<AsyncOperation*> async_ops;
     xlist<AsyncRequest<>*> async_requests;
     std::list<Context*> async_requests_waiters;
@@ -160,7 +164,9 @@ namespace librbd {
 
     // Configuration
     static const string METADATA_CONF_PREFIX;
+    static const string METADATA_FLATTEN_OBJECT_NO;
     bool non_blocking_aio;
+    bool direct_dispatch;
     bool cache;
     bool cache_writethrough_until_flush;
     uint64_t cache_size;
@@ -169,6 +175,8 @@ namespace librbd {
     double cache_max_dirty_age;
     uint32_t cache_max_dirty_object;
     bool cache_block_writes_upfront;
+    std::string cache_type;
+    uint32_t cache_shards;
     uint32_t concurrent_management_ops;
     bool balance_snap_reads;
     bool localize_snap_reads;
@@ -178,6 +186,9 @@ namespace librbd {
     uint64_t readahead_max_bytes;
     uint64_t readahead_disable_after_bytes;
     bool clone_copy_on_read;
+    uint64_t flatten_hot_objects;
+    double flatten_target_latency;
+    uint64_t flatten_progress_update_objects;
     bool blacklist_on_break_lock;
     uint32_t blacklist_expire_seconds;
     uint32_t request_timed_out_seconds;
@@ -188,12 +199,18 @@ namespace librbd {
     int journal_object_flush_interval;
     uint64_t journal_object_flush_bytes;
     double journal_object_flush_age;
+    uint64_t journal_object_max_in_flight_appends;
     std::string journal_pool;
     uint32_t journal_max_payload_bytes;
     int journal_max_concurrent_object_sets;
     bool mirroring_resync_after_disconnect;
     int mirroring_replay_delay;
     bool skip_partial_discard;
+    bool object_map_batch_updates;
+    uint64_t object_map_premark_objects;
+    std::string persistent_cache_path;
+    uint64_t persistent_cache_size;
+    uint32_t persistent_cache_max_writeback_ops;
 
     LibrbdAdminSocketHook *asok_hook;
 
@@ -222,6 +239,7 @@ namespace librbd {
 	     const char *snap, IoCtx& p, bool read_only);
     ~ImageCtx();
     void init();
+    void init_object_cacher();
     void shutdown();
     void init_layout();
     void perf_start(std::string name);
@@ -276,6 +294,9 @@ namespace librbd {
     uint64_t get_parent_snap_id(librados::snap_t in_snap_id) const;
     int get_parent_overlap(librados::snap_t in_snap_id,
 			   uint64_t *overlap) const;
+    void record_parent_read(uint64_t object_no);
+    void get_hot_parent_objects(uint64_t max_objects,
+                                std::vector<uint64_t> *object_nos);
     void aio_read_from_cache(object_t o, uint64_t object_no, bufferlist *bl,
 			     size_t len, uint64_t off, Context *onfinish,
 			     int fadvise_flags);
@@ -62,6 +62,17 @@ public:
 
   int assert_header_locked();
 
+  std::string get_cookie() const {
+    Mutex::Locker l(m_lock);
+    return m_cookie;
+  }
+
+  /// the stale locker broken by the most recent lock acquisition, if any
+  managed_lock::Locker get_broken_locker() const {
+    Mutex::Locker l(m_lock);
+    return m_broken_locker;
+  }
+
   bool is_shutdown() const {
     Mutex::Locker l(m_lock);
     return is_state_shutdown();
@@ -220,6 +231,7 @@ private:
 
   std::string m_cookie;
   std::string m_new_cookie;
+  managed_lock::Locker m_broken_locker;
 
   State m_state;
   State m_post_next_state;
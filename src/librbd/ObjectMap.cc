@@ -5,6 +5,7 @@
 #include "librbd/BlockGuard.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "librbd/object_map/RefreshRequest.h"
 #include "librbd/object_map/ResizeRequest.h"
 #include "librbd/object_map/SnapshotCreateRequest.h"
@@ -41,6 +42,7 @@ ObjectMap<I>::ObjectMap(I &image_ctx, uint64_t snap_id)
 template <typename I>
 ObjectMap<I>::~ObjectMap() {
   delete m_update_guard;
+  delete m_extent_map;
 }
 
 template <typename I>
@@ -120,6 +122,23 @@ bool ObjectMap<I>::update_required(uint64_t object_no, uint8_t new_state) {
 
 template <typename I>
 void ObjectMap<I>::open(Context *on_finish) {
+  if (m_snap_id == CEPH_NOSNAP) {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    if (m_image_ctx.test_features(RBD_FEATURE_EXTENT_MAP,
+                                  m_image_ctx.snap_lock)) {
+      assert(m_extent_map == nullptr);
+      m_extent_map = object_map::ExtentMap<I>::create(m_image_ctx);
+
+      on_finish = new FunctionContext([this, on_finish](int r) {
+          if (r < 0) {
+            on_finish->complete(r);
+            return;
+          }
+          m_extent_map->open(on_finish);
+        });
+    }
+  }
+
   auto req = object_map::RefreshRequest<I>::create(
     m_image_ctx, &m_object_map, m_snap_id, on_finish);
   req->send();
@@ -141,6 +160,12 @@ void ObjectMap<I>::rollback(uint64_t snap_id, Context *on_finish) {
   assert(m_image_ctx.snap_lock.is_locked());
   assert(m_image_ctx.object_map_lock.is_wlocked());
 
+  if (extent_map_enabled()) {
+    on_finish = new FunctionContext([this, on_finish](int r) {
+        m_extent_map->rollback(on_finish);
+      });
+  }
+
   object_map::SnapshotRollbackRequest *req =
     new object_map::SnapshotRollbackRequest(m_image_ctx, snap_id, on_finish);
   req->send();
@@ -152,6 +177,12 @@ void ObjectMap<I>::snapshot_add(uint64_t snap_id, Context *on_finish) {
   assert((m_image_ctx.features & RBD_FEATURE_OBJECT_MAP) != 0);
   assert(snap_id != CEPH_NOSNAP);
 
+  if (extent_map_enabled()) {
+    on_finish = new FunctionContext([this, snap_id, on_finish](int r) {
+        m_extent_map->snapshot_add(snap_id, on_finish);
+      });
+  }
+
   object_map::SnapshotCreateRequest *req =
     new object_map::SnapshotCreateRequest(m_image_ctx, &m_object_map, snap_id,
                                           on_finish);
@@ -164,6 +195,12 @@ void ObjectMap<I>::snapshot_remove(uint64_t snap_id, Context *on_finish) {
   assert((m_image_ctx.features & RBD_FEATURE_OBJECT_MAP) != 0);
   assert(snap_id != CEPH_NOSNAP);
 
+  if (extent_map_enabled()) {
+    on_finish = new FunctionContext([this, snap_id, on_finish](int r) {
+        m_extent_map->snapshot_remove(snap_id, on_finish);
+      });
+  }
+
   object_map::SnapshotRemoveRequest *req =
     new object_map::SnapshotRemoveRequest(m_image_ctx, &m_object_map, snap_id,
                                           on_finish);
@@ -203,6 +240,16 @@ void ObjectMap<I>::aio_resize(uint64_t new_size, uint8_t default_object_state,
   assert(m_image_ctx.exclusive_lock == nullptr ||
          m_image_ctx.exclusive_lock->is_lock_owner());
 
+  if (extent_map_enabled()) {
+    on_finish = new FunctionContext([this, new_size, on_finish](int r) {
+        if (r < 0) {
+          on_finish->complete(r);
+          return;
+        }
+        m_extent_map->aio_resize(new_size, on_finish);
+      });
+  }
+
   object_map::ResizeRequest *req = new object_map::ResizeRequest(
     m_image_ctx, &m_object_map, m_snap_id, new_size, default_object_state,
     on_finish);
@@ -217,6 +264,8 @@ void ObjectMap<I>::detained_aio_update(UpdateOperation &&op) {
   assert(m_image_ctx.snap_lock.is_locked());
   assert(m_image_ctx.object_map_lock.is_wlocked());
 
+  premark_objects(&op);
+
   BlockGuardCell *cell;
   int r = m_update_guard->detain({op.start_object_no, op.end_object_no},
                                 &op, &cell);
@@ -302,6 +351,16 @@ void ObjectMap<I>::aio_update(uint64_t snap_id, uint64_t start_object_no,
       m_image_ctx.op_work_queue->queue(on_finish, 0);
       return;
     }
+
+    if (m_image_ctx.object_map_batch_updates &&
+        queue_sequential_update(start_object_no, end_object_no, new_state,
+                                current_state, on_finish)) {
+      return;
+    }
+
+    send_update(start_object_no, end_object_no, new_state, current_state,
+                {on_finish});
+    return;
   }
 
   auto req = object_map::UpdateRequest<I>::create(
@@ -310,6 +369,146 @@ void ObjectMap<I>::aio_update(uint64_t snap_id, uint64_t start_object_no,
   req->send();
 }
 
+template <typename I>
+void ObjectMap<I>::premark_objects(UpdateOperation *op) {
+  assert(m_image_ctx.object_map_lock.is_wlocked());
+
+  // pre-mark the objects following a sequential write as existing so that
+  // the writes to them do not require their own object map updates
+  uint64_t premark_objects = m_image_ctx.object_map_premark_objects;
+  if (premark_objects == 0 || op->new_state != OBJECT_EXISTS ||
+      op->current_state) {
+    return;
+  }
+
+  if (op->start_object_no == m_premark_object_no) {
+    uint64_t end_object_no = std::min<uint64_t>(
+      op->end_object_no + premark_objects, m_object_map.size());
+    while (op->end_object_no < end_object_no &&
+           m_object_map[op->end_object_no] == OBJECT_NONEXISTENT) {
+      ++op->end_object_no;
+    }
+  }
+  m_premark_object_no = op->end_object_no;
+}
+
+template <typename I>
+bool ObjectMap<I>::queue_sequential_update(
+    uint64_t start_object_no, uint64_t end_object_no, uint8_t new_state,
+    const boost::optional<uint8_t> &current_state, Context *on_finish) {
+  assert(m_image_ctx.object_map_lock.is_wlocked());
+
+  auto &sequential_update = m_sequential_update;
+  if (sequential_update.tid == 0 ||
+      start_object_no != sequential_update.end_object_no ||
+      new_state != sequential_update.new_state ||
+      current_state != sequential_update.current_state) {
+    return false;
+  }
+
+  ldout(m_image_ctx.cct, 20) << "queuing update behind tid="
+                             << sequential_update.tid << dendl;
+  sequential_update.pending_updates.emplace_back(
+    start_object_no, end_object_no, new_state, current_state, on_finish);
+  sequential_update.end_object_no = end_object_no;
+  return true;
+}
+
+template <typename I>
+void ObjectMap<I>::send_update(uint64_t start_object_no,
+                               uint64_t end_object_no, uint8_t new_state,
+                               const boost::optional<uint8_t> &current_state,
+                               const Contexts &on_finishes) {
+  assert(m_image_ctx.object_map_lock.is_wlocked());
+
+  uint64_t tid = ++m_last_update_tid;
+  if (m_sequential_update.pending_updates.empty()) {
+    // contiguous updates arriving while this update is in-flight
+    // will be coalesced
+    m_sequential_update.tid = tid;
+    m_sequential_update.end_object_no = end_object_no;
+    m_sequential_update.new_state = new_state;
+    m_sequential_update.current_state = current_state;
+  }
+
+  Context *ctx = new FunctionContext([this, tid, on_finishes](int r) {
+      handle_update(tid, on_finishes, r);
+    });
+  auto req = object_map::UpdateRequest<I>::create(
+    m_image_ctx, &m_object_map, CEPH_NOSNAP, start_object_no, end_object_no,
+    new_state, current_state, ctx);
+  req->send();
+}
+
+template <typename I>
+void ObjectMap<I>::handle_update(uint64_t tid, const Contexts &on_finishes,
+                                 int r) {
+  ldout(m_image_ctx.cct, 20) << "tid=" << tid << ", r=" << r << dendl;
+
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+    auto &sequential_update = m_sequential_update;
+    if (sequential_update.tid == tid) {
+      sequential_update.tid = 0;
+
+      UpdateOperations pending_updates;
+      pending_updates.swap(sequential_update.pending_updates);
+      if (!pending_updates.empty()) {
+        Contexts pending_on_finishes;
+        for (auto &op : pending_updates) {
+          pending_on_finishes.push_back(op.on_finish);
+        }
+
+        auto &front = pending_updates.front();
+        ldout(m_image_ctx.cct, 20) << "sending " << pending_updates.size()
+                                   << " coalesced updates" << dendl;
+        send_update(front.start_object_no,
+                    pending_updates.back().end_object_no, front.new_state,
+                    front.current_state, pending_on_finishes);
+      }
+    }
+  }
+
+  for (auto ctx : on_finishes) {
+    ctx->complete(r);
+  }
+}
+
+template <typename I>
+bool ObjectMap<I>::extent_map_enabled() const {
+  assert(m_image_ctx.snap_lock.is_locked());
+  return (m_extent_map != nullptr &&
+          m_image_ctx.test_features(RBD_FEATURE_EXTENT_MAP,
+                                    m_image_ctx.snap_lock));
+}
+
+template <typename I>
+bool ObjectMap<I>::extent_update_required(uint64_t object_no,
+                                          uint64_t object_off,
+                                          uint64_t object_len) {
+  assert(m_image_ctx.snap_lock.is_locked());
+  assert(m_image_ctx.object_map_lock.is_wlocked());
+
+  // an invalid HEAD map is reset by the next snapshot
+  if (!extent_map_enabled() ||
+      m_image_ctx.test_flags(RBD_FLAG_EXTENT_MAP_INVALID,
+                             m_image_ctx.snap_lock)) {
+    return false;
+  }
+  return m_extent_map->update_required(object_no, object_off, object_len);
+}
+
+template <typename I>
+void ObjectMap<I>::aio_update_extents(uint64_t object_no, uint64_t object_off,
+                                      uint64_t object_len,
+                                      Context *on_finish) {
+  ldout(m_image_ctx.cct, 20) << "object_no=" << object_no << ", "
+                             << "object_off=" << object_off << ", "
+                             << "object_len=" << object_len << dendl;
+  m_extent_map->aio_update(object_no, object_off, object_len, on_finish);
+}
+
 } // namespace librbd
 
 template class librbd::ObjectMap<librbd::ImageCtx>;
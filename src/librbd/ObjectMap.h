@@ -10,6 +10,8 @@
 #include "common/bit_vector.hpp"
 #include "librbd/Utils.h"
 #include <boost/optional.hpp>
+#include <limits>
+#include <list>
 
 class Context;
 class RWLock;
@@ -23,6 +25,8 @@ template <typename Op> class BlockGuard;
 struct BlockGuardCell;
 class ImageCtx;
 
+namespace object_map { template <typename> class ExtentMap; }
+
 template <typename ImageCtxT = ImageCtx>
 class ObjectMap {
 public:
@@ -94,6 +98,18 @@ public:
     return true;
   }
 
+  template <typename T, void(T::*MF)(int) = &T::complete>
+  bool aio_update_extents(uint64_t object_no, uint64_t object_off,
+                          uint64_t object_len, T *callback_object) {
+    if (!extent_update_required(object_no, object_off, object_len)) {
+      return false;
+    }
+
+    aio_update_extents(object_no, object_off, object_len,
+                       util::create_context_callback<T, MF>(callback_object));
+    return true;
+  }
+
   void rollback(uint64_t snap_id, Context *on_finish);
   void snapshot_add(uint64_t snap_id, Context *on_finish);
   void snapshot_remove(uint64_t snap_id, Context *on_finish);
@@ -117,23 +133,60 @@ private:
   };
 
   typedef BlockGuard<UpdateOperation> UpdateGuard;
+  typedef std::list<UpdateOperation> UpdateOperations;
+  typedef std::list<Context *> Contexts;
+
+  /**
+   * Tracks the most recent HEAD update so that updates to the following
+   * contiguous objects with the same state transition can be coalesced into
+   * a single update once it completes.
+   */
+  struct SequentialUpdate {
+    uint64_t tid = 0;
+    uint64_t end_object_no = 0;
+    uint8_t new_state = 0;
+    boost::optional<uint8_t> current_state;
+    UpdateOperations pending_updates;
+  };
 
   ImageCtxT &m_image_ctx;
   ceph::BitVector<2> m_object_map;
   uint64_t m_snap_id;
 
   UpdateGuard *m_update_guard = nullptr;
+  object_map::ExtentMap<ImageCtxT> *m_extent_map = nullptr;
+
+  uint64_t m_last_update_tid = 0;
+  SequentialUpdate m_sequential_update;
+  uint64_t m_premark_object_no = std::numeric_limits<uint64_t>::max();
 
   void detained_aio_update(UpdateOperation &&update_operation);
   void handle_detained_aio_update(BlockGuardCell *cell, int r,
                                   Context *on_finish);
 
+  void premark_objects(UpdateOperation *update_operation);
+  bool queue_sequential_update(uint64_t start_object_no,
+                               uint64_t end_object_no, uint8_t new_state,
+                               const boost::optional<uint8_t> &current_state,
+                               Context *on_finish);
+  void send_update(uint64_t start_object_no, uint64_t end_object_no,
+                   uint8_t new_state,
+                   const boost::optional<uint8_t> &current_state,
+                   const Contexts &on_finishes);
+  void handle_update(uint64_t tid, const Contexts &on_finishes, int r);
+
   void aio_update(uint64_t snap_id, uint64_t start_object_no,
                   uint64_t end_object_no, uint8_t new_state,
                   const boost::optional<uint8_t> &current_state,
                   Context *on_finish);
   bool update_required(uint64_t object_no, uint8_t new_state);
 
+  bool extent_map_enabled() const;
+  bool extent_update_required(uint64_t object_no, uint64_t object_off,
+                              uint64_t object_len);
+  void aio_update_extents(uint64_t object_no, uint64_t object_off,
+                          uint64_t object_len, Context *on_finish);
+
 };
 
 } // namespace librbd
@@ -15,6 +15,7 @@
 #include "librbd/Utils.h"
 #include "librbd/journal/DisabledPolicy.h"
 #include "librbd/journal/StandardPolicy.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "librbd/operation/DisableFeaturesRequest.h"
 #include "librbd/operation/EnableFeaturesRequest.h"
 #include "librbd/operation/FlattenRequest.h"
@@ -616,6 +617,11 @@ int Operations<I>::resize(uint64_t size, bool allow_shrink, ProgressContext& pro
     lderr(cct) << "New size not compatible with object map" << dendl;
     return -EINVAL;
   }
+  if (m_image_ctx.test_features(RBD_FEATURE_EXTENT_MAP) &&
+      !object_map::ExtentMap<>::is_compatible(m_image_ctx.layout, size)) {
+    lderr(cct) << "New size not compatible with extent map" << dendl;
+    return -EINVAL;
+  }
 
   uint64_t request_id = ++m_async_request_seq;
   r = invoke_async_request("resize", false,
@@ -654,6 +660,13 @@ void Operations<I>::execute_resize(uint64_t size, bool allow_shrink, ProgressCon
     m_image_ctx.snap_lock.put_read();
     on_finish->complete(-EINVAL);
     return;
+  } else if (m_image_ctx.test_features(RBD_FEATURE_EXTENT_MAP,
+                                       m_image_ctx.snap_lock) &&
+             !object_map::ExtentMap<>::is_compatible(m_image_ctx.layout,
+                                                     size)) {
+    m_image_ctx.snap_lock.put_read();
+    on_finish->complete(-EINVAL);
+    return;
   }
   m_image_ctx.snap_lock.put_read();
 
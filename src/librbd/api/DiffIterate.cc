@@ -7,6 +7,7 @@
 #include "librbd/ObjectMap.h"
 #include "librbd/Utils.h"
 #include "librbd/internal.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "include/rados/librados.hpp"
 #include "include/interval_set.h"
 #include "common/errno.h"
@@ -32,6 +33,47 @@ enum ObjectDiffState {
   OBJECT_DIFF_STATE_HOLE    = 2
 };
 
+enum ExtentDiffState {
+  EXTENT_DIFF_STATE_NONE    = 0,
+  EXTENT_DIFF_STATE_UPDATED = 1
+};
+
+typedef boost::tuple<uint64_t, size_t, bool> Diff;
+typedef std::list<Diff> Diffs;
+
+void append_object_diffs(CephContext *cct, const std::string &oid,
+                         uint64_t offset,
+                         const std::vector<ObjectExtent> &object_extents,
+                         const interval_set<uint64_t> &diff, bool exists,
+                         Diffs *diffs) {
+  for (auto q = object_extents.begin(); q != object_extents.end(); ++q) {
+    ldout(cct, 20) << "diff_iterate object " << oid << " extent "
+                   << q->offset << "~" << q->length << " from "
+                   << q->buffer_extents << dendl;
+    uint64_t opos = q->offset;
+    for (auto r = q->buffer_extents.begin(); r != q->buffer_extents.end();
+         ++r) {
+      interval_set<uint64_t> overlap;  // object extents
+      overlap.insert(opos, r->second);
+      overlap.intersection_of(diff);
+      ldout(cct, 20) << " opos " << opos
+                     << " buf " << r->first << "~" << r->second
+                     << " overlap " << overlap << dendl;
+      for (interval_set<uint64_t>::const_iterator s = overlap.begin();
+           s != overlap.end(); ++s) {
+        uint64_t su_off = s.get_start() - opos;
+        uint64_t logical_off = offset + r->first + su_off;
+        ldout(cct, 20) << "   overlap extent " << s.get_start() << "~"
+                       << s.get_len() << " logical " << logical_off << "~"
+                       << s.get_len() << dendl;
+        diffs->push_back(boost::make_tuple(logical_off, s.get_len(), exists));
+      }
+      opos += r->second;
+    }
+    assert(opos == q->offset + q->length);
+  }
+}
+
 struct DiffContext {
   DiffIterate<>::Callback callback;
   void *callback_arg;
@@ -77,9 +119,6 @@ public:
   }
 
 protected:
-  typedef boost::tuple<uint64_t, size_t, bool> Diff;
-  typedef std::list<Diff> Diffs;
-
   void finish(int r) override {
     CephContext *cct = m_cct;
     if (r == 0 && m_snap_ret < 0) {
@@ -151,35 +190,8 @@ private:
       return;
     }
 
-    for (vector<ObjectExtent>::iterator q = m_object_extents.begin();
-         q != m_object_extents.end(); ++q) {
-      ldout(cct, 20) << "diff_iterate object " << m_oid << " extent "
-                     << q->offset << "~" << q->length << " from "
-                     << q->buffer_extents << dendl;
-      uint64_t opos = q->offset;
-      for (vector<pair<uint64_t,uint64_t> >::iterator r =
-             q->buffer_extents.begin();
-           r != q->buffer_extents.end(); ++r) {
-        interval_set<uint64_t> overlap;  // object extents
-        overlap.insert(opos, r->second);
-        overlap.intersection_of(diff);
-        ldout(cct, 20) << " opos " << opos
-                       << " buf " << r->first << "~" << r->second
-                       << " overlap " << overlap << dendl;
-        for (interval_set<uint64_t>::iterator s = overlap.begin();
-    	       s != overlap.end(); ++s) {
-          uint64_t su_off = s.get_start() - opos;
-          uint64_t logical_off = m_offset + r->first + su_off;
-          ldout(cct, 20) << "   overlap extent " << s.get_start() << "~"
-                         << s.get_len() << " logical " << logical_off << "~"
-                         << s.get_len() << dendl;
-          diffs->push_back(boost::make_tuple(logical_off, s.get_len(),
-                           end_exists));
-        }
-        opos += r->second;
-      }
-      assert(opos == q->offset + q->length);
-    }
+    append_object_diffs(cct, m_oid, m_offset, m_object_extents, diff,
+                        end_exists, diffs);
   }
 
   void compute_parent_overlap(Diffs *diffs) {
@@ -287,10 +299,29 @@ int DiffIterate<I>::execute() {
 
   int r;
   bool fast_diff_enabled = false;
+  bool extent_diff_enabled = false;
   BitVector<2> object_diff_state;
+  BitVector<2> extent_diff_state;
   {
     RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
-    if (m_whole_object && (m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0) {
+    if (!m_whole_object && from_snap_id != 0 &&
+        (m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0 &&
+        (m_image_ctx.features & RBD_FEATURE_EXTENT_MAP) != 0) {
+      // the changed chunks of updated objects replace listing their
+      // snapshots
+      r = diff_object_map(from_snap_id, end_snap_id, &object_diff_state);
+      if (r == 0) {
+        r = diff_extent_map(from_snap_id, end_snap_id, &extent_diff_state);
+      }
+      if (r < 0) {
+        ldout(cct, 5) << "extent diff disabled" << dendl;
+      } else {
+        ldout(cct, 5) << "extent diff enabled" << dendl;
+        fast_diff_enabled = true;
+        extent_diff_enabled = true;
+      }
+    } else if (m_whole_object &&
+               (m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0) {
       r = diff_object_map(from_snap_id, end_snap_id, &object_diff_state);
       if (r < 0) {
         ldout(cct, 5) << "fast diff disabled" << dendl;
@@ -301,6 +332,10 @@ int DiffIterate<I>::execute() {
     }
   }
 
+  uint64_t object_size = m_image_ctx.layout.object_size;
+  uint64_t chunk_size = object_map::ExtentMap<>::get_chunk_size(object_size);
+  uint64_t chunks_per_object = std::max<uint64_t>(object_size / chunk_size, 1);
+
   // we must list snaps via the head, not end snap
   head_ctx.snap_set_read(CEPH_SNAPDIR);
 
@@ -351,7 +386,36 @@ int DiffIterate<I>::execute() {
          p != object_extents.end(); ++p) {
       ldout(cct, 20) << "object " << p->first << dendl;
 
-      if (fast_diff_enabled) {
+      if (extent_diff_enabled &&
+          object_diff_state[p->second.front().objectno] ==
+            OBJECT_DIFF_STATE_UPDATED) {
+        const uint64_t object_no = p->second.front().objectno;
+        const uint64_t start_chunk_no = object_no * chunks_per_object;
+
+        interval_set<uint64_t> diff;
+        if (start_chunk_no + chunks_per_object <= extent_diff_state.size()) {
+          for (uint64_t i = 0; i < chunks_per_object; ++i) {
+            if (extent_diff_state[start_chunk_no + i] ==
+                  EXTENT_DIFF_STATE_UPDATED) {
+              diff.insert(i * chunk_size, chunk_size);
+            }
+          }
+        }
+        if (diff.empty()) {
+          // no chunk recorded for an updated object: report all of it
+          diff.insert(0, object_size);
+        }
+
+        Diffs diffs;
+        append_object_diffs(cct, p->first.name, off, p->second, diff, true,
+                            &diffs);
+        for (auto &d : diffs) {
+          r = m_callback(d.get<0>(), d.get<1>(), d.get<2>(), m_callback_arg);
+          if (r < 0) {
+            return r;
+          }
+        }
+      } else if (fast_diff_enabled) {
         const uint64_t object_no = p->second.front().objectno;
         if (object_diff_state[object_no] != OBJECT_DIFF_STATE_NONE) {
           bool updated = (object_diff_state[object_no] ==
@@ -500,6 +564,70 @@ int DiffIterate<I>::diff_object_map(uint64_t from_snap_id, uint64_t to_snap_id,
   return 0;
 }
 
+template <typename I>
+int DiffIterate<I>::diff_extent_map(uint64_t from_snap_id,
+                                    uint64_t to_snap_id,
+                                    BitVector<2>* extent_diff_state) {
+  assert(m_image_ctx.snap_lock.is_locked());
+  assert(from_snap_id != 0);
+  CephContext* cct = m_image_ctx.cct;
+
+  // the map of a snapshot holds the chunks written since the one before
+  std::vector<uint64_t> snap_ids;
+  for (auto it = m_image_ctx.snap_info.upper_bound(from_snap_id);
+       it != m_image_ctx.snap_info.end() && it->first <= to_snap_id; ++it) {
+    snap_ids.push_back(it->first);
+  }
+  if (to_snap_id == CEPH_NOSNAP) {
+    snap_ids.push_back(CEPH_NOSNAP);
+  }
+
+  extent_diff_state->clear();
+  bool first = true;
+  for (auto snap_id : snap_ids) {
+    uint64_t flags;
+    int r = m_image_ctx.get_flags(snap_id, &flags);
+    if (r < 0) {
+      lderr(cct) << "diff_extent_map: failed to retrieve image flags" << dendl;
+      return r;
+    }
+    if ((flags & RBD_FLAG_EXTENT_MAP_INVALID) != 0) {
+      ldout(cct, 1) << "diff_extent_map: cannot perform extent diff on "
+                    << "invalid extent map" << dendl;
+      return -EINVAL;
+    }
+
+    BitVector<2> extent_map;
+    std::string oid(object_map::ExtentMap<>::extent_map_name(m_image_ctx.id,
+                                                             snap_id));
+    r = cls_client::object_map_load(&m_image_ctx.md_ctx, oid, &extent_map);
+    if (r < 0) {
+      ldout(cct, 1) << "diff_extent_map: failed to load extent map " << oid
+                    << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    ldout(cct, 20) << "diff_extent_map: loaded extent map " << oid << dendl;
+
+    // chunks not covered by every map are considered changed
+    uint64_t size = extent_diff_state->size();
+    if (first) {
+      extent_diff_state->resize(extent_map.size());
+      first = false;
+    } else if (extent_map.size() > size) {
+      extent_diff_state->resize(extent_map.size());
+      for (uint64_t i = size; i < extent_map.size(); ++i) {
+        (*extent_diff_state)[i] = EXTENT_DIFF_STATE_UPDATED;
+      }
+    }
+    for (uint64_t i = 0; i < extent_diff_state->size(); ++i) {
+      if (i >= extent_map.size() || extent_map[i] == EXTENT_CHANGED) {
+        (*extent_diff_state)[i] = EXTENT_DIFF_STATE_UPDATED;
+      }
+    }
+  }
+  return 0;
+}
+
 } // namespace api
 } // namespace librbd
 
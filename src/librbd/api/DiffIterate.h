@@ -55,6 +55,8 @@ private:
 
   int diff_object_map(uint64_t from_snap_id, uint64_t to_snap_id,
                       BitVector<2>* object_diff_state);
+  int diff_extent_map(uint64_t from_snap_id, uint64_t to_snap_id,
+                      BitVector<2>* extent_diff_state);
 
 };
 
@@ -0,0 +1,1003 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "BlockImageCache.h"
+#include "include/buffer.h"
+#include "common/Clock.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/perf_counters.h"
+#include "common/Timer.h"
+#include "common/WorkQueue.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+#include <map>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::BlockImageCache: " << this << " " \
+                           <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+template <typename I>
+struct BlockImageCache<I>::C_ReadRequest : public Context {
+  BlockImageCache *cache;
+  Extents image_extents;
+  std::vector<uint64_t> write_seqs;   // of each shard piece, in order
+  bufferlist miss_bl;
+  bufferlist *bl;
+  Context *on_finish;
+
+  C_ReadRequest(BlockImageCache *cache, const Extents &image_extents,
+                bufferlist *bl, Context *on_finish)
+    : cache(cache), image_extents(image_extents), bl(bl),
+      on_finish(on_finish) {
+  }
+
+  void finish(int r) override {
+    if (r < 0) {
+      on_finish->complete(r);
+      return;
+    }
+    cache->handle_read(this);
+    on_finish->complete(0);
+  }
+};
+
+template <typename I>
+BlockImageCache<I>::Block::Block(uint64_t block_no)
+  : block_no(block_no), data(buffer::create(BLOCK_SIZE)) {
+}
+
+template <typename I>
+BlockImageCache<I>::BlockImageCache(ImageCtx &image_ctx)
+  : m_image_ctx(image_ctx), m_image_writeback(image_ctx),
+    m_lock("librbd::BlockImageCache::m_lock") {
+  uint64_t shards = std::max<uint64_t>(1, m_image_ctx.cache_shards);
+  for (uint64_t i = 0; i < shards; ++i) {
+    m_shards.push_back(new Shard("librbd::BlockImageCache::Shard::lock"));
+  }
+  m_max_shard_blocks = std::max<uint64_t>(
+    1, m_image_ctx.cache_size / BLOCK_SIZE / shards);
+  m_max_hot_blocks = std::max<uint64_t>(1, m_max_shard_blocks * 4 / 5);
+}
+
+template <typename I>
+BlockImageCache<I>::~BlockImageCache() {
+  assert(m_in_flight.empty());
+  assert(m_flush_waiters.empty());
+  assert(m_dirty_waiters.empty());
+  assert(m_timer_ctx == nullptr);
+  purge(false);
+  for (auto shard : m_shards) {
+    delete shard;
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::aio_read(Extents &&image_extents, bufferlist *bl,
+                                  int fadvise_flags, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    if (m_image_ctx.snap_id != CEPH_NOSNAP) {
+      // only the image head is cached
+      m_image_writeback.aio_read(std::move(image_extents), bl, fadvise_flags,
+                                 on_finish);
+      return;
+    }
+  }
+
+  auto *req = new C_ReadRequest(this, image_extents, bl, on_finish);
+  bufferlist hit_bl;
+  bool hit = true;
+  uint64_t length = 0;
+  for (auto &extent : image_extents) {
+    uint64_t end = extent.first + extent.second;
+    for (uint64_t off = extent.first; off < end; ) {
+      uint64_t len = piece_length(off, end);
+      Shard &shard = get_shard(off);
+      Mutex::Locker locker(shard.lock);
+      req->write_seqs.push_back(shard.write_seq);
+      if (hit) {
+        hit = read_hit(shard, off, len, &hit_bl);
+      }
+      off += len;
+    }
+    length += extent.second;
+  }
+
+  if (hit) {
+    m_image_ctx.perfcounter->inc(l_librbd_bc_rd_hit_bytes, length);
+    bl->claim(hit_bl);
+    delete req;
+    on_finish->complete(0);
+    return;
+  }
+
+  // read the whole request and merge it with the cache, which may hold
+  // newer data than the cluster
+  m_image_ctx.perfcounter->inc(l_librbd_bc_rd_miss_bytes, length);
+  m_image_writeback.aio_read(std::move(image_extents), &req->miss_bl,
+                             fadvise_flags, req);
+}
+
+template <typename I>
+void BlockImageCache<I>::aio_write(Extents &&image_extents,
+                                   bufferlist&& bl,
+                                   int fadvise_flags,
+                                   Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  bool writethrough = m_writethrough;
+  uint64_t bl_off = 0;
+  for (auto &extent : image_extents) {
+    write_extent(extent.first, bl, bl_off, extent.second, !writethrough);
+    bl_off += extent.second;
+  }
+
+  if (writethrough) {
+    m_image_writeback.aio_write(std::move(image_extents), std::move(bl),
+                                fadvise_flags, on_finish);
+    return;
+  }
+
+  uint64_t dirty = m_dirty_bytes + m_writeback_bytes;
+  if (dirty > m_image_ctx.cache_max_dirty) {
+    // the data is cached already, the write only completes once enough
+    // has been written back
+    Mutex::Locker locker(m_lock);
+    if (m_dirty_bytes + m_writeback_bytes > m_image_ctx.cache_max_dirty) {
+      m_image_ctx.perfcounter->inc(l_librbd_bc_dirty_waits);
+      m_dirty_waiters.push_back(on_finish);
+      on_finish = nullptr;
+    }
+  }
+  if (dirty > m_image_ctx.cache_target_dirty) {
+    schedule_writeback(false);
+  }
+  schedule_timer();
+
+  if (on_finish != nullptr) {
+    on_finish->complete(0);
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::aio_discard(uint64_t offset, uint64_t length,
+                                     bool skip_partial_discard,
+                                     Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  // dirty data must not be written back over the discarded range, so
+  // write back what overlaps it first and then discard in the cluster
+  invalidate_writes(offset, length);
+  flush_range(offset, length, new FunctionContext(
+    [this, offset, length, skip_partial_discard, on_finish](int r) {
+      if (r < 0) {
+        on_finish->complete(r);
+        return;
+      }
+      drop_clean(offset, length);
+
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_discard(
+        offset, length, skip_partial_discard,
+        new FunctionContext([this, offset, length, on_finish](int r) {
+            invalidate_writes(offset, length);
+            drop_clean(offset, length);
+            on_finish->complete(r);
+          }));
+    }));
+}
+
+template <typename I>
+void BlockImageCache<I>::aio_flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  if (m_writethrough && m_image_ctx.cache_max_dirty > 0) {
+    ldout(cct, 10) << "received flush request, switching to writeback"
+                   << dendl;
+    m_writethrough = false;
+  }
+  flush(on_finish);
+}
+
+template <typename I>
+void BlockImageCache<I>::aio_writesame(uint64_t offset, uint64_t length,
+                                       bufferlist&& bl,
+                                       int fadvise_flags,
+                                       Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "data_len=" << bl.length() << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  invalidate_writes(offset, length);
+  auto *data = new bufferlist(std::move(bl));
+  flush_range(offset, length, new FunctionContext(
+    [this, offset, length, data, fadvise_flags, on_finish](int r) {
+      if (r < 0) {
+        delete data;
+        on_finish->complete(r);
+        return;
+      }
+      drop_clean(offset, length);
+
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_writesame(
+        offset, length, std::move(*data), fadvise_flags,
+        new FunctionContext([this, offset, length, on_finish](int r) {
+            invalidate_writes(offset, length);
+            drop_clean(offset, length);
+            on_finish->complete(r);
+          }));
+      delete data;
+    }));
+}
+
+template <typename I>
+void BlockImageCache<I>::init(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "shards=" << m_shards.size() << ", "
+                 << "blocks_per_shard=" << m_max_shard_blocks << dendl;
+
+  ImageCtx::get_timer_instance(cct, &m_timer, &m_timer_lock);
+  m_writethrough = (m_image_ctx.cache_writethrough_until_flush ||
+                    m_image_ctx.cache_max_dirty == 0);
+  m_image_ctx.op_work_queue->queue(on_finish, 0);
+}
+
+template <typename I>
+void BlockImageCache<I>::shut_down(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  flush(new FunctionContext([this, on_finish](int r) {
+      if (r < 0) {
+        lderr(m_image_ctx.cct) << "failed to write back dirty data: "
+                               << cpp_strerror(r) << dendl;
+      }
+      {
+        Mutex::Locker locker(m_lock);
+        m_shutting_down = true;
+      }
+      cancel_timer();
+      m_async_op_tracker.wait_for_ops(new FunctionContext(
+        [this, on_finish, r](int) {
+          purge(false);
+          on_finish->complete(r);
+        }));
+    }));
+}
+
+template <typename I>
+void BlockImageCache<I>::invalidate(bool purge_on_error,
+                                    Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "purge_on_error=" << purge_on_error << dendl;
+
+  // drop everything once it is written back: the image is about to
+  // change underneath the cache.  Dirty data that could not be written
+  // back is only dropped if the caller asks for it or the client is
+  // blacklisted, otherwise it stays cached and -EBUSY is returned
+  invalidate_writes(0, m_shards.size() * SHARD_SPAN);
+  flush(new FunctionContext([this, purge_on_error, on_finish](int r) {
+      CephContext *cct = m_image_ctx.cct;
+      m_image_ctx.perfcounter->inc(l_librbd_invalidate_cache);
+      if (r == -EBLACKLISTED) {
+        lderr(cct) << "blacklisted during flush, purging cache" << dendl;
+        purge(false);
+      } else if (r < 0 && purge_on_error) {
+        lderr(cct) << "failed to write back dirty data: " << cpp_strerror(r)
+                   << ", purging cache" << dendl;
+        purge(false);
+      } else if (r < 0) {
+        lderr(cct) << "failed to write back dirty data: " << cpp_strerror(r)
+                   << dendl;
+        purge(true);
+        r = -EBUSY;
+      } else {
+        purge(false);
+      }
+      on_finish->complete(r);
+    }));
+}
+
+template <typename I>
+void BlockImageCache<I>::flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_flush_requests.push_back(on_finish);
+  }
+  schedule_writeback(true);
+}
+
+template <typename I>
+typename BlockImageCache<I>::Block *
+BlockImageCache<I>::get_block(Shard &shard, uint64_t block_no) {
+  assert(shard.lock.is_locked());
+  auto it = shard.blocks.find(block_no);
+  if (it == shard.blocks.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+template <typename I>
+typename BlockImageCache<I>::Block *
+BlockImageCache<I>::alloc_block(Shard &shard, uint64_t block_no) {
+  assert(shard.lock.is_locked());
+  if (shard.blocks.size() >= m_max_shard_blocks) {
+    evict_block(shard);
+  }
+
+  Block *block = new Block(block_no);
+  shard.blocks[block_no] = block;
+  shard.probation.push_front(*block);
+  return block;
+}
+
+template <typename I>
+void BlockImageCache<I>::touch_block(Shard &shard, Block *block) {
+  assert(shard.lock.is_locked());
+  if (block->hot) {
+    shard.hot.erase(shard.hot.iterator_to(*block));
+    shard.hot.push_front(*block);
+    return;
+  }
+
+  // second access: protect it from blocks that are only seen once
+  shard.probation.erase(shard.probation.iterator_to(*block));
+  block->hot = true;
+  shard.hot.push_front(*block);
+  while (shard.hot.size() > m_max_hot_blocks) {
+    Block &demoted = shard.hot.back();
+    shard.hot.pop_back();
+    demoted.hot = false;
+    shard.probation.push_front(demoted);
+  }
+}
+
+template <typename I>
+bool BlockImageCache<I>::is_clean(Shard &shard, Block *block) {
+  assert(shard.lock.is_locked());
+  return (block->writeback_ops == 0 &&
+          !shard.dirty.intersects(block->block_no * BLOCK_SIZE, BLOCK_SIZE));
+}
+
+template <typename I>
+void BlockImageCache<I>::evict_block(Shard &shard) {
+  assert(shard.lock.is_locked());
+  for (auto list : {&shard.probation, &shard.hot}) {
+    unsigned scanned = 0;
+    for (auto it = list->rbegin();
+         it != list->rend() && scanned < MAX_EVICT_SCAN; ++it, ++scanned) {
+      Block *block = &(*it);
+      if (is_clean(shard, block)) {
+        m_image_ctx.perfcounter->inc(l_librbd_bc_evict);
+        free_block(shard, block);
+        return;
+      }
+    }
+  }
+
+  // only dirty blocks near the tails, which cache_max_dirty bounds --
+  // let the shard grow until they are written back
+  ldout(m_image_ctx.cct, 20) << "no clean block to evict" << dendl;
+}
+
+template <typename I>
+void BlockImageCache<I>::free_block(Shard &shard, Block *block) {
+  assert(shard.lock.is_locked());
+  if (block->hot) {
+    shard.hot.erase(shard.hot.iterator_to(*block));
+  } else {
+    shard.probation.erase(shard.probation.iterator_to(*block));
+  }
+  shard.blocks.erase(block->block_no);
+  delete block;
+}
+
+template <typename I>
+bool BlockImageCache<I>::read_hit(Shard &shard, uint64_t offset,
+                                  uint64_t length, bufferlist *bl) {
+  assert(shard.lock.is_locked());
+  std::list<std::pair<Block*, std::pair<uint32_t, uint32_t> > > pieces;
+  uint64_t end = offset + length;
+  for (uint64_t off = offset; off < end; ) {
+    uint64_t block_no = off / BLOCK_SIZE;
+    uint32_t block_off = off % BLOCK_SIZE;
+    uint32_t len = std::min<uint64_t>(end - off, BLOCK_SIZE - block_off);
+    Block *block = get_block(shard, block_no);
+    if (block == nullptr || !block->valid.contains(block_off, len)) {
+      return false;
+    }
+    pieces.push_back({block, {block_off, len}});
+    off += len;
+  }
+
+  for (auto &piece : pieces) {
+    touch_block(shard, piece.first);
+    bl->append(piece.first->data.c_str() + piece.second.first,
+               piece.second.second);
+  }
+  return true;
+}
+
+template <typename I>
+void BlockImageCache<I>::write_blocks(Shard &shard, uint64_t offset,
+                                      uint64_t length, const char *data,
+                                      bool fill) {
+  assert(shard.lock.is_locked());
+  uint64_t end = offset + length;
+  for (uint64_t off = offset; off < end; ) {
+    uint64_t block_no = off / BLOCK_SIZE;
+    uint32_t block_off = off % BLOCK_SIZE;
+    uint32_t len = std::min<uint64_t>(end - off, BLOCK_SIZE - block_off);
+    const char *src = data + (off - offset);
+    off += len;
+
+    Block *block = get_block(shard, block_no);
+    if (block == nullptr) {
+      block = alloc_block(shard, block_no);
+    } else if (!fill) {
+      touch_block(shard, block);
+    }
+
+    if (!fill) {
+      memcpy(block->data.c_str() + block_off, src, len);
+      if (len == BLOCK_SIZE) {
+        block->valid.clear();
+        block->valid.insert(0, BLOCK_SIZE);
+      } else {
+        block->valid.union_insert(block_off, len);
+      }
+      continue;
+    }
+
+    // a fill from the cluster must not replace data cached since
+    interval_set<uint32_t> missing;
+    missing.insert(block_off, len);
+    interval_set<uint32_t> cached;
+    cached.intersection_of(missing, block->valid);
+    missing.subtract(cached);
+    for (auto it = missing.begin(); it != missing.end(); ++it) {
+      memcpy(block->data.c_str() + it.get_start(),
+             src + (it.get_start() - block_off), it.get_len());
+    }
+    block->valid.union_of(missing);
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::overlay_blocks(Shard &shard, uint64_t offset,
+                                        uint64_t length, char *data) {
+  assert(shard.lock.is_locked());
+  uint64_t end = offset + length;
+  for (uint64_t off = offset; off < end; ) {
+    uint64_t block_no = off / BLOCK_SIZE;
+    uint32_t block_off = off % BLOCK_SIZE;
+    uint32_t len = std::min<uint64_t>(end - off, BLOCK_SIZE - block_off);
+    char *dst = data + (off - offset);
+    off += len;
+
+    Block *block = get_block(shard, block_no);
+    if (block == nullptr) {
+      continue;
+    }
+
+    interval_set<uint32_t> range;
+    range.insert(block_off, len);
+    interval_set<uint32_t> cached;
+    cached.intersection_of(range, block->valid);
+    for (auto it = cached.begin(); it != cached.end(); ++it) {
+      memcpy(dst + (it.get_start() - block_off),
+             block->data.c_str() + it.get_start(), it.get_len());
+    }
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::handle_read(C_ReadRequest *req) {
+  uint64_t length = 0;
+  for (auto &extent : req->image_extents) {
+    length += extent.second;
+  }
+
+  bufferptr bp = buffer::create(length);
+  uint64_t miss_len = std::min<uint64_t>(length, req->miss_bl.length());
+  req->miss_bl.copy(0, miss_len, bp.c_str());
+  if (miss_len < length) {
+    memset(bp.c_str() + miss_len, 0, length - miss_len);
+  }
+
+  auto seq_it = req->write_seqs.begin();
+  uint64_t bp_off = 0;
+  for (auto &extent : req->image_extents) {
+    uint64_t end = extent.first + extent.second;
+    for (uint64_t off = extent.first; off < end; ) {
+      uint64_t len = piece_length(off, end);
+      Shard &shard = get_shard(off);
+      Mutex::Locker locker(shard.lock);
+      overlay_blocks(shard, off, len, bp.c_str() + bp_off);
+      if (shard.write_seq == *seq_it) {
+        // no write since the read was sent, the data is current
+        write_blocks(shard, off, len, bp.c_str() + bp_off, true);
+      }
+      ++seq_it;
+      off += len;
+      bp_off += len;
+    }
+  }
+
+  req->bl->clear();
+  req->bl->push_back(std::move(bp));
+}
+
+template <typename I>
+void BlockImageCache<I>::write_extent(uint64_t offset, bufferlist &bl,
+                                      uint64_t bl_off, uint64_t length,
+                                      bool dirty) {
+  uint64_t end = offset + length;
+  for (uint64_t off = offset; off < end; ) {
+    uint64_t len = piece_length(off, end);
+    bufferlist piece;
+    piece.substr_of(bl, bl_off + (off - offset), len);
+
+    Shard &shard = get_shard(off);
+    Mutex::Locker locker(shard.lock);
+    ++shard.write_seq;
+    if (dirty) {
+      // mark the range before writing it: allocating a block for the
+      // piece may evict, and must not pick the piece's earlier blocks
+      uint64_t size = shard.dirty.size();
+      if (size == 0) {
+        shard.dirty_since = ceph_clock_now();
+      }
+      shard.dirty.union_insert(off, len);
+      m_dirty_bytes += shard.dirty.size() - size;
+    }
+    write_blocks(shard, off, len, piece.c_str(), false);
+    off += len;
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::invalidate_writes(uint64_t offset, uint64_t length) {
+  // reads already sent may return data from before the write, don't
+  // let them fill the cache
+  uint64_t end = std::min(offset + length,
+                          offset + m_shards.size() * SHARD_SPAN);
+  for (uint64_t off = offset; off < end; ) {
+    uint64_t len = piece_length(off, end);
+    Shard &shard = get_shard(off);
+    Mutex::Locker locker(shard.lock);
+    ++shard.write_seq;
+    off += len;
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::drop_clean(uint64_t offset, uint64_t length) {
+  uint64_t end = offset + length;
+  for (uint64_t off = offset; off < end; ) {
+    uint64_t len = piece_length(off, end);
+    Shard &shard = get_shard(off);
+    Mutex::Locker locker(shard.lock);
+
+    interval_set<uint64_t> clean;
+    clean.insert(off, len);
+    interval_set<uint64_t> dirty;
+    dirty.intersection_of(clean, shard.dirty);
+    clean.subtract(dirty);
+    for (auto it = clean.begin(); it != clean.end(); ++it) {
+      uint64_t clean_end = it.get_start() + it.get_len();
+      for (uint64_t pos = it.get_start(); pos < clean_end; ) {
+        uint64_t block_no = pos / BLOCK_SIZE;
+        uint32_t block_off = pos % BLOCK_SIZE;
+        uint32_t block_len = std::min<uint64_t>(clean_end - pos,
+                                                BLOCK_SIZE - block_off);
+        pos += block_len;
+
+        Block *block = get_block(shard, block_no);
+        if (block == nullptr) {
+          continue;
+        }
+        interval_set<uint32_t> range;
+        range.insert(block_off, block_len);
+        range.intersection_of(block->valid);
+        block->valid.subtract(range);
+        if (block->valid.empty() && block->writeback_ops == 0) {
+          free_block(shard, block);
+        }
+      }
+    }
+    off += len;
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::purge(bool keep_dirty) {
+  for (auto shard : m_shards) {
+    Mutex::Locker locker(shard->lock);
+    ++shard->write_seq;
+    if (!keep_dirty) {
+      m_dirty_bytes -= shard->dirty.size();
+      shard->dirty.clear();
+    }
+    for (auto it = shard->blocks.begin(); it != shard->blocks.end(); ) {
+      Block *block = it->second;
+      ++it;
+      block->valid.clear();
+      if (keep_dirty) {
+        uint64_t block_start = block->block_no * BLOCK_SIZE;
+        interval_set<uint64_t> range;
+        range.insert(block_start, BLOCK_SIZE);
+        interval_set<uint64_t> dirty;
+        dirty.intersection_of(range, shard->dirty);
+        for (auto d = dirty.begin(); d != dirty.end(); ++d) {
+          block->valid.insert(d.get_start() - block_start, d.get_len());
+        }
+      }
+      // otherwise freed once the writeback completes
+      if (block->valid.empty() && block->writeback_ops == 0) {
+        free_block(*shard, block);
+      }
+    }
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::flush_range(uint64_t offset, uint64_t length,
+                                     Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_flush_range_requests.push_back({offset, length, on_finish});
+  }
+  schedule_writeback(false);
+}
+
+template <typename I>
+void BlockImageCache<I>::schedule_writeback(bool all) {
+  Mutex::Locker locker(m_lock);
+  if (all) {
+    m_writeback_all = true;
+  }
+  m_writeback_pending = true;
+  if (m_writeback_scheduled) {
+    // a running dispatch will pick it up
+    return;
+  }
+
+  m_writeback_scheduled = true;
+  m_async_op_tracker.start_op();
+  m_image_ctx.op_work_queue->queue(new FunctionContext([this](int r) {
+      dispatch_writeback();
+      m_async_op_tracker.finish_op();
+    }), 0);
+}
+
+template <typename I>
+void BlockImageCache<I>::dispatch_writeback() {
+  // one dispatch at a time, so that a flush also waits for extents that
+  // a concurrent dispatch took out of the shards
+  for (;;) {
+    bool all;
+    std::list<Context*> flush_requests;
+    std::list<FlushRange> range_requests;
+    uint64_t first_seq;
+    {
+      Mutex::Locker locker(m_lock);
+      if (!m_writeback_pending) {
+        m_writeback_scheduled = false;
+        break;
+      }
+      m_writeback_pending = false;
+      all = m_writeback_all;
+      m_writeback_all = false;
+      flush_requests.swap(m_flush_requests);
+      range_requests.swap(m_flush_range_requests);
+      first_seq = (m_in_flight.empty() ? m_next_op_seq :
+                                         *m_in_flight.begin());
+    }
+
+    dispatch_writeback(all, first_seq, std::move(flush_requests),
+                       std::move(range_requests));
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::dispatch_writeback(
+    bool all, uint64_t first_seq, std::list<Context*> &&flush_requests,
+    std::list<FlushRange> &&range_requests) {
+  CephContext *cct = m_image_ctx.cct;
+
+  // oldest shards first, everything for a flush, otherwise until dirty
+  // data is back under the target or younger than the max age
+  utime_t now = ceph_clock_now();
+  utime_t max_age;
+  max_age.set_from_double(m_image_ctx.cache_max_dirty_age);
+  std::multimap<utime_t, Shard*> candidates;
+  for (auto shard : m_shards) {
+    Mutex::Locker locker(shard->lock);
+    if (!shard->dirty.empty()) {
+      candidates.insert({shard->dirty_since, shard});
+    }
+  }
+
+  uint64_t dirty = m_dirty_bytes + m_writeback_bytes;
+  std::map<uint64_t, bufferlist> extents;
+  bool dirty_left = false;
+  for (auto &candidate : candidates) {
+    Shard &shard = *candidate.second;
+    if (!all && dirty <= m_image_ctx.cache_target_dirty &&
+        (m_image_ctx.cache_max_dirty_age <= 0 ||
+         candidate.first + max_age > now)) {
+      dirty_left = true;
+      break;
+    }
+
+    Mutex::Locker locker(shard.lock);
+    interval_set<uint64_t> shard_dirty(shard.dirty);
+    uint64_t size = take_dirty(shard, shard_dirty, &extents);
+    dirty -= std::min(dirty, size);
+  }
+
+  // only the dirty data that overlaps a discard or writesame range, the
+  // rest of the cache is left to the normal writeback
+  for (auto &request : range_requests) {
+    interval_set<uint64_t> range;
+    range.insert(request.offset, request.length);
+    // visit each shard at most once, a discard can span the whole image
+    uint64_t end = std::min(request.offset + request.length,
+                            request.offset + m_shards.size() * SHARD_SPAN);
+    for (uint64_t off = request.offset; off < end; ) {
+      Shard &shard = get_shard(off);
+      off += piece_length(off, end);
+
+      Mutex::Locker locker(shard.lock);
+      interval_set<uint64_t> shard_dirty;
+      shard_dirty.intersection_of(range, shard.dirty);
+      take_dirty(shard, shard_dirty, &extents);
+    }
+  }
+
+  // coalesce adjacent extents, also across shards and objects
+  std::list<std::pair<uint64_t, bufferlist> > ops;
+  for (auto &extent : extents) {
+    if (!ops.empty()) {
+      auto &op = ops.back();
+      if (op.first + op.second.length() == extent.first &&
+          op.second.length() + extent.second.length() <=
+            MAX_WRITEBACK_LENGTH) {
+        op.second.claim_append(extent.second);
+        continue;
+      }
+    }
+    ops.push_back({extent.first, std::move(extent.second)});
+  }
+
+  std::list<uint64_t> seqs;
+  {
+    Mutex::Locker locker(m_lock);
+    for (size_t i = 0; i < ops.size(); ++i) {
+      seqs.push_back(m_next_op_seq);
+      m_in_flight.insert(m_next_op_seq++);
+    }
+    for (auto ctx : flush_requests) {
+      m_flush_waiters.push_back({{first_seq, m_next_op_seq - 1}, ctx});
+    }
+    for (auto &request : range_requests) {
+      m_flush_waiters.push_back({{first_seq, m_next_op_seq - 1},
+                                 request.on_finish});
+    }
+  }
+
+  if (!ops.empty()) {
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    auto seq_it = seqs.begin();
+    for (auto &op : ops) {
+      uint64_t seq = *seq_it++;
+      uint64_t offset = op.first;
+      uint64_t length = op.second.length();
+      ldout(cct, 20) << "seq=" << seq << ", offset=" << offset << ", "
+                     << "length=" << length << dendl;
+
+      m_image_ctx.perfcounter->inc(l_librbd_bc_writeback_ops);
+      m_image_ctx.perfcounter->inc(l_librbd_bc_writeback_bytes, length);
+      m_async_op_tracker.start_op();
+      m_image_writeback.aio_write(
+        {{offset, length}}, std::move(op.second), 0,
+        new FunctionContext([this, seq, offset, length](int r) {
+            handle_writeback(seq, offset, length, r);
+            m_async_op_tracker.finish_op();
+          }));
+    }
+  }
+
+  complete_waiters();
+  if (dirty_left) {
+    schedule_timer();
+  }
+}
+
+template <typename I>
+uint64_t BlockImageCache<I>::take_dirty(
+    Shard &shard, const interval_set<uint64_t> &dirty,
+    std::map<uint64_t, bufferlist> *extents) {
+  assert(shard.lock.is_locked());
+  for (auto it = dirty.begin(); it != dirty.end(); ++it) {
+    bufferlist &bl = (*extents)[it.get_start()];
+    uint64_t end = it.get_start() + it.get_len();
+    for (uint64_t off = it.get_start(); off < end; ) {
+      uint64_t block_no = off / BLOCK_SIZE;
+      uint32_t block_off = off % BLOCK_SIZE;
+      uint32_t len = std::min<uint64_t>(end - off, BLOCK_SIZE - block_off);
+      Block *block = get_block(shard, block_no);
+      assert(block != nullptr);
+      ++block->writeback_ops;
+      bl.append(block->data.c_str() + block_off, len);
+      off += len;
+    }
+  }
+
+  uint64_t size = dirty.size();
+  shard.dirty.subtract(dirty);
+  m_dirty_bytes -= size;
+  m_writeback_bytes += size;
+  return size;
+}
+
+template <typename I>
+void BlockImageCache<I>::handle_writeback(uint64_t seq, uint64_t offset,
+                                          uint64_t length, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "seq=" << seq << ", r=" << r << dendl;
+
+  uint64_t end = offset + length;
+  for (uint64_t off = offset; off < end; ) {
+    uint64_t len = piece_length(off, end);
+    Shard &shard = get_shard(off);
+    Mutex::Locker locker(shard.lock);
+    uint64_t size = shard.dirty.size();
+    uint64_t piece_end = off + len;
+    for (uint64_t pos = off; pos < piece_end; ) {
+      uint64_t block_no = pos / BLOCK_SIZE;
+      uint32_t block_off = pos % BLOCK_SIZE;
+      uint32_t block_len = std::min<uint64_t>(piece_end - pos,
+                                              BLOCK_SIZE - block_off);
+      Block *block = get_block(shard, block_no);
+      assert(block != nullptr && block->writeback_ops > 0);
+      --block->writeback_ops;
+      if (r < 0 && block->valid.contains(block_off, block_len)) {
+        // the cache holds the newest data, write it back again later
+        if (shard.dirty.empty()) {
+          shard.dirty_since = ceph_clock_now();
+        }
+        shard.dirty.union_insert(pos, block_len);
+      } else if (block->valid.empty() && block->writeback_ops == 0) {
+        // purged while it was written back
+        free_block(shard, block);
+      }
+      pos += block_len;
+    }
+    m_dirty_bytes += shard.dirty.size() - size;
+    off += len;
+  }
+  m_writeback_bytes -= length;
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_in_flight.erase(seq);
+    if (r < 0) {
+      lderr(cct) << "failed to write back " << offset << "~" << length
+                 << ": " << cpp_strerror(r) << dendl;
+      m_writeback_error = r;
+      m_error_seq = seq;
+
+      // the data stays cached and the error is returned by the next
+      // flush, don't hold writes until it can be written back
+      for (auto ctx : m_dirty_waiters) {
+        m_image_ctx.op_work_queue->queue(ctx, 0);
+      }
+      m_dirty_waiters.clear();
+    }
+  }
+  complete_waiters();
+
+  if (r < 0) {
+    schedule_timer();
+  } else if (m_dirty_bytes + m_writeback_bytes >
+               m_image_ctx.cache_target_dirty) {
+    schedule_writeback(false);
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::complete_waiters() {
+  Mutex::Locker locker(m_lock);
+  uint64_t first_in_flight = (m_in_flight.empty() ? m_next_op_seq :
+                                                    *m_in_flight.begin());
+  for (auto it = m_flush_waiters.begin(); it != m_flush_waiters.end(); ) {
+    if (it->first.second >= first_in_flight) {
+      ++it;
+      continue;
+    }
+    int r = 0;
+    if (m_writeback_error < 0 && m_error_seq >= it->first.first &&
+        m_error_seq <= it->first.second) {
+      r = m_writeback_error;
+    }
+    m_image_ctx.op_work_queue->queue(it->second, r);
+    it = m_flush_waiters.erase(it);
+  }
+
+  while (!m_dirty_waiters.empty() &&
+         m_dirty_bytes + m_writeback_bytes <= m_image_ctx.cache_max_dirty) {
+    m_image_ctx.op_work_queue->queue(m_dirty_waiters.front(), 0);
+    m_dirty_waiters.pop_front();
+  }
+}
+
+template <typename I>
+void BlockImageCache<I>::schedule_timer() {
+  if (m_image_ctx.cache_max_dirty_age <= 0 || m_timer_scheduled) {
+    return;
+  }
+
+  Mutex::Locker timer_locker(*m_timer_lock);
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_shutting_down || m_timer_ctx != nullptr) {
+      return;
+    }
+  }
+  m_timer_scheduled = true;
+  m_timer_ctx = new FunctionContext([this](int r) {
+      handle_timer();
+    });
+  m_timer->add_event_after(m_image_ctx.cache_max_dirty_age, m_timer_ctx);
+}
+
+template <typename I>
+void BlockImageCache<I>::handle_timer() {
+  assert(m_timer_lock->is_locked());
+  m_timer_ctx = nullptr;
+  m_timer_scheduled = false;
+  schedule_writeback(false);
+}
+
+template <typename I>
+void BlockImageCache<I>::cancel_timer() {
+  Mutex::Locker timer_locker(*m_timer_lock);
+  if (m_timer_ctx != nullptr) {
+    m_timer->cancel_event(m_timer_ctx);
+    m_timer_ctx = nullptr;
+    m_timer_scheduled = false;
+  }
+}
+
+} // namespace cache
+} // namespace librbd
+
+template class librbd::cache::BlockImageCache<librbd::ImageCtx>;
@@ -0,0 +1,186 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_BLOCK_IMAGE_CACHE
+#define CEPH_LIBRBD_CACHE_BLOCK_IMAGE_CACHE
+
+#include "ImageCache.h"
+#include "ImageWriteback.h"
+#include "common/AsyncOpTracker.h"
+#include "common/Mutex.h"
+#include "include/buffer.h"
+#include "include/interval_set.h"
+#include "include/utime.h"
+#include <boost/intrusive/list.hpp>
+#include <atomic>
+#include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+class SafeTimer;
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+/**
+ * In-memory write-back image extent cache
+ *
+ * The image is cached in 4K blocks, spread over independently locked
+ * shards so that IO to different parts of the image does not contend.
+ * Dirty data is tracked as image extents; adjacent dirty extents are
+ * written back together even when they cross object boundaries.  Clean
+ * blocks are evicted by a segmented LRU: blocks enter a probation
+ * segment and are only promoted to the protected segment when accessed
+ * again, so a large sequential read cannot flush out the working set.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class BlockImageCache : public ImageCache {
+public:
+  BlockImageCache(ImageCtx &image_ctx);
+  ~BlockImageCache() override;
+
+  /// client AIO methods
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) override;
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) override;
+  void aio_discard(uint64_t offset, uint64_t length,
+                   bool skip_partial_discard, Context *on_finish) override;
+  void aio_flush(Context *on_finish) override;
+  void aio_writesame(uint64_t offset, uint64_t length,
+                     ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) override;
+
+  /// internal state methods
+  void init(Context *on_finish) override;
+  void shut_down(Context *on_finish) override;
+
+  void invalidate(bool purge_on_error, Context *on_finish) override;
+  void flush(Context *on_finish) override;
+
+private:
+  static const uint64_t BLOCK_SIZE = 4096;
+  static const uint64_t SHARD_SPAN = 16 * BLOCK_SIZE;
+  static const uint64_t MAX_WRITEBACK_LENGTH = 4 << 20;
+  static const unsigned MAX_EVICT_SCAN = 8;
+
+  struct Block : public boost::intrusive::list_base_hook<> {
+    uint64_t block_no;
+    bufferptr data;
+    interval_set<uint32_t> valid;   // byte ranges of data that are cached
+    uint32_t writeback_ops = 0;
+    bool hot = false;               // in the protected segment
+
+    Block(uint64_t block_no);
+  };
+  typedef boost::intrusive::list<Block> BlockList;
+
+  struct Shard {
+    Mutex lock;
+    std::unordered_map<uint64_t, Block*> blocks;
+    BlockList probation;            // accessed once, evicted first
+    BlockList hot;                  // accessed again
+    interval_set<uint64_t> dirty;
+    utime_t dirty_since;
+    uint64_t write_seq = 0;         // read fills are dropped if it changed
+
+    Shard(const std::string &name) : lock(name) {
+    }
+  };
+
+  struct C_ReadRequest;
+
+  /// writes back the dirty data in [offset, offset + length)
+  struct FlushRange {
+    uint64_t offset;
+    uint64_t length;
+    Context *on_finish;
+  };
+
+  ImageCtxT &m_image_ctx;
+  ImageWriteback<ImageCtxT> m_image_writeback;
+  std::vector<Shard*> m_shards;
+  uint64_t m_max_shard_blocks;
+  uint64_t m_max_hot_blocks;
+
+  std::atomic<uint64_t> m_dirty_bytes { 0 };
+  std::atomic<uint64_t> m_writeback_bytes { 0 };
+  std::atomic<bool> m_writethrough { false };
+  std::atomic<bool> m_timer_scheduled { false };
+
+  Mutex m_lock;
+  uint64_t m_next_op_seq = 1;
+  std::set<uint64_t> m_in_flight;
+  bool m_writeback_scheduled = false;
+  bool m_writeback_pending = false;
+  bool m_writeback_all = false;
+  bool m_shutting_down = false;
+  int m_writeback_error = 0;
+  uint64_t m_error_seq = 0;
+  std::list<Context*> m_flush_requests;
+  std::list<FlushRange> m_flush_range_requests;
+  /// (first op seq, last op seq) the flush waits for
+  std::list<std::pair<std::pair<uint64_t, uint64_t>, Context*> > m_flush_waiters;
+  std::list<Context*> m_dirty_waiters;
+
+  SafeTimer *m_timer = nullptr;
+  Mutex *m_timer_lock = nullptr;
+  Context *m_timer_ctx = nullptr;
+  AsyncOpTracker m_async_op_tracker;
+
+  Shard &get_shard(uint64_t offset) {
+    return *m_shards[(offset / SHARD_SPAN) % m_shards.size()];
+  }
+  static uint64_t piece_length(uint64_t offset, uint64_t end) {
+    return std::min(end, (offset / SHARD_SPAN + 1) * SHARD_SPAN) - offset;
+  }
+
+  Block *get_block(Shard &shard, uint64_t block_no);
+  Block *alloc_block(Shard &shard, uint64_t block_no);
+  void touch_block(Shard &shard, Block *block);
+  bool is_clean(Shard &shard, Block *block);
+  void evict_block(Shard &shard);
+  void free_block(Shard &shard, Block *block);
+
+  bool read_hit(Shard &shard, uint64_t offset, uint64_t length,
+                bufferlist *bl);
+  void write_blocks(Shard &shard, uint64_t offset, uint64_t length,
+                    const char *data, bool fill);
+  void overlay_blocks(Shard &shard, uint64_t offset, uint64_t length,
+                      char *data);
+  void handle_read(C_ReadRequest *req);
+
+  void write_extent(uint64_t offset, bufferlist &bl, uint64_t bl_off,
+                    uint64_t length, bool dirty);
+  void invalidate_writes(uint64_t offset, uint64_t length);
+  void drop_clean(uint64_t offset, uint64_t length);
+  void purge(bool keep_dirty);
+
+  void flush_range(uint64_t offset, uint64_t length, Context *on_finish);
+  void schedule_writeback(bool all);
+  void dispatch_writeback();
+  void dispatch_writeback(bool all, uint64_t first_seq,
+                          std::list<Context*> &&flush_requests,
+                          std::list<FlushRange> &&range_requests);
+  uint64_t take_dirty(Shard &shard, const interval_set<uint64_t> &dirty,
+                      std::map<uint64_t, bufferlist> *extents);
+  void handle_writeback(uint64_t seq, uint64_t offset, uint64_t length,
+                        int r);
+  void complete_waiters();
+
+  void schedule_timer();
+  void handle_timer();
+  void cancel_timer();
+};
+
+} // namespace cache
+} // namespace librbd
+
+extern template class librbd::cache::BlockImageCache<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_CACHE_BLOCK_IMAGE_CACHE
@@ -0,0 +1,1379 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "FileImageCache.h"
+#include "include/buffer.h"
+#include "include/stringify.h"
+#include "common/blkdev.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/perf_counters.h"
+#include "common/safe_io.h"
+#include "common/WorkQueue.h"
+#include "librbd/ExclusiveLock.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+#include "librbd/managed_lock/Types.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::FileImageCache: " << this << " " \
+                           <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+namespace file {
+
+void SuperBlock::encode(bufferlist &bl) const {
+  ENCODE_START(2, 1, bl);
+  ::encode(pool_id, bl);
+  ::encode(image_id, bl);
+  ::encode(log_size, bl);
+  ::encode(head_offset, bl);
+  ::encode(head_seq, bl);
+  ::encode(flushed_seq, bl);
+  ::encode(lock_client, bl);
+  ::encode(lock_cookie, bl);
+  ENCODE_FINISH(bl);
+}
+
+void SuperBlock::decode(bufferlist::iterator &it) {
+  DECODE_START(2, it);
+  ::decode(pool_id, it);
+  ::decode(image_id, it);
+  ::decode(log_size, it);
+  ::decode(head_offset, it);
+  ::decode(head_seq, it);
+  ::decode(flushed_seq, it);
+  if (struct_v >= 2) {
+    ::decode(lock_client, it);
+    ::decode(lock_cookie, it);
+  }
+  DECODE_FINISH(it);
+}
+
+void LogEntryHeader::encode(bufferlist &bl) const {
+  ENCODE_START(1, 1, bl);
+  ::encode(type, bl);
+  ::encode(seq, bl);
+  ::encode(image_offset, bl);
+  ::encode(length, bl);
+  ::encode(data_crc, bl);
+  ENCODE_FINISH(bl);
+}
+
+void LogEntryHeader::decode(bufferlist::iterator &it) {
+  DECODE_START(1, it);
+  ::decode(type, it);
+  ::decode(seq, it);
+  ::decode(image_offset, it);
+  ::decode(length, it);
+  ::decode(data_crc, it);
+  DECODE_FINISH(it);
+}
+
+namespace {
+
+// on-disk block: payload length, payload, crc32c of the payload, zero
+// padding up to block_size
+template <typename T>
+void encode_block(const T &t, uint64_t block_size, bufferlist *bl) {
+  bufferlist payload;
+  ::encode(t, payload);
+  assert(payload.length() + 8 <= block_size);
+
+  bufferlist block;
+  ::encode(static_cast<uint32_t>(payload.length()), block);
+  block.append(payload);
+  ::encode(payload.crc32c(-1), block);
+  block.append_zero(block_size - block.length());
+  bl->claim_append(block);
+}
+
+template <typename T>
+int decode_block(bufferlist &bl, T *t) {
+  try {
+    bufferlist::iterator it = bl.begin();
+    uint32_t len;
+    ::decode(len, it);
+    if (len + 8 > bl.length()) {
+      return -EINVAL;
+    }
+    bufferlist payload;
+    it.copy(len, payload);
+    uint32_t crc;
+    ::decode(crc, it);
+    if (crc != payload.crc32c(-1)) {
+      return -EINVAL;
+    }
+    bufferlist::iterator pit = payload.begin();
+    ::decode(*t, pit);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int read_fd(int fd, uint64_t offset, uint64_t length, bufferlist *bl) {
+  bufferptr bp = buffer::create_page_aligned(length);
+  int r = safe_pread_exact(fd, bp.c_str(), length, offset);
+  if (r < 0) {
+    return r;
+  }
+  bl->push_back(std::move(bp));
+  return 0;
+}
+
+/// assembles the result of a read from log hits and cluster reads
+struct C_ReadRequest : public Context {
+  struct Piece {
+    uint64_t length;
+    bool hit;
+    bufferlist bl;
+  };
+
+  std::vector<Piece> pieces;
+  bufferlist miss_bl;
+  bufferlist *out_bl;
+  Context *on_finish;
+
+  C_ReadRequest(bufferlist *out_bl, Context *on_finish)
+    : out_bl(out_bl), on_finish(on_finish) {
+  }
+
+  void finish(int r) override {
+    if (r >= 0) {
+      uint64_t miss_off = 0;
+      for (auto &piece : pieces) {
+        if (piece.hit) {
+          out_bl->claim_append(piece.bl);
+        } else {
+          bufferlist bl;
+          bl.substr_of(miss_bl, miss_off, piece.length);
+          out_bl->claim_append(bl);
+          miss_off += piece.length;
+        }
+      }
+    }
+    on_finish->complete(r);
+  }
+};
+
+} // anonymous namespace
+} // namespace file
+
+using namespace file;
+
+template <typename I>
+FileImageCache<I>::FileImageCache(ImageCtx &image_ctx)
+  : m_image_ctx(image_ctx), m_image_writeback(image_ctx),
+    m_finisher(image_ctx.cct, "librbd::FileImageCache", "rbd_pwl"),
+    m_lock("librbd::FileImageCache::m_lock"),
+    m_lock_client(image_ctx.md_ctx.get_instance_id()) {
+}
+
+template <typename I>
+FileImageCache<I>::~FileImageCache() {
+  if (m_finisher_started) {
+    m_finisher.wait_for_empty();
+    m_finisher.stop();
+  }
+  close_log();
+  assert(m_writeback_in_flight.empty());
+  assert(m_persist_waiters.empty());
+  assert(m_flush_waiters.empty());
+  assert(m_barriers.empty());
+  assert(m_deferred.empty());
+}
+
+template <typename I>
+void FileImageCache<I>::aio_read(Extents &&image_extents, bufferlist *bl,
+                                 int fadvise_flags, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    if (m_image_ctx.snap_id != CEPH_NOSNAP) {
+      // the log only holds data of the image head
+      m_image_writeback.aio_read(std::move(image_extents), bl, fadvise_flags,
+                                 on_finish);
+      return;
+    }
+  }
+
+  auto *req = new C_ReadRequest(bl, on_finish);
+  Extents miss_extents;
+  std::list<std::pair<LogEntry*, std::pair<uint64_t, uint64_t> > > file_reads;
+  uint64_t hit_bytes = 0;
+  uint64_t miss_bytes = 0;
+  {
+    Mutex::Locker locker(m_lock);
+    for (auto &extent : image_extents) {
+      uint64_t cur = extent.first;
+      uint64_t end = extent.first + extent.second;
+      auto it = m_extent_map.lower_bound(cur);
+      if (it != m_extent_map.begin()) {
+        auto prev = it;
+        --prev;
+        if (prev->first + prev->second.length > cur) {
+          it = prev;
+        }
+      }
+
+      while (cur < end) {
+        if (it != m_extent_map.end() && it->first <= cur) {
+          LogEntry *entry = it->second.entry;
+          uint64_t len = std::min(end, it->first + it->second.length) - cur;
+          uint64_t entry_off = cur - entry->image_offset;
+          req->pieces.push_back({len, true, bufferlist()});
+          ++entry->readers;
+          file_reads.push_back({entry, {entry_off, len}});
+          hit_bytes += len;
+          cur += len;
+          ++it;
+        } else {
+          uint64_t next = end;
+          if (it != m_extent_map.end() && it->first < end) {
+            next = it->first;
+          }
+          req->pieces.push_back({next - cur, false, bufferlist()});
+          miss_extents.push_back({cur, next - cur});
+          miss_bytes += next - cur;
+          cur = next;
+        }
+      }
+    }
+  }
+
+  int r = 0;
+  if (!file_reads.empty()) {
+    auto read_it = file_reads.begin();
+    for (auto &piece : req->pieces) {
+      if (!piece.hit) {
+        continue;
+      }
+      if (r == 0) {
+        r = read_fd(m_fd, read_it->first->log_offset + BLOCK_SIZE +
+                      read_it->second.first,
+                    read_it->second.second, &piece.bl);
+      }
+      ++read_it;
+    }
+
+    Mutex::Locker locker(m_lock);
+    for (auto &read : file_reads) {
+      --read.first->readers;
+    }
+    process_deferred();
+  }
+
+  m_image_ctx.perfcounter->inc(l_librbd_pwl_rd_hit_bytes, hit_bytes);
+  m_image_ctx.perfcounter->inc(l_librbd_pwl_rd_miss_bytes, miss_bytes);
+  if (r < 0) {
+    lderr(cct) << "failed to read from cache log: " << cpp_strerror(r)
+               << dendl;
+    req->complete(r);
+  } else if (miss_extents.empty()) {
+    req->complete(0);
+  } else {
+    m_image_writeback.aio_read(std::move(miss_extents), &req->miss_bl,
+                               fadvise_flags, req);
+  }
+}
+
+template <typename I>
+void FileImageCache<I>::aio_write(Extents &&image_extents,
+                                  bufferlist&& bl,
+                                  int fadvise_flags,
+                                  Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  Mutex::Locker locker(m_lock);
+  if (m_error < 0) {
+    m_image_ctx.op_work_queue->queue(on_finish, m_error);
+    return;
+  }
+  if (!m_deferred.empty() || !append_entries(image_extents, bl, on_finish)) {
+    ldout(cct, 20) << "log full, deferring write" << dendl;
+    m_image_ctx.perfcounter->inc(l_librbd_pwl_log_full);
+    m_deferred.push_back({std::move(image_extents), std::move(bl),
+                          on_finish});
+  }
+}
+
+template <typename I>
+void FileImageCache<I>::aio_discard(uint64_t offset, uint64_t length,
+                                    bool skip_partial_discard,
+                                    Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  add_barrier([this, offset, length, skip_partial_discard, on_finish](
+      uint64_t seq, int r) {
+    if (r < 0) {
+      finish_barrier();
+      on_finish->complete(r);
+      return;
+    }
+    {
+      Mutex::Locker locker(m_lock);
+      map_remove(offset, length, seq);
+    }
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    m_image_writeback.aio_discard(
+      offset, length, skip_partial_discard,
+      new FunctionContext([this, on_finish](int r) {
+          finish_barrier();
+          on_finish->complete(r);
+        }));
+  });
+}
+
+template <typename I>
+void FileImageCache<I>::aio_flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  // every acknowledged write is already stable in the log, wait for
+  // the writes that are still being appended
+  Mutex::Locker locker(m_lock);
+  if (m_error < 0) {
+    m_image_ctx.op_work_queue->queue(on_finish, m_error);
+  } else if (!m_deferred.empty()) {
+    m_deferred.push_back({Extents(), bufferlist(), on_finish});
+  } else {
+    Extents image_extents;
+    bufferlist bl;
+    append_entries(image_extents, bl, on_finish);
+  }
+}
+
+template <typename I>
+void FileImageCache<I>::aio_writesame(uint64_t offset, uint64_t length,
+                                      bufferlist&& bl, int fadvise_flags,
+                                      Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "data_len=" << bl.length() << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  add_barrier([this, offset, length, bl, fadvise_flags, on_finish](
+      uint64_t seq, int r) {
+    if (r < 0) {
+      finish_barrier();
+      on_finish->complete(r);
+      return;
+    }
+    {
+      Mutex::Locker locker(m_lock);
+      map_remove(offset, length, seq);
+    }
+    bufferlist data_bl(bl);
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    m_image_writeback.aio_writesame(
+      offset, length, std::move(data_bl), fadvise_flags,
+      new FunctionContext([this, on_finish](int r) {
+          finish_barrier();
+          on_finish->complete(r);
+        }));
+  });
+}
+
+template <typename I>
+void FileImageCache<I>::init(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  m_finisher.start();
+  m_finisher_started = true;
+  m_finisher.queue(new FunctionContext([this, on_finish](int r) {
+      uint64_t next_seq;
+      r = open_log(&next_seq);
+      if (r < 0) {
+        m_image_ctx.op_work_queue->queue(on_finish, r);
+        return;
+      }
+      recover_log(next_seq, on_finish);
+    }));
+}
+
+template <typename I>
+void FileImageCache<I>::shut_down(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  // dirty data that cannot be written back stays in the log, it is
+  // recovered on the next open if no other client took the lock since
+  flush(new FunctionContext([this, on_finish](int r) {
+      m_finisher.wait_for_empty();
+      m_finisher.stop();
+      m_finisher_started = false;
+      close_log();
+      on_finish->complete(r);
+    }));
+}
+
+template <typename I>
+void FileImageCache<I>::invalidate(bool purge_on_error,
+                                   Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "purge_on_error=" << purge_on_error << dendl;
+
+  // acknowledged writes are never dropped from the log: if they cannot
+  // be written back they stay in it, purge_on_error or not
+  add_barrier([this, on_finish](uint64_t seq, int r) {
+      if (r == 0) {
+        Mutex::Locker locker(m_lock);
+        map_remove(0, std::numeric_limits<uint64_t>::max(), seq);
+      }
+      finish_barrier();
+      m_image_ctx.op_work_queue->queue(on_finish, r);
+    });
+}
+
+template <typename I>
+void FileImageCache<I>::flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  // write back everything logged so far and record it in the superblock
+  // before the exclusive lock can move to another client
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      if (r == 0) {
+        r = write_flushed_seq();
+      }
+      m_image_ctx.op_work_queue->queue(on_finish, r);
+    });
+
+  Mutex::Locker locker(m_lock);
+  if (m_writeback_error < 0 && m_writeback_in_flight.empty()) {
+    m_image_ctx.op_work_queue->queue(on_finish, m_writeback_error);
+    delete ctx;
+  } else if (m_flushed_seq >= m_next_seq - 1) {
+    m_finisher.queue(ctx);
+  } else {
+    m_flush_waiters.push_back({m_next_seq - 1, ctx});
+  }
+}
+
+template <typename I>
+int FileImageCache<I>::open_log(uint64_t *next_seq) {
+  CephContext *cct = m_image_ctx.cct;
+
+  int64_t pool_id = m_image_ctx.md_ctx.get_id();
+  std::string path = m_image_ctx.persistent_cache_path;
+  struct stat st;
+  if (::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    path += "/rbd-pwl." + stringify(pool_id) + "." + m_image_ctx.id;
+  }
+  ldout(cct, 5) << "path=" << path << dendl;
+
+  m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (m_fd < 0) {
+    int r = -errno;
+    lderr(cct) << "failed to open " << path << ": " << cpp_strerror(r)
+               << dendl;
+    return r;
+  }
+  if (::flock(m_fd, LOCK_EX | LOCK_NB) < 0) {
+    int r = -errno;
+    lderr(cct) << path << " is in use by another image: "
+               << cpp_strerror(r) << dendl;
+    close_log();
+    return r == -EWOULDBLOCK ? -EBUSY : r;
+  }
+
+  int r = ::fstat(m_fd, &st);
+  if (r < 0) {
+    r = -errno;
+    close_log();
+    return r;
+  }
+  int64_t size = st.st_size;
+  if (S_ISBLK(st.st_mode)) {
+    r = get_block_device_size(m_fd, &size);
+    if (r < 0) {
+      lderr(cct) << "failed to get size of " << path << ": "
+                 << cpp_strerror(r) << dendl;
+      close_log();
+      return r;
+    }
+  } else if (static_cast<uint64_t>(size) <
+               m_image_ctx.persistent_cache_size) {
+    size = m_image_ctx.persistent_cache_size;
+    if (::ftruncate(m_fd, size) < 0) {
+      r = -errno;
+      lderr(cct) << "failed to resize " << path << ": " << cpp_strerror(r)
+                 << dendl;
+      close_log();
+      return r;
+    }
+  }
+  m_log_size = size & ~(BLOCK_SIZE - 1);
+  if (m_log_size < MIN_LOG_SIZE) {
+    lderr(cct) << path << " is smaller than " << MIN_LOG_SIZE << " bytes"
+               << dendl;
+    close_log();
+    return -EINVAL;
+  }
+
+  *next_seq = 1;
+  SuperBlock sb;
+  r = read_superblock(&sb);
+  if (r == -EINVAL) {
+    ldout(cct, 5) << "formatting new log" << dendl;
+    return 0;
+  } else if (r < 0) {
+    close_log();
+    return r;
+  } else if (sb.log_size > m_log_size ||
+             sb.head_offset < SUPERBLOCK_SIZE ||
+             sb.head_offset >= sb.log_size) {
+    lderr(cct) << "log superblock is inconsistent with " << path << dendl;
+    close_log();
+    return -EINVAL;
+  }
+
+  r = replay_log(sb);
+  if (r < 0) {
+    close_log();
+    return r;
+  }
+  // nothing beyond the recovered entries is trusted: continue past any
+  // sequence number the old log could still hold
+  *next_seq = m_next_seq + std::max(sb.log_size, m_log_size) / BLOCK_SIZE;
+
+  if (sb.pool_id != pool_id || sb.image_id != m_image_ctx.id) {
+    bool dirty;
+    {
+      Mutex::Locker locker(m_lock);
+      dirty = !m_dirty.empty();
+    }
+    if (dirty) {
+      lderr(cct) << path << " holds unflushed writes of image "
+                 << sb.pool_id << "/" << sb.image_id << dendl;
+      close_log();
+      return -EBUSY;
+    }
+  }
+  return 0;
+}
+
+template <typename I>
+int FileImageCache<I>::read_superblock(SuperBlock *sb) {
+  bufferlist bl;
+  int r = read_fd(m_fd, 0, SUPERBLOCK_SIZE, &bl);
+  if (r < 0) {
+    lderr(m_image_ctx.cct) << "failed to read log superblock: "
+                           << cpp_strerror(r) << dendl;
+    return r == -EDOM ? -EINVAL : r;
+  }
+  return decode_block(bl, sb);
+}
+
+template <typename I>
+int FileImageCache<I>::write_superblock(const SuperBlock &sb) {
+  bufferlist bl;
+  encode_block(sb, SUPERBLOCK_SIZE, &bl);
+  int r = bl.write_fd(m_fd, 0);
+  if (r < 0) {
+    lderr(m_image_ctx.cct) << "failed to write log superblock: "
+                           << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+template <typename I>
+int FileImageCache<I>::write_flushed_seq() {
+  SuperBlock sb;
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_superblock.flushed_seq == m_flushed_seq) {
+      return 0;
+    }
+    sb = m_superblock;
+    sb.flushed_seq = m_flushed_seq;
+  }
+
+  int r = write_superblock(sb);
+  if (r == 0 && ::fdatasync(m_fd) < 0) {
+    r = -errno;
+  }
+  if (r == 0) {
+    Mutex::Locker locker(m_lock);
+    m_superblock = sb;
+  }
+  return r;
+}
+
+template <typename I>
+int FileImageCache<I>::replay_log(const SuperBlock &sb) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 5) << "head_offset=" << sb.head_offset << ", "
+                << "head_seq=" << sb.head_seq << ", "
+                << "flushed_seq=" << sb.flushed_seq << dendl;
+
+  Mutex::Locker locker(m_lock);
+  uint64_t offset = sb.head_offset;
+  uint64_t seq = sb.head_seq;
+  uint64_t used = 0;
+  while (used + BLOCK_SIZE <= sb.log_size - SUPERBLOCK_SIZE) {
+    if (offset == sb.log_size) {
+      offset = SUPERBLOCK_SIZE;
+    }
+
+    bufferlist bl;
+    int r = read_fd(m_fd, offset, BLOCK_SIZE, &bl);
+    if (r < 0) {
+      lderr(cct) << "failed to read log entry at " << offset << ": "
+                 << cpp_strerror(r) << dendl;
+      return r;
+    }
+    LogEntryHeader header;
+    if (decode_block(bl, &header) < 0 || header.seq != seq) {
+      break;
+    }
+
+    uint64_t log_length;
+    if (header.type == LOG_ENTRY_WRAP) {
+      log_length = sb.log_size - offset;
+    } else if (header.type == LOG_ENTRY_WRITE) {
+      log_length = entry_log_length(header.length);
+      if (offset + log_length > sb.log_size) {
+        break;
+      }
+      bl.clear();
+      r = read_fd(m_fd, offset + BLOCK_SIZE, header.length, &bl);
+      if (r < 0) {
+        lderr(cct) << "failed to read log entry at " << offset << ": "
+                   << cpp_strerror(r) << dendl;
+        return r;
+      }
+      if (bl.crc32c(-1) != header.data_crc) {
+        break;
+      }
+    } else {
+      break;
+    }
+
+    LogEntry *entry = new LogEntry{header.type, seq, offset, log_length,
+                                   header.image_offset, header.length};
+    m_log.push_back(entry);
+    if (header.type == LOG_ENTRY_WRITE && seq > sb.flushed_seq) {
+      entry->dirty = true;
+      m_dirty.push_back(entry);
+    }
+    used += log_length;
+    offset += log_length;
+    ++seq;
+  }
+
+  m_head = sb.head_offset;
+  m_tail = offset == sb.log_size ? SUPERBLOCK_SIZE : offset;
+  m_used = used;
+  m_next_seq = seq;
+  m_persisted_seq = seq - 1;
+  m_flushed_seq = m_dirty.empty() ? seq - 1 : m_dirty.front()->seq - 1;
+  m_superblock = sb;
+  ldout(cct, 5) << "recovered " << m_log.size() << " entries, "
+                << m_dirty.size() << " dirty" << dendl;
+  return 0;
+}
+
+template <typename I>
+int FileImageCache<I>::reset_log(uint64_t next_seq) {
+  ldout(m_image_ctx.cct, 5) << "next_seq=" << next_seq << dendl;
+
+  SuperBlock sb;
+  sb.pool_id = m_image_ctx.md_ctx.get_id();
+  sb.image_id = m_image_ctx.id;
+  sb.log_size = m_log_size;
+  sb.head_offset = SUPERBLOCK_SIZE;
+  sb.head_seq = next_seq;
+  sb.flushed_seq = next_seq - 1;
+  int r = write_superblock(sb);
+  if (r == 0 && ::fdatasync(m_fd) < 0) {
+    r = -errno;
+  }
+  if (r < 0) {
+    return r;
+  }
+
+  Mutex::Locker locker(m_lock);
+  assert(m_dirty.empty());
+  m_extent_map.clear();
+  for (auto entry : m_log) {
+    delete entry;
+  }
+  m_log.clear();
+  m_head = m_tail = SUPERBLOCK_SIZE;
+  m_used = 0;
+  m_next_seq = next_seq;
+  m_persisted_seq = m_flushed_seq = next_seq - 1;
+  m_superblock = sb;
+  return 0;
+}
+
+template <typename I>
+void FileImageCache<I>::close_log() {
+  if (m_fd >= 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+    m_fd = -1;
+  }
+  Mutex::Locker locker(m_lock);
+  m_extent_map.clear();
+  for (auto entry : m_log) {
+    delete entry;
+  }
+  m_log.clear();
+  m_dirty.clear();
+}
+
+template <typename I>
+void FileImageCache<I>::recover_log(uint64_t next_seq, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+
+  Context *ctx = new FunctionContext([this, next_seq, on_finish](int r) {
+      if (r == 0) {
+        r = reset_log(next_seq);
+      }
+      m_image_ctx.op_work_queue->queue(on_finish, r);
+    });
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_dirty.empty()) {
+      m_finisher.queue(ctx);
+      return;
+    }
+  }
+
+  // the log may only be replayed while its writer still holds the
+  // exclusive lock: once another client took it over (breaking it or
+  // after an orderly release) the image may have newer data
+  auto lock_owner = new managed_lock::Locker();
+  Context *get_locker_ctx = new FunctionContext(
+    [this, cct, lock_owner, ctx](int r) {
+      SuperBlock sb;
+      {
+        Mutex::Locker locker(m_lock);
+        sb = m_superblock;
+      }
+      bool lock_held = (r == 0 &&
+                        lock_owner->entity == entity_name_t::CLIENT(
+                          sb.lock_client) &&
+                        lock_owner->cookie == sb.lock_cookie);
+      delete lock_owner;
+      if (!lock_held) {
+        lderr(cct) << "the exclusive lock was taken over since the log was "
+                   << "written, discarding its unflushed writes" << dendl;
+        discard_dirty();
+        m_finisher.queue(ctx);
+        return;
+      }
+
+      // recovered writes can only be written back while holding the lock.
+      // The owner may have changed hands between the check above and the
+      // acquisition, so only replay if the lock we broke was still the one
+      // recorded by the log writer
+      Context *acquire_ctx = new FunctionContext([this, cct, sb, ctx](int r) {
+          if (r < 0) {
+            lderr(cct) << "failed to acquire exclusive lock: "
+                       << cpp_strerror(r) << dendl;
+            {
+              Mutex::Locker locker(m_lock);
+              m_writeback_error = r;
+              fail_writeback();
+            }
+            m_finisher.queue(ctx, r);
+            return;
+          }
+
+          managed_lock::Locker broken_locker;
+          {
+            RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+            if (m_image_ctx.exclusive_lock != nullptr) {
+              broken_locker = m_image_ctx.exclusive_lock->get_broken_locker();
+            }
+          }
+          if (broken_locker.entity != entity_name_t::CLIENT(sb.lock_client) ||
+              broken_locker.cookie != sb.lock_cookie) {
+            lderr(cct) << "the exclusive lock changed hands before it was "
+                       << "acquired, discarding the log's unflushed writes"
+                       << dendl;
+            discard_dirty();
+            m_finisher.queue(ctx);
+            return;
+          }
+
+          {
+            Mutex::Locker locker(m_lock);
+            ldout(cct, 1) << "writing back " << m_dirty.size() << " log "
+                          << "entries left by a previous instance" << dendl;
+            m_flush_waiters.push_back({m_next_seq - 1, ctx});
+          }
+          schedule_writeback();
+        });
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      if (m_image_ctx.exclusive_lock != nullptr) {
+        m_image_ctx.exclusive_lock->acquire_lock(acquire_ctx);
+      } else {
+        acquire_ctx->complete(0);
+      }
+    });
+
+  {
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    if (m_image_ctx.exclusive_lock != nullptr) {
+      m_image_ctx.exclusive_lock->get_locker(lock_owner, get_locker_ctx);
+      return;
+    }
+  }
+  get_locker_ctx->complete(-ENOENT);
+}
+
+template <typename I>
+void FileImageCache<I>::discard_dirty() {
+  Mutex::Locker locker(m_lock);
+  ldout(m_image_ctx.cct, 5) << "discarding " << m_dirty.size() << " entries"
+                            << dendl;
+  for (auto entry : m_dirty) {
+    entry->dirty = false;
+  }
+  m_dirty.clear();
+  m_flushed_seq = m_persisted_seq;
+}
+
+template <typename I>
+bool FileImageCache<I>::append_entries(Extents &image_extents,
+                                       bufferlist &bl, Context *on_finish) {
+  assert(m_lock.is_locked());
+
+  // a write larger than the free space is logged in parts as space is
+  // reclaimed, it is acknowledged once all of it is stable
+  bool appended = true;
+  size_t extent_count = 0;
+  for (auto &extent : image_extents) {
+    while (extent.second > 0) {
+      uint64_t len = std::min(MAX_ENTRY_DATA, extent.second);
+      uint64_t log_offset;
+      if (!allocate(entry_log_length(len), &log_offset)) {
+        appended = false;
+        break;
+      }
+
+      LogEntry *entry = new LogEntry{LOG_ENTRY_WRITE, m_next_seq++,
+                                     log_offset, entry_log_length(len),
+                                     extent.first, len};
+      bl.splice(0, len, &entry->bl);
+      extent.first += len;
+      extent.second -= len;
+      m_log.push_back(entry);
+      m_append_queue.push_back(entry);
+    }
+    if (!appended) {
+      break;
+    }
+    ++extent_count;
+  }
+  image_extents.erase(image_extents.begin(),
+                      image_extents.begin() + extent_count);
+  if (!m_append_queue.empty()) {
+    schedule_append();
+  }
+  if (!appended) {
+    return false;
+  }
+
+  // complete once everything up to the last entry of this write is stable
+  uint64_t seq = m_next_seq - 1;
+  if (m_persisted_seq >= seq) {
+    m_image_ctx.op_work_queue->queue(on_finish, 0);
+  } else {
+    m_persist_waiters.push_back({seq, on_finish});
+  }
+  return true;
+}
+
+template <typename I>
+bool FileImageCache<I>::allocate(uint64_t length, uint64_t *log_offset) {
+  assert(m_lock.is_locked());
+
+  for (int pass = 0; pass < 2; ++pass) {
+    if (m_log.empty()) {
+      m_head = m_tail;
+      if (m_tail + length > m_log_size) {
+        m_head = m_tail = SUPERBLOCK_SIZE;
+      }
+    }
+
+    if (m_log.empty() || m_tail > m_head) {
+      if (m_tail + length > m_log_size && SUPERBLOCK_SIZE + length <= m_head) {
+        // no room before the end of the log -- mark the rest as unused
+        // and continue at its start
+        LogEntry *wrap = new LogEntry{LOG_ENTRY_WRAP, m_next_seq++, m_tail,
+                                      m_log_size - m_tail, 0, 0};
+        m_log.push_back(wrap);
+        m_append_queue.push_back(wrap);
+        m_used += wrap->log_length;
+        m_tail = SUPERBLOCK_SIZE;
+      }
+    }
+    if ((m_log.empty() || m_tail > m_head) ?
+          m_tail + length <= m_log_size : m_tail + length <= m_head) {
+      *log_offset = m_tail;
+      m_tail += length;
+      m_used += length;
+      if (m_tail == m_log_size) {
+        m_tail = SUPERBLOCK_SIZE;
+      }
+      return true;
+    }
+
+    if (pass == 0) {
+      reclaim();
+    }
+  }
+  return false;
+}
+
+template <typename I>
+void FileImageCache<I>::reclaim() {
+  assert(m_lock.is_locked());
+
+  while (!m_log.empty()) {
+    LogEntry *entry = m_log.front();
+    if (entry->dirty || entry->readers > 0 || entry->seq > m_persisted_seq) {
+      break;
+    }
+    ldout(m_image_ctx.cct, 20) << "seq=" << entry->seq << dendl;
+    if (entry->type == LOG_ENTRY_WRITE) {
+      map_remove(entry->image_offset, entry->length, entry->seq);
+    }
+    m_used -= entry->log_length;
+    m_log.pop_front();
+    delete entry;
+  }
+  m_head = m_log.empty() ? m_tail : m_log.front()->log_offset;
+}
+
+template <typename I>
+void FileImageCache<I>::process_deferred() {
+  assert(m_lock.is_locked());
+
+  while (!m_deferred.empty()) {
+    DeferredWrite &write = m_deferred.front();
+    if (m_error < 0) {
+      m_image_ctx.op_work_queue->queue(write.on_finish, m_error);
+    } else if (!append_entries(write.image_extents, write.bl,
+                               write.on_finish)) {
+      break;
+    }
+    m_deferred.pop_front();
+  }
+}
+
+template <typename I>
+void FileImageCache<I>::schedule_append() {
+  assert(m_lock.is_locked());
+  if (m_append_scheduled) {
+    return;
+  }
+  m_append_scheduled = true;
+  m_finisher.queue(new FunctionContext([this](int r) {
+      process_append();
+    }));
+}
+
+template <typename I>
+void FileImageCache<I>::process_append() {
+  CephContext *cct = m_image_ctx.cct;
+
+  // writes are only accepted while holding the exclusive lock and it
+  // is not released before they are written back, so the current
+  // cookie is the one they were logged under
+  std::string lock_cookie;
+  {
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    if (m_image_ctx.exclusive_lock != nullptr) {
+      lock_cookie = m_image_ctx.exclusive_lock->get_cookie();
+    }
+  }
+
+  std::list<LogEntry*> entries;
+  SuperBlock sb;
+  bool head_moved;
+  bool write_sb;
+  {
+    Mutex::Locker locker(m_lock);
+    m_append_scheduled = false;
+    entries.swap(m_append_queue);
+    if (entries.empty()) {
+      return;
+    }
+
+    sb = m_superblock;
+    sb.head_offset = m_head;
+    sb.head_seq = m_log.front()->seq;
+    sb.flushed_seq = m_flushed_seq;
+    sb.lock_client = m_lock_client;
+    sb.lock_cookie = lock_cookie;
+    head_moved = (sb.head_offset != m_superblock.head_offset ||
+                  sb.head_seq != m_superblock.head_seq);
+    write_sb = (head_moved || sb.flushed_seq != m_superblock.flushed_seq ||
+                sb.lock_client != m_superblock.lock_client ||
+                sb.lock_cookie != m_superblock.lock_cookie);
+  }
+  ldout(cct, 20) << "entries=" << entries.size() << ", "
+                 << "head_moved=" << head_moved << dendl;
+
+  utime_t start = ceph_clock_now();
+  int r = 0;
+  if (head_moved) {
+    // reclaimed space must not be reused before the superblock stops
+    // pointing into it
+    r = write_superblock(sb);
+    if (r == 0 && ::fdatasync(m_fd) < 0) {
+      r = -errno;
+    }
+    write_sb = false;
+  }
+
+  // entries are contiguous in the log unless it wrapped
+  bufferlist bl;
+  uint64_t bl_offset = 0;
+  for (auto it = entries.begin(); r == 0 && it != entries.end(); ++it) {
+    LogEntry *entry = *it;
+    if (bl.length() > 0 && bl_offset + bl.length() != entry->log_offset) {
+      r = bl.write_fd(m_fd, bl_offset);
+      bl.clear();
+    }
+    if (bl.length() == 0) {
+      bl_offset = entry->log_offset;
+    }
+
+    LogEntryHeader header;
+    header.type = entry->type;
+    header.seq = entry->seq;
+    header.image_offset = entry->image_offset;
+    header.length = entry->length;
+    if (entry->type == LOG_ENTRY_WRITE) {
+      header.data_crc = entry->bl.crc32c(-1);
+    }
+    encode_block(header, BLOCK_SIZE, &bl);
+    if (entry->type == LOG_ENTRY_WRITE) {
+      bl.append(entry->bl);
+      bl.append_zero(entry->log_length - BLOCK_SIZE - entry->length);
+    }
+  }
+  if (r == 0 && bl.length() > 0) {
+    r = bl.write_fd(m_fd, bl_offset);
+  }
+  if (r == 0 && write_sb) {
+    r = write_superblock(sb);
+  }
+  if (r == 0 && ::fdatasync(m_fd) < 0) {
+    r = -errno;
+  }
+  m_image_ctx.perfcounter->inc(l_librbd_pwl_log_sync);
+  m_image_ctx.perfcounter->tinc(l_librbd_pwl_log_sync_latency,
+                                ceph_clock_now() - start);
+
+  {
+    Mutex::Locker locker(m_lock);
+    if (r < 0) {
+      lderr(cct) << "failed to append to cache log: " << cpp_strerror(r)
+                 << dendl;
+      if (m_error == 0) {
+        m_error = r;
+      }
+    } else {
+      m_superblock = sb;
+    }
+
+    for (auto entry : entries) {
+      // from now on the data is read back from the log
+      entry->bl.clear();
+      if (r == 0 && entry->type == LOG_ENTRY_WRITE) {
+        entry->dirty = true;
+        m_dirty.push_back(entry);
+        map_insert(entry);
+      }
+    }
+    m_persisted_seq = entries.back()->seq;
+
+    while (!m_persist_waiters.empty() &&
+           m_persist_waiters.front().first <= m_persisted_seq) {
+      m_image_ctx.op_work_queue->queue(m_persist_waiters.front().second, r);
+      m_persist_waiters.pop_front();
+    }
+    update_flushed_seq();
+    process_deferred();
+  }
+  dispatch_writeback();
+}
+
+template <typename I>
+void FileImageCache<I>::schedule_writeback() {
+  Mutex::Locker locker(m_lock);
+  if (m_writeback_scheduled) {
+    return;
+  }
+  m_writeback_scheduled = true;
+  m_finisher.queue(new FunctionContext([this](int r) {
+      {
+        Mutex::Locker locker(m_lock);
+        m_writeback_scheduled = false;
+      }
+      dispatch_writeback();
+    }));
+}
+
+template <typename I>
+void FileImageCache<I>::dispatch_writeback() {
+  CephContext *cct = m_image_ctx.cct;
+
+  // writes go out in log order; a write waits while it overlaps one
+  // in flight or is ordered after a pending discard
+  std::list<LogEntry*> entries;
+  {
+    Mutex::Locker locker(m_lock);
+    while (m_writeback_error == 0 && !m_dirty.empty() &&
+           m_writeback_in_flight.size() <
+             m_image_ctx.persistent_cache_max_writeback_ops) {
+      LogEntry *entry = m_dirty.front();
+      if (!m_barriers.empty() && entry->seq > m_barriers.front().seq) {
+        break;
+      }
+      bool overlaps = false;
+      for (auto in_flight : m_writeback_in_flight) {
+        if (entry->image_offset < in_flight->image_offset + in_flight->length &&
+            in_flight->image_offset < entry->image_offset + entry->length) {
+          overlaps = true;
+          break;
+        }
+      }
+      if (overlaps) {
+        break;
+      }
+      m_dirty.pop_front();
+      m_writeback_in_flight.push_back(entry);
+      entries.push_back(entry);
+    }
+  }
+  if (entries.empty()) {
+    return;
+  }
+
+  RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+  for (auto entry : entries) {
+    ldout(cct, 20) << "seq=" << entry->seq << ", "
+                   << "image_offset=" << entry->image_offset << ", "
+                   << "length=" << entry->length << dendl;
+
+    bufferlist bl;
+    int r = read_fd(m_fd, entry->log_offset + BLOCK_SIZE, entry->length, &bl);
+    if (r < 0) {
+      lderr(cct) << "failed to read log entry at " << entry->log_offset
+                 << ": " << cpp_strerror(r) << dendl;
+      handle_writeback(entry, r);
+      continue;
+    }
+
+    m_image_ctx.perfcounter->inc(l_librbd_pwl_writeback_bytes, entry->length);
+    m_image_writeback.aio_write(
+      {{entry->image_offset, entry->length}}, std::move(bl), 0,
+      new FunctionContext([this, entry](int r) {
+          handle_writeback(entry, r);
+        }));
+  }
+}
+
+template <typename I>
+void FileImageCache<I>::handle_writeback(LogEntry *entry, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "seq=" << entry->seq << ", r=" << r << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_writeback_in_flight.remove(entry);
+    if (r < 0) {
+      lderr(cct) << "failed to write back log entry " << entry->seq << ": "
+                 << cpp_strerror(r) << dendl;
+      // keep it dirty, in log order, so that it is recovered on the next
+      // open if it cannot be written back before the image is closed
+      auto it = m_dirty.begin();
+      while (it != m_dirty.end() && (*it)->seq < entry->seq) {
+        ++it;
+      }
+      m_dirty.insert(it, entry);
+      if (m_writeback_error == 0) {
+        m_writeback_error = r;
+      }
+    } else {
+      entry->dirty = false;
+    }
+
+    update_flushed_seq();
+    if (m_writeback_error < 0 && m_writeback_in_flight.empty()) {
+      fail_writeback();
+    }
+    process_deferred();
+  }
+  schedule_writeback();
+}
+
+template <typename I>
+void FileImageCache<I>::update_flushed_seq() {
+  assert(m_lock.is_locked());
+
+  uint64_t seq = m_persisted_seq;
+  if (!m_dirty.empty()) {
+    seq = std::min(seq, m_dirty.front()->seq - 1);
+  }
+  for (auto entry : m_writeback_in_flight) {
+    seq = std::min(seq, entry->seq - 1);
+  }
+  if (seq <= m_flushed_seq) {
+    return;
+  }
+  m_flushed_seq = seq;
+
+  while (!m_flush_waiters.empty() &&
+         m_flush_waiters.front().first <= m_flushed_seq) {
+    m_finisher.queue(m_flush_waiters.front().second, 0);
+    m_flush_waiters.pop_front();
+  }
+  start_barrier();
+}
+
+template <typename I>
+void FileImageCache<I>::fail_writeback() {
+  assert(m_lock.is_locked());
+  assert(m_writeback_error < 0);
+
+  for (auto &waiter : m_flush_waiters) {
+    m_finisher.queue(waiter.second, m_writeback_error);
+  }
+  m_flush_waiters.clear();
+
+  // the log cannot drain, fail the writes waiting for space
+  for (auto &write : m_deferred) {
+    m_image_ctx.op_work_queue->queue(write.on_finish, m_writeback_error);
+  }
+  m_deferred.clear();
+  start_barrier();
+}
+
+template <typename I>
+void FileImageCache<I>::map_insert(LogEntry *entry) {
+  assert(m_lock.is_locked());
+
+  map_remove(entry->image_offset, entry->length,
+             std::numeric_limits<uint64_t>::max());
+  m_extent_map[entry->image_offset] = {entry->length, entry};
+}
+
+template <typename I>
+void FileImageCache<I>::map_remove(uint64_t offset, uint64_t length,
+                                   uint64_t max_seq) {
+  assert(m_lock.is_locked());
+
+  uint64_t end = offset + std::min(length,
+                                   std::numeric_limits<uint64_t>::max() -
+                                     offset);
+  auto it = m_extent_map.lower_bound(offset);
+  if (it != m_extent_map.begin()) {
+    auto prev = it;
+    --prev;
+    if (prev->first + prev->second.length > offset) {
+      it = prev;
+    }
+  }
+
+  while (it != m_extent_map.end() && it->first < end) {
+    uint64_t extent_start = it->first;
+    uint64_t extent_end = it->first + it->second.length;
+    LogEntry *entry = it->second.entry;
+    if (entry->seq > max_seq) {
+      ++it;
+      continue;
+    }
+
+    it = m_extent_map.erase(it);
+    if (extent_start < offset) {
+      m_extent_map[extent_start] = {offset - extent_start, entry};
+    }
+    if (extent_end > end) {
+      m_extent_map[end] = {extent_end - end, entry};
+    }
+  }
+}
+
+template <typename I>
+void FileImageCache<I>::add_barrier(
+    const std::function<void(uint64_t, int)> &on_ready) {
+  Mutex::Locker locker(m_lock);
+  m_barriers.push_back({m_next_seq - 1, false, on_ready});
+  start_barrier();
+}
+
+template <typename I>
+void FileImageCache<I>::start_barrier() {
+  assert(m_lock.is_locked());
+  if (m_barriers.empty() || m_barriers.front().started) {
+    return;
+  }
+
+  Barrier &barrier = m_barriers.front();
+  int r = 0;
+  if (m_writeback_error < 0) {
+    if (!m_writeback_in_flight.empty()) {
+      return;
+    }
+    r = m_writeback_error;
+  } else if (m_flushed_seq < barrier.seq) {
+    return;
+  }
+
+  // the writes before the barrier are on the cluster -- record that
+  // before the barrier op can overwrite them, so that they are not
+  // replayed over it after a crash
+  barrier.started = true;
+  uint64_t seq = barrier.seq;
+  auto on_ready = barrier.on_ready;
+  m_finisher.queue(new FunctionContext([this, seq, on_ready](int r) {
+      if (r == 0) {
+        r = write_flushed_seq();
+      }
+      on_ready(seq, r);
+    }), r);
+}
+
+template <typename I>
+void FileImageCache<I>::finish_barrier() {
+  {
+    Mutex::Locker locker(m_lock);
+    assert(!m_barriers.empty() && m_barriers.front().started);
+    m_barriers.pop_front();
+    start_barrier();
+  }
+  schedule_writeback();
+}
+
+} // namespace cache
+} // namespace librbd
+
+template class librbd::cache::FileImageCache<librbd::ImageCtx>;
@@ -0,0 +1,220 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
+#define CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
+
+#include "ImageCache.h"
+#include "ImageWriteback.h"
+#include "common/Finisher.h"
+#include "common/Mutex.h"
+#include "include/buffer.h"
+#include "include/encoding.h"
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+namespace file {
+
+enum LogEntryType {
+  LOG_ENTRY_WRITE = 1,
+  LOG_ENTRY_WRAP  = 2,   // rest of the log is unused, continue at its start
+};
+
+/**
+ * Superblock of the write log, stored in the first block of the file.
+ * Entries from head_seq on are chained by consecutive sequence numbers,
+ * entries up to flushed_seq have been written back.  The entries were
+ * logged while lock_client held the image's exclusive lock under
+ * lock_cookie.
+ */
+struct SuperBlock {
+  int64_t pool_id = -1;
+  std::string image_id;
+  uint64_t log_size = 0;
+  uint64_t head_offset = 0;
+  uint64_t head_seq = 0;
+  uint64_t flushed_seq = 0;
+  uint64_t lock_client = 0;
+  std::string lock_cookie;
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &it);
+};
+
+struct LogEntryHeader {
+  uint8_t type = LOG_ENTRY_WRITE;
+  uint64_t seq = 0;
+  uint64_t image_offset = 0;
+  uint64_t length = 0;
+  uint32_t data_crc = 0;
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &it);
+};
+
+} // namespace file
+
+/**
+ * Persistent write-back image extent cache
+ *
+ * Writes are appended to a log in a local file or block device and are
+ * acknowledged once the log is stable; writes that arrive together
+ * share one fdatasync.  The log is written back to the cluster in order
+ * through ImageWriteback and reads of data still in the log are served
+ * locally.  A log left behind by a crash is written back when the image
+ * is opened again, unless another client took the exclusive lock in the
+ * meantime.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class FileImageCache : public ImageCache {
+public:
+  FileImageCache(ImageCtx &image_ctx);
+  ~FileImageCache() override;
+
+  /// client AIO methods
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) override;
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) override;
+  void aio_discard(uint64_t offset, uint64_t length,
+                   bool skip_partial_discard, Context *on_finish) override;
+  void aio_flush(Context *on_finish) override;
+  void aio_writesame(uint64_t offset, uint64_t length,
+                     ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) override;
+
+  /// internal state methods
+  void init(Context *on_finish) override;
+  void shut_down(Context *on_finish) override;
+
+  void invalidate(bool purge_on_error, Context *on_finish) override;
+  void flush(Context *on_finish) override;
+
+private:
+  static const uint64_t BLOCK_SIZE = 512;
+  static const uint64_t SUPERBLOCK_SIZE = 4096;
+  static const uint64_t MAX_ENTRY_DATA = 1 << 20;
+  static const uint64_t MIN_LOG_SIZE = 16 << 20;
+
+  struct LogEntry {
+    uint8_t type;
+    uint64_t seq;
+    uint64_t log_offset;    // of the entry header
+    uint64_t log_length;    // header plus padded data
+    uint64_t image_offset;
+    uint64_t length;
+    bufferlist bl;          // kept in memory until it is stable
+    bool dirty = false;
+    int readers = 0;
+  };
+
+  /// image range whose latest data is in the log
+  struct MapExtent {
+    uint64_t length;
+    LogEntry *entry;
+  };
+  typedef std::map<uint64_t, MapExtent> ExtentMap;
+
+  /// write (or flush, without extents) waiting for log space, without
+  /// the part that is already in the log
+  struct DeferredWrite {
+    Extents image_extents;
+    bufferlist bl;
+    Context *on_finish;
+  };
+
+  /// discard, writesame or invalidate, started once every entry up to
+  /// seq has been written back; later entries wait for it
+  struct Barrier {
+    uint64_t seq;
+    bool started;
+    std::function<void(uint64_t, int)> on_ready;
+  };
+
+  typedef std::list<std::pair<uint64_t, Context*> > SeqWaiters;
+
+  ImageCtxT &m_image_ctx;
+  ImageWriteback<ImageCtxT> m_image_writeback;
+  Finisher m_finisher;
+  bool m_finisher_started = false;
+
+  Mutex m_lock;
+  int m_fd = -1;
+  uint64_t m_lock_client;
+  file::SuperBlock m_superblock;      // as last written
+  uint64_t m_log_size = 0;
+  uint64_t m_head = SUPERBLOCK_SIZE;  // oldest entry still in the log
+  uint64_t m_tail = SUPERBLOCK_SIZE;  // where the next entry goes
+  uint64_t m_used = 0;
+  uint64_t m_next_seq = 1;
+  uint64_t m_persisted_seq = 0;
+  uint64_t m_flushed_seq = 0;
+  int m_error = 0;
+  int m_writeback_error = 0;
+
+  std::deque<LogEntry*> m_log;        // in log order
+  std::list<LogEntry*> m_append_queue;
+  bool m_append_scheduled = false;
+  std::list<LogEntry*> m_dirty;       // stable, not yet written back
+  std::list<LogEntry*> m_writeback_in_flight;
+  bool m_writeback_scheduled = false;
+  std::list<DeferredWrite> m_deferred;
+  std::list<Barrier> m_barriers;
+  SeqWaiters m_persist_waiters;
+  SeqWaiters m_flush_waiters;
+  ExtentMap m_extent_map;
+
+  uint64_t entry_log_length(uint64_t length) const {
+    return BLOCK_SIZE + ((length + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1));
+  }
+
+  int open_log(uint64_t *next_seq);
+  int read_superblock(file::SuperBlock *sb);
+  int write_superblock(const file::SuperBlock &sb);
+  int write_flushed_seq();
+  int replay_log(const file::SuperBlock &sb);
+  int reset_log(uint64_t next_seq);
+  void close_log();
+  void recover_log(uint64_t next_seq, Context *on_finish);
+  void discard_dirty();
+
+  bool append_entries(Extents &image_extents, bufferlist &bl,
+                      Context *on_finish);
+  bool allocate(uint64_t length, uint64_t *log_offset);
+  void reclaim();
+  void process_deferred();
+  void schedule_append();
+  void process_append();
+
+  void schedule_writeback();
+  void dispatch_writeback();
+  void handle_writeback(LogEntry *entry, int r);
+  void update_flushed_seq();
+  void fail_writeback();
+
+  void map_insert(LogEntry *entry);
+  void map_remove(uint64_t offset, uint64_t length, uint64_t max_seq);
+
+  void add_barrier(const std::function<void(uint64_t, int)> &on_ready);
+  void start_barrier();
+  void finish_barrier();
+};
+
+} // namespace cache
+} // namespace librbd
+
+WRITE_CLASS_ENCODER(librbd::cache::file::SuperBlock);
+WRITE_CLASS_ENCODER(librbd::cache::file::LogEntryHeader);
+
+extern template class librbd::cache::FileImageCache<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
@@ -38,7 +38,7 @@ struct ImageCache {
   virtual void init(Context *on_finish) = 0;
   virtual void shut_down(Context *on_finish) = 0;
 
-  virtual void invalidate(Context *on_finish) = 0;
+  virtual void invalidate(bool purge_on_error, Context *on_finish) = 0;
   virtual void flush(Context *on_finish) = 0;
 
 };
@@ -93,7 +93,8 @@ void PassthroughImageCache<I>::shut_down(Context *on_finish) {
 }
 
 template <typename I>
-void PassthroughImageCache<I>::invalidate(Context *on_finish) {
+void PassthroughImageCache<I>::invalidate(bool purge_on_error,
+                                          Context *on_finish) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << dendl;
 
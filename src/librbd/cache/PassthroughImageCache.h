@@ -37,7 +37,7 @@ public:
   void init(Context *on_finish) override;
   void shut_down(Context *on_finish) override;
 
-  void invalidate(Context *on_finish) override;
+  void invalidate(bool purge_on_error, Context *on_finish) override;
   void flush(Context *on_finish) override;
 
 private:
@@ -354,6 +354,7 @@ void CloneRequest<I>::handle_metadata_list(int r) {
   if (r == 0) {
     bufferlist::iterator it = m_out_bl.begin();
     r = cls_client::metadata_list_finish(&it, &m_pairs);
+    m_pairs.erase(ImageCtx::METADATA_FLATTEN_OBJECT_NO);
   }
 
   if (r < 0 && r != -EOPNOTSUPP && r != -EIO) {
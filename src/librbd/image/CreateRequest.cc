@@ -12,6 +12,7 @@
 #include "librbd/MirroringWatcher.h"
 #include "librbd/journal/CreateRequest.h"
 #include "librbd/journal/RemoveRequest.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "librbd/mirror/EnableRequest.h"
 #include "librbd/io/AioCompletion.h"
 #include "journal/Journaler.h"
@@ -40,6 +41,11 @@ int validate_features(CephContext *cct, uint64_t features,
     lderr(cct) << "cannot use fast diff without object map" << dendl;
     return -EINVAL;
   }
+  if ((features & RBD_FEATURE_EXTENT_MAP) != 0 &&
+      (features & RBD_FEATURE_FAST_DIFF) == 0) {
+    lderr(cct) << "cannot use extent map without fast diff" << dendl;
+    return -EINVAL;
+  }
   if ((features & RBD_FEATURE_OBJECT_MAP) != 0 &&
       (features & RBD_FEATURE_EXCLUSIVE_LOCK) == 0) {
     lderr(cct) << "cannot use object map without exclusive lock" << dendl;
@@ -92,11 +98,17 @@ int validate_data_pool(CephContext *cct, IoCtx &io_ctx, uint64_t features,
 }
 
 
-bool validate_layout(CephContext *cct, uint64_t size, file_layout_t &layout) {
+bool validate_layout(CephContext *cct, uint64_t size, uint64_t features,
+                     file_layout_t &layout) {
   if (!librbd::ObjectMap<>::is_compatible(layout, size)) {
     lderr(cct) << "image size not compatible with object map" << dendl;
     return false;
   }
+  if ((features & RBD_FEATURE_EXTENT_MAP) != 0 &&
+      !librbd::object_map::ExtentMap<>::is_compatible(layout, size)) {
+    lderr(cct) << "image size not compatible with extent map" << dendl;
+    return false;
+  }
 
   return true;
 }
@@ -145,6 +157,8 @@ CreateRequest<I>::CreateRequest(IoCtx &ioctx, const std::string &image_name,
   m_id_obj = util::id_obj_name(m_image_name);
   m_header_obj = util::header_name(m_image_id);
   m_objmap_name = ObjectMap<>::object_map_name(m_image_id, CEPH_NOSNAP);
+  m_extent_map_name = object_map::ExtentMap<>::extent_map_name(m_image_id,
+                                                               CEPH_NOSNAP);
 
   if (image_options.get(RBD_IMAGE_OPTION_FEATURES, &m_features) != 0) {
     m_features = util::get_rbd_default_features(m_cct);
@@ -257,7 +271,7 @@ void CreateRequest<I>::send() {
     return;
   }
 
-  if (!validate_layout(m_cct, m_size, m_layout)) {
+  if (!validate_layout(m_cct, m_size, m_features, m_layout)) {
     complete(-EINVAL);
     return;
   }
@@ -616,6 +630,44 @@ void CreateRequest<I>::handle_object_map_resize(int r) {
     return;
   }
 
+  extent_map_resize();
+}
+
+template<typename I>
+void CreateRequest<I>::extent_map_resize() {
+  if ((m_features & RBD_FEATURE_EXTENT_MAP) == 0) {
+    fetch_mirror_mode();
+    return;
+  }
+
+  ldout(m_cct, 20) << dendl;
+
+  librados::ObjectWriteOperation op;
+  cls_client::object_map_resize(
+    &op, object_map::ExtentMap<>::get_chunk_count(m_layout, m_size),
+    EXTENT_UNCHANGED);
+
+  using klass = CreateRequest<I>;
+  librados::AioCompletion *comp =
+    create_rados_callback<klass, &klass::handle_extent_map_resize>(this);
+  int r = m_ioctx.aio_operate(m_extent_map_name, comp, &op);
+  assert(r == 0);
+  comp->release();
+}
+
+template<typename I>
+void CreateRequest<I>::handle_extent_map_resize(int r) {
+  ldout(m_cct, 20) << "r=" << r << dendl;
+
+  if (r < 0) {
+    lderr(m_cct) << "error creating initial extent map: "
+                 << cpp_strerror(r) << dendl;
+
+    m_r_saved = r;
+    remove_object_map();
+    return;
+  }
+
   fetch_mirror_mode();
 }
 
@@ -825,6 +877,35 @@ void CreateRequest<I>::handle_remove_object_map(int r) {
                  << cpp_strerror(r) << dendl;
   }
 
+  remove_extent_map();
+}
+
+template<typename I>
+void CreateRequest<I>::remove_extent_map() {
+  if ((m_features & RBD_FEATURE_EXTENT_MAP) == 0) {
+    remove_header_object();
+    return;
+  }
+
+  ldout(m_cct, 20) << dendl;
+
+  using klass = CreateRequest<I>;
+  librados::AioCompletion *comp =
+    create_rados_callback<klass, &klass::handle_remove_extent_map>(this);
+  int r = m_ioctx.aio_remove(m_extent_map_name, comp);
+  assert(r == 0);
+  comp->release();
+}
+
+template<typename I>
+void CreateRequest<I>::handle_remove_extent_map(int r) {
+  ldout(m_cct, 20) << "r=" << r << dendl;
+
+  if (r < 0 && r != -ENOENT) {
+    lderr(m_cct) << "error cleaning up extent map after creation failed: "
+                 << cpp_strerror(r) << dendl;
+  }
+
   remove_header_object();
 }
 
@@ -77,10 +77,14 @@ private:
    * |      REMOVE HEADER OBJ<------/    v                     /. (object-map
    * |               |\           OBJECT MAP RESIZE . . < . . * v  disabled)
    * |               | \              /  |  \ . . . . . > . . . .
+   * |               |  *<-----------/   v                     /. (extent-map
+   * |               |  |         EXTENT MAP RESIZE . . < . . * v  disabled)
+   * |               |  |             /  |  \ . . . . . > . . . .
    * |               |  *<-----------/   v                     /. (journaling
    * |               |             FETCH MIRROR MODE. . < . . * v  disabled)
    * |               |                /   |                     .
    * |     REMOVE OBJECT MAP<--------/    v                     .
+   * |               |   (and extent map) |                     .
    * |               |\             JOURNAL CREATE              .
    * |               | \               /  |                     .
    * v               |  *<------------/   v                     .
@@ -127,7 +131,7 @@ private:
   int m_r_saved;  // used to return actual error after cleanup
   bool m_force_non_primary;
   file_layout_t m_layout;
-  std::string m_id_obj, m_header_obj, m_objmap_name;
+  std::string m_id_obj, m_header_obj, m_objmap_name, m_extent_map_name;
 
   bufferlist m_outbl;
   rbd_mirror_mode_t m_mirror_mode;
@@ -157,6 +161,9 @@ private:
   void object_map_resize();
   void handle_object_map_resize(int r);
 
+  void extent_map_resize();
+  void handle_extent_map_resize(int r);
+
   void fetch_mirror_mode();
   void handle_fetch_mirror_mode(int r);
 
@@ -175,6 +182,9 @@ private:
   void remove_object_map();
   void handle_remove_object_map(int r);
 
+  void remove_extent_map();
+  void handle_remove_extent_map(int r);
+
   void remove_header_object();
   void handle_remove_header_object(int r);
 
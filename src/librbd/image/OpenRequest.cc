@@ -7,6 +7,8 @@
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/BlockImageCache.h"
+#include "librbd/cache/FileImageCache.h"
 #include "librbd/image/CloseRequest.h"
 #include "librbd/image/RefreshRequest.h"
 #include "librbd/image/SetSnapRequest.h"
@@ -488,9 +490,62 @@ Context *OpenRequest<I>::handle_refresh(int *result) {
                << dendl;
     send_close_image(*result);
     return nullptr;
+  } else {
+    return send_init_cache(result);
+  }
+}
+
+template <typename I>
+Context *OpenRequest<I>::send_init_cache(int *result) {
+  CephContext *cct = m_image_ctx->cct;
+  // the persistent cache logs writes to the image head and relies on
+  // the exclusive lock to write them back before another client can
+  // modify the image, other opens keep the cache set up by ImageCtx::init()
+  bool persistent_cache = (!m_image_ctx->persistent_cache_path.empty() &&
+                           !m_image_ctx->read_only &&
+                           m_image_ctx->snap_name.empty());
+  if (persistent_cache &&
+      !m_image_ctx->test_features(RBD_FEATURE_EXCLUSIVE_LOCK)) {
+    lderr(cct) << "persistent cache requires the exclusive-lock feature, "
+               << "not enabling it" << dendl;
+    persistent_cache = false;
+    if (m_image_ctx->cache && m_image_ctx->cache_type != "block") {
+      m_image_ctx->init_object_cacher();
+    }
+  }
+
+  if (persistent_cache) {
+    m_image_ctx->image_cache = new cache::FileImageCache<I>(*m_image_ctx);
+  } else if (m_image_ctx->cache && m_image_ctx->cache_type == "block") {
+    m_image_ctx->image_cache = new cache::BlockImageCache<I>(*m_image_ctx);
   } else {
     return send_set_snap(result);
   }
+
+  ldout(cct, 10) << this << " " << __func__ << dendl;
+
+  using klass = OpenRequest<I>;
+  Context *ctx = create_context_callback<
+    klass, &klass::handle_init_cache>(this);
+  m_image_ctx->image_cache->init(ctx);
+  return nullptr;
+}
+
+template <typename I>
+Context *OpenRequest<I>::handle_init_cache(int *result) {
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 10) << __func__ << ": r=" << *result << dendl;
+
+  if (*result < 0) {
+    lderr(cct) << "failed to init image cache: " << cpp_strerror(*result)
+               << dendl;
+    delete m_image_ctx->image_cache;
+    m_image_ctx->image_cache = nullptr;
+    send_close_image(*result);
+    return nullptr;
+  }
+
+  return send_set_snap(result);
 }
 
 template <typename I>
@@ -61,6 +61,9 @@ private:
    *                                             REFRESH
    *                                                |
    *                                                v
+   *                                             INIT_CACHE (skip if no
+   *                                                |        image cache)
+   *                                                v
    *                                             SET_SNAP (skip if no snap)
    *                                                |
    *                                                v
@@ -117,6 +120,9 @@ private:
   void send_refresh();
   Context *handle_refresh(int *result);
 
+  Context *send_init_cache(int *result);
+  Context *handle_init_cache(int *result);
+
   Context *send_set_snap(int *result);
   Context *handle_set_snap(int *result);
 
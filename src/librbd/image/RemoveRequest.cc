@@ -13,6 +13,7 @@
 #include "librbd/image/RemoveRequest.h"
 #include "librbd/operation/TrimRequest.h"
 #include "librbd/mirror/DisableRequest.h"
+#include "librbd/object_map/ExtentMap.h"
 
 #define dout_subsys ceph_subsys_rbd
 #undef dout_prefix
@@ -536,6 +537,37 @@ Context *RemoveRequest<I>::handle_object_map_remove(int *result) {
     *result = 0;
   }
 
+  send_extent_map_remove();
+  return nullptr;
+}
+
+template<typename I>
+void RemoveRequest<I>::send_extent_map_remove() {
+  ldout(m_cct, 20) << dendl;
+
+  using klass = RemoveRequest<I>;
+  librados::AioCompletion *rados_completion =
+    create_rados_callback<klass, &klass::handle_extent_map_remove>(this);
+
+  int r = m_ioctx.aio_remove(
+    object_map::ExtentMap<>::extent_map_name(m_image_id, CEPH_NOSNAP),
+    rados_completion);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+template<typename I>
+Context *RemoveRequest<I>::handle_extent_map_remove(int *result) {
+  ldout(m_cct, 20) << ": r=" << *result << dendl;
+
+  if (*result < 0 && *result != -ENOENT) {
+    lderr(m_cct) << "failed to remove extent map: " << cpp_strerror(*result)
+                 << dendl;
+    return m_on_finish;
+  } else {
+    *result = 0;
+  }
+
   mirror_image_remove();
   return nullptr;
 }
@@ -81,6 +81,10 @@ private:
    * | 		     |  	      /  |
    * |  	     |-------<-------/   |
    * |               |                   v
+   * |		     |  	  REMOVE EXTENT MAP
+   * | 		     |  	      /  |
+   * |  	     |-------<-------/   |
+   * |               |                   v
    * |		     |  	  REMOVE MIRROR IMAGE
    * | 		     |  	      /  |
    * |  	     |-------<-------/   |
@@ -131,6 +135,9 @@ private:
   void send_object_map_remove();
   Context* handle_object_map_remove(int *result);
 
+  void send_extent_map_remove();
+  Context* handle_extent_map_remove(int *result);
+
   void mirror_image_remove();
   Context* handle_mirror_image_remove(int *result);
 
@@ -1886,6 +1886,7 @@ int validate_pool(IoCtx &io_ctx, CephContext *cct) {
     map<string, bufferlist> pairs;
 
     r = cls_client::metadata_list(&src->md_ctx, src->header_oid, "", 0, &pairs);
+    pairs.erase(ImageCtx::METADATA_FLATTEN_OBJECT_NO);
     if (r < 0 && r != -EOPNOTSUPP && r != -EIO) {
       lderr(cct) << "couldn't list metadata: " << cpp_strerror(r) << dendl;
       return r;
@@ -50,6 +50,23 @@ enum {
 
   l_librbd_invalidate_cache,
 
+  l_librbd_pwl_rd_hit_bytes,
+  l_librbd_pwl_rd_miss_bytes,
+  l_librbd_pwl_log_sync,
+  l_librbd_pwl_log_sync_latency,
+  l_librbd_pwl_log_full,
+  l_librbd_pwl_writeback_bytes,
+
+  l_librbd_bc_rd_hit_bytes,
+  l_librbd_bc_rd_miss_bytes,
+  l_librbd_bc_evict,
+  l_librbd_bc_dirty_waits,
+  l_librbd_bc_writeback_ops,
+  l_librbd_bc_writeback_bytes,
+
+  l_librbd_aio_direct,
+  l_librbd_aio_queued,
+
   l_librbd_last,
 };
 
@@ -137,20 +137,11 @@ void ImageRequestWQ::aio_read(AioCompletion *c, uint64_t off, uint64_t len,
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-
-  // if journaling is enabled -- we need to replay the journal because
-  // it might contain an uncommitted write
-  bool lock_required;
-  {
-    RWLock::RLocker locker(m_lock);
-    lock_required = m_require_lock_on_read;
-  }
-
-  if (m_image_ctx.non_blocking_aio || writes_blocked() || !writes_empty() ||
-      lock_required) {
+  if (!start_direct_dispatch(AIO_TYPE_READ)) {
     queue(new ImageReadRequest<>(m_image_ctx, c, {{off, len}},
                                  std::move(read_result), op_flags));
   } else {
+    m_image_ctx.perfcounter->inc(l_librbd_aio_direct);
     c->start_op();
     ImageRequest<>::aio_read(&m_image_ctx, c, {{off, len}},
                              std::move(read_result), op_flags);
@@ -176,13 +167,15 @@ void ImageRequestWQ::aio_write(AioCompletion *c, uint64_t off, uint64_t len,
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-  if (m_image_ctx.non_blocking_aio || writes_blocked()) {
+  if (!start_direct_dispatch(AIO_TYPE_WRITE)) {
     queue(new ImageWriteRequest<>(m_image_ctx, c, {{off, len}},
                                   std::move(bl), op_flags));
   } else {
+    m_image_ctx.perfcounter->inc(l_librbd_aio_direct);
     c->start_op();
     ImageRequest<>::aio_write(&m_image_ctx, c, {{off, len}},
                               std::move(bl), op_flags);
+    finish_in_progress_write();
     finish_in_flight_op();
   }
 }
@@ -205,11 +198,13 @@ void ImageRequestWQ::aio_discard(AioCompletion *c, uint64_t off,
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-  if (m_image_ctx.non_blocking_aio || writes_blocked()) {
+  if (!start_direct_dispatch(AIO_TYPE_DISCARD)) {
     queue(new ImageDiscardRequest<>(m_image_ctx, c, off, len, skip_partial_discard));
   } else {
+    m_image_ctx.perfcounter->inc(l_librbd_aio_direct);
     c->start_op();
     ImageRequest<>::aio_discard(&m_image_ctx, c, off, len, skip_partial_discard);
+    finish_in_progress_write();
     finish_in_flight_op();
   }
 }
@@ -229,9 +224,10 @@ void ImageRequestWQ::aio_flush(AioCompletion *c, bool native_async) {
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-  if (m_image_ctx.non_blocking_aio || writes_blocked() || !writes_empty()) {
+  if (!start_direct_dispatch(AIO_TYPE_FLUSH)) {
     queue(new ImageFlushRequest<>(m_image_ctx, c));
   } else {
+    m_image_ctx.perfcounter->inc(l_librbd_aio_direct);
     ImageRequest<>::aio_flush(&m_image_ctx, c);
     finish_in_flight_op();
   }
@@ -256,13 +252,15 @@ void ImageRequestWQ::aio_writesame(AioCompletion *c, uint64_t off, uint64_t len,
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-  if (m_image_ctx.non_blocking_aio || writes_blocked()) {
+  if (!start_direct_dispatch(AIO_TYPE_WRITESAME)) {
     queue(new ImageWriteSameRequest<>(m_image_ctx, c, off, len, std::move(bl),
                                       op_flags));
   } else {
+    m_image_ctx.perfcounter->inc(l_librbd_aio_direct);
     c->start_op();
     ImageRequest<>::aio_writesame(&m_image_ctx, c, off, len, std::move(bl),
                                   op_flags);
+    finish_in_progress_write();
     finish_in_flight_op();
   }
 }
@@ -484,6 +482,55 @@ void ImageRequestWQ::finish_in_flight_op() {
   m_image_ctx.flush(on_shutdown);
 }
 
+bool ImageRequestWQ::start_direct_dispatch(aio_type_t aio_type) {
+  assert(m_image_ctx.owner_lock.is_locked());
+  bool write_op = (aio_type != AIO_TYPE_READ && aio_type != AIO_TYPE_FLUSH);
+  if (m_image_ctx.direct_dispatch) {
+    // the op thread refreshes the image before it processes the request
+    if (m_image_ctx.state->is_refresh_required()) {
+      return false;
+    }
+
+    // writes to the object cacher may wait for dirty data to be written back
+    if (write_op && m_image_ctx.object_cacher != nullptr) {
+      return false;
+    }
+  } else if (m_image_ctx.non_blocking_aio) {
+    return false;
+  }
+
+  RWLock::RLocker locker(m_lock);
+  if (m_write_blockers > 0) {
+    // exclusive lock transition or blocking op in progress
+    return false;
+  }
+  if (m_image_ctx.direct_dispatch &&
+      (m_queued_writes > 0 || m_queued_reads > 0)) {
+    // don't overtake requests waiting in the queue
+    return false;
+  }
+
+  switch (aio_type) {
+  case AIO_TYPE_READ:
+    // if journaling is enabled -- we need to replay the journal because
+    // it might contain an uncommitted write
+    if (m_queued_writes > 0 || m_require_lock_on_read) {
+      return false;
+    }
+    break;
+  case AIO_TYPE_FLUSH:
+    if (m_queued_writes > 0) {
+      return false;
+    }
+    break;
+  default:
+    // block_writes() waits for the write to be sent
+    m_in_progress_writes++;
+    break;
+  }
+  return true;
+}
+
 bool ImageRequestWQ::is_lock_required() const {
   assert(m_image_ctx.owner_lock.is_locked());
   if (m_image_ctx.exclusive_lock == NULL) {
@@ -517,6 +564,7 @@ void ImageRequestWQ::queue(ImageRequest<> *req) {
   } else {
     m_queued_reads++;
   }
+  m_image_ctx.perfcounter->inc(l_librbd_aio_queued);
 
   ThreadPool::PointerWQ<ImageRequest<> >::queue(req);
 
@@ -7,6 +7,7 @@
 #include "include/Context.h"
 #include "common/RWLock.h"
 #include "common/WorkQueue.h"
+#include "librbd/io/Types.h"
 
 #include <list>
 #include <atomic>
@@ -120,6 +121,7 @@ private:
   int start_in_flight_op(AioCompletion *c);
   void finish_in_flight_op();
 
+  bool start_direct_dispatch(aio_type_t aio_type);
   void queue(ImageRequest<ImageCtx> *req);
 
   void handle_refreshed(int r, ImageRequest<ImageCtx> *req);
@@ -222,6 +222,9 @@ bool ObjectReadRequest<I>::should_complete(int r)
 
         if (object_overlap > 0) {
           m_tried_parent = true;
+          if (this->m_snap_id == CEPH_NOSNAP) {
+            image_ctx->record_parent_read(this->m_object_no);
+          }
           if (is_copy_on_read(image_ctx, this->m_snap_id)) {
             m_state = LIBRBD_AIO_READ_COPYUP;
           }
@@ -376,6 +379,12 @@ bool AbstractObjectWriteRequest::should_complete(int r)
 
   bool finished = true;
   switch (m_state) {
+  case LIBRBD_AIO_WRITE_EXTENTS:
+    ldout(m_ictx->cct, 20) << "WRITE_EXTENTS" << dendl;
+    send_write();
+    finished = false;
+    break;
+
   case LIBRBD_AIO_WRITE_PRE:
     ldout(m_ictx->cct, 20) << "WRITE_PRE" << dendl;
     if (r < 0) {
@@ -450,6 +459,14 @@ void AbstractObjectWriteRequest::send() {
       // should have been flushed prior to releasing lock
       assert(m_ictx->exclusive_lock->is_lock_owner());
       m_object_exist = m_ictx->object_map->object_may_exist(m_object_no);
+
+      // record the written chunks before touching the object
+      RWLock::WLocker object_map_locker(m_ictx->object_map_lock);
+      m_state = LIBRBD_AIO_WRITE_EXTENTS;
+      if (m_ictx->object_map->aio_update_extents<ObjectRequest>(
+            m_object_no, m_object_off, m_object_len, this)) {
+        return;
+      }
     }
   }
 
@@ -223,6 +223,9 @@ public:
    *
    *   <start>
    *      |
+   *      v
+   * LIBRBD_AIO_WRITE_EXTENTS
+   *      |
    *      |\
    *      | \       -or-
    *      |  ---------------------------------> LIBRBD_AIO_WRITE_PRE
@@ -250,11 +253,14 @@ public:
    *  . . . . . . . . . . . . . . > <finish> < . . . . . . . . . . . . . .
    *
    * The _PRE/_POST states are skipped if the object map is disabled.
+   * The _EXTENTS state is skipped unless the extent map is enabled and
+   * the written chunks were not already recorded since the last snapshot.
    * The write starts in _WRITE_GUARD or _FLAT depending on whether or not
    * there is a parent overlap.
    */
 protected:
   enum write_state_d {
+    LIBRBD_AIO_WRITE_EXTENTS,
     LIBRBD_AIO_WRITE_GUARD,
     LIBRBD_AIO_WRITE_COPYUP,
     LIBRBD_AIO_WRITE_FLAT,
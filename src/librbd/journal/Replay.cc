@@ -175,6 +175,8 @@ Replay<I>::~Replay() {
   assert(m_aio_modify_safe_contexts.empty());
   assert(m_op_events.empty());
   assert(m_in_flight_op_events == 0);
+  assert(m_in_flight_extents.empty());
+  assert(m_on_blocked_ready == nullptr);
 }
 
 template <typename I>
@@ -196,11 +198,103 @@ void Replay<I>::process(const EventEntry &event_entry,
 
   on_ready = util::create_async_context_callback(m_image_ctx, on_ready);
 
+  {
+    Mutex::Locker locker(m_lock);
+    if (is_event_blocked(event_entry)) {
+      // on_ready is held as well, so at most one event is ever blocked
+      ldout(cct, 20) << ": waiting for overlapping in-flight IO" << dendl;
+      assert(m_on_blocked_ready == nullptr);
+      m_blocked_event_entry = event_entry;
+      m_on_blocked_ready = on_ready;
+      m_on_blocked_safe = on_safe;
+      return;
+    }
+  }
+
   RWLock::RLocker owner_lock(m_image_ctx.owner_lock);
   boost::apply_visitor(EventVisitor(this, on_ready, on_safe),
                        event_entry.event);
 }
 
+template <typename I>
+bool Replay<I>::is_event_blocked(const EventEntry &event_entry) const {
+  assert(m_lock.is_locked());
+  if (m_in_flight_extents.empty()) {
+    return false;
+  }
+
+  switch (event_entry.get_event_type()) {
+  case EVENT_TYPE_AIO_FLUSH:
+    // flushes cover all previously dispatched IO
+    return false;
+  case EVENT_TYPE_AIO_DISCARD:
+    {
+      auto &event = boost::get<AioDiscardEvent>(event_entry.event);
+      return (event.length > 0 &&
+              m_in_flight_extents.intersects(event.offset, event.length));
+    }
+  case EVENT_TYPE_AIO_WRITE:
+    {
+      auto &event = boost::get<AioWriteEvent>(event_entry.event);
+      return (event.length > 0 &&
+              m_in_flight_extents.intersects(event.offset, event.length));
+    }
+  case EVENT_TYPE_AIO_WRITESAME:
+    {
+      auto &event = boost::get<AioWriteSameEvent>(event_entry.event);
+      return (event.length > 0 &&
+              m_in_flight_extents.intersects(event.offset, event.length));
+    }
+  default:
+    // ops expect all prior IO to be complete
+    return true;
+  }
+}
+
+template <typename I>
+void Replay<I>::handle_blocked_event() {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  EventEntry event_entry;
+  Context *on_ready;
+  Context *on_safe;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_on_blocked_ready != nullptr && m_blocked_event_queued);
+    event_entry = m_blocked_event_entry;
+    on_ready = m_on_blocked_ready;
+    on_safe = m_on_blocked_safe;
+  }
+
+  // the blocked state is only cleared once the event is dispatched so
+  // that a concurrent shut down keeps waiting for it
+  {
+    RWLock::RLocker owner_lock(m_image_ctx.owner_lock);
+    boost::apply_visitor(EventVisitor(this, on_ready, on_safe),
+                         event_entry.event);
+  }
+
+  io::AioCompletion *flush_comp = nullptr;
+  {
+    Mutex::Locker locker(m_lock);
+    m_blocked_event_entry = EventEntry();
+    m_on_blocked_ready = nullptr;
+    m_on_blocked_safe = nullptr;
+    m_blocked_event_queued = false;
+
+    if (m_flush_ctx != nullptr) {
+      // shut down raced with the blocked event
+      flush_comp = create_aio_flush_completion(nullptr);
+    }
+  }
+
+  if (flush_comp != nullptr) {
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    io::ImageRequest<I>::aio_flush(&m_image_ctx, flush_comp);
+  }
+}
+
 template <typename I>
 void Replay<I>::shut_down(bool cancel_ops, Context *on_finish) {
   CephContext *cct = m_image_ctx.cct;
@@ -315,8 +409,9 @@ void Replay<I>::handle_event(const journal::AioDiscardEvent &event,
   ldout(cct, 20) << ": AIO discard event" << dendl;
 
   bool flush_required;
-  auto aio_comp = create_aio_modify_completion(on_ready, on_safe,
+  auto aio_comp = create_aio_modify_completion(&on_ready, on_safe,
                                                io::AIO_TYPE_DISCARD,
+                                               event.offset, event.length,
                                                &flush_required);
   io::ImageRequest<I>::aio_discard(&m_image_ctx, aio_comp, event.offset,
                                    event.length, event.skip_partial_discard);
@@ -327,6 +422,10 @@ void Replay<I>::handle_event(const journal::AioDiscardEvent &event,
 
     io::ImageRequest<I>::aio_flush(&m_image_ctx, flush_comp);
   }
+
+  if (on_ready != nullptr) {
+    on_ready->complete(0);
+  }
 }
 
 template <typename I>
@@ -337,8 +436,9 @@ void Replay<I>::handle_event(const journal::AioWriteEvent &event,
 
   bufferlist data = event.data;
   bool flush_required;
-  auto aio_comp = create_aio_modify_completion(on_ready, on_safe,
+  auto aio_comp = create_aio_modify_completion(&on_ready, on_safe,
                                                io::AIO_TYPE_WRITE,
+                                               event.offset, event.length,
                                                &flush_required);
   io::ImageRequest<I>::aio_write(&m_image_ctx, aio_comp,
                                  {{event.offset, event.length}},
@@ -350,6 +450,10 @@ void Replay<I>::handle_event(const journal::AioWriteEvent &event,
 
     io::ImageRequest<I>::aio_flush(&m_image_ctx, flush_comp);
   }
+
+  if (on_ready != nullptr) {
+    on_ready->complete(0);
+  }
 }
 
 template <typename I>
@@ -376,8 +480,9 @@ void Replay<I>::handle_event(const journal::AioWriteSameEvent &event,
 
   bufferlist data = event.data;
   bool flush_required;
-  auto aio_comp = create_aio_modify_completion(on_ready, on_safe,
+  auto aio_comp = create_aio_modify_completion(&on_ready, on_safe,
                                                io::AIO_TYPE_WRITESAME,
+                                               event.offset, event.length,
                                                &flush_required);
   io::ImageRequest<I>::aio_writesame(&m_image_ctx, aio_comp, event.offset,
                                      event.length, std::move(data), 0);
@@ -388,6 +493,10 @@ void Replay<I>::handle_event(const journal::AioWriteSameEvent &event,
 
     io::ImageRequest<I>::aio_flush(&m_image_ctx, flush_comp);
   }
+
+  if (on_ready != nullptr) {
+    on_ready->complete(0);
+  }
 }
 
 template <typename I>
@@ -780,16 +889,24 @@ void Replay<I>::handle_event(const journal::UnknownEvent &event,
 }
 
 template <typename I>
-void Replay<I>::handle_aio_modify_complete(Context *on_ready, Context *on_safe,
-                                           int r) {
+void Replay<I>::handle_aio_modify_complete(Context *on_safe, uint64_t offset,
+                                           uint64_t length, int r) {
   Mutex::Locker locker(m_lock);
   CephContext *cct = m_image_ctx.cct;
-  ldout(cct, 20) << ": on_ready=" << on_ready << ", "
-                 << "on_safe=" << on_safe << ", r=" << r << dendl;
+  ldout(cct, 20) << ": on_safe=" << on_safe << ", r=" << r << dendl;
 
-  if (on_ready != nullptr) {
-    on_ready->complete(0);
+  if (length > 0) {
+    m_in_flight_extents.erase(offset, length);
   }
+  if (m_on_blocked_ready != nullptr && !m_blocked_event_queued &&
+      !is_event_blocked(m_blocked_event_entry)) {
+    ldout(cct, 20) << ": resuming blocked event" << dendl;
+    m_blocked_event_queued = true;
+    m_image_ctx.op_work_queue->queue(new FunctionContext([this](int r) {
+        handle_blocked_event();
+      }), 0);
+  }
+
   if (r < 0) {
     lderr(cct) << ": AIO modify op failed: " << cpp_strerror(r) << dendl;
     on_safe->complete(r);
@@ -821,7 +938,8 @@ void Replay<I>::handle_aio_flush_complete(Context *on_flush_safe,
 
     std::swap(on_aio_ready, m_on_aio_ready);
     if (m_in_flight_op_events == 0 &&
-        (m_in_flight_aio_flush + m_in_flight_aio_modify) == 0) {
+        (m_in_flight_aio_flush + m_in_flight_aio_modify) == 0 &&
+        m_on_blocked_ready == nullptr) {
       on_flush = m_flush_ctx;
     }
 
@@ -939,7 +1057,8 @@ void Replay<I>::handle_op_complete(uint64_t op_tid, int r) {
     assert(m_in_flight_op_events > 0);
     --m_in_flight_op_events;
     if (m_in_flight_op_events == 0 &&
-        (m_in_flight_aio_flush + m_in_flight_aio_modify) == 0) {
+        (m_in_flight_aio_flush + m_in_flight_aio_modify) == 0 &&
+        m_on_blocked_ready == nullptr) {
       on_flush = m_flush_ctx;
     }
   }
@@ -950,8 +1069,9 @@ void Replay<I>::handle_op_complete(uint64_t op_tid, int r) {
 
 template <typename I>
 io::AioCompletion *
-Replay<I>::create_aio_modify_completion(Context *on_ready, Context *on_safe,
+Replay<I>::create_aio_modify_completion(Context **on_ready, Context *on_safe,
                                         io::aio_type_t aio_type,
+                                        uint64_t offset, uint64_t length,
                                         bool *flush_required) {
   Mutex::Locker locker(m_lock);
   CephContext *cct = m_image_ctx.cct;
@@ -980,14 +1100,18 @@ Replay<I>::create_aio_modify_completion(Context *on_ready, Context *on_safe,
     ldout(cct, 10) << ": hit AIO replay high-water mark: pausing replay"
                    << dendl;
     assert(m_on_aio_ready == nullptr);
-    std::swap(m_on_aio_ready, on_ready);
+    std::swap(m_on_aio_ready, *on_ready);
   }
 
-  // when the modification is ACKed by librbd, we can process the next
-  // event. when flushed, the completion of the next flush will fire the
-  // on_safe callback
+  // the caller can process the next event as soon as this op is
+  // dispatched: events overlapping the op are held back until it is
+  // ACKed by librbd (see is_event_blocked).  when flushed, the completion
+  // of the next flush will fire the on_safe callback
+  if (length > 0) {
+    m_in_flight_extents.insert(offset, length);
+  }
   auto aio_comp = io::AioCompletion::create_and_start<Context>(
-    new C_AioModifyComplete(this, on_ready, on_safe),
+    new C_AioModifyComplete(this, on_safe, offset, length),
     util::get_image_ctx(&m_image_ctx), aio_type);
   return aio_comp;
 }
@@ -7,6 +7,7 @@
 #include "include/int_types.h"
 #include "include/buffer_fwd.h"
 #include "include/Context.h"
+#include "include/interval_set.h"
 #include "common/Mutex.h"
 #include "librbd/io/Types.h"
 #include "librbd/journal/Types.h"
@@ -75,13 +76,15 @@ private:
 
   struct C_AioModifyComplete : public Context {
     Replay *replay;
-    Context *on_ready;
     Context *on_safe;
-    C_AioModifyComplete(Replay *replay, Context *on_ready, Context *on_safe)
-      : replay(replay), on_ready(on_ready), on_safe(on_safe) {
+    uint64_t offset;
+    uint64_t length;
+    C_AioModifyComplete(Replay *replay, Context *on_safe, uint64_t offset,
+                        uint64_t length)
+      : replay(replay), on_safe(on_safe), offset(offset), length(length) {
     }
     void finish(int r) override {
-      replay->handle_aio_modify_complete(on_ready, on_safe, r);
+      replay->handle_aio_modify_complete(on_safe, offset, length, r);
     }
   };
 
@@ -129,6 +132,18 @@ private:
   Context *m_flush_ctx = nullptr;
   Context *m_on_aio_ready = nullptr;
 
+  // extents of the dispatched but not yet acked AIO modify ops.  They
+  // never overlap: an event overlapping one of them (or any non-IO event)
+  // is held back until the earlier ops are acked
+  interval_set<uint64_t> m_in_flight_extents;
+  EventEntry m_blocked_event_entry;
+  Context *m_on_blocked_ready = nullptr;
+  Context *m_on_blocked_safe = nullptr;
+  bool m_blocked_event_queued = false;
+
+  bool is_event_blocked(const EventEntry &event_entry) const;
+  void handle_blocked_event();
+
   void handle_event(const AioDiscardEvent &event, Context *on_ready,
                     Context *on_safe);
   void handle_event(const AioWriteEvent &event, Context *on_ready,
@@ -170,7 +185,8 @@ private:
   void handle_event(const UnknownEvent &event, Context *on_ready,
                     Context *on_safe);
 
-  void handle_aio_modify_complete(Context *on_ready, Context *on_safe, int r);
+  void handle_aio_modify_complete(Context *on_safe, uint64_t offset,
+                                  uint64_t length, int r);
   void handle_aio_flush_complete(Context *on_flush_safe, Contexts &on_safe_ctxs,
                                  int r);
 
@@ -178,9 +194,11 @@ private:
                                       Context *on_safe, OpEvent **op_event);
   void handle_op_complete(uint64_t op_tid, int r);
 
-  io::AioCompletion *create_aio_modify_completion(Context *on_ready,
+  io::AioCompletion *create_aio_modify_completion(Context **on_ready,
                                                   Context *on_safe,
                                                   io::aio_type_t aio_type,
+                                                  uint64_t offset,
+                                                  uint64_t length,
                                                   bool *flush_required);
   io::AioCompletion *create_aio_flush_completion(Context *on_safe);
   void handle_aio_completion(io::AioCompletion *aio_comp);
@@ -39,10 +39,12 @@ AcquireRequest<I>* AcquireRequest<I>::create(librados::IoCtx& ioctx,
                                              bool exclusive,
 					     bool blacklist_on_break_lock,
 					     uint32_t blacklist_expire_seconds,
+                                             Locker *broken_locker,
                                              Context *on_finish) {
     return new AcquireRequest(ioctx, watcher, work_queue, oid, cookie,
                               exclusive, blacklist_on_break_lock,
-                              blacklist_expire_seconds, on_finish);
+                              blacklist_expire_seconds, broken_locker,
+                              on_finish);
 }
 
 template <typename I>
@@ -51,6 +53,7 @@ AcquireRequest<I>::AcquireRequest(librados::IoCtx& ioctx, Watcher *watcher,
                                   const string& cookie, bool exclusive,
                                   bool blacklist_on_break_lock,
                                   uint32_t blacklist_expire_seconds,
+                                  Locker *broken_locker,
                                   Context *on_finish)
   : m_ioctx(ioctx), m_watcher(watcher),
     m_cct(reinterpret_cast<CephContext *>(m_ioctx.cct())),
@@ -58,6 +61,7 @@ AcquireRequest<I>::AcquireRequest(librados::IoCtx& ioctx, Watcher *watcher,
     m_exclusive(exclusive),
     m_blacklist_on_break_lock(blacklist_on_break_lock),
     m_blacklist_expire_seconds(blacklist_expire_seconds),
+    m_broken_locker(broken_locker),
     m_on_finish(new C_AsyncCallback<ContextWQ>(work_queue, on_finish)) {
 }
 
@@ -67,6 +71,9 @@ AcquireRequest<I>::~AcquireRequest() {
 
 template <typename I>
 void AcquireRequest<I>::send() {
+  if (m_broken_locker != nullptr) {
+    *m_broken_locker = {};
+  }
   send_get_locker();
 }
 
@@ -165,6 +172,9 @@ void AcquireRequest<I>::handle_break_lock(int r) {
     return;
   }
 
+  if (m_broken_locker != nullptr) {
+    *m_broken_locker = m_locker;
+  }
   send_get_locker();
 }
 
@@ -34,7 +34,7 @@ public:
                                 bool exclusive,
                                 bool blacklist_on_break_lock,
                                 uint32_t blacklist_expire_seconds,
-                                Context *on_finish);
+                                Locker *broken_locker, Context *on_finish);
 
   ~AcquireRequest();
   void send();
@@ -64,7 +64,8 @@ private:
                  ContextWQ *work_queue, const std::string& oid,
                  const std::string& cookie, bool exclusive,
                  bool blacklist_on_break_lock,
-                 uint32_t blacklist_expire_seconds, Context *on_finish);
+                 uint32_t blacklist_expire_seconds, Locker *broken_locker,
+                 Context *on_finish);
 
   librados::IoCtx& m_ioctx;
   Watcher *m_watcher;
@@ -75,6 +76,7 @@ private:
   bool m_exclusive;
   bool m_blacklist_on_break_lock;
   uint32_t m_blacklist_expire_seconds;
+  Locker *m_broken_locker;
   Context *m_on_finish;
 
   bufferlist m_out_bl;
@@ -0,0 +1,628 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "librbd/object_map/ExtentMap.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/WorkQueue.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "cls/rbd/cls_rbd_types.h"
+#include "include/rbd/object_map_types.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include "librbd/object_map/ResizeRequest.h"
+#include "osdc/Striper.h"
+#include <sstream>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::object_map::ExtentMap: " << this << " " \
+                           << __func__ << ": "
+
+namespace librbd {
+namespace object_map {
+
+namespace {
+
+const uint64_t MAX_CHUNKS_PER_OBJECT = 64;
+const uint64_t MIN_CHUNK_SIZE = 4096;
+
+} // anonymous namespace
+
+using util::create_rados_callback;
+
+template <typename I>
+std::string ExtentMap<I>::extent_map_name(const std::string &image_id,
+                                          uint64_t snap_id) {
+  std::string oid(RBD_EXTENT_MAP_PREFIX + image_id);
+  if (snap_id != CEPH_NOSNAP) {
+    std::stringstream snap_suffix;
+    snap_suffix << "." << std::setfill('0') << std::setw(16) << std::hex
+		<< snap_id;
+    oid += snap_suffix.str();
+  }
+  return oid;
+}
+
+template <typename I>
+uint64_t ExtentMap<I>::get_chunk_size(uint64_t object_size) {
+  return std::max(object_size / MAX_CHUNKS_PER_OBJECT, MIN_CHUNK_SIZE);
+}
+
+template <typename I>
+uint64_t ExtentMap<I>::get_chunk_count(const file_layout_t &layout,
+                                       uint64_t size) {
+  uint64_t chunks_per_object = std::max<uint64_t>(
+    layout.object_size / get_chunk_size(layout.object_size), 1);
+  return Striper::get_num_objects(layout, size) * chunks_per_object;
+}
+
+template <typename I>
+bool ExtentMap<I>::is_compatible(const file_layout_t &layout, uint64_t size) {
+  return (get_chunk_count(layout, size) <=
+            cls::rbd::MAX_OBJECT_MAP_OBJECT_COUNT);
+}
+
+template <typename I>
+ExtentMap<I>::ExtentMap(I &image_ctx)
+  : m_image_ctx(image_ctx),
+    m_chunk_size(get_chunk_size(image_ctx.layout.object_size)),
+    m_chunks_per_object(std::max<uint64_t>(
+      image_ctx.layout.object_size / m_chunk_size, 1)) {
+}
+
+template <typename I>
+void ExtentMap<I>::open(Context *on_finish) {
+  uint64_t chunk_count;
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    chunk_count = get_chunk_count(m_image_ctx.layout,
+                                  m_image_ctx.get_image_size(CEPH_NOSNAP));
+  }
+
+  std::string oid(extent_map_name(m_image_ctx.id, CEPH_NOSNAP));
+  ldout(m_image_ctx.cct, 10) << "oid=" << oid << ", "
+                             << "chunk_count=" << chunk_count << dendl;
+
+  librados::ObjectReadOperation op;
+  cls_client::object_map_load_start(&op);
+
+  bufferlist *out_bl = new bufferlist();
+  Context *ctx = new FunctionContext(
+    [this, out_bl, chunk_count, on_finish](int r) {
+      handle_load(out_bl, chunk_count, r, on_finish);
+    });
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op, out_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::handle_load(bufferlist *out_bl, uint64_t chunk_count,
+                               int r, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "r=" << r << dendl;
+
+  ceph::BitVector<2> extent_map;
+  if (r == 0) {
+    bufferlist::iterator bl_it = out_bl->begin();
+    r = cls_client::object_map_load_finish(&bl_it, &extent_map);
+  }
+  delete out_bl;
+
+  if (r == 0 && extent_map.size() < chunk_count) {
+    lderr(cct) << "extent map smaller than current image size: "
+               << extent_map.size() << " < " << chunk_count << dendl;
+    r = -EINVAL;
+  }
+
+  if (r == 0) {
+    RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+    m_extent_map = extent_map;
+    ResizeRequest::resize(&m_extent_map, chunk_count, EXTENT_CHANGED);
+    on_finish->complete(0);
+    return;
+  }
+
+  lderr(cct) << "failed to load extent map: " << cpp_strerror(r) << dendl;
+  {
+    RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+    m_extent_map.clear();
+    ResizeRequest::resize(&m_extent_map, chunk_count, EXTENT_UNCHANGED);
+  }
+
+  // flag the map before starting over with an empty one -- the chunks
+  // written until the next snapshot are tracked again from here on
+  std::string oid(extent_map_name(m_image_ctx.id, CEPH_NOSNAP));
+  Context *ctx = new FunctionContext(
+    [this, cct, oid, chunk_count, on_finish](int r) {
+      librados::ObjectWriteOperation op;
+      op.truncate(0);
+      cls_client::object_map_resize(&op, chunk_count, EXTENT_UNCHANGED);
+
+      Context *ctx = new FunctionContext([this, cct, on_finish](int r) {
+          if (r < 0) {
+            lderr(cct) << "failed to reset extent map: " << cpp_strerror(r)
+                       << dendl;
+          }
+          on_finish->complete(0);
+        });
+      librados::AioCompletion *comp = create_rados_callback(ctx);
+      r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op);
+      assert(r == 0);
+      comp->release();
+    });
+  invalidate(CEPH_NOSNAP, ctx);
+}
+
+template <typename I>
+void ExtentMap<I>::get_chunk_range(uint64_t object_no, uint64_t object_off,
+                                   uint64_t object_len,
+                                   uint64_t *start_chunk_no,
+                                   uint64_t *end_chunk_no) {
+  // a zero length covers the rest of the object (remove, truncate)
+  uint64_t object_size = m_image_ctx.layout.object_size;
+  uint64_t object_end = object_size;
+  if (object_len != 0) {
+    object_end = std::min(object_off + object_len, object_size);
+  }
+  object_off = std::min(object_off, object_end);
+
+  *start_chunk_no = object_no * m_chunks_per_object +
+                    object_off / m_chunk_size;
+  *end_chunk_no = object_no * m_chunks_per_object +
+                  (object_end + m_chunk_size - 1) / m_chunk_size;
+}
+
+template <typename I>
+bool ExtentMap<I>::update_required(uint64_t object_no, uint64_t object_off,
+                                   uint64_t object_len) {
+  assert(m_image_ctx.object_map_lock.is_locked());
+
+  uint64_t start_chunk_no;
+  uint64_t end_chunk_no;
+  get_chunk_range(object_no, object_off, object_len, &start_chunk_no,
+                  &end_chunk_no);
+  if (start_chunk_no >= end_chunk_no ||
+      end_chunk_no > m_extent_map.size()) {
+    return false;
+  }
+
+  for (uint64_t chunk_no = start_chunk_no; chunk_no < end_chunk_no;
+       ++chunk_no) {
+    if (m_extent_map[chunk_no] != EXTENT_CHANGED) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename I>
+void ExtentMap<I>::aio_update(uint64_t object_no, uint64_t object_off,
+                              uint64_t object_len, Context *on_finish) {
+  assert(m_image_ctx.snap_lock.is_locked());
+  assert(m_image_ctx.object_map_lock.is_wlocked());
+
+  uint64_t start_chunk_no;
+  uint64_t end_chunk_no;
+  get_chunk_range(object_no, object_off, object_len, &start_chunk_no,
+                  &end_chunk_no);
+
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "start=" << start_chunk_no << ", "
+                 << "end=" << end_chunk_no << dendl;
+
+  // unlike the object map, the chunk states are only ever set to changed
+  // between two snapshots: updates can overlap without ordering them
+  librados::ObjectWriteOperation op;
+  cls_client::object_map_update(&op, start_chunk_no, end_chunk_no,
+                                EXTENT_CHANGED, boost::none);
+
+  Context *ctx = new FunctionContext(
+    [this, cct, start_chunk_no, end_chunk_no, on_finish](int r) {
+      if (r < 0) {
+        lderr(cct) << "failed to update extent map: " << cpp_strerror(r)
+                   << dendl;
+      }
+
+      {
+        RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+        RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+        uint64_t end = std::min<uint64_t>(end_chunk_no, m_extent_map.size());
+        for (uint64_t chunk_no = start_chunk_no; chunk_no < end; ++chunk_no) {
+          m_extent_map[chunk_no] = EXTENT_CHANGED;
+        }
+      }
+
+      if (r < 0) {
+        invalidate(CEPH_NOSNAP, on_finish);
+        return;
+      }
+      on_finish->complete(0);
+    });
+
+  std::string oid(extent_map_name(m_image_ctx.id, CEPH_NOSNAP));
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::aio_resize(uint64_t new_size, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+
+  uint64_t chunk_count = get_chunk_count(m_image_ctx.layout, new_size);
+  uint64_t orig_chunk_count;
+  {
+    RWLock::RLocker object_map_locker(m_image_ctx.object_map_lock);
+    orig_chunk_count = m_extent_map.size();
+  }
+  ldout(cct, 10) << "orig_chunk_count=" << orig_chunk_count << ", "
+                 << "chunk_count=" << chunk_count << dendl;
+
+  // objects past the end of the image may come back with a later resize:
+  // new chunks are always considered changed since the last snapshot
+  librados::ObjectWriteOperation op;
+  if (chunk_count < orig_chunk_count) {
+    cls_client::object_map_update(&op, chunk_count, orig_chunk_count,
+                                  EXTENT_CHANGED, boost::none);
+  }
+  cls_client::object_map_resize(&op, chunk_count, EXTENT_CHANGED);
+
+  Context *ctx = new FunctionContext(
+    [this, cct, chunk_count, on_finish](int r) {
+      if (r < 0) {
+        lderr(cct) << "failed to resize extent map: " << cpp_strerror(r)
+                   << dendl;
+      }
+
+      {
+        RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+        RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+        ResizeRequest::resize(&m_extent_map, chunk_count, EXTENT_CHANGED);
+      }
+
+      if (r < 0) {
+        invalidate(CEPH_NOSNAP, on_finish);
+        return;
+      }
+      on_finish->complete(0);
+    });
+
+  std::string oid(extent_map_name(m_image_ctx.id, CEPH_NOSNAP));
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::snapshot_add(uint64_t snap_id, Context *on_finish) {
+  assert(snap_id != CEPH_NOSNAP);
+
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "snap_id=" << snap_id << dendl;
+
+  // IO is blocked while creating a snapshot: copy the on-disk HEAD map
+  // as-is to the snapshot before resetting it
+  std::string oid(extent_map_name(m_image_ctx.id, CEPH_NOSNAP));
+  std::string snap_oid(extent_map_name(m_image_ctx.id, snap_id));
+
+  auto reset_ctx = new FunctionContext([this, cct, oid, on_finish](int r) {
+      librados::ObjectWriteOperation op;
+      cls_client::object_map_snap_add(&op);
+
+      Context *ctx = new FunctionContext([this, cct, on_finish](int r) {
+          if (r < 0) {
+            lderr(cct) << "failed to reset extent map: " << cpp_strerror(r)
+                       << dendl;
+            invalidate(CEPH_NOSNAP, on_finish);
+            return;
+          }
+
+          bool invalid;
+          {
+            RWLock::WLocker snap_locker(m_image_ctx.snap_lock);
+            RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+            for (uint64_t chunk_no = 0; chunk_no < m_extent_map.size();
+                 ++chunk_no) {
+              if (m_extent_map[chunk_no] == EXTENT_CHANGED) {
+                m_extent_map[chunk_no] = EXTENT_UNCHANGED;
+              }
+            }
+
+            uint64_t flags = 0;
+            m_image_ctx.get_flags(CEPH_NOSNAP, &flags);
+            invalid = ((flags & RBD_FLAG_EXTENT_MAP_INVALID) != 0);
+            if (invalid) {
+              m_image_ctx.update_flags(CEPH_NOSNAP,
+                                       RBD_FLAG_EXTENT_MAP_INVALID, false);
+            }
+          }
+
+          if (!invalid) {
+            on_finish->complete(0);
+            return;
+          }
+
+          // everything written from now on is tracked again
+          ldout(cct, 5) << "clearing invalid extent map flag" << dendl;
+          librados::ObjectWriteOperation op;
+          cls_client::set_flags(&op, CEPH_NOSNAP, 0,
+                                RBD_FLAG_EXTENT_MAP_INVALID);
+
+          Context *ctx = new FunctionContext([this, cct, on_finish](int r) {
+              if (r < 0) {
+                lderr(cct) << "failed to clear invalid extent map flag: "
+                           << cpp_strerror(r) << dendl;
+              }
+              on_finish->complete(0);
+            });
+          librados::AioCompletion *comp = create_rados_callback(ctx);
+          r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid, comp,
+                                             &op);
+          assert(r == 0);
+          comp->release();
+        });
+
+      librados::AioCompletion *comp = create_rados_callback(ctx);
+      r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op);
+      assert(r == 0);
+      comp->release();
+    });
+
+  bufferlist *read_bl = new bufferlist();
+  auto copy_ctx = new FunctionContext(
+    [this, cct, snap_oid, read_bl, reset_ctx](int r) {
+      if (r < 0) {
+        // diffs across the snapshot will not find its map
+        lderr(cct) << "failed to read extent map: " << cpp_strerror(r)
+                   << dendl;
+        delete read_bl;
+        reset_ctx->complete(0);
+        return;
+      }
+
+      librados::ObjectWriteOperation op;
+      op.write_full(*read_bl);
+      delete read_bl;
+
+      Context *ctx = new FunctionContext([this, cct, reset_ctx](int r) {
+          if (r < 0) {
+            lderr(cct) << "failed to copy extent map: " << cpp_strerror(r)
+                       << dendl;
+          }
+          reset_ctx->complete(0);
+        });
+      librados::AioCompletion *comp = create_rados_callback(ctx);
+      r = m_image_ctx.md_ctx.aio_operate(snap_oid, comp, &op);
+      assert(r == 0);
+      comp->release();
+    });
+
+  librados::ObjectReadOperation op;
+  op.read(0, 0, nullptr, nullptr);
+
+  librados::AioCompletion *comp = create_rados_callback(copy_ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op, read_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::snapshot_remove(uint64_t snap_id, Context *on_finish) {
+  assert(snap_id != CEPH_NOSNAP);
+
+  CephContext *cct = m_image_ctx.cct;
+
+  uint64_t next_snap_id = CEPH_NOSNAP;
+  bool invalid = true;
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    auto it = m_image_ctx.snap_info.find(snap_id);
+    if (it != m_image_ctx.snap_info.end()) {
+      invalid = ((it->second.flags & RBD_FLAG_EXTENT_MAP_INVALID) != 0);
+      ++it;
+      if (it != m_image_ctx.snap_info.end()) {
+        next_snap_id = it->first;
+      }
+    }
+  }
+  ldout(cct, 10) << "snap_id=" << snap_id << ", "
+                 << "next_snap_id=" << next_snap_id << dendl;
+
+  // the chunks changed up to the removed snapshot have to be merged into
+  // the map of the next one
+  if (invalid) {
+    Context *ctx = new FunctionContext([this, snap_id, on_finish](int r) {
+        send_snapshot_remove_map(snap_id, on_finish);
+      });
+    invalidate(next_snap_id, ctx);
+    return;
+  }
+
+  librados::ObjectReadOperation op;
+  cls_client::object_map_load_start(&op);
+
+  bufferlist *out_bl = new bufferlist();
+  Context *ctx = new FunctionContext(
+    [this, snap_id, next_snap_id, out_bl, on_finish](int r) {
+      handle_snapshot_remove_load(snap_id, next_snap_id, out_bl, r,
+                                  on_finish);
+    });
+  std::string oid(extent_map_name(m_image_ctx.id, snap_id));
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op, out_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::handle_snapshot_remove_load(uint64_t snap_id,
+                                               uint64_t next_snap_id,
+                                               bufferlist *out_bl, int r,
+                                               Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "r=" << r << dendl;
+
+  ceph::BitVector<2> snap_extent_map;
+  if (r == 0) {
+    bufferlist::iterator bl_it = out_bl->begin();
+    r = cls_client::object_map_load_finish(&bl_it, &snap_extent_map);
+  }
+  delete out_bl;
+
+  Context *remove_ctx = new FunctionContext(
+    [this, snap_id, on_finish](int r) {
+      send_snapshot_remove_map(snap_id, on_finish);
+    });
+  if (r < 0) {
+    lderr(cct) << "failed to load extent map: " << cpp_strerror(r) << dendl;
+    invalidate(next_snap_id, remove_ctx);
+    return;
+  }
+
+  librados::ObjectWriteOperation op;
+  cls_client::object_map_snap_remove(&op, snap_extent_map);
+
+  Context *ctx = new FunctionContext(
+    [this, cct, next_snap_id, snap_extent_map, remove_ctx](int r) {
+      if (r < 0) {
+        lderr(cct) << "failed to merge extent map: " << cpp_strerror(r)
+                   << dendl;
+        invalidate(next_snap_id, remove_ctx);
+        return;
+      }
+
+      if (next_snap_id == CEPH_NOSNAP) {
+        RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+        RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+        for (uint64_t chunk_no = 0; chunk_no < m_extent_map.size();
+             ++chunk_no) {
+          if (chunk_no >= snap_extent_map.size() ||
+              snap_extent_map[chunk_no] == EXTENT_CHANGED) {
+            m_extent_map[chunk_no] = EXTENT_CHANGED;
+          }
+        }
+      }
+      remove_ctx->complete(0);
+    });
+
+  std::string oid(extent_map_name(m_image_ctx.id, next_snap_id));
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::send_snapshot_remove_map(uint64_t snap_id,
+                                            Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "snap_id=" << snap_id << dendl;
+
+  Context *ctx = new FunctionContext([this, cct, on_finish](int r) {
+      if (r < 0 && r != -ENOENT) {
+        lderr(cct) << "failed to remove extent map: " << cpp_strerror(r)
+                   << dendl;
+      }
+      on_finish->complete(0);
+    });
+
+  std::string oid(extent_map_name(m_image_ctx.id, snap_id));
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_remove(oid, comp);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::rollback(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+
+  uint64_t chunk_count;
+  {
+    RWLock::RLocker object_map_locker(m_image_ctx.object_map_lock);
+    chunk_count = m_extent_map.size();
+  }
+  ldout(cct, 10) << "chunk_count=" << chunk_count << dendl;
+
+  if (chunk_count == 0) {
+    m_image_ctx.op_work_queue->queue(on_finish, 0);
+    return;
+  }
+
+  // the HEAD content now differs from the previous snapshot anywhere
+  librados::ObjectWriteOperation op;
+  cls_client::object_map_update(&op, 0, chunk_count, EXTENT_CHANGED,
+                                boost::none);
+
+  Context *ctx = new FunctionContext([this, cct, on_finish](int r) {
+      if (r < 0) {
+        lderr(cct) << "failed to update extent map: " << cpp_strerror(r)
+                   << dendl;
+      }
+
+      {
+        RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+        RWLock::WLocker object_map_locker(m_image_ctx.object_map_lock);
+        for (uint64_t chunk_no = 0; chunk_no < m_extent_map.size();
+             ++chunk_no) {
+          m_extent_map[chunk_no] = EXTENT_CHANGED;
+        }
+      }
+
+      if (r < 0) {
+        invalidate(CEPH_NOSNAP, on_finish);
+        return;
+      }
+      on_finish->complete(0);
+    });
+
+  std::string oid(extent_map_name(m_image_ctx.id, CEPH_NOSNAP));
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(oid, comp, &op);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ExtentMap<I>::invalidate(uint64_t snap_id, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+
+  {
+    RWLock::WLocker snap_locker(m_image_ctx.snap_lock);
+    uint64_t flags;
+    int r = m_image_ctx.get_flags(snap_id, &flags);
+    if (r < 0 || (flags & RBD_FLAG_EXTENT_MAP_INVALID) != 0) {
+      m_image_ctx.op_work_queue->queue(on_finish, 0);
+      return;
+    }
+
+    lderr(cct) << "invalidating extent map: snap_id=" << snap_id << dendl;
+    m_image_ctx.update_flags(snap_id, RBD_FLAG_EXTENT_MAP_INVALID, true);
+  }
+
+  librados::ObjectWriteOperation op;
+  cls_client::set_flags(&op, snap_id, RBD_FLAG_EXTENT_MAP_INVALID,
+                        RBD_FLAG_EXTENT_MAP_INVALID);
+
+  Context *ctx = new FunctionContext([this, cct, on_finish](int r) {
+      if (r < 0) {
+        lderr(cct) << "failed to invalidate extent map: " << cpp_strerror(r)
+                   << dendl;
+      }
+      on_finish->complete(0);
+    });
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid, comp, &op);
+  assert(r == 0);
+  comp->release();
+}
+
+} // namespace object_map
+} // namespace librbd
+
+template class librbd::object_map::ExtentMap<librbd::ImageCtx>;
@@ -0,0 +1,89 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_OBJECT_MAP_EXTENT_MAP_H
+#define CEPH_LIBRBD_OBJECT_MAP_EXTENT_MAP_H
+
+#include "include/int_types.h"
+#include "include/buffer.h"
+#include "include/fs_types.h"
+#include "common/bit_vector.hpp"
+#include <string>
+
+class Context;
+
+namespace librbd {
+
+class ImageCtx;
+
+namespace object_map {
+
+/**
+ * Map of the object chunks written since the last snapshot
+ *
+ * Every object is split into up to 64 chunks of at least 4K.  A chunk is
+ * marked EXTENT_CHANGED before the first write to it after a snapshot.
+ * Creating a snapshot copies the HEAD map to the snapshot and resets it,
+ * so the map of a snapshot holds the chunks written since the snapshot
+ * before it.  A diff between two snapshots only has to combine the maps
+ * in between instead of listing the snapshots of every object.
+ *
+ * Errors never fail the IO: the affected map is flagged with
+ * RBD_FLAG_EXTENT_MAP_INVALID and diffs fall back to the object map.
+ * A HEAD map becomes valid again with the next snapshot.
+ */
+template <typename ImageCtxT = ImageCtx>
+class ExtentMap {
+public:
+  static ExtentMap *create(ImageCtxT &image_ctx) {
+    return new ExtentMap(image_ctx);
+  }
+
+  static std::string extent_map_name(const std::string &image_id,
+                                     uint64_t snap_id);
+  static uint64_t get_chunk_size(uint64_t object_size);
+  static uint64_t get_chunk_count(const file_layout_t &layout, uint64_t size);
+  static bool is_compatible(const file_layout_t &layout, uint64_t size);
+
+  ExtentMap(ImageCtxT &image_ctx);
+
+  void open(Context *on_finish);
+
+  bool update_required(uint64_t object_no, uint64_t object_off,
+                       uint64_t object_len);
+  void aio_update(uint64_t object_no, uint64_t object_off,
+                  uint64_t object_len, Context *on_finish);
+
+  void aio_resize(uint64_t new_size, Context *on_finish);
+  void snapshot_add(uint64_t snap_id, Context *on_finish);
+  void snapshot_remove(uint64_t snap_id, Context *on_finish);
+  void rollback(Context *on_finish);
+
+private:
+  ImageCtxT &m_image_ctx;
+  uint64_t m_chunk_size;
+  uint64_t m_chunks_per_object;
+
+  /// protected by the image's object_map_lock
+  ceph::BitVector<2> m_extent_map;
+
+  void get_chunk_range(uint64_t object_no, uint64_t object_off,
+                       uint64_t object_len, uint64_t *start_chunk_no,
+                       uint64_t *end_chunk_no);
+
+  void handle_load(bufferlist *out_bl, uint64_t chunk_count, int r,
+                   Context *on_finish);
+  void handle_snapshot_remove_load(uint64_t snap_id, uint64_t next_snap_id,
+                                   bufferlist *out_bl, int r,
+                                   Context *on_finish);
+  void send_snapshot_remove_map(uint64_t snap_id, Context *on_finish);
+
+  void invalidate(uint64_t snap_id, Context *on_finish);
+};
+
+} // namespace object_map
+} // namespace librbd
+
+extern template class librbd::object_map::ExtentMap<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_OBJECT_MAP_EXTENT_MAP_H
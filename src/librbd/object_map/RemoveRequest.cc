@@ -8,6 +8,7 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/ObjectMap.h"
 #include "librbd/Utils.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "include/assert.h"
 
 #define dout_subsys ceph_subsys_rbd
@@ -20,8 +21,9 @@ namespace object_map {
 using util::create_rados_callback;
 
 template <typename I>
-RemoveRequest<I>::RemoveRequest(I *image_ctx, Context *on_finish)
-  : m_image_ctx(image_ctx), m_on_finish(on_finish),
+RemoveRequest<I>::RemoveRequest(I *image_ctx, uint64_t features,
+                                Context *on_finish)
+  : m_image_ctx(image_ctx), m_features(features), m_on_finish(on_finish),
     m_lock("object_map::RemoveRequest::m_lock") {
 }
 
@@ -45,9 +47,19 @@ void RemoveRequest<I>::send_remove_object_map() {
   Mutex::Locker locker(m_lock);
   assert(m_ref_counter == 0);
 
+  std::vector<std::string> oids;
   for (auto snap_id : snap_ids) {
+    if ((m_features & RBD_FEATURE_OBJECT_MAP) != 0) {
+      oids.push_back(ObjectMap<>::object_map_name(m_image_ctx->id, snap_id));
+    }
+    if ((m_features & RBD_FEATURE_EXTENT_MAP) != 0) {
+      oids.push_back(ExtentMap<>::extent_map_name(m_image_ctx->id, snap_id));
+    }
+  }
+  assert(!oids.empty());
+
+  for (auto &oid : oids) {
     m_ref_counter++;
-    std::string oid(ObjectMap<>::object_map_name(m_image_ctx->id, snap_id));
     using klass = RemoveRequest<I>;
     librados::AioCompletion *comp =
       create_rados_callback<klass, &klass::handle_remove_object_map>(this);
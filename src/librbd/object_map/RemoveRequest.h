@@ -20,8 +20,9 @@ namespace object_map {
 template <typename ImageCtxT = ImageCtx>
 class RemoveRequest {
 public:
-  static RemoveRequest *create(ImageCtxT *image_ctx, Context *on_finish) {
-    return new RemoveRequest(image_ctx, on_finish);
+  static RemoveRequest *create(ImageCtxT *image_ctx, uint64_t features,
+                               Context *on_finish) {
+    return new RemoveRequest(image_ctx, features, on_finish);
   }
 
   void send();
@@ -33,17 +34,18 @@ private:
    * <start>
    *    |          .  .  .
    *    v          v     .
-   * REMOVE_OBJECT_MAP   . (for every snapshot)
-   *    |          .     .
-   *    v          .  .  .
+   * REMOVE_OBJECT_MAP   . (for every snapshot and
+   *    |          .     .  for the object and/or
+   *    v          .  .  .  extent map features)
    * <finis>
    *
    * @endverbatim
    */
 
-  RemoveRequest(ImageCtxT *image_ctx, Context *on_finish);
+  RemoveRequest(ImageCtxT *image_ctx, uint64_t features, Context *on_finish);
 
   ImageCtxT *m_image_ctx;
+  uint64_t m_features;
   Context *m_on_finish;
 
   int m_error_result = 0;
@@ -190,8 +190,17 @@ Context *DisableFeaturesRequest<I>::handle_acquire_exclusive_lock(int *result) {
                           RBD_FEATURE_JOURNALING);
     }
     if ((m_features & RBD_FEATURE_FAST_DIFF) != 0) {
+      if ((m_new_features & RBD_FEATURE_EXTENT_MAP) != 0) {
+        lderr(cct) << "cannot disable fast-diff. extent-map must be "
+                      "disabled before disabling fast-diff." << dendl;
+        *result = -EINVAL;
+        break;
+      }
       m_disable_flags |= RBD_FLAG_FAST_DIFF_INVALID;
     }
+    if ((m_features & RBD_FEATURE_EXTENT_MAP) != 0) {
+      m_disable_flags |= RBD_FLAG_EXTENT_MAP_INVALID;
+    }
     if ((m_features & RBD_FEATURE_OBJECT_MAP) != 0) {
       if ((m_new_features & RBD_FEATURE_FAST_DIFF) != 0) {
         lderr(cct) << "cannot disable object-map. fast-diff must be "
@@ -454,7 +463,9 @@ void DisableFeaturesRequest<I>::send_remove_object_map() {
   CephContext *cct = image_ctx.cct;
   ldout(cct, 20) << this << " " << __func__ << dendl;
 
-  if ((m_features & RBD_FEATURE_OBJECT_MAP) == 0) {
+  uint64_t features = m_features & (RBD_FEATURE_OBJECT_MAP |
+                                    RBD_FEATURE_EXTENT_MAP);
+  if (features == 0) {
     send_set_features();
     return;
   }
@@ -464,7 +475,7 @@ void DisableFeaturesRequest<I>::send_remove_object_map() {
     &DisableFeaturesRequest<I>::handle_remove_object_map>(this);
 
   object_map::RemoveRequest<I> *req =
-    object_map::RemoveRequest<I>::create(&image_ctx, ctx);
+    object_map::RemoveRequest<I>::create(&image_ctx, features, ctx);
   req->send();
 }
 
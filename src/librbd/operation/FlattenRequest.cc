@@ -5,9 +5,14 @@
 #include "librbd/AsyncObjectThrottle.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/ObjectMap.h"
+#include "librbd/Utils.h"
 #include "librbd/io/ObjectRequest.h"
+#include "common/Clock.h"
 #include "common/dout.h"
 #include "common/errno.h"
+#include "common/strtol.h"
+#include "include/stringify.h"
 #include <boost/lambda/bind.hpp>
 #include <boost/lambda/construct.hpp>
 
@@ -22,10 +27,12 @@ template <typename I>
 class C_FlattenObject : public C_AsyncObjectThrottle<I> {
 public:
   C_FlattenObject(AsyncObjectThrottle<I> &throttle, I *image_ctx,
-                  uint64_t object_size, ::SnapContext snapc, uint64_t object_no)
-    : C_AsyncObjectThrottle<I>(throttle, *image_ctx), m_object_size(object_size),
-      m_snapc(snapc), m_object_no(object_no)
+                  FlattenRequest<I> *request, uint64_t object_size,
+                  ::SnapContext snapc, uint64_t index)
+    : C_AsyncObjectThrottle<I>(throttle, *image_ctx), m_throttle(throttle),
+      m_request(request), m_object_size(object_size), m_snapc(snapc)
   {
+    m_object_no = m_request->get_flatten_object_no(index, &m_skip);
   }
 
   int send() override {
@@ -33,6 +40,10 @@ public:
     assert(image_ctx.owner_lock.is_locked());
     CephContext *cct = image_ctx.cct;
 
+    if (m_skip) {
+      return 1;
+    }
+
     if (image_ctx.exclusive_lock != nullptr &&
         !image_ctx.exclusive_lock->is_lock_owner()) {
       ldout(cct, 1) << "lost exclusive lock during flatten" << dendl;
@@ -47,24 +58,170 @@ public:
       // stop early if the parent went away - it just means
       // another flatten finished first or the image was resized
       delete req;
+      m_request->handle_flatten_object(m_throttle, m_object_no, 0, 0);
       return 1;
     }
 
+    m_start_time = ceph_clock_now();
     req->send();
     return 0;
   }
 
+protected:
+  void finish(int r) override {
+    double latency = ceph_clock_now() - m_start_time;
+    m_request->handle_flatten_object(m_throttle, m_object_no, latency, r);
+    C_AsyncObjectThrottle<I>::finish(r);
+  }
+
 private:
+  AsyncObjectThrottle<I> &m_throttle;
+  FlattenRequest<I> *m_request;
   uint64_t m_object_size;
   ::SnapContext m_snapc;
   uint64_t m_object_no;
+  bool m_skip = false;
+  utime_t m_start_time;
 };
 
+template <typename I>
+FlattenRequest<I>::FlattenRequest(I &image_ctx, Context *on_finish,
+                                  uint64_t object_size,
+                                  uint64_t overlap_objects,
+                                  const ::SnapContext &snapc,
+                                  ProgressContext &prog_ctx)
+  : Request<I>(image_ctx, on_finish), m_object_size(object_size),
+    m_overlap_objects(overlap_objects), m_snapc(snapc), m_prog_ctx(prog_ctx),
+    m_ignore_enoent(false),
+    m_lock(util::unique_lock_name("librbd::operation::FlattenRequest::m_lock",
+                                  this)) {
+}
+
+template <typename I>
+uint64_t FlattenRequest<I>::get_flatten_object_no(uint64_t index,
+                                                  bool *skip) {
+  I &image_ctx = this->m_image_ctx;
+  *skip = false;
+
+  uint64_t object_no;
+  if (index < m_hot_object_nos.size()) {
+    object_no = m_hot_object_nos[index];
+  } else {
+    object_no = index - m_hot_object_nos.size();
+    if (m_hot_object_set.count(object_no) != 0) {
+      *skip = true;
+    } else if (object_no < m_resume_object_no) {
+      // objects below the saved progress were flattened by an earlier
+      // attempt unless they have since been removed (e.g. by a discard or
+      // a snapshot rollback)
+      RWLock::RLocker snap_locker(image_ctx.snap_lock);
+      RWLock::RLocker object_map_locker(image_ctx.object_map_lock);
+      if (image_ctx.object_map != nullptr &&
+          object_no < image_ctx.object_map->size()) {
+        const auto &object_map = *image_ctx.object_map;
+        uint8_t state = object_map[object_no];
+        *skip = (state == OBJECT_EXISTS || state == OBJECT_EXISTS_CLEAN);
+      }
+    }
+  }
+
+  Mutex::Locker locker(m_lock);
+  if (index >= m_hot_object_nos.size()) {
+    m_next_object_no = object_no + 1;
+  }
+  if (!*skip) {
+    m_in_flight_object_nos.insert(object_no);
+  }
+  return object_no;
+}
+
+template <typename I>
+void FlattenRequest<I>::handle_flatten_object(
+    AsyncObjectThrottle<I> &throttle, uint64_t object_no, double latency,
+    int r) {
+  I &image_ctx = this->m_image_ctx;
+  CephContext *cct = image_ctx.cct;
+
+  librados::AioCompletion *comp = nullptr;
+  uint64_t concurrent_ops = 0;
+  uint64_t progress_object_no;
+  {
+    Mutex::Locker locker(m_lock);
+    if (r < 0) {
+      // keep the object in-flight so that progress is never saved past it
+      return;
+    }
+    m_in_flight_object_nos.erase(object_no);
+
+    double target_latency = image_ctx.flatten_target_latency;
+    if (latency > 0 && target_latency > 0) {
+      // additive increase / multiplicative decrease once per window of
+      // completed copyups, based on their average latency
+      m_latency_sum += latency;
+      if (++m_ops_since_adjust >= m_concurrent_ops) {
+        double avg_latency = m_latency_sum / m_ops_since_adjust;
+        uint64_t prev_concurrent_ops = m_concurrent_ops;
+        if (avg_latency > target_latency) {
+          m_concurrent_ops = std::max<uint64_t>(m_concurrent_ops / 2, 1);
+        } else if (m_concurrent_ops < m_max_concurrent_ops) {
+          ++m_concurrent_ops;
+        }
+        m_ops_since_adjust = 0;
+        m_latency_sum = 0;
+
+        if (m_concurrent_ops != prev_concurrent_ops) {
+          ldout(cct, 10) << this << " average copyup latency " << avg_latency
+                         << ": concurrent_ops=" << m_concurrent_ops << dendl;
+          concurrent_ops = m_concurrent_ops;
+        }
+      }
+    }
+
+    progress_object_no = get_progress_object_no();
+    if (m_save_progress &&
+        progress_object_no >= m_saved_object_no +
+                                image_ctx.flatten_progress_update_objects) {
+      m_saved_object_no = progress_object_no;
+      comp = librados::Rados::aio_create_completion();
+    }
+  }
+
+  if (concurrent_ops > 0) {
+    throttle.set_max_concurrent_ops(concurrent_ops);
+  }
+
+  if (comp != nullptr) {
+    // fire-and-forget: updates to the header are applied in order, so the
+    // header update that completes the flatten is applied after this one
+    save_progress(progress_object_no, comp);
+    comp->release();
+  }
+}
+
 template <typename I>
 bool FlattenRequest<I>::should_complete(int r) {
   I &image_ctx = this->m_image_ctx;
   CephContext *cct = image_ctx.cct;
   ldout(cct, 5) << this << " should_complete: " << " r=" << r << dendl;
+  if (m_state == STATE_GET_PROGRESS) {
+    return handle_get_progress(r);
+  } else if (m_state == STATE_SAVE_PROGRESS) {
+    if (r < 0) {
+      lderr(cct) << "failed to save flatten progress: " << cpp_strerror(r)
+                 << dendl;
+    }
+    return true;
+  } else if (m_state == STATE_FLATTEN_OBJECTS && r < 0) {
+    m_ret_val = r;
+    if (r == -ERESTART) {
+      ldout(cct, 5) << "flatten operation interrupted" << dendl;
+    } else {
+      lderr(cct) << "flatten encountered an error: " << cpp_strerror(r)
+                 << dendl;
+    }
+    return send_save_progress();
+  }
+
   if (r == -ERESTART) {
     ldout(cct, 5) << "flatten operation interrupted" << dendl;
     return true;
@@ -102,15 +259,127 @@ void FlattenRequest<I>::send_op() {
   CephContext *cct = image_ctx.cct;
   ldout(cct, 5) << this << " send" << dendl;
 
+  send_get_progress();
+}
+
+template <typename I>
+void FlattenRequest<I>::send_get_progress() {
+  I &image_ctx = this->m_image_ctx;
+  CephContext *cct = image_ctx.cct;
+  ldout(cct, 5) << this << " send_get_progress" << dendl;
+
+  m_state = STATE_GET_PROGRESS;
+
+  librados::ObjectReadOperation op;
+  cls_client::metadata_get_start(&op, ImageCtx::METADATA_FLATTEN_OBJECT_NO);
+
+  librados::AioCompletion *rados_completion = this->create_callback_completion();
+  m_out_bl.clear();
+  int r = image_ctx.md_ctx.aio_operate(image_ctx.header_oid, rados_completion,
+                                       &op, &m_out_bl);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+template <typename I>
+bool FlattenRequest<I>::handle_get_progress(int r) {
+  I &image_ctx = this->m_image_ctx;
+  CephContext *cct = image_ctx.cct;
+  ldout(cct, 5) << this << " handle_get_progress: r=" << r << dendl;
+
+  std::string value;
+  if (r == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    r = cls_client::metadata_get_finish(&it, &value);
+  }
+
+  if (r == 0) {
+    std::string err;
+    long long object_no = strict_strtoll(value.c_str(), 10, &err);
+    if (err.empty() && object_no < 0) {
+      err = "negative object number";
+    }
+    if (err.empty()) {
+      ldout(cct, 5) << "resuming flatten at object " << object_no << dendl;
+      m_resume_object_no = object_no;
+    } else {
+      lderr(cct) << "ignoring invalid flatten progress: " << err << dendl;
+    }
+  } else if (r != -ENOENT) {
+    // not fatal: the flatten just starts over
+    lderr(cct) << "failed to retrieve flatten progress: " << cpp_strerror(r)
+               << dendl;
+  }
+
+  RWLock::RLocker owner_locker(image_ctx.owner_lock);
+  send_flatten_objects();
+  return false;
+}
+
+template <typename I>
+void FlattenRequest<I>::send_flatten_objects() {
+  I &image_ctx = this->m_image_ctx;
+  assert(image_ctx.owner_lock.is_locked());
+  CephContext *cct = image_ctx.cct;
+
   m_state = STATE_FLATTEN_OBJECTS;
+
+  // the saved progress can only be verified against the object map
+  m_save_progress = (image_ctx.flatten_progress_update_objects > 0 &&
+                     image_ctx.test_features(RBD_FEATURE_OBJECT_MAP));
+  if (!m_save_progress) {
+    m_resume_object_no = 0;
+  }
+  m_saved_object_no = m_resume_object_no;
+
+  std::vector<uint64_t> hot_object_nos;
+  image_ctx.get_hot_parent_objects(image_ctx.flatten_hot_objects,
+                                   &hot_object_nos);
+  for (auto object_no : hot_object_nos) {
+    if (object_no < m_overlap_objects && object_no >= m_resume_object_no) {
+      m_hot_object_nos.push_back(object_no);
+      m_hot_object_set.insert(object_no);
+    }
+  }
+
+  m_max_concurrent_ops = image_ctx.concurrent_management_ops;
+  m_concurrent_ops = m_max_concurrent_ops;
+  ldout(cct, 5) << this << " send_flatten_objects: "
+                << "hot_objects=" << m_hot_object_nos.size() << ", "
+                << "resume_object_no=" << m_resume_object_no << dendl;
+
   typename AsyncObjectThrottle<I>::ContextFactory context_factory(
     boost::lambda::bind(boost::lambda::new_ptr<C_FlattenObject<I> >(),
-      boost::lambda::_1, &image_ctx, m_object_size, m_snapc,
+      boost::lambda::_1, &image_ctx, this, m_object_size, m_snapc,
       boost::lambda::_2));
   AsyncObjectThrottle<I> *throttle = new AsyncObjectThrottle<I>(
     this, image_ctx, context_factory, this->create_callback_context(), &m_prog_ctx,
-    0, m_overlap_objects);
-  throttle->start_ops(image_ctx.concurrent_management_ops);
+    0, m_hot_object_nos.size() + m_overlap_objects);
+  throttle->start_ops(m_max_concurrent_ops);
+}
+
+template <typename I>
+bool FlattenRequest<I>::send_save_progress() {
+  I &image_ctx = this->m_image_ctx;
+  CephContext *cct = image_ctx.cct;
+
+  uint64_t progress_object_no;
+  {
+    Mutex::Locker locker(m_lock);
+    progress_object_no = get_progress_object_no();
+    if (!m_save_progress || progress_object_no <= m_saved_object_no) {
+      return true;
+    }
+    m_saved_object_no = progress_object_no;
+    ldout(cct, 5) << this << " send_save_progress: object_no="
+                  << m_saved_object_no << dendl;
+  }
+
+  m_state = STATE_SAVE_PROGRESS;
+  librados::AioCompletion *rados_completion = this->create_callback_completion();
+  save_progress(progress_object_no, rados_completion);
+  rados_completion->release();
+  return false;
 }
 
 template <typename I>
@@ -141,6 +410,9 @@ bool FlattenRequest<I>::send_update_header() {
   // remove parent from this (base) image
   librados::ObjectWriteOperation op;
   cls_client::remove_parent(&op);
+  if (m_save_progress) {
+    cls_client::metadata_remove(&op, ImageCtx::METADATA_FLATTEN_OBJECT_NO);
+  }
 
   librados::AioCompletion *rados_completion = this->create_callback_completion();
   int r = image_ctx.md_ctx.aio_operate(image_ctx.header_oid,
@@ -183,6 +455,32 @@ bool FlattenRequest<I>::send_update_children() {
   return false;
 }
 
+template <typename I>
+uint64_t FlattenRequest<I>::get_progress_object_no() const {
+  assert(m_lock.is_locked());
+
+  // all objects below the first in-flight (or failed) object are flattened
+  uint64_t object_no = m_next_object_no;
+  if (!m_in_flight_object_nos.empty()) {
+    object_no = std::min(object_no, *m_in_flight_object_nos.begin());
+  }
+  return object_no;
+}
+
+template <typename I>
+void FlattenRequest<I>::save_progress(uint64_t object_no,
+                                      librados::AioCompletion *comp) {
+  I &image_ctx = this->m_image_ctx;
+
+  std::map<std::string, bufferlist> data;
+  data[ImageCtx::METADATA_FLATTEN_OBJECT_NO].append(stringify(object_no));
+
+  librados::ObjectWriteOperation op;
+  cls_client::metadata_set(&op, data);
+  int r = image_ctx.md_ctx.aio_operate(image_ctx.header_oid, comp, &op);
+  assert(r == 0);
+}
+
 } // namespace operation
 } // namespace librbd
 
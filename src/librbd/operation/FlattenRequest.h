@@ -4,13 +4,17 @@
 #define CEPH_LIBRBD_OPERATION_FLATTEN_REQUEST_H
 
 #include "librbd/operation/Request.h"
+#include "common/Mutex.h"
 #include "common/snap_types.h"
 #include "librbd/Types.h"
+#include <set>
+#include <vector>
 
 namespace librbd {
 
 class ImageCtx;
 class ProgressContext;
+template <typename> class AsyncObjectThrottle;
 
 namespace operation {
 
@@ -20,17 +24,23 @@ class FlattenRequest : public Request<ImageCtxT>
 public:
   FlattenRequest(ImageCtxT &image_ctx, Context *on_finish,
 		 uint64_t object_size, uint64_t overlap_objects,
-		 const ::SnapContext &snapc, ProgressContext &prog_ctx)
-    : Request<ImageCtxT>(image_ctx, on_finish), m_object_size(object_size),
-      m_overlap_objects(overlap_objects), m_snapc(snapc), m_prog_ctx(prog_ctx),
-      m_ignore_enoent(false)
-  {
-  }
+		 const ::SnapContext &snapc, ProgressContext &prog_ctx);
+
+  uint64_t get_flatten_object_no(uint64_t index, bool *skip);
+  void handle_flatten_object(AsyncObjectThrottle<ImageCtxT> &throttle,
+                             uint64_t object_no, double latency, int r);
 
 protected:
   void send_op() override;
   bool should_complete(int r) override;
 
+  int filter_return_code(int r) const override {
+    if (m_ret_val < 0) {
+      return m_ret_val;
+    }
+    return r;
+  }
+
   journal::Event create_event(uint64_t op_tid) const override {
     return journal::FlattenEvent(op_tid);
   }
@@ -45,6 +55,9 @@ private:
    * <start>
    *    |
    *    v
+   * STATE_GET_PROGRESS
+   *    |
+   *    v
    * STATE_FLATTEN_OBJECTS ---> STATE_UPDATE_HEADER . . . . .
    *           .                         |                  .
    *           .                         |                  .
@@ -52,19 +65,28 @@ private:
    *           .               STATE_UPDATE_CHILDREN        .
    *           .                         |                  .
    *           .                         |                  .
-   *           .                         \---> <finish> < . .
+   *           . (error)                 \---> <finish> < . .
    *           .                                   ^
-   *           .                                   .
-   *           . . . . . . . . . . . . . . . . . . .
+   *           v                                   .
+   * STATE_SAVE_PROGRESS . . . . . . . . . . . . . .
    *
    * @endverbatim
    *
    * The _UPDATE_CHILDREN state will be skipped if the image has one or
    * more snapshots. The _UPDATE_HEADER state will be skipped if the
    * image was concurrently flattened by another client.
+   *
+   * The objects most recently read from the parent are flattened first,
+   * followed by the remaining objects in order. The number of objects
+   * below which all objects are flattened is periodically saved in the
+   * image metadata, so an interrupted flatten does not have to revisit
+   * them. The _SAVE_PROGRESS state records it one last time before the
+   * error is returned.
    */
   enum State {
+    STATE_GET_PROGRESS,
     STATE_FLATTEN_OBJECTS,
+    STATE_SAVE_PROGRESS,
     STATE_UPDATE_HEADER,
     STATE_UPDATE_CHILDREN
   };
@@ -77,9 +99,34 @@ private:
 
   ParentSpec m_parent_spec;
   bool m_ignore_enoent;
+  int m_ret_val = 0;
+
+  bufferlist m_out_bl;
+  uint64_t m_resume_object_no = 0;
+  std::vector<uint64_t> m_hot_object_nos;
+  std::set<uint64_t> m_hot_object_set;
+
+  Mutex m_lock;
+  bool m_save_progress = false;
+  uint64_t m_saved_object_no = 0;
+  uint64_t m_next_object_no = 0;
+  std::set<uint64_t> m_in_flight_object_nos;
 
+  uint64_t m_max_concurrent_ops = 0;
+  uint64_t m_concurrent_ops = 0;
+  uint64_t m_ops_since_adjust = 0;
+  double m_latency_sum = 0;
+
+  void send_get_progress();
+  bool handle_get_progress(int r);
+
+  void send_flatten_objects();
+  bool send_save_progress();
   bool send_update_header();
   bool send_update_children();
+
+  uint64_t get_progress_object_no() const;
+  void save_progress(uint64_t object_no, librados::AioCompletion *comp);
 };
 
 } // namespace operation
@@ -183,7 +183,12 @@ template <typename I>
 void ResizeRequest<I>::send_flush_cache() {
   I &image_ctx = this->m_image_ctx;
   if (image_ctx.object_cacher == nullptr) {
-    send_trim_image();
+    if (image_ctx.image_cache != nullptr) {
+      // already written back when writes were blocked
+      send_invalidate_cache();
+    } else {
+      send_trim_image();
+    }
     return;
   }
 
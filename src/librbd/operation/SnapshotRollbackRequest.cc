@@ -276,7 +276,7 @@ Context *SnapshotRollbackRequest<I>::send_invalidate_cache() {
   I &image_ctx = this->m_image_ctx;
 
   apply();
-  if (image_ctx.object_cacher == NULL) {
+  if (image_ctx.object_cacher == NULL && image_ctx.image_cache == nullptr) {
     return this->create_context_finisher(0);
   }
 
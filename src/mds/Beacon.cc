@@ -483,12 +483,19 @@ void Beacon::notify_health(MDSRank const *mds)
   }
 
   // Report if we have significantly exceeded our cache size limit
-  if (mds->mdcache->get_cache_size() >
-        g_conf->mds_cache_size * g_conf->mds_health_cache_threshold) {
+  if (MDCache::cache_overfull()) {
     std::ostringstream oss;
-    oss << "Too many inodes in cache (" << mds->mdcache->get_cache_size()
-        << "/" << g_conf->mds_cache_size << "), "
-        << mds->mdcache->num_inodes_with_caps << " inodes in use by clients, "
+    if (MDCache::cache_limit_inodes() &&
+	CInode::count() >
+	  MDCache::cache_limit_inodes() * g_conf->mds_health_cache_threshold) {
+      oss << "Too many inodes in cache (" << CInode::count()
+	  << "/" << MDCache::cache_limit_inodes() << "), ";
+    } else {
+      oss << "MDS cache is too large ("
+	  << pretty_si_t(MDCache::cache_memory_size()) << "B/"
+	  << pretty_si_t(MDCache::cache_limit_memory()) << "B), ";
+    }
+    oss << mds->mdcache->num_inodes_with_caps << " inodes in use by clients, "
         << mds->mdcache->get_num_strays() << " stray files";
 
     MDSHealthMetric m(MDS_HEALTH_CACHE_OVERSIZED, HEALTH_WARN, oss.str());
@@ -21,6 +21,7 @@
 #include <set>
 
 #include "include/counter.h"
+#include "include/mempool.h"
 #include "include/types.h"
 #include "include/buffer_fwd.h"
 #include "include/lru.h"
@@ -49,6 +50,8 @@ bool operator<(const CDentry& l, const CDentry& r);
 // dentry
 class CDentry : public MDSCacheObject, public LRUObject, public Counter<CDentry> {
 public:
+  MEMPOOL_CLASS_HELPERS();
+
   friend class CDir;
 
   struct linkage_t {
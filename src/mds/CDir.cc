@@ -42,6 +42,8 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "mds." << cache->mds->get_nodeid() << ".cache.dir(" << this->dirfrag() << ") "
 
+MEMPOOL_DEFINE_OBJECT_FACTORY(CDir, co_dir, mds_co);
+
 int CDir::num_frozen_trees = 0;
 int CDir::num_freezing_trees = 0;
 
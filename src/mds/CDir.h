@@ -18,6 +18,7 @@
 #define CEPH_CDIR_H
 
 #include "include/counter.h"
+#include "include/mempool.h"
 #include "include/types.h"
 #include "include/buffer_fwd.h"
 #include "common/bloom_filter.hpp"
@@ -43,6 +44,9 @@ struct ObjectOperation;
 
 ostream& operator<<(ostream& out, const class CDir& dir);
 class CDir : public MDSCacheObject, public Counter<CDir> {
+public:
+  MEMPOOL_CLASS_HELPERS();
+
   friend ostream& operator<<(ostream& out, const class CDir& dir);
 
 public:
@@ -220,7 +224,7 @@ private:
   void log_mark_dirty();
 
 public:
-  typedef std::map<dentry_key_t, CDentry*> map_t;
+  typedef mempool::mds_co::map<dentry_key_t, CDentry*> map_t;
 
   class scrub_info_t {
   public:
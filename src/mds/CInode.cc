@@ -53,6 +53,8 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "mds." << mdcache->mds->get_nodeid() << ".cache.ino(" << inode.ino << ") "
 
+MEMPOOL_DEFINE_OBJECT_FACTORY(CInode, co_inode, mds_co);
+
 
 class CInodeIOContext : public MDSIOContextBase
 {
@@ -19,6 +19,7 @@
 
 #include "common/config.h"
 #include "include/counter.h"
+#include "include/mempool.h"
 #include "include/elist.h"
 #include "include/types.h"
 #include "include/lru.h"
@@ -130,6 +131,8 @@ WRITE_CLASS_ENCODER_FEATURES(InodeStore)
 // cached inode wrapper
 class CInode : public MDSCacheObject, public InodeStoreBase, public Counter<CInode> {
  public:
+  MEMPOOL_CLASS_HELPERS();
+
   // -- pins --
   static const int PIN_DIRFRAG =         -1; 
   static const int PIN_CAPS =             2;  // client caps
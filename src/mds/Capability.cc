@@ -16,6 +16,8 @@
 
 #include "common/Formatter.h"
 
+MEMPOOL_DEFINE_OBJECT_FACTORY(Capability, co_cap, mds_co);
+
 
 /*
  * Capability::Export
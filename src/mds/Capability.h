@@ -17,6 +17,7 @@
 #define CEPH_CAPABILITY_H
 
 #include "include/counter.h"
+#include "include/mempool.h"
 #include "include/buffer_fwd.h"
 #include "include/xlist.h"
 
@@ -66,6 +67,8 @@ namespace ceph {
 
 class Capability : public Counter<Capability> {
 public:
+  MEMPOOL_CLASS_HELPERS();
+
   struct Export {
     int64_t cap_id;
     int32_t wanted;
@@ -29,6 +29,7 @@
 #include "msg/Messenger.h"
 #include "messages/MHeartbeat.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -50,6 +51,21 @@ using std::vector;
 #define MIN_REEXPORT 5  // will automatically reexport
 #define MIN_OFFLOAD 10   // point at which i stop trying, close enough
 
+#define MIN_HEAT    .01  // forget dirfrags colder than this
+#define MAX_HEAT_TREND 4.0  // never predict more than this many times the current load
+
+MDBalancer::MDBalancer(MDSRank *m, Messenger *msgr, MonClient *monc) :
+  mds(m),
+  messenger(msgr),
+  mon_client(monc),
+  beat_epoch(0),
+  last_epoch_under(0), last_epoch_over(0), my_load(0.0), target_load(0.0),
+  heat_recent_halflife(g_conf->mds_bal_heat_recent_halflife),
+  heat_sustained_halflife(g_conf->mds_bal_heat_sustained_halflife),
+  heat_recent_rate(heat_recent_halflife),
+  heat_sustained_rate(heat_sustained_halflife)
+{
+}
 
 /* This function DOES put the passed message before returning */
 int MDBalancer::proc_message(Message *m)
@@ -130,6 +146,7 @@ void MDBalancer::tick()
   if ((double)now - (double)last_sample > g_conf->mds_bal_sample_interval) {
     dout(15) << "tick last_sample now " << now << dendl;
     last_sample = now;
+    trim_heatmap(now);
   }
 
   // balance?
@@ -809,6 +826,8 @@ void MDBalancer::try_rebalance(balance_state_t& state)
 
   // do my exports!
   set<CDir*> already_exporting;
+  int max_exports = g_conf->mds_bal_max_export_dirs;
+  int num_exports = 0;
 
   for (auto &it : state.targets) {
     mds_rank_t target = it.first;
@@ -840,6 +859,8 @@ void MDBalancer::try_rebalance(balance_state_t& state)
 	    dir->inode->is_stray())
 	  continue;
 	if (dir->is_freezing() || dir->is_frozen()) continue;  // export pbly already in progress
+	if (in_migrate_cooldown(rebalance_time, dir)) continue;
+	if (max_exports > 0 && num_exports >= max_exports) break;
 	double pop = dir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
 	assert(dir->inode->authority().first == target);  // cuz that's how i put it in the map, dummy
 
@@ -848,6 +869,7 @@ void MDBalancer::try_rebalance(balance_state_t& state)
 		  << " pop " << pop
 		  << " back to mds." << target << dendl;
 	  mds->mdcache->migrator->export_dir_nicely(dir, target);
+	  num_exports++;
 	  have += pop;
 	  import_from_map.erase(plast);
 	  import_pop_map.erase(pop);
@@ -904,6 +926,11 @@ void MDBalancer::try_rebalance(balance_state_t& state)
     //fudge = amount - have;
 
     for (list<CDir*>::iterator it = exports.begin(); it != exports.end(); ++it) {
+      if (max_exports > 0 && num_exports >= max_exports) {
+	dout(5) << "hit mds_bal_max_export_dirs " << max_exports
+		<< ", leaving the rest for the next round" << dendl;
+	break;
+      }
       dout(0) << "   - exporting "
 	       << (*it)->pop_auth_subtree
 	       << " "
@@ -912,6 +939,7 @@ void MDBalancer::try_rebalance(balance_state_t& state)
 	       << " " << **it
 	       << dendl;
       mds->mdcache->migrator->export_dir_nicely(*it, target);
+      num_exports++;
     }
   }
 
@@ -969,14 +997,30 @@ void MDBalancer::find_exports(CDir *dir,
       if (already_exporting.count(subdir)) continue;
 
       if (subdir->is_frozen()) continue;  // can't export this right now!
+      if (in_migrate_cooldown(rebalance_time, subdir)) {
+	dout(15) << "   subdir moved recently, leaving it " << *subdir << dendl;
+	continue;
+      }
 
       // how popular?
-      double pop = subdir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
+      double pop = get_predicted_load(rebalance_time, subdir);
       subdir_sum += pop;
       dout(15) << "   subdir pop " << pop << " " << *subdir << dendl;
 
       if (pop < minchunk) continue;
 
+      // worth what it costs to move?
+      double max_cost = g_conf->mds_bal_max_export_cost;
+      if (max_cost > 0 && get_export_cost(subdir) > pop * max_cost) {
+	dout(15) << "   subdir too expensive to move, cost "
+		 << get_export_cost(subdir) << " " << *subdir << dendl;
+	if (subdir->is_rep())
+	  bigger_rep.push_back(subdir);
+	else
+	  bigger_unrep.push_back(subdir);
+	continue;
+      }
+
       // lucky find?
       if (pop > needmin && pop < needmax) {
 	exports.push_back(subdir);
@@ -1095,6 +1139,9 @@ void MDBalancer::hit_dir(utime_t now, CDir *dir, int type, int who, double amoun
   // hit me
   double v = dir->pop_me.get(type).hit(now, amount);
 
+  if (dir->is_auth())
+    hit_heatmap(now, dir, amount);
+
   const bool hot = (v > g_conf->mds_bal_split_rd && type == META_POP_IRD) ||
                    (v > g_conf->mds_bal_split_wr && type == META_POP_IWR);
 
@@ -1198,6 +1245,9 @@ void MDBalancer::subtract_export(CDir *dir, utime_t now)
 {
   dirfrag_load_vec_t subload = dir->pop_auth_subtree;
 
+  last_migrated[dir->dirfrag()] = now;
+  heatmap.erase(dir->dirfrag());
+
   while (true) {
     dir = dir->inode->get_parent_dir();
     if (!dir) break;
@@ -1212,6 +1262,8 @@ void MDBalancer::add_import(CDir *dir, utime_t now)
 {
   dirfrag_load_vec_t subload = dir->pop_auth_subtree;
 
+  last_migrated[dir->dirfrag()] = now;
+
   while (true) {
     dir = dir->inode->get_parent_dir();
     if (!dir) break;
@@ -1221,3 +1273,150 @@ void MDBalancer::add_import(CDir *dir, utime_t now)
   }
 }
 
+
+// -----------------------
+// heatmap
+
+/*
+ * Request rate (per second) behind a decay counter: hit at a steady
+ * rate r, a counter settles at r * halflife / ln(2).
+ */
+static double heat_rate(DecayCounter& c, utime_t now, const DecayRate& rate,
+			double halflife)
+{
+  return c.get(now, rate) * M_LN2 / halflife;
+}
+
+void MDBalancer::hit_heatmap(utime_t now, CDir *dir, double amount)
+{
+  auto p = heatmap.find(dir->dirfrag());
+  if (p == heatmap.end())
+    p = heatmap.emplace(dir->dirfrag(), dirfrag_heat_t(now)).first;
+  p->second.recent.hit(now, heat_recent_rate, amount);
+  p->second.sustained.hit(now, heat_sustained_rate, amount);
+}
+
+/*
+ * Forget dirfrags that went cold or that we are no longer auth for,
+ * keep at most mds_bal_heatmap_max of the hottest, and expire
+ * migration cooldowns.
+ */
+void MDBalancer::trim_heatmap(utime_t now)
+{
+  vector<pair<double, dirfrag_t> > heat;
+  heat.reserve(heatmap.size());
+  for (auto p = heatmap.begin(); p != heatmap.end(); ) {
+    CDir *dir = mds->mdcache->get_dirfrag(p->first);
+    double v = p->second.sustained.get(now, heat_sustained_rate);
+    if (!dir || !dir->is_auth() || v < MIN_HEAT) {
+      p = heatmap.erase(p);
+      continue;
+    }
+    heat.push_back(make_pair(v, p->first));
+    ++p;
+  }
+
+  size_t max = g_conf->mds_bal_heatmap_max;
+  if (heat.size() > max) {
+    auto cut = heat.begin() + (heat.size() - max);
+    std::nth_element(heat.begin(), cut, heat.end());
+    for (auto p = heat.begin(); p != cut; ++p)
+      heatmap.erase(p->second);
+  }
+  dout(20) << "trim_heatmap " << heatmap.size() << " dirfrags" << dendl;
+
+  for (auto p = last_migrated.begin(); p != last_migrated.end(); ) {
+    if ((double)(now - p->second) >= g_conf->mds_bal_migrate_cooldown)
+      last_migrated.erase(p++);
+    else
+      ++p;
+  }
+}
+
+/*
+ * Ratio of the recent to the sustained request rate of a dirfrag: 1
+ * for steady load, above 1 while load is ramping up and below 1 while
+ * it fades.  Dirfrags we have no heat for are taken to be steady.
+ */
+double MDBalancer::get_heat_trend(utime_t now, CDir *dir)
+{
+  auto p = heatmap.find(dir->dirfrag());
+  if (p == heatmap.end())
+    return 1.0;
+  double recent = heat_rate(p->second.recent, now, heat_recent_rate,
+			    heat_recent_halflife);
+  double sustained = heat_rate(p->second.sustained, now, heat_sustained_rate,
+			       heat_sustained_halflife);
+  if (sustained <= 0)
+    return 1.0;
+  return MIN(recent / sustained, MAX_HEAT_TREND);
+}
+
+/*
+ * Load we expect the subtree under dir to carry by the time an export
+ * of it completes: its current load, extrapolated along the trend of
+ * the dirfrag's own request rate by mds_bal_predict_gain.
+ */
+double MDBalancer::get_predicted_load(utime_t now, CDir *dir)
+{
+  double pop = dir->pop_auth_subtree.meta_load(now, mds->mdcache->decayrate);
+  double gain = g_conf->mds_bal_predict_gain;
+  if (gain <= 0)
+    return pop;
+  double predicted = pop * (1.0 + gain * (get_heat_trend(now, dir) - 1.0));
+  return MAX(predicted, 0.0);
+}
+
+/*
+ * Rough number of entries the Migrator has to ship to export the
+ * subtree under dir.
+ */
+double MDBalancer::get_export_cost(CDir *dir)
+{
+  const fnode_t *pf = dir->get_projected_fnode();
+  return pf->rstat.rfiles + pf->rstat.rsubdirs;
+}
+
+bool MDBalancer::in_migrate_cooldown(utime_t now, CDir *dir)
+{
+  auto p = last_migrated.find(dir->dirfrag());
+  return p != last_migrated.end() &&
+    (double)(now - p->second) < g_conf->mds_bal_migrate_cooldown;
+}
+
+void MDBalancer::dump_heatmap(Formatter *f)
+{
+  utime_t now = ceph_clock_now();
+
+  // hottest first
+  vector<pair<double, dirfrag_t> > heat;
+  heat.reserve(heatmap.size());
+  for (auto &p : heatmap)
+    heat.push_back(make_pair(heat_rate(p.second.recent, now, heat_recent_rate,
+				       heat_recent_halflife),
+			     p.first));
+  std::sort(heat.rbegin(), heat.rend());
+
+  f->open_array_section("heatmap");
+  for (auto &h : heat) {
+    dirfrag_heat_t &d = heatmap.at(h.second);
+    CDir *dir = mds->mdcache->get_dirfrag(h.second);
+    f->open_object_section("dirfrag");
+    f->dump_stream("dirfrag") << h.second;
+    f->dump_float("recent_rate", h.first);
+    f->dump_float("sustained_rate",
+		  heat_rate(d.sustained, now, heat_sustained_rate,
+			    heat_sustained_halflife));
+    if (dir) {
+      f->dump_string("path", dir->get_path());
+      f->dump_float("trend", get_heat_trend(now, dir));
+      f->dump_float("subtree_load",
+		    dir->pop_auth_subtree.meta_load(now, mds->mdcache->decayrate));
+      f->dump_float("predicted_load", get_predicted_load(now, dir));
+      f->dump_float("export_cost", get_export_cost(dir));
+      f->dump_bool("migrate_cooldown", in_migrate_cooldown(now, dir));
+    }
+    f->close_section();
+  }
+  f->close_section();
+}
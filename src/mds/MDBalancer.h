@@ -19,12 +19,15 @@
 
 #include <list>
 #include <map>
+#include <unordered_map>
 using std::list;
 using std::map;
 
 #include "include/types.h"
 #include "common/Clock.h"
 #include "common/Cond.h"
+#include "common/DecayCounter.h"
+#include "mdstypes.h"
 
 class MDSRank;
 class Message;
@@ -37,13 +40,7 @@ class MonClient;
 class MDBalancer {
   friend class C_Bal_SendHeartbeat;
 public:
-  MDBalancer(MDSRank *m, Messenger *msgr, MonClient *monc) : 
-    mds(m),
-    messenger(msgr),
-    mon_client(monc),
-    beat_epoch(0),
-    last_epoch_under(0), last_epoch_over(0), my_load(0.0), target_load(0.0)
-    { }
+  MDBalancer(MDSRank *m, Messenger *msgr, MonClient *monc);
 
   mds_load_t get_load(utime_t);
 
@@ -73,7 +70,32 @@ public:
    */
   void maybe_fragment(CDir *dir, bool hot);
 
+  /**
+   * Dump the dirfrag heatmap: the recent and sustained request rate of
+   * the hottest dirfrags we are auth for, and the load the balancer
+   * predicts for their subtrees.
+   */
+  void dump_heatmap(Formatter *f);
+
 private:
+  /**
+   * Request rate of one dirfrag over a short and a long window.  A
+   * short-window rate above the long-window one means load on the
+   * dirfrag is ramping up.
+   */
+  struct dirfrag_heat_t {
+    DecayCounter recent;
+    DecayCounter sustained;
+    explicit dirfrag_heat_t(utime_t now) : recent(now), sustained(now) {}
+  };
+
+  void hit_heatmap(utime_t now, CDir *dir, double amount);
+  void trim_heatmap(utime_t now);
+  double get_heat_trend(utime_t now, CDir *dir);
+  double get_predicted_load(utime_t now, CDir *dir);
+  double get_export_cost(CDir *dir);
+  bool in_migrate_cooldown(utime_t now, CDir *dir);
+
   typedef struct {
     std::map<mds_rank_t, double> targets;
     std::map<mds_rank_t, double> imported;
@@ -146,6 +168,15 @@ private:
 
   // per-epoch state
   double          my_load, target_load;
+
+  // dirfrag heatmap; trimmed to mds_bal_heatmap_max entries every
+  // mds_bal_sample_interval
+  std::unordered_map<dirfrag_t, dirfrag_heat_t> heatmap;
+  double heat_recent_halflife, heat_sustained_halflife;
+  DecayRate heat_recent_rate, heat_sustained_rate;
+
+  // when each subtree root last moved between ranks
+  map<dirfrag_t, utime_t> last_migrated;
 };
 
 #endif
@@ -202,7 +202,7 @@ MDCache::MDCache(MDSRank *m, PurgeQueue &purge_queue_) :
   cap_imports_num_opening = 0;
 
   opening_root = open = false;
-  lru.lru_set_max(g_conf->mds_cache_size);
+  lru.lru_set_max(cache_limit_inodes());
   lru.lru_set_midpoint(g_conf->mds_cache_mid);
 
   decayrate.set_halflife(g_conf->mds_decay_halflife);
@@ -221,7 +221,7 @@ MDCache::~MDCache()
 
 void MDCache::log_stat()
 {
-  mds->logger->set(l_mds_inode_max, g_conf->mds_cache_size);
+  mds->logger->set(l_mds_inode_max, cache_limit_inodes());
   mds->logger->set(l_mds_inodes, lru.lru_get_size());
   mds->logger->set(l_mds_inodes_pinned, lru.lru_get_num_pinned());
   mds->logger->set(l_mds_inodes_top, lru.lru_get_top());
@@ -229,6 +229,8 @@ void MDCache::log_stat()
   mds->logger->set(l_mds_inodes_pin_tail, lru.lru_get_pintail());
   mds->logger->set(l_mds_inodes_with_caps, num_inodes_with_caps);
   mds->logger->set(l_mds_caps, Capability::count());
+  mds->logger->set(l_mds_cache_memory_max, cache_limit_memory());
+  mds->logger->set(l_mds_cache_memory, cache_memory_size());
 }
 
 
@@ -269,8 +271,7 @@ void MDCache::add_inode(CInode *in)
       base_inodes.insert(in);
   }
 
-  if (CInode::count() >
-        g_conf->mds_cache_size * g_conf->mds_health_cache_threshold) {
+  if (cache_overfull()) {
     exceeded_size_limit = true;
   }
 }
@@ -6400,17 +6401,29 @@ void MDCache::start_recovered_truncates()
  */
 bool MDCache::trim(int max, int count)
 {
+  bool trim_memory = false;
+
   // trim LRU
   if (count > 0) {
     max = lru.lru_get_size() - count;
     if (max <= 0)
       max = 1;
   } else if (max < 0) {
-    max = g_conf->mds_cache_size;
-    if (max <= 0)
-      return false;
-  }
-  dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size() << dendl;
+    // trim down to the inode limit, and further while we are over the
+    // memory limit
+    max = cache_limit_inodes();
+    if (max <= 0) {
+      if (!cache_limit_memory())
+	return false;
+      max = lru.lru_get_size();
+      // no inode limit, so let the midpoint follow the cache size
+      lru.lru_set_max(max);
+    }
+    trim_memory = cache_limit_memory() > 0;
+  }
+  dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size()
+	  << " bytes=" << cache_memory_size() << "/" << cache_limit_memory()
+	  << dendl;
 
   // process delayed eval_stray()
   stray_manager.advance_delayed();
@@ -6420,18 +6433,20 @@ bool MDCache::trim(int max, int count)
   int unexpirable = 0;
   list<CDentry*> unexpirables;
 
-  // trim dentries from the LRU: only enough to satisfy `max`,
-  // unless we see null dentries at the bottom of the LRU,
+  // trim dentries from the LRU: only enough to satisfy `max` and the
+  // memory limit, unless we see null dentries at the bottom of the LRU,
   // in which case trim all those.
   bool trimming_nulls = true;
-  while (trimming_nulls || lru.lru_get_size() + unexpirable > (unsigned)max) {
+  while (trimming_nulls || lru.lru_get_size() + unexpirable > (unsigned)max ||
+	 (trim_memory && cache_toofull())) {
     CDentry *dn = static_cast<CDentry*>(lru.lru_expire());
     if (!dn) {
       break;
     }
     if (!dn->get_linkage()->is_null()) {
       trimming_nulls = false;
-      if (lru.lru_get_size() + unexpirable < (unsigned)max) {
+      if (lru.lru_get_size() + unexpirable < (unsigned)max &&
+	  !(trim_memory && cache_toofull())) {
 	unexpirables.push_back(dn);
 	break;
       }
@@ -7376,20 +7391,21 @@ void MDCache::check_memory_usage()
   mds->mlogger->set(l_mdm_rss, last.get_rss());
   mds->mlogger->set(l_mdm_heap, last.get_heap());
 
-  if (num_inodes_with_caps > g_conf->mds_cache_size) {
-    float ratio = (float)g_conf->mds_cache_size * .9 / (float)num_inodes_with_caps;
-    if (ratio < 1.0) {
-      last_recall_state = ceph_clock_now();
-      mds->server->recall_client_state(ratio);
-    }
+  // Recall caps in proportion to how far over the cache limits we are,
+  // so that clients release at most 80% of their caps at once.
+  float ratio = 1.0;
+  if (cache_limit_inodes() && num_inodes_with_caps > cache_limit_inodes())
+    ratio = (float)cache_limit_inodes() * .9 / (float)num_inodes_with_caps;
+  ratio = MIN(ratio, 1.0 - MIN(0.8, cache_toofull_ratio()));
+  if (ratio < 1.0) {
+    last_recall_state = ceph_clock_now();
+    mds->server->recall_client_state(ratio);
   }
 
   // If the cache size had exceeded its limit, but we're back in bounds
   // now, free any unused pool memory so that our memory usage isn't
   // permanently bloated.
-  if (exceeded_size_limit
-      && CInode::count() <=
-        g_conf->mds_cache_size * g_conf->mds_health_cache_threshold) {
+  if (exceeded_size_limit && !cache_overfull()) {
     // Only do this once we are back in bounds: otherwise the releases would
     // slow down whatever process caused us to exceed bounds to begin with
     if (ceph_using_tcmalloc()) {
@@ -660,6 +660,46 @@ public:
   void set_cache_size(size_t max) { lru.lru_set_max(max); }
   size_t get_cache_size() { return lru.lru_get_size(); }
 
+  // cache limits: mds_cache_size caps the number of inodes and
+  // mds_cache_memory_limit the bytes of cache metadata (the mds_co
+  // mempool: CInode, CDentry, CDir, Capability and dentry maps); 0
+  // disables either.  we trim and recall caps once we are past
+  // (1 - mds_cache_reservation) of a limit.
+  static uint64_t cache_limit_inodes() {
+    return g_conf->mds_cache_size > 0 ? g_conf->mds_cache_size : 0;
+  }
+  static uint64_t cache_limit_memory() {
+    return g_conf->mds_cache_memory_limit;
+  }
+  static uint64_t cache_memory_size() {
+    return mempool::mds_co::allocated_bytes();
+  }
+  /// how far past the reserved fraction of the tightest limit we are
+  /// (0 if within it): 0.1 means 10% over
+  static double cache_toofull_ratio() {
+    double keep = 1.0 - g_conf->mds_cache_reservation;
+    double r = 0;
+    if (cache_limit_inodes()) {
+      double want = cache_limit_inodes() * keep;
+      r = MAX(r, (CInode::count() - want) / want);
+    }
+    if (cache_limit_memory()) {
+      double want = cache_limit_memory() * keep;
+      r = MAX(r, (cache_memory_size() - want) / want);
+    }
+    return r;
+  }
+  static bool cache_toofull() { return cache_toofull_ratio() > 0; }
+  /// true if we exceed a limit by mds_health_cache_threshold
+  static bool cache_overfull() {
+    return (cache_limit_inodes() &&
+	    CInode::count() >
+	      cache_limit_inodes() * g_conf->mds_health_cache_threshold) ||
+      (cache_limit_memory() &&
+       cache_memory_size() >
+         cache_limit_memory() * g_conf->mds_health_cache_threshold);
+  }
+
   // trimming
   bool trim(int max=-1, int count=-1);   // trim cache
   bool trim_dentry(CDentry *dn, map<mds_rank_t, MCacheExpire*>& expiremap);
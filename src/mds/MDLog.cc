@@ -78,6 +78,14 @@ void MDLog::create_logger()
 
   plb.add_u64_counter(l_mdl_replayed, "replayed", "Events replayed");
 
+  plb.add_u64_counter(l_mdl_jflush, "jflush", "Journal flushes issued");
+  plb.add_u64_counter(l_mdl_jflush_deferred, "jflush_deferred",
+      "Journal flushes folded into a later one");
+  plb.add_u64_avg(l_mdl_jflush_events, "jflush_events",
+      "Events per journal flush");
+  plb.add_time_avg(l_mdl_jflush_lat, "jflush_lat",
+      "Journal flush latency, from issue to safe");
+
   // logger
   logger = plb.create_perf_counters();
   g_ceph_context->get_perfcounters_collection()->add(logger);
@@ -394,6 +402,11 @@ void MDLog::_submit_thread()
       // journal it.
       const uint64_t new_write_pos = journaler->append_entry(bl);  // bl is destroyed.
       ls->end = new_write_pos;
+      {
+	// count it before a flush below picks up the tally
+	Mutex::Locker l(submit_mutex);
+	events_since_flush++;
+      }
 
       MDSLogContextBase *fin;
       if (data.fin) {
@@ -407,7 +420,7 @@ void MDLog::_submit_thread()
       journaler->wait_for_flush(fin);
 
       if (data.flush)
-	journaler->flush();
+	_flush_journal();
 
       if (logger)
 	logger->set(l_mdl_wrpos, ls->end);
@@ -423,7 +436,7 @@ void MDLog::_submit_thread()
 	journaler->wait_for_flush(fin2);
       }
       if (data.flush)
-	journaler->flush();
+	_flush_journal();
     }
 
     submit_mutex.Lock();
@@ -468,7 +481,73 @@ void MDLog::flush()
   submit_mutex.Unlock();
 
   if (do_flush)
-    journaler->flush();
+    _flush_journal();
+}
+
+class C_MDL_JournalFlushed : public Context {
+  MDLog *mdlog;
+  uint64_t events;
+  utime_t start;
+public:
+  C_MDL_JournalFlushed(MDLog *m, uint64_t e, utime_t s)
+    : mdlog(m), events(e), start(s) {}
+  void finish(int r) override {
+    mdlog->_journal_flushed(r, events, start);
+  }
+};
+
+/*
+ * Write out everything appended to the journal so far.  If
+ * mds_log_max_inflight_flushes flushes are already on their way to
+ * RADOS, don't issue another small write: note that one is wanted
+ * and let the next flush to become safe issue it, carrying everything
+ * appended in the meantime (group commit).  Under light load this
+ * flushes immediately; under heavy load the batch grows to whatever
+ * arrives during one journal round trip.
+ */
+void MDLog::_flush_journal()
+{
+  uint64_t events;
+  {
+    Mutex::Locker l(submit_mutex);
+    int max = g_conf->mds_log_max_inflight_flushes;
+    if (max > 0 && flushes_in_flight >= max) {
+      flush_deferred = true;
+      if (logger)
+	logger->inc(l_mdl_jflush_deferred);
+      return;
+    }
+    flushes_in_flight++;
+    // this flush carries whatever a deferred one was asked for
+    flush_deferred = false;
+    events = events_since_flush;
+    events_since_flush = 0;
+  }
+
+  if (logger)
+    logger->inc(l_mdl_jflush);
+  journaler->flush(new C_MDL_JournalFlushed(this, events, ceph_clock_now()));
+}
+
+void MDLog::_journal_flushed(int r, uint64_t events, utime_t start)
+{
+  bool kick;
+  {
+    Mutex::Locker l(submit_mutex);
+    assert(flushes_in_flight > 0);
+    flushes_in_flight--;
+    // on error the deferred flush stays pending and is issued by the
+    // next flush rather than dropped
+    kick = flush_deferred && r == 0 && !mds->is_daemon_stopping();
+  }
+
+  if (logger) {
+    logger->inc(l_mdl_jflush_events, events);
+    logger->tinc(l_mdl_jflush_lat, ceph_clock_now() - start);
+  }
+
+  if (kick)
+    _flush_journal();
 }
 
 void MDLog::kick_submitter()
@@ -35,6 +35,10 @@ enum {
   l_mdl_rdpos,
   l_mdl_jlat,
   l_mdl_replayed,
+  l_mdl_jflush,
+  l_mdl_jflush_deferred,
+  l_mdl_jflush_events,
+  l_mdl_jflush_lat,
   l_mdl_last,
 };
 
@@ -139,6 +143,15 @@ protected:
   Mutex submit_mutex;
   Cond submit_cond;
 
+  // group commit state, protected by submit_mutex
+  int flushes_in_flight;    // journal flushes not yet safe
+  bool flush_deferred;      // a flush was asked for while at the limit
+  uint64_t events_since_flush;
+
+  void _flush_journal();
+  void _journal_flushed(int r, uint64_t events, utime_t start);
+  friend class C_MDL_JournalFlushed;
+
   void set_safe_pos(uint64_t pos)
   {
     Mutex::Locker l(submit_mutex);
@@ -205,6 +218,9 @@ public:
                       event_seq(0), expiring_events(0), expired_events(0),
 		      mdsmap_up_features(0),
                       submit_mutex("MDLog::submit_mutex"),
+                      flushes_in_flight(0),
+                      flush_deferred(false),
+                      events_since_flush(0),
                       submit_thread(this),
                       cur_event(NULL) { }		  
   ~MDLog();
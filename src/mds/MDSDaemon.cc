@@ -295,6 +295,11 @@ void MDSDaemon::set_up_admin_socket()
 				     asok_hook,
 				     "Return the subtree map");
   assert(r == 0);
+  r = admin_socket->register_command("dump heatmap",
+				     "dump heatmap",
+				     asok_hook,
+				     "Dump the balancer's dirfrag load heatmap");
+  assert(r == 0);
   r = admin_socket->register_command("dirfrag split",
 				     "dirfrag split "
                                      "name=path,type=CephString,req=true "
@@ -339,6 +344,7 @@ void MDSDaemon::clean_up_admin_socket()
   admin_socket->unregister_command("flush journal");
   admin_socket->unregister_command("force_readonly");
   admin_socket->unregister_command("get subtrees");
+  admin_socket->unregister_command("dump heatmap");
   admin_socket->unregister_command("dirfrag split");
   admin_socket->unregister_command("dirfrag merge");
   admin_socket->unregister_command("dirfrag ls");
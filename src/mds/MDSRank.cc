@@ -301,16 +301,21 @@ void MDSRankDispatcher::tick()
       uint64_t pq_progress = 0 ;
       uint64_t pq_total = 0;
       size_t pq_in_flight = 0;
-      if (!purge_queue.drain(&pq_progress, &pq_total, &pq_in_flight)) {
+      double pq_eta = 0;
+      if (!purge_queue.drain(&pq_progress, &pq_total, &pq_in_flight,
+                             &pq_eta)) {
         dout(7) << "shutdown_pass=true, but still waiting for purge queue"
                 << dendl;
         // This takes unbounded time, so we must indicate progress
         // to the administrator: we do it in a slightly imperfect way
         // by sending periodic (tick frequency) clog messages while
         // in this state.
+        std::ostringstream eta;
+        if (pq_eta > 0)
+          eta << ", about " << (uint64_t)pq_eta << "s remaining";
         clog->info() << "MDS rank " << whoami << " waiting for purge queue ("
           << std::dec << pq_progress << "/" << pq_total << " " << pq_in_flight
-          << " files purging" << ")";
+          << " files purging" << eta.str() << ")";
       } else {
         dout(7) << "shutdown_pass=true, finished w/ shutdown, moving to "
                    "down:stopped" << dendl;
@@ -673,6 +678,12 @@ bool MDSRank::_dispatch(Message *m, bool new_msg)
     mlogger->set(l_mdm_caps, Capability::decrements());
 
     mlogger->set(l_mdm_buf, buffer::get_total_alloc());
+
+    mlogger->set(l_mdm_cache_bytes, MDCache::cache_memory_size());
+    mlogger->set(l_mdm_ino_bytes, CInode::count() * sizeof(CInode));
+    mlogger->set(l_mdm_dir_bytes, CDir::count() * sizeof(CDir));
+    mlogger->set(l_mdm_dn_bytes, CDentry::count() * sizeof(CDentry));
+    mlogger->set(l_mdm_cap_bytes, Capability::count() * sizeof(Capability));
   }
 
   return true;
@@ -1886,6 +1897,9 @@ bool MDSRankDispatcher::handle_asok_command(
     command_flush_journal(f);
   } else if (command == "get subtrees") {
     command_get_subtrees(f);
+  } else if (command == "dump heatmap") {
+    Mutex::Locker l(mds_lock);
+    balancer->dump_heatmap(f);
   } else if (command == "export dir") {
     string path;
     if(!cmd_getval(g_ceph_context, cmdmap, "path", path)) {
@@ -2497,6 +2511,8 @@ void MDSRank::create_logger()
       l_mds_forward, "forward", "Forwarding request", "fwd",
       PerfCountersBuilder::PRIO_INTERESTING);
     mds_plb.add_u64_counter(l_mds_dir_fetch, "dir_fetch", "Directory fetch");
+    mds_plb.add_u64_counter(l_mds_dir_prefetch, "dir_prefetch",
+			    "Directory fetch ahead of readdir");
     mds_plb.add_u64_counter(l_mds_dir_commit, "dir_commit", "Directory commit");
     mds_plb.add_u64_counter(l_mds_dir_split, "dir_split", "Directory split");
     mds_plb.add_u64_counter(l_mds_dir_merge, "dir_merge", "Directory merge");
@@ -2514,6 +2530,10 @@ void MDSRank::create_logger()
       l_mds_inodes_with_caps, "inodes_with_caps", "Inodes with capabilities");
     mds_plb.add_u64(l_mds_caps, "caps", "Capabilities", "caps",
 		    PerfCountersBuilder::PRIO_INTERESTING);
+    mds_plb.add_u64(l_mds_cache_memory_max, "cache_memory_max",
+		    "Max cache memory, bytes");
+    mds_plb.add_u64(l_mds_cache_memory, "cache_memory",
+		    "Cache memory (mds_co mempool), bytes");
     mds_plb.add_u64(l_mds_subtrees, "subtrees", "Subtrees");
 
     mds_plb.add_u64_counter(l_mds_traverse, "traverse", "Traverses");
@@ -2561,6 +2581,12 @@ void MDSRank::create_logger()
     mdm_plb.add_u64(l_mdm_rss, "rss", "RSS");
     mdm_plb.add_u64(l_mdm_heap, "heap", "Heap size");
     mdm_plb.add_u64(l_mdm_buf, "buf", "Buffer size");
+    mdm_plb.add_u64(l_mdm_cache_bytes, "cache_bytes",
+		    "Cache metadata (mds_co mempool) size");
+    mdm_plb.add_u64(l_mdm_ino_bytes, "ino_bytes", "Inode objects size");
+    mdm_plb.add_u64(l_mdm_dir_bytes, "dir_bytes", "Directory objects size");
+    mdm_plb.add_u64(l_mdm_dn_bytes, "dn_bytes", "Dentry objects size");
+    mdm_plb.add_u64(l_mdm_cap_bytes, "cap_bytes", "Capability objects size");
     mlogger = mdm_plb.create_perf_counters();
     g_ceph_context->get_perfcounters_collection()->add(mlogger);
   }
@@ -43,6 +43,7 @@ enum {
   l_mds_reply_latency,
   l_mds_forward,
   l_mds_dir_fetch,
+  l_mds_dir_prefetch,
   l_mds_dir_commit,
   l_mds_dir_split,
   l_mds_dir_merge,
@@ -55,6 +56,8 @@ enum {
   l_mds_inodes_expired,
   l_mds_inodes_with_caps,
   l_mds_caps,
+  l_mds_cache_memory_max,
+  l_mds_cache_memory,
   l_mds_subtrees,
   l_mds_traverse,
   l_mds_traverse_hit,
@@ -90,6 +93,11 @@ enum {
   l_mdm_rss,
   l_mdm_heap,
   l_mdm_buf,
+  l_mdm_cache_bytes,
+  l_mdm_ino_bytes,
+  l_mdm_dir_bytes,
+  l_mdm_dn_bytes,
+  l_mdm_cap_bytes,
   l_mdm_last,
 };
 
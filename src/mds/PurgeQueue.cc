@@ -79,7 +79,11 @@ PurgeQueue::PurgeQueue(
     max_purge_ops(0),
     drain_initial(0),
     draining(false),
-    delayed_flush(nullptr)
+    delayed_flush(nullptr),
+    have_stashed(false),
+    stashed_expire_to(0),
+    rate_pos(0),
+    drain_rate(0)
 {
   assert(cct != nullptr);
   assert(on_error != nullptr);
@@ -101,6 +105,10 @@ void PurgeQueue::create_logger()
   pcb.add_u64(l_pq_executing_ops, "pq_executing_ops", "Purge queue ops in flight");
   pcb.add_u64(l_pq_executing, "pq_executing", "Purge queue tasks in flight");
   pcb.add_u64_counter(l_pq_executed, "pq_executed", "Purge queue tasks executed", "purg");
+  pcb.add_time_avg(l_pq_item_lat, "pq_item_latency",
+                   "Purge queue task latency, per round of object deletes");
+  pcb.add_u64(l_pq_drain_eta, "pq_drain_eta",
+              "Projected seconds until the purge queue is empty");
 
   logger.reset(pcb.create_perf_counters());
   g_ceph_context->get_perfcounters_collection()->add(logger.get());
@@ -278,6 +286,27 @@ uint32_t PurgeQueue::_calculate_ops(const PurgeItem &item) const
   return ops_required;
 }
 
+int64_t PurgeQueue::_get_pool(const PurgeItem &item) const
+{
+  if (item.action == PurgeItem::PURGE_DIR)
+    return metadata_pool;
+  return item.layout.pool_id;
+}
+
+/*
+ * Filer issues at most filer_max_purge_ops deletes per file at a time,
+ * so a large file is purged in several rounds: normalize its latency
+ * by that before comparing it with the target.
+ */
+uint32_t PurgeQueue::_calculate_rounds(const PurgeItem &item) const
+{
+  if (item.action == PurgeItem::PURGE_DIR || item.size == 0)
+    return 1;
+  const uint64_t num = Striper::get_num_objects(item.layout, item.size);
+  const uint64_t per_round = MAX(1, g_conf->filer_max_purge_ops);
+  return MAX(1, (num + per_round - 1) / per_round);
+}
+
 bool PurgeQueue::can_consume()
 {
   dout(20) << ops_in_flight << "/" << max_purge_ops << " ops, "
@@ -307,12 +336,37 @@ bool PurgeQueue::can_consume()
   }
 }
 
+bool PurgeQueue::_pool_can_execute(const PurgeItem &item)
+{
+  auto p = pool_throttle.find(_get_pool(item));
+  if (p == pool_throttle.end())
+    return true;
+  PoolThrottle &pt = p->second;
+  // like can_consume, always let one item per pool through
+  if (pt.ops_in_flight == 0 ||
+      pt.ops_in_flight + _calculate_ops(item) <= pt.window) {
+    return true;
+  }
+  dout(20) << "Throttling on pool " << p->first << " limit "
+           << pt.ops_in_flight << "/" << pt.window << dendl;
+  return false;
+}
+
 bool PurgeQueue::_consume()
 {
   assert(lock.is_locked_by_me());
 
   bool could_consume = false;
   while(can_consume()) {
+    if (have_stashed) {
+      if (!_pool_can_execute(stashed_item))
+        break;
+      could_consume = true;
+      have_stashed = false;
+      _execute_item(stashed_item, stashed_expire_to);
+      continue;
+    }
+
     could_consume = true;
 
     if (delayed_flush) {
@@ -354,6 +408,14 @@ bool PurgeQueue::_consume()
            << journaler.get_read_pos() << dendl;
       on_error->complete(0);
     }
+    if (!_pool_can_execute(item)) {
+      // keep it for when the pool has room: items of other pools
+      // behind it wait too, as we consume the journal in order
+      stashed_item = item;
+      stashed_expire_to = journaler.get_read_pos();
+      have_stashed = true;
+      break;
+    }
     dout(20) << " executing item (0x" << std::hex << item.ino
              << std::dec << ")" << dendl;
     _execute_item(item, journaler.get_read_pos());
@@ -371,9 +433,13 @@ void PurgeQueue::_execute_item(
   assert(lock.is_locked_by_me());
 
   in_flight[expire_to] = item;
+  in_flight_start[expire_to] = ceph_clock_now();
   logger->set(l_pq_executing, in_flight.size());
   ops_in_flight += _calculate_ops(item);
   logger->set(l_pq_executing_ops, ops_in_flight);
+  auto pt = pool_throttle.find(_get_pool(item));
+  if (pt != pool_throttle.end())
+    pt->second.ops_in_flight += _calculate_ops(item);
 
   SnapContext nullsnapc;
 
@@ -439,7 +505,12 @@ void PurgeQueue::_execute_item(
   } else {
     derr << "Invalid item (action=" << item.action << ") in purge queue, "
             "dropping it" << dendl;
+    ops_in_flight -= _calculate_ops(item);
+    logger->set(l_pq_executing_ops, ops_in_flight);
+    if (pt != pool_throttle.end())
+      pt->second.ops_in_flight -= _calculate_ops(item);
     in_flight.erase(expire_to);
+    in_flight_start.erase(expire_to);
     logger->set(l_pq_executing, in_flight.size());
     return;
   }
@@ -501,11 +572,81 @@ void PurgeQueue::_execute_item_complete(
   dout(10) << "completed item for ino 0x" << std::hex << iter->second.ino
            << std::dec << dendl;
 
+  auto start = in_flight_start.find(expire_to);
+  assert(start != in_flight_start.end());
+  double latency = (double)(ceph_clock_now() - start->second) /
+                   _calculate_rounds(iter->second);
+  in_flight_start.erase(start);
+  utime_t lat;
+  lat.set_from_double(latency);
+  logger->tinc(l_pq_item_lat, lat);
+  _update_pool_window(iter->second, latency);
+
   in_flight.erase(iter);
   logger->set(l_pq_executing, in_flight.size());
   dout(10) << "in_flight.size() now " << in_flight.size() << dendl;
 
   logger->inc(l_pq_executed);
+  _update_drain_rate();
+}
+
+/*
+ * Grow the pool's window by the ops of each item that completed within
+ * mds_purge_latency_target per round, and halve it (at most once per
+ * target interval) when one didn't.  Growing by the ops that complete
+ * lets the window double every round trip, so it recovers quickly once
+ * the OSDs catch up.
+ */
+void PurgeQueue::_update_pool_window(const PurgeItem &item, double latency)
+{
+  auto p = pool_throttle.find(_get_pool(item));
+  if (p == pool_throttle.end())
+    return;
+  PoolThrottle &pt = p->second;
+  // the pool may have started being throttled while this was in flight
+  const uint32_t ops = _calculate_ops(item);
+  pt.ops_in_flight -= MIN(pt.ops_in_flight, ops);
+
+  const double target = g_conf->mds_purge_latency_target;
+  if (target <= 0) {
+    pt.window = pt.max_ops;
+    return;
+  }
+  utime_t now = ceph_clock_now();
+  if (latency > target) {
+    if ((double)(now - pt.last_backoff) > target) {
+      pt.window = MAX(1.0, pt.window / 2);
+      pt.last_backoff = now;
+      dout(10) << "pool " << p->first << " purge latency " << latency
+               << " > " << target << ", window now " << pt.window << dendl;
+    }
+  } else {
+    pt.window = MIN((double)pt.max_ops, pt.window + ops);
+  }
+}
+
+void PurgeQueue::_update_drain_rate()
+{
+  const utime_t now = ceph_clock_now();
+  const uint64_t pos = journaler.get_read_pos();
+  if (rate_stamp == utime_t() || pos < rate_pos) {
+    rate_stamp = now;
+    rate_pos = pos;
+    return;
+  }
+  const double elapsed = now - rate_stamp;
+  if (elapsed < 10.0)
+    return;
+
+  // smooth over the last few samples
+  const double rate = (pos - rate_pos) / elapsed;
+  drain_rate = drain_rate > 0 ? .5 * drain_rate + .5 * rate : rate;
+  rate_stamp = now;
+  rate_pos = pos;
+
+  const uint64_t remaining = journaler.get_write_pos() - pos;
+  logger->set(l_pq_drain_eta,
+              drain_rate > 0 ? (uint64_t)(remaining / drain_rate) : 0);
 }
 
 void PurgeQueue::update_op_limit(const MDSMap &mds_map)
@@ -513,6 +654,7 @@ void PurgeQueue::update_op_limit(const MDSMap &mds_map)
   Mutex::Locker l(lock);
 
   uint64_t pg_count = 0;
+  std::map<int64_t, uint64_t> pool_pg_count;
   objecter->with_osdmap([&](const OSDMap& o) {
     // Number of PGs across all data pools
     const std::set<int64_t> &data_pools = mds_map.get_data_pools();
@@ -525,6 +667,7 @@ void PurgeQueue::update_op_limit(const MDSMap &mds_map)
         continue;
       }
       pg_count += o.get_pg_num(dp);
+      pool_pg_count[dp] = o.get_pg_num(dp);
     }
   });
 
@@ -537,6 +680,22 @@ void PurgeQueue::update_op_limit(const MDSMap &mds_map)
   if (cct->_conf->mds_max_purge_ops) {
     max_purge_ops = MIN(max_purge_ops, cct->_conf->mds_max_purge_ops);
   }
+
+  // Give each data pool the share of that limit its PGs account for,
+  // so that purges of files in a small pool don't load its OSDs with
+  // ops meant to be spread over every pool.
+  for (auto &p : pool_pg_count) {
+    PoolThrottle &pt = pool_throttle[p.first];
+    pt.max_ops = pg_count ? MAX(1, max_purge_ops * p.second / pg_count) : 0;
+    if (pt.window == 0 || pt.window > pt.max_ops)
+      pt.window = pt.max_ops;
+  }
+  for (auto p = pool_throttle.begin(); p != pool_throttle.end(); ) {
+    if (pool_pg_count.count(p->first) == 0 && p->second.ops_in_flight == 0)
+      pool_throttle.erase(p++);
+    else
+      ++p;
+  }
 }
 
 void PurgeQueue::handle_conf_change(const struct md_config_t *conf,
@@ -565,14 +724,16 @@ void PurgeQueue::handle_conf_change(const struct md_config_t *conf,
 bool PurgeQueue::drain(
     uint64_t *progress,
     uint64_t *progress_total,
-    size_t *in_flight_count
+    size_t *in_flight_count,
+    double *eta
     )
 {
   assert(progress != nullptr);
   assert(progress_total != nullptr);
   assert(in_flight_count != nullptr);
+  assert(eta != nullptr);
 
-  const bool done = in_flight.empty() && (
+  const bool done = in_flight.empty() && !have_stashed && (
       journaler.get_read_pos() == journaler.get_write_pos());
   if (done) {
     return true;
@@ -587,8 +748,11 @@ bool PurgeQueue::drain(
     draining = true;
 
     // Life the op throttle as this daemon now has nothing to do but
-    // drain the purge queue, so do it as fast as we can.
+    // drain the purge queue, so do it as fast as we can.  The pool
+    // windows still back off if the OSDs can't keep up.
     max_purge_ops = 0xffff;
+    for (auto &p : pool_throttle)
+      p.second.max_ops = max_purge_ops;
   }
 
   drain_initial = max(bytes_remaining, drain_initial);
@@ -596,6 +760,7 @@ bool PurgeQueue::drain(
   *progress = drain_initial - bytes_remaining;
   *progress_total = drain_initial;
   *in_flight_count = in_flight.size();
+  *eta = drain_rate > 0 ? bytes_remaining / drain_rate : 0;
 
   return false;
 }
@@ -60,6 +60,8 @@ enum {
   l_pq_executing_ops,
   l_pq_executing,
   l_pq_executed,
+  l_pq_item_lat,
+  l_pq_drain_eta,
   l_pq_last
 };
 
@@ -101,9 +103,43 @@ protected:
   // Dynamic op limit per MDS based on PG count
   uint64_t max_purge_ops;
 
+  /**
+   * Per data pool share of the op limit, by the pool's PG count.  The
+   * window is the part of it we currently use: it backs off while
+   * purges in the pool take longer than mds_purge_latency_target and
+   * grows back as they speed up again.
+   */
+  struct PoolThrottle {
+    uint64_t ops_in_flight = 0;
+    uint64_t max_ops = 0;
+    double window = 0;
+    utime_t last_backoff;
+  };
+  std::map<int64_t, PoolThrottle> pool_throttle;
+
+  // Start time of each item in flight, by journal offset
+  std::map<uint64_t, utime_t> in_flight_start;
+
+  // An item read from the journal that is waiting for its pool's
+  // throttle; it goes before anything else we read
+  bool have_stashed;
+  PurgeItem stashed_item;
+  uint64_t stashed_expire_to;
+
+  // Rate at which we consume the queue, in bytes/s, for the projected
+  // drain time
+  utime_t rate_stamp;
+  uint64_t rate_pos;
+  double drain_rate;
+
   uint32_t _calculate_ops(const PurgeItem &item) const;
+  int64_t _get_pool(const PurgeItem &item) const;
+  uint32_t _calculate_rounds(const PurgeItem &item) const;
 
   bool can_consume();
+  bool _pool_can_execute(const PurgeItem &item);
+  void _update_pool_window(const PurgeItem &item, double latency);
+  void _update_drain_rate();
 
   // How many bytes were remaining when drain() was first called,
   // used for indicating progress.
@@ -159,13 +195,15 @@ public:
    * @param progress: bytes consumed since we started draining
    * @param progress_total: max bytes that were outstanding during purge
    * @param in_flight_count: number of file purges currently in flight
+   * @param eta: projected seconds until the queue is empty, 0 if unknown
    *
    * @returns true if drain is complete
    */
   bool drain(
     uint64_t *progress,
     uint64_t *progress_total,
-    size_t *in_flight_count);
+    size_t *in_flight_count,
+    double *eta);
 
   void update_op_limit(const MDSMap &mds_map);
 
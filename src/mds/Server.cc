@@ -935,7 +935,10 @@ void Server::recover_filelocks(CInode *in, bufferlist locks, int64_t client)
  */
 void Server::recall_client_state(float ratio)
 {
-  int max_caps_per_client = (int)(g_conf->mds_cache_size * .8);
+  uint64_t limit = MDCache::cache_limit_inodes();
+  if (!limit)
+    limit = Capability::count();
+  int max_caps_per_client = MAX((int)(limit * .8), 100);
   int min_caps_per_client = 100;
 
   dout(10) << "recall_client_state " << ratio
@@ -2753,6 +2756,36 @@ CDir* Server::try_open_auth_dirfrag(CInode *diri, frag_t fg, MDRequestRef& mdr)
   return dir;
 }
 
+/*
+ * Fetch the dirfrags that follow fg (in the order a readdir walks
+ * them), up to mds_readdir_prefetch_frags of them.  Only frags we are
+ * auth for and that can be fetched right now are touched; anything
+ * else is left for the readdir to deal with when it gets there.
+ */
+void Server::prefetch_readdir_frags(CInode *diri, frag_t fg)
+{
+  int max = g_conf->mds_readdir_prefetch_frags;
+  for (int n = 0; n < max && !fg.is_rightmost(); n++) {
+    fg = diri->dirfragtree[fg.next().value()];
+
+    CDir *dir = diri->get_dirfrag(fg);
+    if (!dir) {
+      if (!diri->is_auth() || diri->is_frozen())
+	break;
+      dir = diri->get_or_open_dirfrag(mdcache, fg);
+    }
+    if (!dir->is_auth() || dir->is_complete() ||
+	dir->state_test(CDir::STATE_FETCHING) ||
+	!dir->can_auth_pin())
+      continue;
+
+    dout(10) << "prefetch_readdir_frags fetching " << *dir << dendl;
+    if (mds->logger)
+      mds->logger->inc(l_mds_dir_prefetch);
+    dir->fetch(NULL);
+  }
+}
+
 
 // ===============================================================================
 // STAT
@@ -3406,6 +3439,11 @@ void Server::handle_client_readdir(MDRequestRef& mdr)
   dout(10) << "handle_client_readdir on " << *dir << dendl;
   assert(dir->is_auth());
 
+  // start loading the frags the client will ask for next, so that
+  // their fetches overlap with this one and with the client consuming
+  // the reply
+  prefetch_readdir_frags(diri, fg);
+
   if (!dir->is_complete()) {
     if (dir->is_frozen()) {
       dout(7) << "dir is frozen " << *dir << dendl;
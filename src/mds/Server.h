@@ -155,6 +155,7 @@ public:
 				    file_layout_t **layout=NULL);
 
   CDir* try_open_auth_dirfrag(CInode *diri, frag_t fg, MDRequestRef& mdr);
+  void prefetch_readdir_frags(CInode *diri, frag_t fg);
 
 
   // requests on existing inodes.
@@ -82,6 +82,9 @@ void ClusterState::ingest_pgstats(MPGStats *stats)
       dout(15) << " had " << pgid << " from " << pg_map.pg_stat[pgid].reported_epoch << ":"
                << pg_map.pg_stat[pgid].reported_seq << dendl;
       continue;
+    // Nothing to apply if the stats were resent unchanged
+    } else if (pg_map.pg_stat[pgid] == pg_stats) {
+      continue;
     }
 
     pending_inc.pg_stat_updates[pgid] = pg_stats;
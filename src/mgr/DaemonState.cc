@@ -13,6 +13,9 @@
 
 #include "DaemonState.h"
 
+#include <algorithm>
+#include <numeric>
+
 #define dout_context g_ceph_context
 #define dout_subsys ceph_subsys_mgr
 #undef dout_prefix
@@ -107,6 +110,18 @@ void DaemonStateIndex::cull(entity_type_t daemon_type,
   }
 }
 
+DaemonPerfCounters::DaemonPerfCounters(PerfCounterTypes &types_)
+  : types(types_),
+    // the newest raw sample is the current value, so at least one is kept
+    raw_t(std::max<int64_t>(1, g_conf->mgr_stats_history_samples)),
+    coarse_t(std::max<int64_t>(0, g_conf->mgr_stats_history_coarse_samples)),
+    raw_samples(std::max<int64_t>(1, g_conf->mgr_stats_history_samples)),
+    coarse_samples(std::max<int64_t>(0,
+                     g_conf->mgr_stats_history_coarse_samples)),
+    downsample_interval(g_conf->mgr_stats_history_coarse_interval, 0)
+{
+}
+
 void DaemonPerfCounters::update(MMgrReport *report)
 {
   dout(20) << "loading " << report->declare_types.size() << " new types, "
@@ -126,6 +141,19 @@ void DaemonPerfCounters::update(MMgrReport *report)
 
   const auto now = ceph_clock_now();
 
+  // Once the raw rings are full this report pushes the oldest raw
+  // sample out; keep it in the coarse rings if it is at least
+  // downsample_interval newer than the last one we kept.
+  const uint64_t seq = next_seq++;
+  int64_t coarse_seq = -1;
+  if (raw_t.full() && coarse_samples > 0 &&
+      (coarse_t.empty() ||
+       raw_t.front() - coarse_t.back() >= downsample_interval)) {
+    coarse_seq = next_coarse_seq++;
+    coarse_t.push(coarse_seq, raw_t.front());
+  }
+  raw_t.push(seq, now);
+
   // Parse packed data according to declared set of types
   bufferlist::iterator p = report->packed.begin();
   DECODE_START(1, p);
@@ -141,18 +169,90 @@ void DaemonPerfCounters::update(MMgrReport *report)
       ::decode(avgcount2, p);
     }
     // TODO: interface for insertion of avgs
-    instances[t_path].push(now, val);
+    auto i = instances.find(t_path);
+    if (i == instances.end()) {
+      i = instances.emplace(
+	t_path, PerfCounterInstance(raw_samples, coarse_samples)).first;
+    }
+    i->second.push(seq, val, coarse_seq);
   }
   DECODE_FINISH(p);
 }
 
-uint64_t PerfCounterInstance::get_current() const
+int DaemonPerfCounters::get_summary(const std::string &path, utime_t since,
+				    PerfCounterSummary *out) const
 {
-  return buffer.front().v;
+  auto i = instances.find(path);
+  if (i == instances.end())
+    return -ENOENT;
+  auto t = types.find(path);
+  const bool is_counter = t != types.end() &&
+    (t->second.type & PERFCOUNTER_COUNTER);
+
+  PerfCounterSummary r;
+  std::vector<double> points;
+  points.reserve(i->second.raw.size() + i->second.coarse.size());
+  for_each_sample(i->second, since,
+    [&](const utime_t &st, uint64_t v) {
+      if (r.count == 0) {
+	r.first_t = st;
+	r.first_v = v;
+	if (!is_counter)
+	  points.push_back(v);
+      } else if (is_counter) {
+	double dt = st - r.last_t;
+	if (dt > 0)
+	  points.push_back(((double)v - (double)r.last_v) / dt);
+      } else {
+	points.push_back(v);
+      }
+      r.last_t = st;
+      r.last_v = v;
+      ++r.count;
+    });
+  if (r.count == 0)
+    return -ENOENT;
+
+  double span = r.last_t - r.first_t;
+  if (span > 0)
+    r.rate = ((double)r.last_v - (double)r.first_v) / span;
+  if (!points.empty()) {
+    std::sort(points.begin(), points.end());
+    r.min = points.front();
+    r.max = points.back();
+    r.avg = std::accumulate(points.begin(), points.end(), 0.0) /
+      points.size();
+    auto pct = [&points](unsigned q) {
+      return points[(points.size() - 1) * q / 100];
+    };
+    r.p50 = pct(50);
+    r.p90 = pct(90);
+    r.p99 = pct(99);
+  }
+  *out = r;
+  return 0;
 }
 
-void PerfCounterInstance::push(utime_t t, uint64_t const &v)
+void PerfCounterInstance::push(uint64_t seq, uint64_t v, int64_t coarse_seq)
 {
-  buffer.push_back({t, v});
+  if (coarse_seq >= 0 && raw.full() && raw.end_seq() == seq) {
+    coarse.push(coarse_seq, raw.front());
+  }
+  raw.push(seq, v);
 }
 
+void PerfCounterSummary::dump(Formatter *f) const
+{
+  f->dump_unsigned("count", count);
+  f->dump_float("first_t", (double)first_t);
+  f->dump_unsigned("first_v", first_v);
+  f->dump_float("last_t", (double)last_t);
+  f->dump_unsigned("last_v", last_v);
+  f->dump_float("rate", rate);
+  f->dump_float("avg", avg);
+  f->dump_float("min", min);
+  f->dump_float("max", max);
+  f->dump_float("p50", p50);
+  f->dump_float("p90", p90);
+  f->dump_float("p99", p99);
+}
@@ -31,31 +31,86 @@
 // Unique reference to a daemon within a cluster
 typedef std::pair<entity_type_t, std::string> DaemonKey;
 
-// An instance of a performance counter type, within
-// a particular daemon.
-class PerfCounterInstance
+/**
+ * A fixed-capacity ring of samples addressed by a monotonically
+ * increasing sample sequence number.  It holds the samples
+ * [begin_seq(), end_seq()); pushing a sample that does not follow
+ * the last one starts the ring over.
+ */
+template<typename T>
+class SampleRing
 {
-  class DataPoint
-  {
-    public:
-    utime_t t;
-    uint64_t v;
-    DataPoint(utime_t t_, uint64_t v_)
-      : t(t_), v(v_)
-    {}
-  };
-
-  boost::circular_buffer<DataPoint> buffer;
-  uint64_t get_current() const;
+  boost::circular_buffer<T> buf;
+  uint64_t first = 0;   ///< sequence number of buf.front()
 
   public:
-  const boost::circular_buffer<DataPoint> & get_data() const
-  {
-    return buffer;
+  explicit SampleRing(size_t capacity)
+    : buf(capacity) {}
+
+  bool empty() const { return buf.empty(); }
+  bool full() const { return buf.full(); }
+  size_t size() const { return buf.size(); }
+  uint64_t begin_seq() const { return first; }
+  uint64_t end_seq() const { return first + buf.size(); }
+  bool contains(uint64_t seq) const {
+    return seq >= first && seq < end_seq();
+  }
+  const T &at(uint64_t seq) const { return buf[seq - first]; }
+  const T &front() const { return buf.front(); }
+  const T &back() const { return buf.back(); }
+
+  void push(uint64_t seq, const T &v) {
+    if (buf.empty() || seq != end_seq()) {
+      buf.clear();
+      first = seq;
+    } else if (buf.full()) {
+      ++first;
+    }
+    buf.push_back(v);
+  }
+  void clear() {
+    buf.clear();
+    first = 0;
   }
-  void push(utime_t t, uint64_t const &v);
-  PerfCounterInstance()
-    : buffer(20) {}
+};
+
+// The history of one performance counter, within a particular
+// daemon.  Only the values are stored here: the sample timestamps
+// are shared by all the counters of the daemon (see
+// DaemonPerfCounters), so each sample costs 8 bytes.
+class PerfCounterInstance
+{
+  public:
+  SampleRing<uint64_t> raw;     ///< the most recent samples
+  SampleRing<uint64_t> coarse;  ///< older samples, downsampled
+
+  PerfCounterInstance(size_t raw_samples, size_t coarse_samples)
+    : raw(raw_samples), coarse(coarse_samples) {}
+
+  /**
+   * Add the value of sample `seq`.  If that pushes the oldest raw
+   * sample out and `coarse_seq` is not -1, the old sample is kept in
+   * the coarse ring as sample `coarse_seq`.
+   */
+  void push(uint64_t seq, uint64_t v, int64_t coarse_seq);
+
+  uint64_t get_current() const { return raw.back(); }
+};
+
+// A summary of the samples of a counter over a time window, computed
+// in place from the sample rings.  For counters (PERFCOUNTER_COUNTER)
+// min/max/avg and the percentiles are over the per-second rate
+// between consecutive samples, for gauges over the sampled values.
+struct PerfCounterSummary
+{
+  uint32_t count = 0;   ///< samples in the window
+  utime_t first_t, last_t;
+  uint64_t first_v = 0, last_v = 0;
+  double rate = 0;      ///< (last_v - first_v) / (last_t - first_t)
+  double avg = 0, min = 0, max = 0;
+  double p50 = 0, p90 = 0, p99 = 0;
+
+  void dump(Formatter *f) const;
 };
 
 
@@ -68,12 +123,15 @@ class DaemonPerfCounters
   // The record of perf stat types, shared between daemons
   PerfCounterTypes &types;
 
-  DaemonPerfCounters(PerfCounterTypes &types_)
-    : types(types_)
-  {}
+  explicit DaemonPerfCounters(PerfCounterTypes &types_);
 
   std::map<std::string, PerfCounterInstance> instances;
 
+  // Timestamps of the samples in the instances' rings: each report
+  // is one sample of every declared counter.
+  SampleRing<utime_t> raw_t;
+  SampleRing<utime_t> coarse_t;
+
   // FIXME: this state is really local to DaemonServer, it's part
   // of the protocol rather than being part of what other classes
   // mgiht want to read.  Maybe have a separate session object
@@ -86,7 +144,44 @@ class DaemonPerfCounters
   {
     instances.clear();
     declared_types.clear();
+    raw_t.clear();
+    coarse_t.clear();
+    next_seq = next_coarse_seq = 0;
+  }
+
+  /**
+   * Call f(t, v) for each sample of a counter taken at or after
+   * `since`, oldest first.
+   */
+  template<typename F>
+  void for_each_sample(const PerfCounterInstance &inst, utime_t since,
+		       F &&f) const
+  {
+    for (uint64_t s = inst.coarse.begin_seq(); s < inst.coarse.end_seq();
+	 ++s) {
+      if (coarse_t.contains(s) && coarse_t.at(s) >= since)
+	f(coarse_t.at(s), inst.coarse.at(s));
+    }
+    for (uint64_t s = inst.raw.begin_seq(); s < inst.raw.end_seq(); ++s) {
+      if (raw_t.contains(s) && raw_t.at(s) >= since)
+	f(raw_t.at(s), inst.raw.at(s));
+    }
   }
+
+  /**
+   * Summarise the samples of counter `path` taken at or after `since`.
+   *
+   * @return 0 on success, -ENOENT if there is no such counter or it
+   *         has no samples in the window
+   */
+  int get_summary(const std::string &path, utime_t since,
+		  PerfCounterSummary *out) const;
+
+  private:
+  size_t raw_samples, coarse_samples;
+  utime_t downsample_interval;
+  uint64_t next_seq = 0;
+  uint64_t next_coarse_seq = 0;
 };
 
 // The state that we store about one daemon
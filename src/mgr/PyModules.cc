@@ -632,16 +632,16 @@ PyObject* PyModules::get_counter_python(
   // FIXME: this is unsafe, I need to either be inside DaemonStateIndex's
   // lock or put a lock on individual DaemonStates
   if (metadata) {
-    if (metadata->perf_counters.instances.count(path)) {
-      auto counter_instance = metadata->perf_counters.instances.at(path);
-      const auto &data = counter_instance.get_data();
-      for (const auto &datapoint : data) {
-        f.open_array_section("datapoint");
-        f.dump_unsigned("t", datapoint.t.sec());
-        f.dump_unsigned("v", datapoint.v);
-        f.close_section();
-
-      }
+    const auto &counters = metadata->perf_counters;
+    auto i = counters.instances.find(path);
+    if (i != counters.instances.end()) {
+      counters.for_each_sample(i->second, utime_t(),
+        [&f](const utime_t &t, uint64_t v) {
+          f.open_array_section("datapoint");
+          f.dump_unsigned("t", t.sec());
+          f.dump_unsigned("v", v);
+          f.close_section();
+        });
     } else {
       dout(4) << "Missing counter: '" << path << "' ("
               << ceph_entity_type_name(svc_type) << "."
@@ -660,6 +660,58 @@ PyObject* PyModules::get_counter_python(
   return f.get();
 }
 
+PyObject* PyModules::get_counter_summary_python(
+    const std::string &handle,
+    entity_type_t svc_type,
+    const std::string &svc_id,
+    const std::string &path,
+    int window)
+{
+  PyThreadState *tstate = PyEval_SaveThread();
+  Mutex::Locker l(lock);
+  PyEval_RestoreThread(tstate);
+
+  PerfCounterSummary summary;
+  int r = -ENOENT;
+  auto metadata = daemon_state.get(DaemonKey(svc_type, svc_id));
+  // FIXME: same DaemonState locking caveat as get_counter_python
+  if (metadata) {
+    r = metadata->perf_counters.get_summary(
+      path, ceph_clock_now() - utime_t(window, 0), &summary);
+  }
+  if (r < 0) {
+    Py_RETURN_NONE;
+  }
+
+  PyFormatter f;
+  summary.dump(&f);
+  return f.get();
+}
+
+PyObject* PyModules::get_all_counter_summaries_python(
+    const std::string &handle,
+    entity_type_t svc_type,
+    const std::string &path,
+    int window)
+{
+  PyThreadState *tstate = PyEval_SaveThread();
+  Mutex::Locker l(lock);
+  PyEval_RestoreThread(tstate);
+
+  const utime_t since = ceph_clock_now() - utime_t(window, 0);
+  PyFormatter f;
+  // FIXME: same DaemonState locking caveat as get_counter_python
+  for (const auto &i : daemon_state.get_by_type(svc_type)) {
+    PerfCounterSummary summary;
+    if (i.second->perf_counters.get_summary(path, since, &summary) < 0)
+      continue;
+    f.open_object_section(i.first.second.c_str());
+    summary.dump(&f);
+    f.close_section();
+  }
+  return f.get();
+}
+
 PyObject *PyModules::get_context()
 {
   PyThreadState *tstate = PyEval_SaveThread();
@@ -65,6 +65,11 @@ public:
   PyObject *get_counter_python(std::string const &handle,
       entity_type_t svc_type, const std::string &svc_id,
       const std::string &path);
+  PyObject *get_counter_summary_python(std::string const &handle,
+      entity_type_t svc_type, const std::string &svc_id,
+      const std::string &path, int window);
+  PyObject *get_all_counter_summaries_python(std::string const &handle,
+      entity_type_t svc_type, const std::string &path, int window);
   PyObject *get_context();
 
   std::map<std::string, std::string> config_cache;
@@ -301,6 +301,51 @@ get_counter(PyObject *self, PyObject *args)
       handle, svc_type, svc_id, counter_path);
 }
 
+static PyObject*
+get_counter_summary(PyObject *self, PyObject *args)
+{
+  char *handle = nullptr;
+  char *type_str = nullptr;
+  char *svc_id = nullptr;
+  char *counter_path = nullptr;
+  int window = 0;
+  if (!PyArg_ParseTuple(args, "ssssi:get_counter_summary", &handle,
+                        &type_str, &svc_id, &counter_path, &window)) {
+    return nullptr;
+  }
+
+  entity_type_t svc_type = svc_type_from_str(type_str);
+  if (svc_type == CEPH_ENTITY_TYPE_ANY) {
+    // FIXME: form a proper exception
+    return nullptr;
+  }
+
+  return global_handle->get_counter_summary_python(
+      handle, svc_type, svc_id, counter_path, window);
+}
+
+static PyObject*
+get_all_counter_summaries(PyObject *self, PyObject *args)
+{
+  char *handle = nullptr;
+  char *type_str = nullptr;
+  char *counter_path = nullptr;
+  int window = 0;
+  if (!PyArg_ParseTuple(args, "sssi:get_all_counter_summaries", &handle,
+                        &type_str, &counter_path, &window)) {
+    return nullptr;
+  }
+
+  entity_type_t svc_type = svc_type_from_str(type_str);
+  if (svc_type == CEPH_ENTITY_TYPE_ANY) {
+    // FIXME: form a proper exception
+    return nullptr;
+  }
+
+  return global_handle->get_all_counter_summaries_python(
+      handle, svc_type, counter_path, window);
+}
+
 PyMethodDef CephStateMethods[] = {
     {"get", ceph_state_get, METH_VARARGS,
      "Get a cluster object"},
@@ -316,6 +361,10 @@ PyMethodDef CephStateMethods[] = {
      "Set a configuration value"},
     {"get_counter", get_counter, METH_VARARGS,
       "Get a performance counter"},
+    {"get_counter_summary", get_counter_summary, METH_VARARGS,
+      "Summarise a performance counter over a time window"},
+    {"get_all_counter_summaries", get_all_counter_summaries, METH_VARARGS,
+      "Summarise a performance counter of all daemons of a type"},
     {"log", ceph_log, METH_VARARGS,
      "Emit a (local) log message"},
     {"get_version", ceph_get_version, METH_VARARGS,
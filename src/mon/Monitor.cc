@@ -265,6 +265,18 @@ PaxosService *Monitor::get_paxos_service_by_name(const string& name)
   return NULL;
 }
 
+int Monitor::join_pending_proposals()
+{
+  int joined = 0;
+  for (vector<PaxosService*>::iterator p = paxos_service.begin();
+       p != paxos_service.end();
+       ++p) {
+    if ((*p)->join_pending_proposal())
+      ++joined;
+  }
+  return joined;
+}
+
 Monitor::~Monitor()
 {
   for (vector<PaxosService*>::iterator p = paxos_service.begin(); p != paxos_service.end(); ++p)
@@ -604,6 +604,14 @@ public:
 
   PaxosService *get_paxos_service_by_name(const string& name);
 
+  /**
+   * Let the services waiting for their proposal timer add their
+   * pending values to the Paxos proposal about to be made.
+   *
+   * @returns the number of services that joined the proposal
+   */
+  int join_pending_proposals();
+
   class PGMonitor *pgmon() {
     return (class PGMonitor *)paxos_service[PAXOS_PGMAP];
   }
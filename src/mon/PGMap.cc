@@ -344,6 +344,8 @@ void PGMap::calc_stats()
   osd_sum = osd_stat_t();
   pg_by_osd.clear();
   num_primary_pg_by_osd.clear();
+  num_pg_by_last_epoch_clean.clear();
+  num_pg_by_stuck_since.clear();
 
   for (ceph::unordered_map<pg_t,pg_stat_t>::iterator p = pg_stat.begin();
        p != pg_stat.end();
@@ -442,6 +444,40 @@ void PGMap::remove_osd(int osd)
   }
 }
 
+template<typename K>
+static void count_add(map<K,int> &m, const K &k)
+{
+  ++m[k];
+}
+
+template<typename K>
+static void count_sub(map<K,int> &m, const K &k)
+{
+  typename map<K,int>::iterator p = m.find(k);
+  assert(p != m.end());
+  if (--p->second == 0)
+    m.erase(p);
+}
+
+/*
+ * call f(type, since) for each STUCK_* state the pg is in, where
+ * since is the last time the pg was seen out of that state.
+ */
+template<typename F>
+static void for_each_stuck_state(const pg_stat_t &s, F f)
+{
+  if (!(s.state & PG_STATE_ACTIVE))
+    f(PGMap::STUCK_INACTIVE, s.last_active);
+  if (!(s.state & PG_STATE_CLEAN))
+    f(PGMap::STUCK_UNCLEAN, s.last_clean);
+  if (s.state & PG_STATE_DEGRADED)
+    f(PGMap::STUCK_DEGRADED, s.last_undegraded);
+  if (s.state & PG_STATE_UNDERSIZED)
+    f(PGMap::STUCK_UNDERSIZED, s.last_fullsized);
+  if (s.state & PG_STATE_STALE)
+    f(PGMap::STUCK_STALE, s.last_unstale);
+}
+
 void PGMap::stat_pg_add(const pg_t &pgid, const pg_stat_t &s,
                         bool sameosds)
 {
@@ -450,6 +486,10 @@ void PGMap::stat_pg_add(const pg_t &pgid, const pg_stat_t &s,
 
   num_pg++;
   num_pg_by_state[s.state]++;
+  count_add(num_pg_by_last_epoch_clean, s.get_effective_last_epoch_clean());
+  for_each_stuck_state(s, [this](int type, const utime_t &since) {
+      count_add(num_pg_by_stuck_since[type], since);
+    });
 
   if ((s.state & PG_STATE_CREATING) &&
       s.parent_split_bits == 0) {
@@ -495,6 +535,13 @@ void PGMap::stat_pg_sub(const pg_t &pgid, const pg_stat_t &s,
   assert(end >= 0);
   if (end == 0)
     num_pg_by_state.erase(s.state);
+  count_sub(num_pg_by_last_epoch_clean, s.get_effective_last_epoch_clean());
+  for_each_stuck_state(s, [this](int type, const utime_t &since) {
+      map<utime_t,int> &m = num_pg_by_stuck_since[type];
+      count_sub(m, since);
+      if (m.empty())
+	num_pg_by_stuck_since.erase(type);
+    });
 
   if ((s.state & PG_STATE_CREATING) &&
       s.parent_split_bits == 0) {
@@ -583,16 +630,10 @@ void PGMap::stat_osd_sub(const osd_stat_t &s)
 
 epoch_t PGMap::calc_min_last_epoch_clean() const
 {
-  if (pg_stat.empty())
+  if (num_pg_by_last_epoch_clean.empty())
     return 0;
 
-  ceph::unordered_map<pg_t,pg_stat_t>::const_iterator p = pg_stat.begin();
-  epoch_t min = p->second.get_effective_last_epoch_clean();
-  for (++p; p != pg_stat.end(); ++p) {
-    epoch_t lec = p->second.get_effective_last_epoch_clean();
-    if (lec < min)
-      min = lec;
-  }
+  epoch_t min = num_pg_by_last_epoch_clean.begin()->first;
   // also scan osd epochs
   // don't trim past the oldest reported osd epoch
   for (ceph::unordered_map<int32_t, epoch_t>::const_iterator i = osd_epochs.begin();
@@ -1067,37 +1108,12 @@ void PGMap::get_stuck_stats(int types, const utime_t cutoff,
 
 bool PGMap::get_stuck_counts(const utime_t cutoff, map<string, int>& note) const
 {
-  int inactive = 0;
-  int unclean = 0;
-  int degraded = 0;
-  int undersized = 0;
-  int stale = 0;
+  int inactive = count_stuck_pgs(STUCK_INACTIVE, cutoff);
+  int unclean = count_stuck_pgs(STUCK_UNCLEAN, cutoff);
+  int degraded = count_stuck_pgs(STUCK_DEGRADED, cutoff);
+  int undersized = count_stuck_pgs(STUCK_UNDERSIZED, cutoff);
+  int stale = count_stuck_pgs(STUCK_STALE, cutoff);
 
-  for (ceph::unordered_map<pg_t, pg_stat_t>::const_iterator i = pg_stat.begin();
-       i != pg_stat.end();
-       ++i) {
-    if (! (i->second.state & PG_STATE_ACTIVE)) {
-      if (i->second.last_active < cutoff)
-        ++inactive;
-    }
-    if (! (i->second.state & PG_STATE_CLEAN)) {
-      if (i->second.last_clean < cutoff)
-        ++unclean;
-    }
-    if (i->second.state & PG_STATE_DEGRADED) {
-      if (i->second.last_undegraded < cutoff)
-        ++degraded;
-    }
-    if (i->second.state & PG_STATE_UNDERSIZED) {
-      if (i->second.last_fullsized < cutoff)
-        ++undersized;
-    }
-    if (i->second.state & PG_STATE_STALE) {
-      if (i->second.last_unstale < cutoff)
-        ++stale;
-    }
-  }
-  
   if (inactive)
     note["stuck inactive"] = inactive;
   
@@ -1116,6 +1132,21 @@ bool PGMap::get_stuck_counts(const utime_t cutoff, map<string, int>& note) const
   return inactive || unclean || undersized || degraded || stale;
 }
 
+int PGMap::count_stuck_pgs(int type, const utime_t cutoff) const
+{
+  ceph::unordered_map<int,map<utime_t,int> >::const_iterator p =
+    num_pg_by_stuck_since.find(type);
+  if (p == num_pg_by_stuck_since.end())
+    return 0;
+  // only the pgs that are stuck are visited
+  int count = 0;
+  for (map<utime_t,int>::const_iterator q = p->second.begin();
+       q != p->second.end() && q->first < cutoff;
+       ++q)
+    count += q->second;
+  return count;
+}
+
 void PGMap::dump_stuck(Formatter *f, int types, utime_t cutoff) const
 {
   ceph::unordered_map<pg_t, pg_stat_t> stuck_pg_stats;
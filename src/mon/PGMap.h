@@ -127,6 +127,17 @@ public:
   ceph::unordered_map<int,set<pg_t> > pg_by_osd;
   ceph::unordered_map<int,int> num_primary_pg_by_osd;
 
+  /// number of pgs by effective last_epoch_clean
+  map<epoch_t,int> num_pg_by_last_epoch_clean;
+
+  /**
+   * number of pgs in each of the STUCK_* states, by the time they
+   * were last seen out of that state (i.e. last_active for the pgs
+   * that are not active). Stuck pgs are counted without walking all
+   * the pgs.
+   */
+  ceph::unordered_map<int,map<utime_t,int> > num_pg_by_stuck_since;
+
   utime_t stamp;
 
   // recent deltas, and summation
@@ -304,6 +315,7 @@ public:
 			   bool brief) const;
   void get_stuck_stats(int types, const utime_t cutoff,
 		       ceph::unordered_map<pg_t, pg_stat_t>& stuck_pgs) const;
+  int count_stuck_pgs(int type, const utime_t cutoff) const;
   bool get_stuck_counts(const utime_t cutoff, map<string, int>& note) const;
   void dump_stuck(Formatter *f, int types, utime_t cutoff) const;
   void dump_stuck_plain(ostream& ss, int types, utime_t cutoff) const;
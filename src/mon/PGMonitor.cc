@@ -799,6 +799,12 @@ bool PGMonitor::prepare_pg_stats(MonOpRequestRef op)
                << dendl;
       continue;
     }
+    if (pending_inc.pg_stat_updates.count(pgid) == 0 &&
+        pg_map.pg_stat[pgid] == p->second) {
+      // resent without any change, do not rewrite it in the store
+      dout(20) << " unchanged " << pgid << dendl;
+      continue;
+    }
 
     dout(15) << " got " << pgid
              << " reported at " << p->second.reported_epoch << ":" << p->second.reported_seq
@@ -118,6 +118,8 @@ void Paxos::init_logger()
   pcb.add_u64_avg(l_paxos_share_state_bytes, "share_state_bytes", "Data in shared state");
   pcb.add_u64_counter(l_paxos_new_pn, "new_pn", "New proposal number queries");
   pcb.add_time_avg(l_paxos_new_pn_latency, "new_pn_latency", "New proposal number getting latency");
+  pcb.add_u64_counter(l_paxos_propose_coalesced, "propose_coalesced",
+		      "Service proposals coalesced into another proposal");
   logger = pcb.create_perf_counters();
   g_ceph_context->get_perfcounters_collection()->add(logger);
 }
@@ -1502,6 +1504,17 @@ void Paxos::propose_pending()
 
   cancel_events();
 
+  if (g_conf->paxos_coalesce_proposals) {
+    // the services that are only waiting for their proposal timer
+    // would otherwise have to wait for this round to finish
+    int joined = mon->join_pending_proposals();
+    if (joined) {
+      dout(10) << __func__ << " " << joined
+	       << " pending service proposals joined" << dendl;
+      logger->inc(l_paxos_propose_coalesced, joined);
+    }
+  }
+
   bufferlist bl;
   pending_proposal->encode(bl);
 
@@ -171,6 +171,21 @@ bool PaxosService::should_propose(double& delay)
 void PaxosService::propose_pending()
 {
   dout(10) << "propose_pending" << dendl;
+  queue_pending_proposal();
+  paxos->trigger_propose();
+}
+
+bool PaxosService::join_pending_proposal()
+{
+  if (!proposal_timer || !have_pending || !is_active())
+    return false;
+  dout(10) << __func__ << dendl;
+  queue_pending_proposal();
+  return true;
+}
+
+void PaxosService::queue_pending_proposal()
+{
   assert(have_pending);
   assert(!proposing);
   assert(mon->is_leader());
@@ -230,7 +245,6 @@ void PaxosService::propose_pending()
     }
   };
   paxos->queue_pending_finisher(new C_Committed(this));
-  paxos->trigger_propose();
 }
 
 bool PaxosService::should_stash_full()
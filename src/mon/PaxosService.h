@@ -212,6 +212,28 @@ public:
    */
   void propose_pending();
 
+  /**
+   * Add our pending value to the pending Paxos proposal if we were
+   * only waiting for our proposal timer to propose it.
+   *
+   * This is called by the Monitor when Paxos is about to start a
+   * round on behalf of another service, so that the changes of
+   * several services are committed by a single round instead of
+   * queuing behind each other.
+   *
+   * @returns true if our pending value joined the proposal
+   */
+  bool join_pending_proposal();
+
+private:
+  /**
+   * Encode our pending value in the pending Paxos transaction and
+   * queue the callback marking us active once it commits, without
+   * triggering the proposal.
+   */
+  void queue_pending_proposal();
+
+public:
   /**
    * Let others request us to propose.
    *
@@ -1464,6 +1464,16 @@ OSDMapRef OSDService::_add_map(OSDMap *o)
   if (existed) {
     delete o;
   }
+  if (logger) {
+    // maps share substructures, so report the pool total rather than
+    // a sum of per-map sizes
+    uint64_t epochs = map_cache.get_num_live();
+    uint64_t bytes = mempool::osdmap::allocated_bytes();
+    logger->set(l_osd_map_cache_epochs, epochs);
+    logger->set(l_osd_map_cache_bytes, bytes);
+    logger->set(l_osd_map_cache_bytes_per_epoch,
+		epochs ? bytes / epochs : 0);
+  }
   return l;
 }
 
@@ -2924,6 +2934,15 @@ void OSD::create_logger()
   osd_plb.add_u64_avg(
     l_osd_map_cache_miss_low_avg, "osd_map_cache_miss_low_avg",
     "osdmap cache miss, avg distance below cache lower bound");
+  osd_plb.add_u64(
+    l_osd_map_cache_epochs, "osd_map_cache_epochs",
+    "osdmap epochs in memory");
+  osd_plb.add_u64(
+    l_osd_map_cache_bytes, "osd_map_cache_bytes",
+    "osdmap memory (mempool osdmap)");
+  osd_plb.add_u64(
+    l_osd_map_cache_bytes_per_epoch, "osd_map_cache_bytes_per_epoch",
+    "osdmap memory per epoch in memory");
 
   osd_plb.add_u64(l_osd_stat_bytes, "stat_bytes", "OSD size");
   osd_plb.add_u64(l_osd_stat_bytes_used, "stat_bytes_used", "Used space");
@@ -7306,10 +7325,11 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
-        bool got = get_map_bl(e - 1, obl);
-        assert(got);
-	o->decode(obl);
+	// start from the previous epoch (normally still cached) and share
+	// everything this incremental leaves alone
+	OSDMapRef prev = service.try_get_map(e - 1);
+	assert(prev);
+	o->shallow_copy_from(*prev);
       }
 
       OSDMap::Incremental inc;
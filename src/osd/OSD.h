@@ -131,6 +131,9 @@ enum {
   l_osd_map_cache_miss,
   l_osd_map_cache_miss_low,
   l_osd_map_cache_miss_low_avg,
+  l_osd_map_cache_epochs,
+  l_osd_map_cache_bytes,
+  l_osd_map_cache_bytes_per_epoch,
 
   l_osd_stat_bytes,
   l_osd_stat_bytes_used,
@@ -282,6 +282,27 @@ private:
 
   void _calc_up_osd_features();
 
+  /// make sure we hold the only reference to p before modifying it
+  template<typename T>
+  static void _unshare(ceph::shared_ptr<T>& p) {
+    if (p && p.use_count() > 1)
+      p = std::make_shared<T>(*p);
+  }
+  /// replace every shared substructure with a fresh one
+  void _unshare_all() {
+    if (osd_addrs.use_count() > 1)
+      osd_addrs = std::make_shared<addrs_s>();
+    if (pg_temp.use_count() > 1)
+      pg_temp = std::make_shared<
+	mempool::osdmap::map<pg_t,mempool::osdmap::vector<int32_t>>>();
+    if (primary_temp.use_count() > 1)
+      primary_temp = std::make_shared<mempool::osdmap::map<pg_t,int32_t>>();
+    if (osd_uuid.use_count() > 1)
+      osd_uuid = std::make_shared<mempool::osdmap::vector<uuid_d>>();
+    if (crush.use_count() > 1)
+      crush = std::make_shared<CrushWrapper>();
+  }
+
  public:
   bool have_crc() const { return crc_defined; }
   uint32_t get_crc() const { return crc; }
@@ -330,6 +351,21 @@ public:
     // allocate a new CrushWrapper, though.
   }
 
+  /**
+   * Copy another map, sharing all of its refcounted substructures
+   * (crush, osd_addrs, pg_temp, primary_temp, osd_primary_affinity,
+   * osd_uuid).
+   *
+   * apply_incremental(), decode() and the setters below copy a shared
+   * substructure before they modify it, so a map built this way from
+   * the previous epoch only pays for the parts the next incremental
+   * actually changes.  Callers must not modify the shared parts (e.g.
+   * crush) in place by other means.
+   */
+  void shallow_copy_from(const OSDMap& o) {
+    *this = o;
+  }
+
   // map info
   const uuid_d& get_fsid() const { return fsid; }
   void set_fsid(uuid_d& f) { fsid = f; }
@@ -433,6 +469,8 @@ public:
       osd_primary_affinity.reset(
 	new mempool::osdmap::vector<__u32>(
 	  max_osd, CEPH_OSD_DEFAULT_PRIMARY_AFFINITY));
+    else
+      _unshare(osd_primary_affinity);
     (*osd_primary_affinity)[o] = w;
   }
   unsigned get_primary_affinity(int o) const {
@@ -942,8 +980,9 @@ public:
   bool crush_ruleset_in_use(int ruleset) const;
 
   void clear_temp() {
-    pg_temp->clear();
-    primary_temp->clear();
+    pg_temp = std::make_shared<
+      mempool::osdmap::map<pg_t,mempool::osdmap::vector<int32_t>>>();
+    primary_temp = std::make_shared<mempool::osdmap::map<pg_t,int32_t>>();
   }
 
 private:
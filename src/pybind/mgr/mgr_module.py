@@ -123,6 +123,34 @@ class MgrModule(object):
         """
         return ceph_state.get_counter(self._handle, svc_type, svc_name, path)
 
+    def get_counter_summary(self, svc_type, svc_name, path, window):
+        """
+        Summarise the samples of a perf counter on a particular service
+        over the last `window` seconds, without copying the samples.
+
+        :param svc_type:
+        :param svc_name:
+        :param path:
+        :param window: seconds
+        :return: dict with count, first_t, first_v, last_t, last_v, rate,
+                 avg, min, max, p50, p90 and p99, or None if there is no
+                 data
+        """
+        return ceph_state.get_counter_summary(self._handle, svc_type,
+                                              svc_name, path, int(window))
+
+    def get_all_counter_summaries(self, svc_type, path, window):
+        """
+        Like ``get_counter_summary``, for every service of a type.
+
+        :param svc_type:
+        :param path:
+        :param window: seconds
+        :return: dict of service name to summary
+        """
+        return ceph_state.get_all_counter_summaries(self._handle, svc_type,
+                                                    path, int(window))
+
     def list_servers(self):
         """
         Like ``get_server``, but instead of returning information
@@ -109,7 +109,8 @@
   rbd help bench
   usage: rbd bench [--pool <pool>] [--image <image>] [--io-size <io-size>] 
                    [--io-threads <io-threads>] [--io-total <io-total>] 
-                   [--io-pattern <io-pattern>] --io-type <io-type> 
+                   [--io-pattern <io-pattern>] 
+                   [--io-queues <io-queues>] --io-type <io-type> 
                    <image-spec> 
   
   Simple benchmark.
@@ -125,6 +126,8 @@
     --io-threads arg     ios in flight [default: 16]
     --io-total arg       total size for IO (in B/K/M/G/T) [default: 1G]
     --io-pattern arg     IO pattern (rand or seq) [default: seq]
+    --io-queues arg      threads submitting IO, each with io-threads ios in
+                         flight [default: 1]
     --io-type arg        IO type (read or write)
   
   rbd help children
@@ -177,7 +180,7 @@
     --image-feature arg       image features
                               [layering(+), striping, exclusive-lock(+*),
                               object-map(+*), fast-diff(+*), deep-flatten(+-),
-                              journaling(*), data-pool]
+                              journaling(*), data-pool, extent-map(-)]
     --image-shared            shared image
     --stripe-unit arg         stripe unit in B/K/M
     --stripe-count arg        stripe count
@@ -224,7 +227,7 @@
     --image-feature arg          image features
                                  [layering(+), striping, exclusive-lock(+*),
                                  object-map(+*), fast-diff(+*), deep-flatten(+-),
-                                 journaling(*), data-pool]
+                                 journaling(*), data-pool, extent-map(-)]
     --image-shared               shared image
     --stripe-unit arg            stripe unit in B/K/M
     --stripe-count arg           stripe count
@@ -269,7 +272,7 @@
     --image-feature arg       image features
                               [layering(+), striping, exclusive-lock(+*),
                               object-map(+*), fast-diff(+*), deep-flatten(+-),
-                              journaling(*), data-pool]
+                              journaling(*), data-pool, extent-map(-)]
     --image-shared            shared image
     --stripe-unit arg         stripe unit in B/K/M
     --stripe-count arg        stripe count
@@ -381,7 +384,8 @@
                          (example: [<pool-name>/]<image-name>)
     <features>           image features
                          [layering, striping, exclusive-lock, object-map,
-                         fast-diff, deep-flatten, journaling, data-pool]
+                         fast-diff, deep-flatten, journaling, data-pool,
+                         extent-map]
   
   Optional arguments
     -p [ --pool ] arg    pool name
@@ -401,7 +405,8 @@
                               (example: [<pool-name>/]<image-name>)
     <features>                image features
                               [layering, striping, exclusive-lock, object-map,
-                              fast-diff, deep-flatten, journaling, data-pool]
+                              fast-diff, deep-flatten, journaling, data-pool,
+                              extent-map]
   
   Optional arguments
     -p [ --pool ] arg         pool name
@@ -620,7 +625,7 @@
     --image-feature arg       image features
                               [layering(+), striping, exclusive-lock(+*),
                               object-map(+*), fast-diff(+*), deep-flatten(+-),
-                              journaling(*), data-pool]
+                              journaling(*), data-pool, extent-map(-)]
     --image-shared            shared image
     --stripe-unit arg         stripe unit in B/K/M
     --stripe-count arg        stripe count
@@ -1131,7 +1136,7 @@
   usage: rbd nbd map [--pool <pool>] [--image <image>] [--snap <snap>] 
                      [--read-only] [--exclusive] [--device <device>] 
                      [--nbds_max <nbds_max>] [--max_part <max_part>] 
-                     <image-or-snap-spec> 
+                     [--connections <connections>] <image-or-snap-spec> 
   
   Map image to a nbd device.
   
@@ -1148,6 +1153,7 @@
     --device arg          specify nbd device
     --nbds_max arg        override module param nbds_max
     --max_part arg        override module param max_part
+    --connections arg     number of nbd connections (queues) per device
   
   rbd help nbd unmap
   usage: rbd nbd unmap 
@@ -151,6 +151,52 @@ TEST(ErasureCodeTest, encode_misaligned_non_contiguous)
   }
 }
 
+TEST(ErasureCodeTest, encode_stripes_padding)
+{
+  int k = 3;
+  int m = 1;
+  unsigned chunk_size = ErasureCode::SIMD_ALIGN * 2;
+  ErasureCodeTest erasure_code(k, m, chunk_size);
+
+  set<int> want_to_encode;
+  for (unsigned int i = 0; i < erasure_code.get_chunk_count(); i++)
+    want_to_encode.insert(i);
+  // a stripe uses 2.5 chunks out of 3, the last data chunk is padded
+  unsigned stripe_width = chunk_size * 2 + chunk_size / 2;
+  unsigned stripe_count = 3;
+  bufferlist in;
+  for (unsigned s = 0; s < stripe_count; s++)
+    in.append(string(stripe_width, 'A' + s));
+  map<int, bufferlist> encoded;
+
+  ASSERT_EQ(0, erasure_code.encode_stripes(want_to_encode, in, stripe_width,
+					   &encoded));
+  ASSERT_EQ(4u, encoded.size());
+  for (unsigned int i = 0; i < erasure_code.get_chunk_count(); i++) {
+    ASSERT_TRUE(encoded[i].is_contiguous());
+    ASSERT_TRUE(encoded[i].is_aligned(ErasureCode::SIMD_ALIGN));
+    ASSERT_EQ(stripe_count * chunk_size, encoded[i].length());
+  }
+  for (unsigned s = 0; s < stripe_count; s++) {
+    unsigned offset = s * chunk_size;
+    ASSERT_EQ('A' + (int)s, encoded[0][offset]);
+    ASSERT_EQ('A' + (int)s, encoded[1][offset + chunk_size - 1]);
+    ASSERT_EQ('A' + (int)s, encoded[2][offset + chunk_size / 2 - 1]);
+    ASSERT_EQ(0, encoded[2][offset + chunk_size / 2]);
+    ASSERT_EQ(0, encoded[2][offset + chunk_size - 1]);
+  }
+  // encode_chunks was called with the chunks of the last stripe
+  ASSERT_EQ(chunk_size, erasure_code.encode_chunks_encoded[0].length());
+  ASSERT_EQ((stripe_count - 1) * chunk_size,
+	    (unsigned)(erasure_code.encode_chunks_encoded[0].c_str() -
+		       encoded[0].c_str()));
+
+  map<int, bufferlist> not_a_stripe;
+  ASSERT_EQ(-EINVAL, erasure_code.encode_stripes(want_to_encode, in,
+						 stripe_width + 1,
+						 &not_a_stripe));
+}
+
 /*
  * Local Variables:
  * compile-command: "cd ../.. ;
@@ -187,6 +187,61 @@ TEST_F(IsaErasureCodeTest, encode_decode)
   encode_decode(4096 + 1);
 }
 
+TEST_F(IsaErasureCodeTest, encode_decode_stripes)
+{
+  ErasureCodeIsaDefault Isa(tcache);
+  ErasureCodeProfile profile;
+  profile["k"] = "3";
+  profile["m"] = "2";
+  Isa.init(profile, &cerr);
+
+  unsigned int chunk_size = Isa.get_chunk_size(1);
+  unsigned int stripe_width = 3 * chunk_size;
+  unsigned int stripe_count = 7;
+  bufferlist in;
+  for (unsigned int i = 0; i < stripe_width * stripe_count; i++)
+    in.append((char)(i * 13 + i / stripe_width));
+  set<int> want;
+  for (int i = 0; i < 5; i++)
+    want.insert(i);
+
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, Isa.encode_stripes(want, in, stripe_width, &encoded));
+  EXPECT_EQ(5u, encoded.size());
+  // same chunks as encoding each stripe separately
+  for (unsigned int s = 0; s < stripe_count; s++) {
+    bufferlist stripe;
+    stripe.substr_of(in, s * stripe_width, stripe_width);
+    map<int, bufferlist> stripe_encoded;
+    EXPECT_EQ(0, Isa.encode(want, stripe, &stripe_encoded));
+    for (int i = 0; i < 5; i++) {
+      EXPECT_EQ(stripe_count * chunk_size, encoded[i].length());
+      EXPECT_EQ(0, memcmp(encoded[i].c_str() + s * chunk_size,
+                          stripe_encoded[i].c_str(), chunk_size));
+    }
+  }
+
+  // two chunks are missing
+  map<int, bufferlist> degraded = encoded;
+  degraded.erase(1);
+  degraded.erase(2);
+  set<int> want_to_decode;
+  want_to_decode.insert(1);
+  want_to_decode.insert(2);
+  map<int, bufferlist> decoded;
+  EXPECT_EQ(0, Isa.decode_stripes(want_to_decode, degraded, chunk_size,
+                                  &decoded));
+  EXPECT_TRUE(decoded[1].contents_equal(encoded[1]));
+  EXPECT_TRUE(decoded[2].contents_equal(encoded[2]));
+
+  // the input must be made of whole stripes
+  bufferlist partial;
+  partial.substr_of(in, 0, stripe_width + 1);
+  map<int, bufferlist> partial_encoded;
+  EXPECT_EQ(-EINVAL, Isa.encode_stripes(want, partial, stripe_width,
+                                        &partial_encoded));
+}
+
 TEST_F(IsaErasureCodeTest, minimum_to_decode)
 {
   ErasureCodeIsaDefault Isa(tcache);
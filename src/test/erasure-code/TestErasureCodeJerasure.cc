@@ -129,6 +129,63 @@ TYPED_TEST(ErasureCodeTest, encode_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, encode_decode_stripes)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+
+  unsigned int chunk_size = jerasure.get_chunk_size(1);
+  unsigned int stripe_width = 2 * chunk_size;
+  unsigned int stripe_count = 5;
+  bufferlist in;
+  for (unsigned int i = 0; i < stripe_width * stripe_count; i++)
+    in.append((char)(i * 7 + i / stripe_width));
+  int want_to_encode[] = { 0, 1, 2, 3 };
+  set<int> want(want_to_encode, want_to_encode+4);
+
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, jerasure.encode_stripes(want, in, stripe_width, &encoded));
+  EXPECT_EQ(4u, encoded.size());
+  // same chunks as encoding each stripe separately
+  for (unsigned int s = 0; s < stripe_count; s++) {
+    bufferlist stripe;
+    stripe.substr_of(in, s * stripe_width, stripe_width);
+    map<int, bufferlist> stripe_encoded;
+    EXPECT_EQ(0, jerasure.encode(want, stripe, &stripe_encoded));
+    for (int i = 0; i < 4; i++) {
+      EXPECT_EQ(stripe_count * chunk_size, encoded[i].length());
+      EXPECT_EQ(0, memcmp(encoded[i].c_str() + s * chunk_size,
+			  stripe_encoded[i].c_str(), chunk_size));
+    }
+  }
+
+  // two chunks are missing
+  map<int, bufferlist> degraded = encoded;
+  degraded.erase(0);
+  degraded.erase(3);
+  int want_to_decode[] = { 0, 1 };
+  map<int, bufferlist> decoded;
+  EXPECT_EQ(0, jerasure.decode_stripes(set<int>(want_to_decode,
+						want_to_decode+2),
+				       degraded, chunk_size, &decoded));
+  for (unsigned int s = 0; s < stripe_count; s++) {
+    EXPECT_EQ(0, memcmp(decoded[0].c_str() + s * chunk_size,
+			in.c_str() + s * stripe_width, chunk_size));
+    EXPECT_EQ(0, memcmp(decoded[1].c_str() + s * chunk_size,
+			in.c_str() + s * stripe_width + chunk_size,
+			chunk_size));
+  }
+
+  EXPECT_EQ(-EINVAL, jerasure.decode_stripes(set<int>(want_to_decode,
+						      want_to_decode+2),
+					     degraded, chunk_size + 1,
+					     &decoded));
+}
+
 TYPED_TEST(ErasureCodeTest, minimum_to_decode)
 {
   TypeParam jerasure;
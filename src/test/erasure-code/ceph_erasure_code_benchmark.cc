@@ -44,6 +44,9 @@ int ErasureCodeBench::setup(int argc, char** argv) {
     ("verbose,v", "explain what happens")
     ("size,s", po::value<int>()->default_value(1024 * 1024),
      "size of the buffer to be encoded")
+    ("stripe-width,S", po::value<int>()->default_value(0),
+     "if not zero, encode/decode the buffer as stripes of this size "
+     "with a single batched call")
     ("iterations,i", po::value<int>()->default_value(1),
      "number of encode/decode runs")
     ("plugin,p", po::value<string>()->default_value("jerasure"),
@@ -109,6 +112,12 @@ int ErasureCodeBench::setup(int argc, char** argv) {
   }
 
   in_size = vm["size"].as<int>();
+  stripe_width = vm["stripe-width"].as<int>();
+  if (stripe_width < 0 || (stripe_width > 0 && in_size % stripe_width)) {
+    cout << "size " << in_size << " is not a multiple of the stripe width "
+	 << stripe_width << endl;
+    return -EINVAL;
+  }
   max_iterations = vm["iterations"].as<int>();
   plugin = vm["plugin"].as<string>();
   workload = vm["workload"].as<string>();
@@ -147,6 +156,29 @@ int ErasureCodeBench::run() {
     return decode();
 }
 
+int ErasureCodeBench::encode(ErasureCodeInterfaceRef erasure_code,
+			     const set<int> &want_to_encode,
+			     const bufferlist &in,
+			     map<int,bufferlist> *encoded)
+{
+  if (stripe_width > 0)
+    return erasure_code->encode_stripes(want_to_encode, in, stripe_width,
+					encoded);
+  return erasure_code->encode(want_to_encode, in, encoded);
+}
+
+int ErasureCodeBench::decode(ErasureCodeInterfaceRef erasure_code,
+			     const set<int> &want_to_read,
+			     const map<int,bufferlist> &chunks,
+			     map<int,bufferlist> *decoded)
+{
+  if (stripe_width > 0)
+    return erasure_code->decode_stripes(
+      want_to_read, chunks, erasure_code->get_chunk_size(stripe_width),
+      decoded);
+  return erasure_code->decode(want_to_read, chunks, decoded);
+}
+
 int ErasureCodeBench::encode()
 {
   ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
@@ -179,7 +211,7 @@ int ErasureCodeBench::encode()
   utime_t begin_time = ceph_clock_now();
   for (int i = 0; i < max_iterations; i++) {
     map<int,bufferlist> encoded;
-    code = erasure_code->encode(want_to_encode, in, &encoded);
+    code = encode(erasure_code, want_to_encode, in, &encoded);
     if (code)
       return code;
   }
@@ -219,7 +251,7 @@ int ErasureCodeBench::decode_erasures(const map<int,bufferlist> &all_chunks,
 	want_to_read.insert(chunk);
 
     map<int,bufferlist> decoded;
-    code = erasure_code->decode(want_to_read, chunks, &decoded);
+    code = decode(erasure_code, want_to_read, chunks, &decoded);
     if (code)
       return code;
     for (set<int>::iterator chunk = want_to_read.begin();
@@ -281,7 +313,7 @@ int ErasureCodeBench::decode()
   }
 
   map<int,bufferlist> encoded;
-  code = erasure_code->encode(want_to_encode, in, &encoded);
+  code = encode(erasure_code, want_to_encode, in, &encoded);
   if (code)
     return code;
 
@@ -303,7 +335,7 @@ int ErasureCodeBench::decode()
 	return code;
     } else if (erased.size() > 0) {
       map<int,bufferlist> decoded;
-      code = erasure_code->decode(want_to_read, encoded, &decoded);
+      code = decode(erasure_code, want_to_read, encoded, &decoded);
       if (code)
 	return code;
     } else {
@@ -316,7 +348,7 @@ int ErasureCodeBench::decode()
 	chunks.erase(erasure);
       }
       map<int,bufferlist> decoded;
-      code = erasure_code->decode(want_to_read, chunks, &decoded);
+      code = decode(erasure_code, want_to_read, chunks, &decoded);
       if (code)
 	return code;
     }
@@ -24,6 +24,7 @@ using namespace std;
 
 class ErasureCodeBench {
   int in_size;
+  int stripe_width;
   int max_iterations;
   int erasures;
   int k;
@@ -49,6 +50,15 @@ public:
 		      ErasureCodeInterfaceRef erasure_code);
   int decode();
   int encode();
+private:
+  int encode(ErasureCodeInterfaceRef erasure_code,
+	     const set<int> &want_to_encode,
+	     const bufferlist &in,
+	     map<int,bufferlist> *encoded);
+  int decode(ErasureCodeInterfaceRef erasure_code,
+	     const set<int> &want_to_read,
+	     const map<int,bufferlist> &chunks,
+	     map<int,bufferlist> *decoded);
 };
 
 #endif
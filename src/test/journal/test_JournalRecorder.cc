@@ -22,7 +22,8 @@ public:
   journal::JournalRecorder *create_recorder(const std::string &oid,
                                             const journal::JournalMetadataPtr &metadata) {
     journal::JournalRecorder *recorder(new journal::JournalRecorder(
-      m_ioctx, oid + ".", metadata, 0, std::numeric_limits<uint32_t>::max(), 0));
+      m_ioctx, oid + ".", metadata, 0, std::numeric_limits<uint32_t>::max(),
+      0, 0));
     m_recorders.push_back(recorder);
     return recorder;
   }
@@ -17,7 +17,8 @@ public:
   TestObjectRecorder()
     : m_flush_interval(std::numeric_limits<uint32_t>::max()),
       m_flush_bytes(std::numeric_limits<uint64_t>::max()),
-      m_flush_age(600)
+      m_flush_age(600),
+      m_max_in_flight_appends(0)
   {
   }
 
@@ -57,6 +58,7 @@ public:
   uint32_t m_flush_interval;
   uint64_t m_flush_bytes;
   double m_flush_age;
+  uint64_t m_max_in_flight_appends;
   Handler m_handler;
 
   void TearDown() override {
@@ -80,6 +82,9 @@ public:
   inline void set_flush_age(double i) {
     m_flush_age = i;
   }
+  inline void set_max_in_flight_appends(uint64_t i) {
+    m_max_in_flight_appends = i;
+  }
 
   journal::AppendBuffer create_append_buffer(uint64_t tag_tid, uint64_t entry_tid,
                                              const std::string &payload) {
@@ -96,7 +101,8 @@ public:
                                            uint8_t order, shared_ptr<Mutex> lock) {
     journal::ObjectRecorderPtr object(new journal::ObjectRecorder(
       m_ioctx, oid, 0, lock, m_work_queue, *m_timer, m_timer_lock, &m_handler,
-      order, m_flush_interval, m_flush_bytes, m_flush_age));
+      order, m_flush_interval, m_flush_bytes, m_flush_age,
+      m_max_in_flight_appends));
     m_object_recorders.push_back(object);
     m_object_recorder_locks.insert(std::make_pair(oid, lock));
     m_handler.object_lock = lock;
@@ -257,6 +263,37 @@ TEST_F(TestObjectRecorder, AppendFilledObject) {
   ASSERT_EQ(0U, object->get_pending_appends());
 }
 
+TEST_F(TestObjectRecorder, AppendMaxInFlight) {
+  std::string oid = get_temp_oid();
+  ASSERT_EQ(0, create(oid));
+  ASSERT_EQ(0, client_register(oid));
+  journal::JournalMetadataPtr metadata = create_metadata(oid);
+  ASSERT_EQ(0, init_metadata(metadata));
+
+  set_flush_interval(1);
+  set_max_in_flight_appends(1);
+  shared_ptr<Mutex> lock(new Mutex("object_recorder_lock"));
+  journal::ObjectRecorderPtr object = create_object(oid, 24, lock);
+
+  journal::AppendBuffers append_buffers;
+  std::list<journal::AppendBuffer> appended;
+  for (uint64_t entry_tid = 123; entry_tid < 133; ++entry_tid) {
+    journal::AppendBuffer append_buffer = create_append_buffer(
+      234, entry_tid, "payload");
+    appended.push_back(append_buffer);
+    append_buffers = {append_buffer};
+    lock->Lock();
+    ASSERT_FALSE(object->append_unlock(std::move(append_buffers)));
+  }
+
+  for (auto &append_buffer : appended) {
+    C_SaferCond cond;
+    append_buffer.first->wait(&cond);
+    ASSERT_EQ(0, cond.wait());
+  }
+  ASSERT_EQ(0U, object->get_pending_appends());
+}
+
 TEST_F(TestObjectRecorder, Flush) {
   std::string oid = get_temp_oid();
   ASSERT_EQ(0, create(oid));
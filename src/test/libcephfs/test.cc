@@ -28,6 +28,7 @@
 #include <limits.h>
 #endif
 
+#include <atomic>
 #include <map>
 #include <vector>
 
@@ -1077,6 +1078,82 @@ TEST(LibCephFS, PreadvPwritev) {
   ceph_shutdown(cmount);
 }
 
+static void aio_count_cb(ceph_completion_t c, void *arg)
+{
+  (*(std::atomic<int>*)arg)++;
+}
+
+TEST(LibCephFS, LlAio) {
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(ceph_create(&cmount, NULL), 0);
+  ASSERT_EQ(ceph_conf_read_file(cmount, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(ceph_mount(cmount, NULL), 0);
+
+  UserPerm *perms = ceph_mount_perms(cmount);
+  Inode *root, *file;
+  ASSERT_EQ(ceph_ll_lookup_root(cmount, &root), 0);
+
+  char name[256];
+  sprintf(name, "test_llaio%d", getpid());
+  Fh *fh;
+  struct ceph_statx stx;
+  ASSERT_EQ(ceph_ll_create(cmount, root, name, 0644, O_RDWR | O_CREAT,
+			   &file, &fh, &stx, 0, 0, perms), 0);
+
+  // queue several writes before waiting for any of them
+  const int nios = 16;
+  char out[nios][1024];
+  std::atomic<int> called(0);
+  ceph_completion_t c[nios];
+  for (int i = 0; i < nios; ++i) {
+    memset(out[i], 'a' + i, sizeof(out[i]));
+    ASSERT_EQ(0, ceph_aio_create_completion(&called, aio_count_cb, &c[i]));
+    ASSERT_EQ(0, ceph_ll_aio_write(cmount, fh, i * sizeof(out[i]),
+				   sizeof(out[i]), out[i], c[i]));
+  }
+  for (int i = 0; i < nios; ++i) {
+    ASSERT_EQ(0, ceph_aio_wait_for_complete(c[i]));
+    ASSERT_TRUE(ceph_aio_is_complete(c[i]));
+    ASSERT_EQ((int64_t)sizeof(out[i]), ceph_aio_get_return_value(c[i]));
+    ceph_aio_release(c[i]);
+  }
+
+  ceph_completion_t sc;
+  ASSERT_EQ(0, ceph_aio_create_completion(NULL, NULL, &sc));
+  ASSERT_EQ(0, ceph_ll_aio_fsync(cmount, fh, 0, sc));
+  ceph_aio_wait_for_complete(sc);
+  ASSERT_EQ(0, ceph_aio_get_return_value(sc));
+  ceph_aio_release(sc);
+
+  char in[nios][1024];
+  for (int i = 0; i < nios; ++i) {
+    ASSERT_EQ(0, ceph_aio_create_completion(&called, aio_count_cb, &c[i]));
+    ASSERT_EQ(0, ceph_ll_aio_read(cmount, fh, i * sizeof(in[i]),
+				  sizeof(in[i]), in[i], c[i]));
+  }
+  for (int i = 0; i < nios; ++i) {
+    ceph_aio_wait_for_complete(c[i]);
+    ASSERT_EQ((int64_t)sizeof(in[i]), ceph_aio_get_return_value(c[i]));
+    ASSERT_EQ(0, memcmp(in[i], out[i], sizeof(in[i])));
+    ceph_aio_release(c[i]);
+  }
+  ASSERT_EQ(2 * nios, called);
+
+  ASSERT_EQ(0, ceph_aio_create_completion(NULL, NULL, &sc));
+  ASSERT_EQ(0, ceph_ll_aio_getattr(cmount, file, &stx, CEPH_STATX_SIZE, 0,
+				   perms, sc));
+  ceph_aio_wait_for_complete(sc);
+  ASSERT_EQ(0, ceph_aio_get_return_value(sc));
+  ASSERT_EQ((uint64_t)nios * sizeof(out[0]), stx.stx_size);
+  ceph_aio_release(sc);
+
+  ceph_ll_close(cmount, fh);
+  ceph_ll_put(cmount, file);
+  ASSERT_EQ(0, ceph_unlink(cmount, name));
+  ceph_shutdown(cmount);
+}
+
 TEST(LibCephFS, StripeUnitGran) {
   struct ceph_mount_info *cmount;
   ASSERT_EQ(ceph_create(&cmount, NULL), 0);
@@ -760,6 +760,28 @@ void ObjectReadOperation::read(size_t off, uint64_t len, bufferlist *pbl,
   o->ops.push_back(op);
 }
 
+void ObjectReadOperation::checksum(rados_checksum_type_t type,
+                                   const bufferlist &init_value_bl,
+                                   uint64_t off, size_t len, size_t chunk_size,
+                                   bufferlist *pbl, int *prval) {
+  TestObjectOperationImpl *o = reinterpret_cast<TestObjectOperationImpl*>(impl);
+
+  ObjectOperationTestImpl op;
+  if (pbl != NULL) {
+    op = boost::bind(&TestIoCtxImpl::checksum, _1, _2, type, init_value_bl,
+                     off, len, chunk_size, pbl);
+  } else {
+    op = boost::bind(&TestIoCtxImpl::checksum, _1, _2, type, init_value_bl,
+                     off, len, chunk_size, _3);
+  }
+
+  if (prval != NULL) {
+    op = boost::bind(save_operation_result,
+                     boost::bind(op, _1, _2, _3, _4), prval);
+  }
+  o->ops.push_back(op);
+}
+
 void ObjectReadOperation::sparse_read(uint64_t off, uint64_t len,
                                       std::map<uint64_t,uint64_t> *m,
                                       bufferlist *pbl, int *prval) {
@@ -153,6 +153,48 @@ int TestIoCtxImpl::aio_unwatch(uint64_t handle, AioCompletionImpl *c) {
   return 0;
 }
 
+int TestIoCtxImpl::checksum(const std::string& oid, rados_checksum_type_t type,
+                            const bufferlist &init_value_bl, uint64_t off,
+                            size_t len, size_t chunk_size, bufferlist *pbl) {
+  if (type != LIBRADOS_CHECKSUM_TYPE_CRC32C) {
+    return -EOPNOTSUPP;
+  }
+
+  bufferlist read_bl;
+  int r = read(oid, len, off, &read_bl);
+  if (r < 0) {
+    return r;
+  } else if (len > 0 && read_bl.length() != len) {
+    return -EINVAL;
+  }
+
+  uint32_t init_value;
+  bufferlist init_bl(init_value_bl);
+  bufferlist::iterator it = init_bl.begin();
+  try {
+    ::decode(init_value, it);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  size_t csum_chunk_size = (chunk_size != 0 ? chunk_size : read_bl.length());
+  uint32_t csum_count = (csum_chunk_size > 0 ?
+                           read_bl.length() / csum_chunk_size : 0);
+
+  bufferlist csum_bl;
+  ::encode(csum_count, csum_bl);
+  for (uint32_t i = 0; i < csum_count; ++i) {
+    bufferlist chunk_bl;
+    chunk_bl.substr_of(read_bl, i * csum_chunk_size, csum_chunk_size);
+    ::encode(chunk_bl.crc32c(init_value), csum_bl);
+  }
+
+  if (pbl != nullptr) {
+    pbl->claim_append(csum_bl);
+  }
+  return 0;
+}
+
 int TestIoCtxImpl::exec(const std::string& oid, TestClassHandler *handler,
                         const char *cls, const char *method,
                         bufferlist& inbl, bufferlist* outbl,
@@ -87,6 +87,9 @@ public:
   virtual int append(const std::string& oid, const bufferlist &bl,
                      const SnapContext &snapc) = 0;
   virtual int assert_exists(const std::string &oid) = 0;
+  virtual int checksum(const std::string& oid, rados_checksum_type_t type,
+                       const bufferlist &init_value_bl, uint64_t off,
+                       size_t len, size_t chunk_size, bufferlist *pbl);
 
   virtual int create(const std::string& oid, bool exclusive) = 0;
   virtual int exec(const std::string& oid, TestClassHandler *handler,
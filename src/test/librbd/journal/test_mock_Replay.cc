@@ -433,6 +433,87 @@ TEST_F(TestMockJournalReplay, AioWriteSame) {
   ASSERT_EQ(0, on_safe.wait());
 }
 
+TEST_F(TestMockJournalReplay, NonOverlappingIO) {
+  REQUIRE_FEATURE(RBD_FEATURE_JOURNALING);
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockReplayImageCtx mock_image_ctx(*ictx);
+  MockJournalReplay mock_journal_replay(mock_image_ctx);
+  MockIoImageRequest mock_io_image_request;
+  expect_op_work_queue(mock_image_ctx);
+
+  InSequence seq;
+  io::AioCompletion *aio_comp1;
+  io::AioCompletion *aio_comp2;
+  C_SaferCond on_ready1;
+  C_SaferCond on_safe1;
+  C_SaferCond on_ready2;
+  C_SaferCond on_safe2;
+  expect_aio_write(mock_io_image_request, &aio_comp1, 123, 456, "test");
+  when_process(mock_journal_replay,
+               EventEntry{AioWriteEvent(123, 456, to_bl("test"))},
+               &on_ready1, &on_safe1);
+  ASSERT_EQ(0, on_ready1.wait());
+
+  // ready for the next event before the first write is ACKed
+  expect_aio_write(mock_io_image_request, &aio_comp2, 1024, 456, "test");
+  when_process(mock_journal_replay,
+               EventEntry{AioWriteEvent(1024, 456, to_bl("test"))},
+               &on_ready2, &on_safe2);
+  ASSERT_EQ(0, on_ready2.wait());
+
+  when_complete(mock_image_ctx, aio_comp2, 0);
+  when_complete(mock_image_ctx, aio_comp1, 0);
+
+  expect_aio_flush(mock_image_ctx, mock_io_image_request, 0);
+  ASSERT_EQ(0, when_shut_down(mock_journal_replay, false));
+  ASSERT_EQ(0, on_safe1.wait());
+  ASSERT_EQ(0, on_safe2.wait());
+}
+
+TEST_F(TestMockJournalReplay, OverlappingIO) {
+  REQUIRE_FEATURE(RBD_FEATURE_JOURNALING);
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockReplayImageCtx mock_image_ctx(*ictx);
+  MockJournalReplay mock_journal_replay(mock_image_ctx);
+  MockIoImageRequest mock_io_image_request;
+  expect_op_work_queue(mock_image_ctx);
+
+  InSequence seq;
+  io::AioCompletion *aio_comp1;
+  io::AioCompletion *aio_comp2;
+  C_SaferCond on_ready1;
+  C_SaferCond on_safe1;
+  C_SaferCond on_ready2;
+  C_SaferCond on_safe2;
+  expect_aio_write(mock_io_image_request, &aio_comp1, 123, 456, "test");
+  when_process(mock_journal_replay,
+               EventEntry{AioWriteEvent(123, 456, to_bl("test"))},
+               &on_ready1, &on_safe1);
+  ASSERT_EQ(0, on_ready1.wait());
+
+  // the overlapping discard is not issued until the write is ACKed
+  when_process(mock_journal_replay,
+               EventEntry{AioDiscardEvent(200, 456, ictx->skip_partial_discard)},
+               &on_ready2, &on_safe2);
+
+  expect_aio_discard(mock_io_image_request, &aio_comp2, 200, 456,
+                     ictx->skip_partial_discard);
+  when_complete(mock_image_ctx, aio_comp1, 0);
+  ASSERT_EQ(0, on_ready2.wait());
+  when_complete(mock_image_ctx, aio_comp2, 0);
+
+  expect_aio_flush(mock_image_ctx, mock_io_image_request, 0);
+  ASSERT_EQ(0, when_shut_down(mock_journal_replay, false));
+  ASSERT_EQ(0, on_safe1.wait());
+  ASSERT_EQ(0, on_safe2.wait());
+}
+
 TEST_F(TestMockJournalReplay, IOError) {
   REQUIRE_FEATURE(RBD_FEATURE_JOURNALING);
 
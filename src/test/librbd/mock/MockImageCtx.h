@@ -95,13 +95,20 @@ struct MockImageCtx {
       journal_object_flush_interval(image_ctx.journal_object_flush_interval),
       journal_object_flush_bytes(image_ctx.journal_object_flush_bytes),
       journal_object_flush_age(image_ctx.journal_object_flush_age),
+      journal_object_max_in_flight_appends(
+        image_ctx.journal_object_max_in_flight_appends),
       journal_pool(image_ctx.journal_pool),
       journal_max_payload_bytes(image_ctx.journal_max_payload_bytes),
       journal_max_concurrent_object_sets(
           image_ctx.journal_max_concurrent_object_sets),
       mirroring_resync_after_disconnect(
           image_ctx.mirroring_resync_after_disconnect),
-      mirroring_replay_delay(image_ctx.mirroring_replay_delay)
+      mirroring_replay_delay(image_ctx.mirroring_replay_delay),
+      object_map_batch_updates(image_ctx.object_map_batch_updates),
+      object_map_premark_objects(image_ctx.object_map_premark_objects),
+      flatten_hot_objects(image_ctx.flatten_hot_objects),
+      flatten_target_latency(image_ctx.flatten_target_latency),
+      flatten_progress_update_objects(image_ctx.flatten_progress_update_objects)
   {
     md_ctx.dup(image_ctx.md_ctx);
     data_ctx.dup(image_ctx.data_ctx);
@@ -281,11 +288,17 @@ struct MockImageCtx {
   int journal_object_flush_interval;
   uint64_t journal_object_flush_bytes;
   double journal_object_flush_age;
+  uint64_t journal_object_max_in_flight_appends;
   std::string journal_pool;
   uint32_t journal_max_payload_bytes;
   int journal_max_concurrent_object_sets;
   bool mirroring_resync_after_disconnect;
   int mirroring_replay_delay;
+  bool object_map_batch_updates;
+  uint64_t object_map_premark_objects;
+  uint64_t flatten_hot_objects;
+  double flatten_target_latency;
+  uint64_t flatten_progress_update_objects;
 };
 
 } // namespace librbd
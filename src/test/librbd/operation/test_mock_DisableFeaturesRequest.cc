@@ -124,7 +124,8 @@ public:
   static RemoveRequest *s_instance;
   Context *on_finish = nullptr;
 
-  static RemoveRequest *create(MockOperationImageCtx *image_ctx, Context *on_finish) {
+  static RemoveRequest *create(MockOperationImageCtx *image_ctx,
+                               uint64_t features, Context *on_finish) {
     assert(s_instance != nullptr);
     s_instance->on_finish = on_finish;
     return s_instance;
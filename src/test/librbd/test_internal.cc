@@ -1,10 +1,13 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include "cls/lock/cls_lock_client.h"
 #include "cls/rbd/cls_rbd_types.h"
+#include "test/librados/test.h"
 #include "test/librbd/test_fixture.h"
 #include "test/librbd/test_support.h"
 #include "include/rbd/librbd.h"
+#include "include/stringify.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageState.h"
 #include "librbd/ImageWatcher.h"
@@ -32,6 +35,13 @@ public:
   typedef std::vector<std::pair<std::string, bool> > Snaps;
 
   void TearDown() override {
+    if (!m_persistent_cache_dir.empty()) {
+      _rados.conf_set("rbd_persistent_cache_path", "");
+      _rados.conf_set("rbd_persistent_cache_size", "1073741824");
+      std::string cmd = "rm -rf " + m_persistent_cache_dir;
+      EXPECT_EQ(0, system(cmd.c_str()));
+    }
+
     unlock_image();
     for (Snaps::iterator iter = m_snaps.begin(); iter != m_snaps.end(); ++iter) {
       librbd::ImageCtx *ictx;
@@ -72,7 +82,61 @@ public:
     return 0;
   }
 
+  // logs writes to a temporary directory, removed again by TearDown()
+  void set_up_persistent_cache() {
+    char tmpl[] = "/tmp/rbd_pwl.XXXXXX";
+    ASSERT_TRUE(mkdtemp(tmpl) != NULL);
+    m_persistent_cache_dir = tmpl;
+    ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path",
+                                 m_persistent_cache_dir.c_str()));
+    ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_size", "16777216"));
+  }
+
+  // writes through the persistent cache of a second client that is
+  // blacklisted first: the write is acknowledged from the log but
+  // cannot be written back, as if the client crashed holding the lock
+  void write_and_crash(const std::string &image_name, uint64_t off,
+                       const bufferlist &bl) {
+    std::string path;
+    std::string size;
+    ASSERT_EQ(0, _rados.conf_get("rbd_persistent_cache_path", path));
+    ASSERT_EQ(0, _rados.conf_get("rbd_persistent_cache_size", size));
+
+    librados::Rados rados;
+    ASSERT_EQ("", connect_cluster_pp(rados));
+    ASSERT_EQ(0, rados.conf_set("rbd_persistent_cache_path", path.c_str()));
+    ASSERT_EQ(0, rados.conf_set("rbd_persistent_cache_size", size.c_str()));
+    librados::IoCtx ioctx;
+    ASSERT_EQ(0, rados.ioctx_create(_pool_name.c_str(), ioctx));
+
+    librbd::ImageCtx *ictx = new librbd::ImageCtx(image_name, "", nullptr,
+                                                  ioctx, false);
+    ASSERT_EQ(0, ictx->state->open(false));
+    ASSERT_TRUE(ictx->image_cache != nullptr);
+    ASSERT_EQ(0, acquire_exclusive_lock(*ictx));
+
+    std::map<rados::cls::lock::locker_id_t,
+             rados::cls::lock::locker_info_t> lockers;
+    ClsLockType lock_type;
+    std::string lock_tag;
+    ASSERT_EQ(0, rados::cls::lock::get_lock_info(&m_ioctx, ictx->header_oid,
+                                                 RBD_LOCK_NAME, &lockers,
+                                                 &lock_type, &lock_tag));
+    ASSERT_EQ(1U, lockers.size());
+    ASSERT_EQ(0, _rados.blacklist_add(
+                   stringify(lockers.begin()->second.addr), 0));
+    ASSERT_EQ(0, rados.wait_for_latest_osdmap());
+
+    ASSERT_EQ(static_cast<ssize_t>(bl.length()),
+              ictx->io_work_queue->write(off, bl.length(), bufferlist{bl},
+                                         0));
+    ictx->state->close();
+    ioctx.close();
+    rados.shutdown();
+  }
+
   Snaps m_snaps;
+  std::string m_persistent_cache_dir;
 };
 
 class DummyContext : public Context {
@@ -1261,3 +1325,416 @@ TEST_F(TestInternal, FlattenNoEmptyObjects)
 
   rados_ioctx_destroy(d_ioctx);
 }
+
+TEST_F(TestInternal, FlattenResume)
+{
+  REQUIRE_FEATURE(RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP);
+
+  m_image_name = get_temp_image_name();
+  m_image_size = 1 << 14;
+
+  uint64_t features = 0;
+  get_features(&features);
+  int order = 12;
+  ASSERT_EQ(0, m_rbd.create2(m_ioctx, m_image_name.c_str(), m_image_size,
+                             features, &order));
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  bufferlist bl;
+  bl.append(std::string(1 << order, '1'));
+  for (size_t i = 0; i < m_image_size; i += bl.length()) {
+    ASSERT_EQ((ssize_t)bl.length(),
+              ictx->io_work_queue->write(i, bl.length(),
+                                         bufferlist{bl}, 0));
+  }
+
+  ASSERT_EQ(0, snap_create(*ictx, "snap1"));
+  ASSERT_EQ(0,
+            ictx->operations->snap_protect(cls::rbd::UserSnapshotNamespace(),
+                                           "snap1"));
+
+  std::string clone_name = get_temp_image_name();
+  ASSERT_EQ(0, librbd::clone(m_ioctx, m_image_name.c_str(), "snap1", m_ioctx,
+                             clone_name.c_str(), features, &order, 0, 0));
+
+  librbd::ImageCtx *ictx2;
+  ASSERT_EQ(0, open_image(clone_name, &ictx2));
+
+  bufferlist write_bl;
+  write_bl.append(std::string(1 << order, '2'));
+  ASSERT_EQ((ssize_t)write_bl.length(),
+            ictx2->io_work_queue->write(0, write_bl.length(),
+                                        bufferlist{write_bl}, 0));
+
+  // reads served by the parent mark the object as hot
+  bufferlist read_bl;
+  ASSERT_EQ((ssize_t)bl.length(),
+            ictx2->io_work_queue->read(3 << order, bl.length(),
+                                       librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(bl.contents_equal(read_bl));
+  std::vector<uint64_t> hot_object_nos;
+  ictx2->get_hot_parent_objects(ictx2->flatten_hot_objects, &hot_object_nos);
+  ASSERT_EQ(std::vector<uint64_t>{3}, hot_object_nos);
+
+  // saved progress past objects that were never flattened must not
+  // cause them to be skipped
+  ASSERT_EQ(0, ictx2->operations->metadata_set(
+                 librbd::ImageCtx::METADATA_FLATTEN_OBJECT_NO, "4"));
+
+  librbd::NoOpProgressContext no_op;
+  ASSERT_EQ(0, ictx2->operations->flatten(no_op));
+
+  std::string value;
+  ASSERT_EQ(-ENOENT, librbd::metadata_get(
+                       ictx2, librbd::ImageCtx::METADATA_FLATTEN_OBJECT_NO,
+                       &value));
+
+  for (size_t i = 0; i < m_image_size; i += bl.length()) {
+    read_bl.clear();
+    ASSERT_EQ((ssize_t)bl.length(),
+              ictx2->io_work_queue->read(i, bl.length(),
+                                         librbd::io::ReadResult{&read_bl}, 0));
+    ASSERT_TRUE((i == 0 ? write_bl : bl).contents_equal(read_bl));
+  }
+}
+
+TEST_F(TestInternal, BlockCache) {
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_type", "block"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_writethrough_until_flush", "false"));
+  BOOST_SCOPE_EXIT(void) {
+    _rados.conf_set("rbd_cache_type", "object");
+    _rados.conf_set("rbd_cache_writethrough_until_flush", "true");
+  } BOOST_SCOPE_EXIT_END;
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  if (!ictx->cache) {
+    std::cout << "SKIPPING due to disabled cache" << std::endl;
+    return;
+  }
+  ASSERT_TRUE(ictx->image_cache != nullptr);
+  ASSERT_TRUE(ictx->object_cacher == nullptr);
+
+  // partial blocks and extents that cross shards
+  bufferlist bl1;
+  bl1.append(std::string(131072, '1'));
+  bufferlist bl2;
+  bl2.append(std::string(5000, '2'));
+  ASSERT_EQ(131072, ictx->io_work_queue->write(0, bl1.length(),
+                                               bufferlist{bl1}, 0));
+  ASSERT_EQ(5000, ictx->io_work_queue->write(65000, bl2.length(),
+                                             bufferlist{bl2}, 0));
+
+  bufferlist expected_bl;
+  expected_bl.append(std::string(65000, '1'));
+  expected_bl.append(std::string(5000, '2'));
+  expected_bl.append(std::string(131072 - 70000, '1'));
+  expected_bl.append_zero(8192);
+
+  // dirty hits and a miss at the end
+  bufferlist read_bl;
+  ASSERT_EQ(139264,
+            ictx->io_work_queue->read(0, 139264,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+
+  ASSERT_EQ(0, librbd::flush(ictx));
+  ASSERT_EQ(4096, ictx->io_work_queue->discard(8192, 4096, false));
+  expected_bl.clear();
+  expected_bl.append(std::string(8192, '1'));
+  expected_bl.append_zero(4096);
+  expected_bl.append(std::string(4096, '1'));
+  read_bl.clear();
+  ASSERT_EQ(16384,
+            ictx->io_work_queue->read(0, 16384,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+
+  // a discard only writes back the dirty data that it overlaps
+  ictx->cache_max_dirty_age = 0;
+  bufferlist bl3;
+  bl3.append(std::string(16384, '3'));
+  ASSERT_EQ(16384, ictx->io_work_queue->write(0, bl3.length(),
+                                              bufferlist{bl3}, 0));
+  ASSERT_EQ(16384, ictx->io_work_queue->write(1 << 20, bl3.length(),
+                                              bufferlist{bl3}, 0));
+  uint64_t writeback_bytes =
+    ictx->perfcounter->get(l_librbd_bc_writeback_bytes);
+  ASSERT_EQ(8192, ictx->io_work_queue->discard(4096, 8192, false));
+  ASSERT_EQ(writeback_bytes + 8192,
+            ictx->perfcounter->get(l_librbd_bc_writeback_bytes));
+
+  expected_bl.clear();
+  expected_bl.append(std::string(4096, '3'));
+  expected_bl.append_zero(8192);
+  expected_bl.append(std::string(4096, '3'));
+  read_bl.clear();
+  ASSERT_EQ(16384,
+            ictx->io_work_queue->read(0, 16384,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+
+  // closing writes the cache back to the cluster
+  close_image(ictx);
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_type", "object"));
+
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  ASSERT_TRUE(ictx->image_cache == nullptr);
+  read_bl.clear();
+  ASSERT_EQ(16384,
+            ictx->io_work_queue->read(0, 16384,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+}
+
+TEST_F(TestInternal, BlockCacheSmall) {
+  // four blocks per shard: a single write allocates past the shard size
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_type", "block"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_writethrough_until_flush", "false"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_size", "16384"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_shards", "1"));
+  BOOST_SCOPE_EXIT(void) {
+    _rados.conf_set("rbd_cache_type", "object");
+    _rados.conf_set("rbd_cache_writethrough_until_flush", "true");
+    _rados.conf_set("rbd_cache_size", "33554432");
+    _rados.conf_set("rbd_cache_shards", "16");
+  } BOOST_SCOPE_EXIT_END;
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  if (!ictx->cache) {
+    std::cout << "SKIPPING due to disabled cache" << std::endl;
+    return;
+  }
+  ASSERT_TRUE(ictx->image_cache != nullptr);
+
+  // clean blocks first, so that the writes below have to evict
+  bufferlist read_bl;
+  ASSERT_EQ(16384,
+            ictx->io_work_queue->read(0, 16384,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+
+  bufferlist expected_bl;
+  for (int i = 0; i < 4; ++i) {
+    bufferlist bl;
+    bl.append(std::string(65536, '1' + i));
+    ASSERT_EQ(65536, ictx->io_work_queue->write(i * 65536, bl.length(),
+                                                bufferlist{bl}, 0));
+    expected_bl.append(bl);
+  }
+
+  read_bl.clear();
+  ASSERT_EQ(262144,
+            ictx->io_work_queue->read(0, 262144,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+  ASSERT_EQ(0, librbd::flush(ictx));
+  close_image(ictx);
+
+  ASSERT_EQ(0, _rados.conf_set("rbd_cache_type", "object"));
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  read_bl.clear();
+  ASSERT_EQ(262144,
+            ictx->io_work_queue->read(0, 262144,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+}
+
+TEST_F(TestInternal, PersistentCache) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  ASSERT_NO_FATAL_FAILURE(set_up_persistent_cache());
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  ASSERT_TRUE(ictx->image_cache != nullptr);
+  ASSERT_TRUE(ictx->object_cacher == nullptr);
+
+  bufferlist bl1;
+  bl1.append(std::string(8192, '1'));
+  bufferlist bl2;
+  bl2.append(std::string(4096, '2'));
+  ASSERT_EQ(8192, ictx->io_work_queue->write(0, bl1.length(),
+                                             bufferlist{bl1}, 0));
+  ASSERT_EQ(4096, ictx->io_work_queue->write(2048, bl2.length(),
+                                             bufferlist{bl2}, 0));
+  ASSERT_EQ(0, librbd::flush(ictx));
+
+  bufferlist expected_bl;
+  expected_bl.append(std::string(2048, '1'));
+  expected_bl.append(std::string(4096, '2'));
+  expected_bl.append(std::string(2048, '1'));
+  expected_bl.append_zero(4096);
+
+  // overlapping log entries and a miss at the end
+  bufferlist read_bl;
+  ASSERT_EQ(12288,
+            ictx->io_work_queue->read(0, 12288,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+
+  // closing writes the log back to the cluster
+  close_image(ictx);
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path", ""));
+
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  ASSERT_TRUE(ictx->image_cache == nullptr);
+  read_bl.clear();
+  ASSERT_EQ(12288,
+            ictx->io_work_queue->read(0, 12288,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+}
+
+TEST_F(TestInternal, PersistentCacheSnapshot) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  ASSERT_EQ(0, create_snapshot("snap1", false));
+  ASSERT_NO_FATAL_FAILURE(set_up_persistent_cache());
+
+  // snapshots cannot be logged to, they keep the in-memory cache
+  librbd::ImageCtx *ictx = new librbd::ImageCtx(m_image_name, "", "snap1",
+                                                m_ioctx, true);
+  ASSERT_EQ(0, ictx->state->open(false));
+  ASSERT_TRUE(ictx->image_cache == nullptr);
+  ASSERT_EQ(ictx->cache, ictx->object_cacher != nullptr);
+  ASSERT_EQ(0, ictx->state->close());
+}
+
+TEST_F(TestInternal, PersistentCacheReplay) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  ASSERT_NO_FATAL_FAILURE(set_up_persistent_cache());
+
+  bufferlist bl1;
+  bl1.append(std::string(8192, '1'));
+  ASSERT_NO_FATAL_FAILURE(write_and_crash(m_image_name, 0, bl1));
+
+  // the crashed client still holds the lock: the log is replayed
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  bufferlist read_bl;
+  ASSERT_EQ(8192,
+            ictx->io_work_queue->read(0, 8192,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(bl1.contents_equal(read_bl));
+  close_image(ictx);
+
+  bufferlist bl2;
+  bl2.append(std::string(8192, '2'));
+  ASSERT_NO_FATAL_FAILURE(write_and_crash(m_image_name, 0, bl2));
+
+  // another client breaks the lock and writes newer data
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path", ""));
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  ASSERT_TRUE(ictx->image_cache == nullptr);
+  bufferlist bl3;
+  bl3.append(std::string(4096, '3'));
+  ASSERT_EQ(4096, ictx->io_work_queue->write(0, bl3.length(),
+                                             bufferlist{bl3}, 0));
+  close_image(ictx);
+
+  // the stale log is discarded rather than replayed over it
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path",
+                               m_persistent_cache_dir.c_str()));
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  ASSERT_TRUE(ictx->image_cache != nullptr);
+  bufferlist expected_bl;
+  expected_bl.append(bl3);
+  expected_bl.append(std::string(4096, '1'));
+  read_bl.clear();
+  ASSERT_EQ(8192,
+            ictx->io_work_queue->read(0, 8192,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+}
+
+TEST_F(TestInternal, PersistentCacheLogFull) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  ASSERT_NO_FATAL_FAILURE(set_up_persistent_cache());
+
+  const uint64_t size = 32 << 20;
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  ASSERT_TRUE(ictx->image_cache != nullptr);
+  librbd::NoOpProgressContext no_op;
+  ASSERT_EQ(0, ictx->operations->resize(size, true, no_op));
+
+  // a single write larger than the log is logged in parts
+  uint64_t log_full = ictx->perfcounter->get(l_librbd_pwl_log_full);
+  bufferlist big_bl;
+  for (char c = 'a'; c < 'a' + 24; ++c) {
+    big_bl.append(std::string(1 << 20, c));
+  }
+  ASSERT_EQ(static_cast<ssize_t>(big_bl.length()),
+            ictx->io_work_queue->write(0, big_bl.length(),
+                                       bufferlist{big_bl}, 0));
+  ASSERT_LT(log_full, ictx->perfcounter->get(l_librbd_pwl_log_full));
+
+  bufferlist read_bl;
+  ASSERT_EQ(static_cast<ssize_t>(big_bl.length()),
+            ictx->io_work_queue->read(0, big_bl.length(),
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(big_bl.contents_equal(read_bl));
+
+  // twice the image through the log: it wraps around several times
+  for (uint64_t i = 0; i < 64; ++i) {
+    bufferlist bl;
+    bl.append(std::string(1 << 20, 'A' + i % 26));
+    ASSERT_EQ(1 << 20, ictx->io_work_queue->write((i % 32) << 20, bl.length(),
+                                                  std::move(bl), 0));
+  }
+
+  bufferlist expected_bl;
+  for (uint64_t i = 32; i < 64; ++i) {
+    expected_bl.append(std::string(1 << 20, 'A' + i % 26));
+  }
+  read_bl.clear();
+  ASSERT_EQ(static_cast<ssize_t>(size),
+            ictx->io_work_queue->read(0, size,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+  close_image(ictx);
+
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path", ""));
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  read_bl.clear();
+  ASSERT_EQ(static_cast<ssize_t>(size),
+            ictx->io_work_queue->read(0, size,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+}
+
+TEST_F(TestInternal, PersistentCacheImageMismatch) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  ASSERT_NO_FATAL_FAILURE(set_up_persistent_cache());
+  std::string path = m_persistent_cache_dir + "/log";
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path", path.c_str()));
+
+  bufferlist bl;
+  bl.append(std::string(4096, '1'));
+  ASSERT_NO_FATAL_FAILURE(write_and_crash(m_image_name, 0, bl));
+
+  // the log file holds unflushed writes of the first image
+  std::string name = get_temp_image_name();
+  ASSERT_EQ(0, create_image_pp(m_rbd, m_ioctx, name, m_image_size));
+  librbd::ImageCtx *ictx = new librbd::ImageCtx(name, "", nullptr, m_ioctx,
+                                                false);
+  ASSERT_EQ(-EBUSY, ictx->state->open(false));
+
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+  bufferlist read_bl;
+  ASSERT_EQ(4096,
+            ictx->io_work_queue->read(0, 4096,
+                                      librbd::io::ReadResult{&read_bl}, 0));
+  ASSERT_TRUE(bl.contents_equal(read_bl));
+  close_image(ictx);
+
+  // once written back, the file can be used by the other image
+  ASSERT_EQ(0, open_image(name, &ictx));
+  ASSERT_TRUE(ictx->image_cache != nullptr);
+}
@@ -3474,6 +3474,69 @@ TYPED_TEST(DiffIterateTest, DiffIterateParentDiscard)
   ASSERT_TRUE(two.subset_of(diff));
 }
 
+TEST_F(TestLibRBD, DiffIterateExtentMap)
+{
+  REQUIRE_FEATURE(RBD_FEATURE_FAST_DIFF);
+
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(m_pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  librbd::Image image;
+  int order = 22;
+  std::string name = get_temp_image_name();
+  uint64_t size = 20 << 20;
+  uint64_t object_size = 1 << order;
+  uint64_t chunk_size = object_size / 64;
+
+  bool old_format;
+  uint64_t features;
+  ASSERT_EQ(0, get_features(&old_format, &features));
+  ASSERT_FALSE(old_format);
+  features &= ~RBD_FEATURE_STRIPINGV2;
+  features |= RBD_FEATURE_EXTENT_MAP;
+  ASSERT_EQ(0, create_image_full_pp(rbd, ioctx, name, size, features, false,
+                                    &order));
+  ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+
+  bufferlist bl;
+  bl.append(std::string(object_size, '1'));
+  ASSERT_EQ((ssize_t)object_size, image.write(0, object_size, bl));
+  ASSERT_EQ(0, image.snap_create("one"));
+
+  bufferlist small_bl;
+  small_bl.append(std::string(512, '2'));
+  ASSERT_EQ(512, image.write(chunk_size + 100, 512, small_bl));
+
+  // only the written chunk of the updated object is reported
+  vector<diff_extent> extents;
+  ASSERT_EQ(0, image.diff_iterate2("one", 0, size, true, false,
+                                   vector_iterate_cb, (void *) &extents));
+  ASSERT_EQ(1u, extents.size());
+  ASSERT_EQ(diff_extent(chunk_size, chunk_size, true, 0), extents[0]);
+
+  ASSERT_EQ(0, image.snap_create("two"));
+  ASSERT_EQ(512, image.write(object_size, 512, small_bl));
+
+  extents.clear();
+  ASSERT_EQ(0, image.diff_iterate2("one", 0, size, true, false,
+                                   vector_iterate_cb, (void *) &extents));
+  ASSERT_EQ(2u, extents.size());
+  ASSERT_EQ(diff_extent(chunk_size, chunk_size, true, 0), extents[0]);
+  ASSERT_EQ(diff_extent(object_size, chunk_size, true, 0), extents[1]);
+
+  // the changes up to a removed snapshot move to the next map
+  ASSERT_EQ(0, image.snap_remove("two"));
+  extents.clear();
+  ASSERT_EQ(0, image.diff_iterate2("one", 0, size, true, false,
+                                   vector_iterate_cb, (void *) &extents));
+  ASSERT_EQ(2u, extents.size());
+  ASSERT_EQ(diff_extent(chunk_size, chunk_size, true, 0), extents[0]);
+  ASSERT_EQ(diff_extent(object_size, chunk_size, true, 0), extents[1]);
+
+  ASSERT_PASSED(validate_object_map, image);
+}
+
 TEST_F(TestLibRBD, ZeroLengthWrite)
 {
   rados_ioctx_t ioctx;
@@ -4844,6 +4907,67 @@ TEST_F(TestLibRBD, BlockingAIO)
   ASSERT_TRUE(expected_bl.contents_equal(read_bl));
 }
 
+TEST_F(TestLibRBD, DirectDispatchAIO)
+{
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(m_pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  std::string name = get_temp_image_name();
+  uint64_t size = 1 << 20;
+  int order = 18;
+  ASSERT_EQ(0, create_image_pp(rbd, ioctx, name.c_str(), size, &order));
+
+  std::string direct_dispatch;
+  ASSERT_EQ(0, _rados.conf_get("rbd_direct_dispatch", direct_dispatch));
+  ASSERT_EQ(0, _rados.conf_set("rbd_direct_dispatch", "true"));
+  BOOST_SCOPE_EXIT( (direct_dispatch) ) {
+    ASSERT_EQ(0, _rados.conf_set("rbd_direct_dispatch",
+                                 direct_dispatch.c_str()));
+  } BOOST_SCOPE_EXIT_END;
+
+  librbd::Image image;
+  ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+
+  // the first writes might have to wait for the exclusive lock
+  std::list<librbd::RBD::AioCompletion *> comps;
+  for (uint64_t off = 0; off < size; off += 4096) {
+    bufferlist bl;
+    bl.append(std::string(4096, 'a' + (off / 4096) % 26));
+    librbd::RBD::AioCompletion *comp =
+      new librbd::RBD::AioCompletion(NULL, NULL);
+    ASSERT_EQ(0, image.aio_write(off, bl.length(), bl, comp));
+    comps.push_back(comp);
+  }
+
+  librbd::RBD::AioCompletion *flush_comp =
+    new librbd::RBD::AioCompletion(NULL, NULL);
+  ASSERT_EQ(0, image.aio_flush(flush_comp));
+  ASSERT_EQ(0, flush_comp->wait_for_complete());
+  ASSERT_EQ(0, flush_comp->get_return_value());
+  flush_comp->release();
+
+  for (auto comp : comps) {
+    ASSERT_EQ(1, comp->is_complete());
+    ASSERT_EQ(0, comp->get_return_value());
+    comp->release();
+  }
+
+  for (uint64_t off = 0; off < size; off += 4096) {
+    librbd::RBD::AioCompletion *read_comp =
+      new librbd::RBD::AioCompletion(NULL, NULL);
+    bufferlist read_bl;
+    image.aio_read(off, 4096, read_bl, read_comp);
+    ASSERT_EQ(0, read_comp->wait_for_complete());
+    ASSERT_EQ(4096, read_comp->get_return_value());
+    read_comp->release();
+
+    bufferlist expected_bl;
+    expected_bl.append(std::string(4096, 'a' + (off / 4096) % 26));
+    ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+  }
+}
+
 TEST_F(TestLibRBD, ExclusiveLockTransition)
 {
   REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
@@ -59,7 +59,7 @@ struct AcquireRequest<MockManagedLockImageCtx> : public BaseRequest<AcquireReque
                                 const std::string& cookie,
                                 bool exclusive, bool blacklist_on_break_lock,
                                 uint32_t blacklist_expire_seconds,
-                                Context *on_finish) {
+                                Locker *broken_locker, Context *on_finish) {
     return BaseRequest::create(ioctx, watcher, work_queue, oid, cookie, on_finish);
   }
 
@@ -5,6 +5,7 @@
 #include "test/librbd/test_support.h"
 #include "test/librbd/mock/MockImageCtx.h"
 #include "librbd/ObjectMap.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "librbd/object_map/RefreshRequest.h"
 #include "librbd/object_map/UnlockRequest.h"
 #include "librbd/object_map/UpdateRequest.h"
@@ -22,6 +23,20 @@ struct MockTestImageCtx : public MockImageCtx {
 
 namespace object_map {
 
+template <>
+struct ExtentMap<MockTestImageCtx> {
+  static ExtentMap *s_instance;
+  static ExtentMap *create(MockTestImageCtx &image_ctx) {
+    assert(s_instance != nullptr);
+    return s_instance;
+  }
+
+  MOCK_METHOD1(open, void(Context *));
+  ExtentMap() {
+    s_instance = this;
+  }
+};
+
 template <>
 struct RefreshRequest<MockTestImageCtx> {
   Context *on_finish = nullptr;
@@ -87,6 +102,7 @@ struct UpdateRequest<MockTestImageCtx> {
   }
 };
 
+ExtentMap<MockTestImageCtx> *ExtentMap<MockTestImageCtx>::s_instance = nullptr;
 RefreshRequest<MockTestImageCtx> *RefreshRequest<MockTestImageCtx>::s_instance = nullptr;
 UnlockRequest<MockTestImageCtx> *UnlockRequest<MockTestImageCtx>::s_instance = nullptr;
 UpdateRequest<MockTestImageCtx> *UpdateRequest<MockTestImageCtx>::s_instance = nullptr;
@@ -101,14 +117,30 @@ namespace librbd {
 using testing::_;
 using testing::InSequence;
 using testing::Invoke;
+using testing::Return;
 
 class TestMockObjectMap : public TestMockFixture {
 public:
   typedef ObjectMap<MockTestImageCtx> MockObjectMap;
+  typedef object_map::ExtentMap<MockTestImageCtx> MockExtentMap;
   typedef object_map::RefreshRequest<MockTestImageCtx> MockRefreshRequest;
   typedef object_map::UnlockRequest<MockTestImageCtx> MockUnlockRequest;
   typedef object_map::UpdateRequest<MockTestImageCtx> MockUpdateRequest;
 
+  void expect_test_features(MockTestImageCtx &mock_image_ctx,
+                            uint64_t features, bool enabled) {
+    EXPECT_CALL(mock_image_ctx, test_features(features, _))
+      .WillOnce(Return(enabled));
+  }
+
+  void expect_extent_map_open(MockTestImageCtx &mock_image_ctx,
+                              MockExtentMap &mock_extent_map, int r) {
+    EXPECT_CALL(mock_extent_map, open(_))
+      .WillOnce(Invoke([&mock_image_ctx, r](Context *on_finish) {
+          mock_image_ctx.image_ctx->op_work_queue->queue(on_finish, r);
+        }));
+  }
+
   void expect_refresh(MockTestImageCtx &mock_image_ctx,
                       MockRefreshRequest &mock_refresh_request,
                       const ceph::BitVector<2u> &object_map, int r) {
@@ -152,6 +184,7 @@ TEST_F(TestMockObjectMap, NonDetainedUpdate) {
   ASSERT_EQ(0, open_image(m_image_name, &ictx));
 
   MockTestImageCtx mock_image_ctx(*ictx);
+  mock_image_ctx.object_map_batch_updates = false;
 
   InSequence seq;
   ceph::BitVector<2u> object_map;
@@ -268,5 +301,159 @@ TEST_F(TestMockObjectMap, DetainedUpdate) {
   ASSERT_EQ(0, close_ctx.wait());
 }
 
-} // namespace librbd
+TEST_F(TestMockObjectMap, CoalescedUpdate) {
+  REQUIRE_FEATURE(RBD_FEATURE_OBJECT_MAP);
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  mock_image_ctx.object_map_batch_updates = true;
+
+  InSequence seq;
+  ceph::BitVector<2u> object_map;
+  object_map.resize(4);
+  MockRefreshRequest mock_refresh_request;
+  expect_refresh(mock_image_ctx, mock_refresh_request, object_map, 0);
 
+  MockUpdateRequest mock_update_request;
+  Context *finish_update_1;
+  expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
+                0, 1, 1, {}, &finish_update_1);
+  Context *finish_update_2 = nullptr;
+  expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
+                1, 3, 1, {}, &finish_update_2);
+
+  MockUnlockRequest mock_unlock_request;
+  expect_unlock(mock_image_ctx, mock_unlock_request, 0);
+
+  MockObjectMap mock_object_map(mock_image_ctx, CEPH_NOSNAP);
+  C_SaferCond open_ctx;
+  mock_object_map.open(&open_ctx);
+  ASSERT_EQ(0, open_ctx.wait());
+
+  C_SaferCond update_ctx1;
+  C_SaferCond update_ctx2;
+  C_SaferCond update_ctx3;
+  {
+    RWLock::RLocker snap_locker(mock_image_ctx.snap_lock);
+    RWLock::WLocker object_map_locker(mock_image_ctx.object_map_lock);
+    mock_object_map.aio_update(CEPH_NOSNAP, 0, 1, {}, &update_ctx1);
+    mock_object_map.aio_update(CEPH_NOSNAP, 1, 1, {}, &update_ctx2);
+    mock_object_map.aio_update(CEPH_NOSNAP, 2, 1, {}, &update_ctx3);
+  }
+
+  // updates 2 and 3 are coalesced behind update 1
+  ASSERT_EQ(nullptr, finish_update_2);
+  finish_update_1->complete(0);
+  ASSERT_EQ(0, update_ctx1.wait());
+
+  ASSERT_NE(nullptr, finish_update_2);
+  finish_update_2->complete(0);
+  ASSERT_EQ(0, update_ctx2.wait());
+  ASSERT_EQ(0, update_ctx3.wait());
+
+  C_SaferCond close_ctx;
+  mock_object_map.close(&close_ctx);
+  ASSERT_EQ(0, close_ctx.wait());
+}
+
+TEST_F(TestMockObjectMap, PremarkSequentialUpdate) {
+  REQUIRE_FEATURE(RBD_FEATURE_OBJECT_MAP);
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  mock_image_ctx.object_map_batch_updates = false;
+  mock_image_ctx.object_map_premark_objects = 2;
+
+  InSequence seq;
+  ceph::BitVector<2u> object_map;
+  object_map.resize(4);
+  MockRefreshRequest mock_refresh_request;
+  expect_refresh(mock_image_ctx, mock_refresh_request, object_map, 0);
+
+  MockUpdateRequest mock_update_request;
+  Context *finish_update_1;
+  expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
+                0, 1, OBJECT_EXISTS, {}, &finish_update_1);
+  Context *finish_update_2;
+  expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
+                1, 3, OBJECT_EXISTS, {}, &finish_update_2);
+  Context *finish_update_3;
+  expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
+                3, 4, OBJECT_EXISTS, {}, &finish_update_3);
+
+  MockUnlockRequest mock_unlock_request;
+  expect_unlock(mock_image_ctx, mock_unlock_request, 0);
+
+  MockObjectMap mock_object_map(mock_image_ctx, CEPH_NOSNAP);
+  C_SaferCond open_ctx;
+  mock_object_map.open(&open_ctx);
+  ASSERT_EQ(0, open_ctx.wait());
+
+  // the first update does not continue an earlier one and is not
+  // extended, the ones following it are
+  C_SaferCond update_ctx1;
+  C_SaferCond update_ctx2;
+  C_SaferCond update_ctx3;
+  {
+    RWLock::RLocker snap_locker(mock_image_ctx.snap_lock);
+    RWLock::WLocker object_map_locker(mock_image_ctx.object_map_lock);
+    mock_object_map.aio_update(CEPH_NOSNAP, 0, OBJECT_EXISTS, {},
+                               &update_ctx1);
+    mock_object_map.aio_update(CEPH_NOSNAP, 1, OBJECT_EXISTS, {},
+                               &update_ctx2);
+    mock_object_map.aio_update(CEPH_NOSNAP, 3, OBJECT_EXISTS, {},
+                               &update_ctx3);
+  }
+
+  finish_update_1->complete(0);
+  ASSERT_EQ(0, update_ctx1.wait());
+  finish_update_2->complete(0);
+  ASSERT_EQ(0, update_ctx2.wait());
+  finish_update_3->complete(0);
+  ASSERT_EQ(0, update_ctx3.wait());
+
+  C_SaferCond close_ctx;
+  mock_object_map.close(&close_ctx);
+  ASSERT_EQ(0, close_ctx.wait());
+}
+
+TEST_F(TestMockObjectMap, OpenExtentMap) {
+  REQUIRE_FEATURE(RBD_FEATURE_OBJECT_MAP);
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+
+  InSequence seq;
+  expect_test_features(mock_image_ctx, RBD_FEATURE_EXTENT_MAP, true);
+
+  ceph::BitVector<2u> object_map;
+  object_map.resize(4);
+  MockRefreshRequest mock_refresh_request;
+  expect_refresh(mock_image_ctx, mock_refresh_request, object_map, 0);
+
+  // deleted along with the object map
+  MockExtentMap *mock_extent_map = new MockExtentMap();
+  expect_extent_map_open(mock_image_ctx, *mock_extent_map, 0);
+
+  MockUnlockRequest mock_unlock_request;
+  expect_unlock(mock_image_ctx, mock_unlock_request, 0);
+
+  MockObjectMap *mock_object_map = new MockObjectMap(mock_image_ctx,
+                                                     CEPH_NOSNAP);
+  C_SaferCond open_ctx;
+  mock_object_map->open(&open_ctx);
+  ASSERT_EQ(0, open_ctx.wait());
+
+  C_SaferCond close_ctx;
+  mock_object_map->close(&close_ctx);
+  ASSERT_EQ(0, close_ctx.wait());
+  delete mock_object_map;
+}
+
+} // namespace librbd
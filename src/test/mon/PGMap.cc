@@ -114,6 +114,71 @@ TEST(pgmap, calc_stats)
   }
 }
 
+TEST(pgmap, stuck_counts)
+{
+  PGMap pg_map;
+  PGMap::Incremental inc;
+  osd_stat_t os;
+  pg_stat_t ps;
+
+  inc.version = 1;
+  inc.update_stat(0, 1, os);
+  ps.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+  ps.last_active = ps.last_clean = utime_t(100, 0);
+  inc.pg_stat_updates[pg_t(1,1)] = ps;
+  ps.state = PG_STATE_ACTIVE | PG_STATE_DEGRADED;
+  ps.last_undegraded = utime_t(10, 0);
+  inc.pg_stat_updates[pg_t(2,1)] = ps;
+  ps.state = PG_STATE_PEERING;
+  ps.last_active = utime_t(20, 0);
+  ps.last_clean = utime_t(20, 0);
+  inc.pg_stat_updates[pg_t(3,1)] = ps;
+  pg_map.apply_incremental(g_ceph_context, inc);
+
+  map<string, int> note;
+  ASSERT_FALSE(pg_map.get_stuck_counts(utime_t(5, 0), note));
+  ASSERT_TRUE(note.empty());
+  ASSERT_TRUE(pg_map.get_stuck_counts(utime_t(50, 0), note));
+  ASSERT_EQ(1, note["stuck inactive"]);
+  ASSERT_EQ(1, note["stuck unclean"]);
+  ASSERT_EQ(1, note["stuck degraded"]);
+  ASSERT_EQ(0u, note.count("stuck stale"));
+
+  // the degraded pg recovers, the peering pg becomes active
+  inc = PGMap::Incremental();
+  inc.version = 2;
+  ps = pg_map.pg_stat[pg_t(2,1)];
+  ps.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+  ps.last_clean = ps.last_undegraded = utime_t(60, 0);
+  inc.pg_stat_updates[pg_t(2,1)] = ps;
+  ps = pg_map.pg_stat[pg_t(3,1)];
+  ps.state = PG_STATE_ACTIVE;
+  ps.last_active = utime_t(60, 0);
+  inc.pg_stat_updates[pg_t(3,1)] = ps;
+  pg_map.apply_incremental(g_ceph_context, inc);
+
+  note.clear();
+  ASSERT_TRUE(pg_map.get_stuck_counts(utime_t(50, 0), note));
+  ASSERT_EQ(1u, note.size());
+  ASSERT_EQ(1, note["stuck unclean"]);
+  ASSERT_EQ(1, pg_map.count_stuck_pgs(PGMap::STUCK_UNCLEAN, utime_t(50, 0)));
+  ASSERT_EQ(0, pg_map.count_stuck_pgs(PGMap::STUCK_UNCLEAN, utime_t(20, 0)));
+
+  // the aggregates maintained incrementally match a full recalculation
+  PGMap::Incremental rm;
+  rm.version = 3;
+  rm.pg_remove.insert(pg_t(3,1));
+  pg_map.apply_incremental(g_ceph_context, rm);
+  map<epoch_t,int> by_lec = pg_map.num_pg_by_last_epoch_clean;
+  ceph::unordered_map<int,map<utime_t,int> > by_stuck =
+    pg_map.num_pg_by_stuck_since;
+  pg_map.calc_stats();
+  ASSERT_EQ(by_lec, pg_map.num_pg_by_last_epoch_clean);
+  ASSERT_EQ(by_stuck, pg_map.num_pg_by_stuck_since);
+  note.clear();
+  ASSERT_FALSE(pg_map.get_stuck_counts(utime_t(50, 0), note));
+}
+
 namespace {
   class CheckTextTable : public TextTable {
   public:
@@ -269,6 +269,42 @@ function TEST_mon_features() {
     teardown $dir || return 1
 }
 
+function get_propose_coalesced() {
+    local dir=$1
+
+    CEPH_ARGS='' ceph --admin-daemon $dir/ceph-mon.a.asok perf dump | \
+        jq '.paxos.propose_coalesced'
+}
+
+function TEST_mon_coalesce_proposals() {
+    local dir=$1
+
+    setup $dir || return 1
+    run_mon $dir a || return 1
+
+    # keep the log entry waiting for its proposal timer
+    CEPH_ARGS='' ceph --admin-daemon $dir/ceph-mon.a.asok \
+        config set paxos_propose_interval 60 || return 1
+    local coalesced=$(get_propose_coalesced $dir)
+    ceph log "coalesced proposal" &
+    local pid=$!
+    sleep 2
+
+    # the config-key is proposed immediately and the log entry joins it
+    # instead of waiting another minute
+    ceph config-key put coalesce-test true || return 1
+    local i
+    for i in $(seq 30) ; do
+        kill -0 $pid 2>/dev/null || break
+        sleep 1
+    done
+    ! kill -0 $pid 2>/dev/null || return 1
+    wait $pid || return 1
+    test $(get_propose_coalesced $dir) -gt $coalesced || return 1
+
+    teardown $dir || return 1
+}
+
 main misc "$@"
 
 # Local Variables:
@@ -0,0 +1,198 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Replay synthetic pg stat reports against a PGMap, the way the
+ * monitor leader applies them, and time the incremental updates and
+ * the summary queries served from the aggregates.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/strtol.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "mon/PGMap.h"
+
+static void usage()
+{
+  std::cout << "usage: ceph_test_mon_pgmap_bench [options]\n"
+	    << "  --pgs <n>          number of pgs (default 100000)\n"
+	    << "  --osds <n>         number of osds (default 1000)\n"
+	    << "  --pools <n>        number of pools (default 10)\n"
+	    << "  --reports <n>      number of osd reports to replay (default 10000)\n"
+	    << "  --dirty-ratio <n>  percentage of the pgs of an osd that changed\n"
+	    << "                     in each report (default 10)\n"
+	    << std::endl;
+}
+
+static int parse_int(const std::string &name, const std::string &val, int *out)
+{
+  std::string err;
+  int v = strict_strtol(val.c_str(), 10, &err);
+  if (!err.empty() || v < 0) {
+    std::cerr << "** error parsing '" << name << " " << val << "': "
+	      << err << std::endl;
+    return -EINVAL;
+  }
+  *out = v;
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  int num_pgs = 100000;
+  int num_osds = 1000;
+  int num_pools = 10;
+  int num_reports = 10000;
+  int dirty_ratio = 10;
+
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end();) {
+    std::string val;
+    int r = 0;
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pgs", (char*)NULL)) {
+      r = parse_int("--pgs", val, &num_pgs);
+    } else if (ceph_argparse_witharg(args, i, &val, "--osds", (char*)NULL)) {
+      r = parse_int("--osds", val, &num_osds);
+    } else if (ceph_argparse_witharg(args, i, &val, "--pools", (char*)NULL)) {
+      r = parse_int("--pools", val, &num_pools);
+    } else if (ceph_argparse_witharg(args, i, &val, "--reports", (char*)NULL)) {
+      r = parse_int("--reports", val, &num_reports);
+    } else if (ceph_argparse_witharg(args, i, &val, "--dirty-ratio",
+				     (char*)NULL)) {
+      r = parse_int("--dirty-ratio", val, &dirty_ratio);
+    } else if (ceph_argparse_flag(args, i, "--help", (char*)NULL)) {
+      usage();
+      return 0;
+    } else {
+      std::cerr << "unknown argument '" << *i << "'" << std::endl;
+      usage();
+      return 1;
+    }
+    if (r < 0)
+      return 1;
+  }
+  if (num_osds < 3 || num_pools < 1 || num_pgs < num_pools) {
+    std::cerr << "** need at least 3 osds, 1 pool and 1 pg per pool"
+	      << std::endl;
+    return 1;
+  }
+
+  // build the initial map, each pg mapped to three osds
+  PGMap pg_map;
+  std::vector<std::vector<pg_t> > pgs_by_primary(num_osds);
+  {
+    PGMap::Incremental inc;
+    inc.version = pg_map.version + 1;
+    inc.stamp = ceph_clock_now();
+    int pgs_per_pool = num_pgs / num_pools;
+    for (int pool = 0; pool < num_pools; ++pool) {
+      for (int ps = 0; ps < pgs_per_pool; ++ps) {
+	pg_t pgid(ps, pool);
+	pg_stat_t &st = inc.pg_stat_updates[pgid];
+	int primary = (pool * pgs_per_pool + ps) % num_osds;
+	st.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+	st.up.push_back(primary);
+	st.up.push_back((primary + 1) % num_osds);
+	st.up.push_back((primary + 2) % num_osds);
+	st.acting = st.up;
+	st.up_primary = st.acting_primary = primary;
+	st.last_active = st.last_clean = st.last_unstale =
+	  st.last_undegraded = st.last_fullsized = inc.stamp;
+	st.last_epoch_clean = 1;
+	pgs_by_primary[primary].push_back(pgid);
+      }
+    }
+    for (int osd = 0; osd < num_osds; ++osd) {
+      osd_stat_t os;
+      os.kb = 1 << 30;
+      inc.update_stat(osd, 1, os);
+    }
+    pg_map.apply_incremental(g_ceph_context, inc);
+  }
+
+  utime_t apply_time, summary_time;
+  uint64_t pg_updates = 0;
+  for (int report = 0; report < num_reports; ++report) {
+    int osd = report % num_osds;
+    epoch_t epoch = 2 + report / num_osds;
+    PGMap::Incremental inc;
+    inc.version = pg_map.version + 1;
+    inc.stamp = ceph_clock_now();
+    osd_stat_t os = pg_map.osd_stat[osd];
+    os.kb_used += 1;
+    inc.update_stat(osd, epoch, os);
+
+    // a fraction of the pgs of the osd changed since the last report,
+    // some of them are going through recovery
+    const std::vector<pg_t> &pgs = pgs_by_primary[osd];
+    size_t dirty = pgs.size() * dirty_ratio / 100;
+    for (size_t i = 0; i < dirty; ++i) {
+      const pg_t &pgid = pgs[(report / num_osds * dirty + i) % pgs.size()];
+      pg_stat_t st = pg_map.pg_stat[pgid];
+      st.reported_epoch = epoch;
+      st.reported_seq++;
+      st.stats.sum.num_objects++;
+      st.stats.sum.num_bytes += 4096;
+      st.stats.sum.num_wr++;
+      if (i % 10 == 0) {
+	st.state = PG_STATE_ACTIVE | PG_STATE_DEGRADED | PG_STATE_RECOVERING;
+      } else {
+	st.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+	st.last_clean = st.last_undegraded = inc.stamp;
+	st.last_epoch_clean = epoch;
+      }
+      st.last_active = st.last_unstale = st.last_fullsized = inc.stamp;
+      inc.pg_stat_updates[pgid] = st;
+    }
+    pg_updates += inc.pg_stat_updates.size();
+
+    utime_t start = ceph_clock_now();
+    pg_map.apply_incremental(g_ceph_context, inc);
+    utime_t applied = ceph_clock_now();
+    apply_time += applied - start;
+
+    // what the leader computes for each status/health request
+    map<string,int> note;
+    pg_map.get_stuck_counts(inc.stamp, note);
+    pg_map.get_min_last_epoch_clean();
+    ostringstream ss;
+    pg_map.print_oneline_summary(NULL, &ss);
+    summary_time += ceph_clock_now() - applied;
+  }
+
+  std::cout << "pgs " << pg_map.pg_stat.size()
+	    << " osds " << pg_map.osd_stat.size()
+	    << " reports " << num_reports
+	    << " pg updates " << pg_updates << std::endl;
+  std::cout << "apply_incremental " << apply_time << " s total, "
+	    << (num_reports ? (double)apply_time / num_reports * 1000000 : 0)
+	    << " us per report" << std::endl;
+  std::cout << "summary " << summary_time << " s total, "
+	    << (num_reports ? (double)summary_time / num_reports * 1000000 : 0)
+	    << " us per report" << std::endl;
+  return 0;
+}
@@ -266,6 +266,49 @@ TEST_F(OSDMapTest, PrimaryTempRespected) {
   EXPECT_EQ(acting_primary, acting_osds[1]);
 }
 
+TEST_F(OSDMapTest, ShallowCopySharesUnchanged) {
+  set_up_map();
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, 0, -1));
+  vector<int> up_osds, acting_osds;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting_osds, &acting_primary);
+
+  // next epoch only sets a pg_temp; crush stays shared
+  OSDMap next;
+  next.shallow_copy_from(osdmap);
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = osdmap.get_fsid();
+  inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+    acting_osds.rbegin(), acting_osds.rend());
+  next.apply_incremental(inc);
+  EXPECT_EQ(osdmap.crush, next.crush);
+  EXPECT_EQ(0u, osdmap.get_num_pg_temp());
+  EXPECT_EQ(1u, next.get_num_pg_temp());
+
+  // modifying the copy must not leak into the map it was copied from
+  next.set_primary_affinity(0, 0);
+  EXPECT_EQ((unsigned)CEPH_OSD_DEFAULT_PRIMARY_AFFINITY,
+	    osdmap.get_primary_affinity(0));
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting_osds, &acting_primary);
+  EXPECT_EQ(up_osds, acting_osds);
+
+  // a new crush map is not shared
+  OSDMap last;
+  last.shallow_copy_from(next);
+  OSDMap::Incremental crush_inc(next.get_epoch() + 1);
+  crush_inc.fsid = next.get_fsid();
+  next.crush->encode(crush_inc.crush, CEPH_FEATURES_SUPPORTED_DEFAULT);
+  last.apply_incremental(crush_inc);
+  EXPECT_NE(next.crush, last.crush);
+
+  // ...until we dedup it against the previous epoch
+  OSDMap::dedup(&next, &last);
+  EXPECT_EQ(next.crush, last.crush);
+}
+
 TEST_F(OSDMapTest, CleanTemps) {
   set_up_map();
 
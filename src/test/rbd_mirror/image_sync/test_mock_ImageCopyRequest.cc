@@ -47,10 +47,14 @@ struct ObjectCopyRequest<librbd::MockTestImageCtx> {
   static ObjectCopyRequest* create(librbd::MockTestImageCtx *local_image_ctx,
                                    librbd::MockTestImageCtx *remote_image_ctx,
                                    const ImageCopyRequest<librbd::MockTestImageCtx>::SnapMap *snap_map,
-                                   uint64_t object_number, Context *on_finish) {
+                                   const ImageCopyRequest<librbd::MockTestImageCtx>::SnapExtentMaps *extent_diffs,
+                                   uint64_t object_number,
+                                   bool skip_matching_object,
+                                   Context *on_finish) {
     assert(s_instance != nullptr);
     Mutex::Locker locker(s_instance->lock);
     s_instance->snap_map = snap_map;
+    s_instance->skip_matching_object = skip_matching_object;
     s_instance->object_contexts[object_number] = on_finish;
     s_instance->cond.Signal();
     return s_instance;
@@ -62,6 +66,7 @@ struct ObjectCopyRequest<librbd::MockTestImageCtx> {
   Cond cond;
 
   const ImageCopyRequest<librbd::MockTestImageCtx>::SnapMap *snap_map = nullptr;
+  bool skip_matching_object = false;
   std::map<uint64_t, Context *> object_contexts;
 
   ObjectCopyRequest() : lock("lock") {
@@ -251,11 +256,6 @@ TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
     ASSERT_EQ(0, _rados->conf_set("rbd_mirror_sync_point_update_age", update_sync_age.c_str()));
   } BOOST_SCOPE_EXIT_END;
 
-
-  std::string max_ops_str;
-  ASSERT_EQ(0, _rados->conf_get("rbd_concurrent_management_ops", max_ops_str));
-  int max_ops = std::stoi(max_ops_str);
-
   uint64_t object_count = 55;
 
   librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
@@ -270,21 +270,19 @@ TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
 
   EXPECT_CALL(mock_object_copy_request, send()).Times(object_count);
 
-  boost::optional<uint64_t> expected_object_number(boost::none);
+  // the sync point should never advance past an incomplete object copy
+  Mutex completed_lock("completed_lock");
+  std::set<uint64_t> completed_object_nos;
   EXPECT_CALL(mock_journaler, update_client(_, _))
     .WillRepeatedly(
-        Invoke([&expected_object_number, max_ops, object_count, this]
+        Invoke([&completed_lock, &completed_object_nos, this]
                (bufferlist data, Context *ctx) {
-          ASSERT_EQ(expected_object_number,
-                    m_client_meta.sync_points.front().object_number);
-          if (!expected_object_number) {
-            expected_object_number = (max_ops - 1);
-          } else {
-            expected_object_number = expected_object_number.get() + max_ops;
-          }
-
-          if (expected_object_number.get() > (object_count - 1)) {
-            expected_object_number = (object_count - 1);
+          auto &object_number = m_client_meta.sync_points.front().object_number;
+          if (object_number) {
+            Mutex::Locker locker(completed_lock);
+            for (uint64_t i = 0; i <= *object_number; ++i) {
+              ASSERT_EQ(1U, completed_object_nos.count(i));
+            }
           }
 
           m_threads->work_queue->queue(ctx, 0);
@@ -299,19 +297,22 @@ TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
                                                  &ctx);
   request->send();
 
-  std::function<void()> sleep_fn = [request]() {
-    sleep(2);
-  };
-
   ASSERT_EQ(m_snap_map, wait_for_snap_map(mock_object_copy_request));
   for (uint64_t i = 0; i < object_count; ++i) {
-    if (i % 10 == 0) {
-      ASSERT_TRUE(complete_object_copy(mock_object_copy_request, i, 0, sleep_fn));
-    } else {
-      ASSERT_TRUE(complete_object_copy(mock_object_copy_request, i, 0));
-    }
+    std::function<void()> complete_fn =
+      [&completed_lock, &completed_object_nos, i]() {
+        if (i % 10 == 0) {
+          sleep(2);
+        }
+        Mutex::Locker locker(completed_lock);
+        completed_object_nos.insert(i);
+      };
+    ASSERT_TRUE(complete_object_copy(mock_object_copy_request, i, 0,
+                                     complete_fn));
   }
   ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(object_count - 1,
+            m_client_meta.sync_points.front().object_number.get());
 }
 
 TEST_F(TestMockImageSyncImageCopyRequest, SnapshotSubset) {
@@ -517,7 +518,8 @@ TEST_F(TestMockImageSyncImageCopyRequest, Cancel_Inflight_Sync) {
   ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 5, 0));
 
   ASSERT_EQ(-ECANCELED, ctx.wait());
-  ASSERT_EQ(5u, m_client_meta.sync_points.front().object_number.get());
+  // objects 3 through 5 were still in-flight during the last sync point update
+  ASSERT_EQ(2u, m_client_meta.sync_points.front().object_number.get());
 }
 
 TEST_F(TestMockImageSyncImageCopyRequest, Cancel1) {
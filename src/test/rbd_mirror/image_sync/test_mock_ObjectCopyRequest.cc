@@ -11,6 +11,7 @@
 #include "librbd/Operations.h"
 #include "librbd/io/ImageRequestWQ.h"
 #include "librbd/io/ReadResult.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "test/librados_test_stub/MockTestMemIoCtxImpl.h"
 #include "test/librbd/mock/MockImageCtx.h"
 #include "tools/rbd_mirror/Threads.h"
@@ -120,12 +121,14 @@ public:
 
   MockObjectCopyRequest *create_request(librbd::MockTestImageCtx &mock_remote_image_ctx,
                                         librbd::MockTestImageCtx &mock_local_image_ctx,
-                                        Context *on_finish) {
+                                        Context *on_finish,
+                                        bool skip_matching_object = false) {
     expect_get_object_name(mock_local_image_ctx);
     expect_get_object_name(mock_remote_image_ctx);
     return new MockObjectCopyRequest(&mock_local_image_ctx,
                                      &mock_remote_image_ctx, &m_snap_map,
-                                     0, on_finish);
+                                     &m_extent_diffs, 0, skip_matching_object,
+                                     on_finish);
   }
 
   void expect_set_snap_read(librados::MockTestMemIoCtxImpl &mock_io_ctx,
@@ -144,6 +147,16 @@ public:
     }
   }
 
+  void expect_read(librados::MockTestMemIoCtxImpl &mock_io_ctx,
+                   uint64_t offset, uint64_t length, int r) {
+    auto &expect = EXPECT_CALL(mock_io_ctx, read(_, length, offset, _));
+    if (r < 0) {
+      expect.WillOnce(Return(r));
+    } else {
+      expect.WillOnce(DoDefault());
+    }
+  }
+
   void expect_sparse_read(librados::MockTestMemIoCtxImpl &mock_io_ctx,
                    const interval_set<uint64_t> &extents, int r) {
     for (auto extent : extents) {
@@ -337,6 +350,7 @@ public:
   librbd::ImageCtx *m_local_image_ctx;
 
   MockObjectCopyRequest::SnapMap m_snap_map;
+  MockObjectCopyRequest::SnapExtentMaps m_extent_diffs;
   std::vector<librados::snap_t> m_remote_snap_ids;
   std::vector<librados::snap_t> m_local_snap_ids;
 };
@@ -401,6 +415,101 @@ TEST_F(TestMockImageSyncObjectCopyRequest, Write) {
   ASSERT_EQ(0, compare_objects());
 }
 
+TEST_F(TestMockImageSyncObjectCopyRequest, SkipMatchingObject) {
+  // scribble some data
+  interval_set<uint64_t> one;
+  scribble(m_remote_image_ctx, 10, 102400, &one);
+
+  ASSERT_EQ(0, create_snap("sync"));
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  librbd::MockObjectMap mock_object_map;
+  mock_local_image_ctx.object_map = &mock_object_map;
+
+  expect_test_features(mock_local_image_ctx);
+
+  // initial copy of the object
+  C_SaferCond ctx1;
+  MockObjectCopyRequest *request1 = create_request(mock_remote_image_ctx,
+                                                   mock_local_image_ctx, &ctx1);
+
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx1(get_mock_io_ctx(
+    request1->get_remote_io_ctx()));
+  librados::MockTestMemIoCtxImpl &mock_local_io_ctx1(get_mock_io_ctx(
+    request1->get_local_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx1, 0);
+  expect_set_snap_read(mock_remote_io_ctx1, m_remote_snap_ids[0]);
+  expect_sparse_read(mock_remote_io_ctx1, 0, one.range_end(), 0);
+  expect_write(mock_local_io_ctx1, 0, one.range_end(), {0, {}}, 0);
+  expect_update_object_map(mock_local_image_ctx, mock_object_map,
+                           m_local_snap_ids[0], OBJECT_EXISTS, 0);
+
+  request1->send();
+  ASSERT_EQ(0, ctx1.wait());
+
+  // resumed copy of the same object only compares checksums
+  C_SaferCond ctx2;
+  MockObjectCopyRequest *request2 = create_request(mock_remote_image_ctx,
+                                                   mock_local_image_ctx, &ctx2,
+                                                   true);
+
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx2(get_mock_io_ctx(
+    request2->get_remote_io_ctx()));
+  librados::MockTestMemIoCtxImpl &mock_local_io_ctx2(get_mock_io_ctx(
+    request2->get_local_io_ctx()));
+
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx2, 0);
+  expect_read(mock_local_io_ctx2, 0, one.range_end(), 0);
+  expect_set_snap_read(mock_remote_io_ctx2, m_remote_snap_ids[0]);
+  expect_read(mock_remote_io_ctx2, 0, one.range_end(), 0);
+  expect_update_object_map(mock_local_image_ctx, mock_object_map,
+                           m_local_snap_ids[0], OBJECT_EXISTS, 0);
+
+  request2->send();
+  ASSERT_EQ(0, ctx2.wait());
+  ASSERT_EQ(0, compare_objects());
+}
+
+TEST_F(TestMockImageSyncObjectCopyRequest, SkipMatchingObjectMissing) {
+  // scribble some data
+  interval_set<uint64_t> one;
+  scribble(m_remote_image_ctx, 10, 102400, &one);
+
+  ASSERT_EQ(0, create_snap("sync"));
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  librbd::MockObjectMap mock_object_map;
+  mock_local_image_ctx.object_map = &mock_object_map;
+
+  expect_test_features(mock_local_image_ctx);
+
+  C_SaferCond ctx;
+  MockObjectCopyRequest *request = create_request(mock_remote_image_ctx,
+                                                  mock_local_image_ctx, &ctx,
+                                                  true);
+
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+  librados::MockTestMemIoCtxImpl &mock_local_io_ctx(get_mock_io_ctx(
+    request->get_local_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, 0);
+  expect_set_snap_read(mock_remote_io_ctx, m_remote_snap_ids[0]);
+  expect_sparse_read(mock_remote_io_ctx, 0, one.range_end(), 0);
+  expect_write(mock_local_io_ctx, 0, one.range_end(), {0, {}}, 0);
+  expect_update_object_map(mock_local_image_ctx, mock_object_map,
+                           m_local_snap_ids[0], OBJECT_EXISTS, 0);
+
+  request->send();
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(0, compare_objects());
+}
+
 TEST_F(TestMockImageSyncObjectCopyRequest, ReadMissingStaleSnapSet) {
   ASSERT_EQ(0, create_snap("one"));
   ASSERT_EQ(0, create_snap("two"));
@@ -612,6 +721,73 @@ TEST_F(TestMockImageSyncObjectCopyRequest, WriteSnaps) {
   ASSERT_EQ(0, compare_objects());
 }
 
+TEST_F(TestMockImageSyncObjectCopyRequest, WriteSnapsExtentDiff) {
+  uint64_t object_size = 1 << m_remote_image_ctx->order;
+  uint64_t chunk_size =
+    librbd::object_map::ExtentMap<>::get_chunk_size(object_size);
+  ASSERT_LE(3 * chunk_size, object_size);
+
+  bufferlist bl;
+  bl.append(std::string(4096, '1'));
+  ASSERT_EQ(4096, m_remote_image_ctx->io_work_queue->write(
+    0, 4096, bufferlist{bl}, 0));
+  ASSERT_EQ(0, create_snap("one"));
+
+  // rewrite the same data into the first chunk: the snap set diff still
+  // lists it, while the extent map only records the third chunk
+  ASSERT_EQ(4096, m_remote_image_ctx->io_work_queue->write(
+    0, 4096, bufferlist{bl}, 0));
+  ASSERT_EQ(4096, m_remote_image_ctx->io_work_queue->write(
+    2 * chunk_size, 4096, bufferlist{bl}, 0));
+  ASSERT_EQ(0, create_snap("two"));
+
+  ceph::BitVector<2> extent_diff;
+  extent_diff.resize(object_size / chunk_size);
+  for (uint64_t i = 0; i < extent_diff.size(); ++i) {
+    extent_diff[i] = EXTENT_UNCHANGED;
+  }
+  extent_diff[2] = EXTENT_CHANGED;
+  m_extent_diffs[m_remote_snap_ids[1]] = extent_diff;
+
+  ASSERT_EQ(0, create_snap("sync"));
+  librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
+  librbd::MockTestImageCtx mock_local_image_ctx(*m_local_image_ctx);
+
+  librbd::MockObjectMap mock_object_map;
+  mock_local_image_ctx.object_map = &mock_object_map;
+
+  expect_test_features(mock_local_image_ctx);
+
+  C_SaferCond ctx;
+  MockObjectCopyRequest *request = create_request(mock_remote_image_ctx,
+                                                  mock_local_image_ctx, &ctx);
+
+  librados::MockTestMemIoCtxImpl &mock_remote_io_ctx(get_mock_io_ctx(
+    request->get_remote_io_ctx()));
+  librados::MockTestMemIoCtxImpl &mock_local_io_ctx(get_mock_io_ctx(
+    request->get_local_io_ctx()));
+
+  InSequence seq;
+  expect_list_snaps(mock_remote_image_ctx, mock_remote_io_ctx, 0);
+  expect_set_snap_read(mock_remote_io_ctx, m_remote_snap_ids[0]);
+  expect_sparse_read(mock_remote_io_ctx, 0, 4096, 0);
+  expect_write(mock_local_io_ctx, 0, 4096, {0, {}}, 0);
+  expect_set_snap_read(mock_remote_io_ctx, m_remote_snap_ids[2]);
+  expect_sparse_read(mock_remote_io_ctx, 2 * chunk_size, 4096, 0);
+  expect_write(mock_local_io_ctx, 2 * chunk_size, 4096,
+               {m_local_snap_ids[0], {m_local_snap_ids[0]}}, 0);
+  expect_update_object_map(mock_local_image_ctx, mock_object_map,
+                           m_local_snap_ids[0], OBJECT_EXISTS, 0);
+  expect_update_object_map(mock_local_image_ctx, mock_object_map,
+                           m_local_snap_ids[1], OBJECT_EXISTS, 0);
+  expect_update_object_map(mock_local_image_ctx, mock_object_map,
+                           m_local_snap_ids[2], OBJECT_EXISTS_CLEAN, 0);
+
+  request->send();
+  ASSERT_EQ(0, ctx.wait());
+  ASSERT_EQ(0, compare_objects());
+}
+
 TEST_F(TestMockImageSyncObjectCopyRequest, Trim) {
   ASSERT_EQ(0, m_remote_image_ctx->operations->metadata_set(
               "conf_rbd_skip_partial_discard", "false"));
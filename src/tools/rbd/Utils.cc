@@ -26,11 +26,23 @@ namespace po = boost::program_options;
 int ProgressContext::update_progress(uint64_t offset, uint64_t total) {
   if (progress) {
     int pc = total ? (offset * 100ull / total) : 0;
-    if (pc != last_pc) {
+    uint64_t moved = bytes;
+    ceph::mono_time now = ceph::mono_clock::now();
+    // refresh the throughput at least once a second, even if the
+    // percentage did not change (large images)
+    if (pc != last_pc ||
+        (moved > 0 && now - last_update >= std::chrono::seconds(1))) {
       cerr << "\r" << operation << ": "
            << pc << "% complete...";
+      if (moved > 0) {
+        double elapsed = std::chrono::duration<double>(now - start_time).count();
+        if (elapsed > 0) {
+          cerr << " (" << prettybyte_t(moved / elapsed) << "/s)   ";
+        }
+      }
       cerr.flush();
       last_pc = pc;
+      last_update = now;
     }
   }
   return 0;
@@ -38,7 +50,14 @@ int ProgressContext::update_progress(uint64_t offset, uint64_t total) {
 
 void ProgressContext::finish() {
   if (progress) {
-    cerr << "\r" << operation << ": 100% complete...done." << std::endl;
+    cerr << "\r" << operation << ": 100% complete...done.";
+    uint64_t moved = bytes;
+    double elapsed = std::chrono::duration<double>(
+      ceph::mono_clock::now() - start_time).count();
+    if (moved > 0 && elapsed > 0) {
+      cerr << " (" << prettybyte_t(moved / elapsed) << "/s)";
+    }
+    cerr << std::endl;
   }
 }
 
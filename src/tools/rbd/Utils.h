@@ -8,6 +8,8 @@
 #include "include/rados/librados.hpp"
 #include "include/rbd/librbd.hpp"
 #include "tools/rbd/ArgumentTypes.h"
+#include "common/ceph_time.h"
+#include <atomic>
 #include <string>
 #include <boost/program_options.hpp>
 
@@ -69,8 +71,18 @@ struct ProgressContext : public librbd::ProgressContext {
   bool progress;
   int last_pc;
 
+  // bytes moved so far, reported as throughput when non-zero
+  std::atomic<uint64_t> bytes;
+  ceph::mono_time start_time;
+  ceph::mono_time last_update;
+
   ProgressContext(const char *o, bool no_progress)
-    : operation(o), progress(!no_progress), last_pc(0) {
+    : operation(o), progress(!no_progress), last_pc(0), bytes(0),
+      start_time(ceph::mono_clock::now()), last_update(start_time) {
+  }
+
+  void add_bytes(uint64_t len) {
+    bytes += len;
   }
 
   int update_progress(uint64_t offset, uint64_t total) override;
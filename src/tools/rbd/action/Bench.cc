@@ -8,7 +8,11 @@
 #include "common/strtol.h"
 #include "common/Cond.h"
 #include "common/Mutex.h"
+#include <atomic>
 #include <iostream>
+#include <list>
+#include <thread>
+#include <sys/resource.h>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
 #include <boost/accumulators/statistics/rolling_sum.hpp>
@@ -184,9 +188,71 @@ void rbd_bencher_completion(void *vc, void *pc)
   delete bc;
 }
 
+struct bench_queue_t {
+  rbd_bencher bencher;
+  uint64_t io_bytes;
+  unsigned seed;
+  std::thread thread;
+
+  bench_queue_t(librbd::Image *image, io_type_t io_type, uint64_t io_size,
+                uint64_t io_bytes, unsigned seed)
+    : bencher(image, io_type, io_size), io_bytes(io_bytes), seed(seed) {
+  }
+};
+
+void run_bench_queue(bench_queue_t *q, uint64_t size, uint64_t io_size,
+                     uint64_t io_threads, bool random, int op_flags,
+                     std::atomic<uint64_t> *ios, std::atomic<uint64_t> *bytes)
+{
+  rbd_bencher &b = q->bencher;
+  vector<uint64_t> thread_offset;
+  uint64_t i;
+  uint64_t start_pos;
+
+  // disturb all thread's offset, used by seq IO
+  for (i = 0; i < io_threads; i++) {
+    start_pos = (rand_r(&q->seed) % (size / io_size)) * io_size;
+    thread_offset.push_back(start_pos);
+  }
+
+  uint64_t off;
+  for (off = 0; off < q->io_bytes; ) {
+    b.wait_for(io_threads - 1);
+    i = 0;
+    while (i < io_threads && off < q->io_bytes) {
+      if (random) {
+        thread_offset[i] = (rand_r(&q->seed) % (size / io_size)) * io_size;
+      } else {
+        thread_offset[i] += io_size;
+        if (thread_offset[i] + io_size > size)
+          thread_offset[i] = 0;
+      }
+
+      if (!b.start_io(io_threads, thread_offset[i], io_size, op_flags))
+        break;
+
+      ++i;
+      off += io_size;
+      ++(*ios);
+      *bytes += io_size;
+    }
+  }
+  b.wait_for(0);
+}
+
+double get_cpu_seconds()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) < 0) {
+    return 0;
+  }
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
 int do_bench(librbd::Image& image, io_type_t io_type,
 		   uint64_t io_size, uint64_t io_threads,
-		   uint64_t io_bytes, bool random)
+		   uint64_t io_bytes, bool random, uint64_t io_queues)
 {
   uint64_t size = 0;
   image.size(&size);
@@ -201,30 +267,42 @@ int do_bench(librbd::Image& image, io_type_t io_type,
     return -EINVAL;
   }
 
-  rbd_bencher b(&image, io_type, io_size);
-
   std::cout << "bench "
        << " type " << (io_type == IO_TYPE_READ ? "read" : "write")
        << " io_size " << io_size
        << " io_threads " << io_threads
        << " bytes " << io_bytes
        << " pattern " << (random ? "random" : "sequential")
+       << " io_queues " << io_queues
        << std::endl;
 
   srand(time(NULL) % (unsigned long) -1);
 
-  utime_t start = ceph_clock_now();
-  utime_t last;
-  unsigned ios = 0;
+  int op_flags;
+  if  (random) {
+    op_flags = LIBRADOS_OP_FLAG_FADVISE_RANDOM;
+  } else {
+    op_flags = LIBRADOS_OP_FLAG_FADVISE_SEQUENTIAL;
+  }
 
-  vector<uint64_t> thread_offset;
-  uint64_t i;
-  uint64_t start_pos;
+  // each queue submits from its own thread with its own window of
+  // io_threads requests in flight
+  std::atomic<uint64_t> ios(0);
+  std::atomic<uint64_t> bytes(0);
+  std::list<bench_queue_t> queues;
+  uint64_t ios_per_queue = io_bytes / io_size / io_queues;
 
-  // disturb all thread's offset, used by seq IO
-  for (i = 0; i < io_threads; i++) {
-    start_pos = (rand() % (size / io_size)) * io_size;
-    thread_offset.push_back(start_pos);
+  double cpu_start = get_cpu_seconds();
+  utime_t start = ceph_clock_now();
+  for (uint64_t q = 0; q < io_queues; ++q) {
+    uint64_t queue_bytes = ios_per_queue * io_size;
+    if (q == 0) {
+      queue_bytes = io_bytes - (io_queues - 1) * queue_bytes;
+    }
+    queues.emplace_back(&image, io_type, io_size, queue_bytes, rand());
+    bench_queue_t *queue = &queues.back();
+    queue->thread = std::thread(run_bench_queue, queue, size, io_size,
+                                io_threads, random, op_flags, &ios, &bytes);
   }
 
   const int WINDOW_SIZE = 5;
@@ -238,62 +316,39 @@ int do_bench(librbd::Image& image, io_type_t io_type,
     boost::accumulators::tag::rolling_window::window_size = WINDOW_SIZE);
   RollingSum off_acc(
     boost::accumulators::tag::rolling_window::window_size = WINDOW_SIZE);
-  uint64_t cur_ios = 0;
-  uint64_t cur_off = 0;
-
-  int op_flags;
-  if  (random) {
-    op_flags = LIBRADOS_OP_FLAG_FADVISE_RANDOM;
-  } else {
-    op_flags = LIBRADOS_OP_FLAG_FADVISE_SEQUENTIAL;
-  }
+  utime_t last;
+  uint64_t last_ios = 0;
+  uint64_t last_bytes = 0;
 
   printf("  SEC       OPS   OPS/SEC   BYTES/SEC\n");
-  uint64_t off;
-  for (off = 0; off < io_bytes; ) {
-    b.wait_for(io_threads - 1);
-    i = 0;
-    while (i < io_threads && off < io_bytes) {
-      if (random) {
-        thread_offset[i] = (rand() % (size / io_size)) * io_size;
-      } else {
-        thread_offset[i] += io_size;
-        if (thread_offset[i] + io_size > size)
-          thread_offset[i] = 0;
-      }
-
-      if (!b.start_io(io_threads, thread_offset[i], io_size, op_flags))
-        break;
-
-      ++i;
-      ++ios;
-      off += io_size;
-
-      ++cur_ios;
-      cur_off += io_size;
-    }
+  while (bytes < io_bytes) {
+    usleep(100000);
 
     utime_t now = ceph_clock_now();
     utime_t elapsed = now - start;
     if (last.is_zero()) {
       last = elapsed;
     } else if (elapsed.sec() != last.sec()) {
+      uint64_t cur_ios = ios;
+      uint64_t cur_bytes = bytes;
       time_acc(elapsed - last);
-      ios_acc(static_cast<double>(cur_ios));
-      off_acc(static_cast<double>(cur_off));
-      cur_ios = 0;
-      cur_off = 0;
+      ios_acc(static_cast<double>(cur_ios - last_ios));
+      off_acc(static_cast<double>(cur_bytes - last_bytes));
+      last_ios = cur_ios;
+      last_bytes = cur_bytes;
 
       double time_sum = boost::accumulators::rolling_sum(time_acc);
       printf("%5d  %8d  %8.2lf  %8.2lf\n",
              (int)elapsed,
-             (int)(ios - io_threads),
+             (int)cur_ios,
              boost::accumulators::rolling_sum(ios_acc) / time_sum,
              boost::accumulators::rolling_sum(off_acc) / time_sum);
       last = elapsed;
     }
   }
-  b.wait_for(0);
+  for (auto &queue : queues) {
+    queue.thread.join();
+  }
   int r = image.flush();
   if (r < 0) {
     std::cerr << "Error flushing data at the end: " << cpp_strerror(r)
@@ -302,9 +357,15 @@ int do_bench(librbd::Image& image, io_type_t io_type,
 
   utime_t now = ceph_clock_now();
   double elapsed = now - start;
+  double cpu = get_cpu_seconds() - cpu_start;
 
   printf("elapsed: %5d  ops: %8d  ops/sec: %8.2lf  bytes/sec: %8.2lf\n",
-         (int)elapsed, ios, (double)ios / elapsed, (double)off / elapsed);
+         (int)elapsed, (int)ios.load(), (double)ios / elapsed,
+         (double)bytes / elapsed);
+  if (cpu > 0) {
+    // ops per second of client CPU time, i.e. per fully busy core
+    printf("cpu: %8.2lf  ops/cpu-sec: %8.2lf\n", cpu, (double)ios / cpu);
+  }
 
   return 0;
 }
@@ -317,7 +378,8 @@ void add_bench_common_options(po::options_description *positional,
     ("io-size", po::value<Size>(), "IO size (in B/K/M/G/T) [default: 4K]")
     ("io-threads", po::value<uint32_t>(), "ios in flight [default: 16]")
     ("io-total", po::value<Size>(), "total size for IO (in B/K/M/G/T) [default: 1G]")
-    ("io-pattern", po::value<IOPattern>(), "IO pattern (rand or seq) [default: seq]");
+    ("io-pattern", po::value<IOPattern>(), "IO pattern (rand or seq) [default: seq]")
+    ("io-queues", po::value<uint32_t>(), "threads submitting IO, each with io-threads ios in flight [default: 1]");
 }
 
 void get_arguments_for_write(po::options_description *positional,
@@ -385,6 +447,17 @@ int bench_execute(const po::variables_map &vm, io_type_t bench_io_type) {
     bench_random = false;
   }
 
+  uint32_t bench_io_queues;
+  if (vm.count("io-queues")) {
+    bench_io_queues = vm["io-queues"].as<uint32_t>();
+  } else {
+    bench_io_queues = 1;
+  }
+  if (bench_io_queues == 0) {
+    std::cerr << "rbd: --io-queues should be greater than zero." << std::endl;
+    return -EINVAL;
+  }
+
   librados::Rados rados;
   librados::IoCtx io_ctx;
   librbd::Image image;
@@ -395,7 +468,7 @@ int bench_execute(const po::variables_map &vm, io_type_t bench_io_type) {
   }
 
   r = do_bench(image, bench_io_type, bench_io_size, bench_io_threads,
-		     bench_bytes, bench_random);
+		     bench_bytes, bench_random, bench_io_queues);
   if (r < 0) {
     std::cerr << "bench failed: " << cpp_strerror(r) << std::endl;
     return r;
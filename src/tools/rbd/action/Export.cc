@@ -9,6 +9,7 @@
 #include "common/errno.h"
 #include "common/Throttle.h"
 #include "include/encoding.h"
+#include "include/interval_set.h"
 #include <iostream>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -19,6 +20,9 @@ namespace rbd {
 namespace action {
 namespace export_full {
 
+// number of periods covered by one allocated extent lookup
+static const uint64_t EXPORT_HOLE_WINDOW_PERIODS = 1024;
+
 struct ExportDiffContext {
   librbd::Image *image;
   int fd;
@@ -77,6 +81,7 @@ protected:
   void finish(int r) override {
     if (r >= 0) {
       if (m_exists) {
+        m_export_diff_context->pc.add_bytes(m_length);
         m_exists = !m_read_data.is_zero();
       }
       r = write_extent(m_export_diff_context, m_offset, m_length, m_exists, m_export_format);
@@ -301,32 +306,45 @@ Shell::Action action_diff(
 class C_Export : public Context
 {
 public:
-  C_Export(SimpleThrottle &simple_throttle, librbd::Image &image,
-	   uint64_t fd_offset, uint64_t offset, uint64_t length, int fd)
-    : m_aio_completion(
-        new librbd::RBD::AioCompletion(this, &utils::aio_context_callback)),
-      m_throttle(simple_throttle), m_image(image), m_dest_offset(fd_offset),
-      m_offset(offset), m_length(length), m_fd(fd)
+  C_Export(OrderedThrottle &ordered_throttle, librbd::Image &image,
+	   uint64_t fd_offset, uint64_t offset, uint64_t length, bool exists,
+	   int fd, utils::ProgressContext &pc)
+    : m_throttle(ordered_throttle), m_image(image), m_dest_offset(fd_offset),
+      m_offset(offset), m_length(length), m_exists(exists), m_fd(fd), m_pc(pc)
   {
   }
 
-  void send()
+  int send()
   {
-    m_throttle.start_op();
+    if (m_throttle.pending_error()) {
+      return m_throttle.wait_for_ret();
+    }
+
+    C_OrderedThrottle *ctx = m_throttle.start_op(this);
+    if (!m_exists) {
+      // known hole: nothing to read
+      ctx->complete(0);
+      return 0;
+    }
 
+    librbd::RBD::AioCompletion *aio_completion =
+      new librbd::RBD::AioCompletion(ctx, &utils::aio_context_callback);
     int op_flags = LIBRADOS_OP_FLAG_FADVISE_SEQUENTIAL |
                    LIBRADOS_OP_FLAG_FADVISE_NOCACHE;
     int r = m_image.aio_read2(m_offset, m_length, m_bufferlist,
-                              m_aio_completion, op_flags);
+                              aio_completion, op_flags);
     if (r < 0) {
       cerr << "rbd: error requesting read from source image" << std::endl;
-      m_aio_completion->release();
-      m_throttle.end_op(r);
+      aio_completion->release();
+      ctx->complete(r);
     }
+    return 0;
   }
 
   void finish(int r) override
   {
+    // the ordered throttle completes the extents in offset order, so the
+    // output can be streamed sequentially regardless of the read depth
     BOOST_SCOPE_EXIT((&m_throttle) (&r))
     {
       m_throttle.end_op(r);
@@ -338,12 +356,20 @@ public:
       return;
     }
 
-    assert(m_bufferlist.length() == static_cast<size_t>(r));
-    if (m_fd != STDOUT_FILENO) {
-      if (m_bufferlist.is_zero()) {
+    m_pc.add_bytes(m_length);
+    if (m_exists) {
+      assert(m_bufferlist.length() == static_cast<size_t>(r));
+    }
+    if (!m_exists || m_bufferlist.is_zero()) {
+      if (m_fd != STDOUT_FILENO) {
+        // leave a hole in the destination file
         return;
       }
+      m_bufferlist.clear();
+      m_bufferlist.append_zero(m_length);
+    }
 
+    if (m_fd != STDOUT_FILENO) {
       uint64_t chkret = lseek64(m_fd, m_dest_offset, SEEK_SET);
       if (chkret != m_dest_offset) {
         cerr << "rbd: error seeking destination image to offset "
@@ -361,16 +387,37 @@ public:
   }
 
 private:
-  librbd::RBD::AioCompletion *m_aio_completion;
-  SimpleThrottle &m_throttle;
+  OrderedThrottle &m_throttle;
   librbd::Image &m_image;
   bufferlist m_bufferlist;
   uint64_t m_dest_offset;
   uint64_t m_offset;
   uint64_t m_length;
+  bool m_exists;
   int m_fd;
+  utils::ProgressContext &m_pc;
 };
 
+static int export_extent_cb(uint64_t offset, size_t length, int exists,
+                            void *arg) {
+  interval_set<uint64_t> *extents =
+    reinterpret_cast<interval_set<uint64_t> *>(arg);
+  if (exists) {
+    extents->union_insert(offset, length);
+  }
+  return 0;
+}
+
+static bool use_fast_diff(librbd::Image &image) {
+  uint64_t features;
+  uint64_t flags;
+  if (image.features(&features) < 0 || image.get_flags(&flags) < 0) {
+    return false;
+  }
+  return ((features & RBD_FEATURE_FAST_DIFF) != 0 &&
+          (flags & RBD_FLAG_FAST_DIFF_INVALID) == 0);
+}
+
 static int do_export_v2(librbd::Image& image, librbd::image_info_t &info, int fd,
 		        uint64_t period, int max_concurrent_ops, utils::ProgressContext &pc)
 {
@@ -466,21 +513,47 @@ static int do_export_v1(librbd::Image& image, librbd::image_info_t &info, int fd
 {
   int r = 0;
   size_t file_size = 0;
-  SimpleThrottle throttle(max_concurrent_ops, false);
+  OrderedThrottle throttle(max_concurrent_ops, false);
+
+  // with a valid fast-diff map the allocated extents are known up front,
+  // so holes are skipped (or zero-filled on stdout) without a read
+  bool skip_holes = use_fast_diff(image);
+  uint64_t window = period * EXPORT_HOLE_WINDOW_PERIODS;
+  interval_set<uint64_t> extents;
   for (uint64_t offset = 0; offset < info.size; offset += period) {
     if (throttle.pending_error()) {
       break;
     }
 
+    if (skip_holes && offset % window == 0) {
+      extents.clear();
+      r = image.diff_iterate2(NULL, offset, min(window, info.size - offset),
+                              true, true, export_extent_cb, &extents);
+      if (r < 0) {
+        cerr << "rbd: error listing allocated extents: " << cpp_strerror(r)
+             << std::endl;
+        break;
+      }
+    }
+
     uint64_t length = min(period, info.size - offset);
-    C_Export *ctx = new C_Export(throttle, image, file_size + offset, offset, length, fd);
+    bool exists = true;
+    if (skip_holes) {
+      exists = extents.intersects(offset, length);
+    }
+
+    C_Export *ctx = new C_Export(throttle, image, file_size + offset, offset,
+                                 length, exists, fd, pc);
     ctx->send();
 
     pc.update_progress(offset, info.size);
   }
 
   file_size += info.size;
-  r = throttle.wait_for_ret();
+  int ret = throttle.wait_for_ret();
+  if (r >= 0) {
+    r = ret;
+  }
   if (fd != 1) {
     if (r >= 0) {
       r = ftruncate(fd, file_size);
@@ -503,13 +576,12 @@ static int do_export(librbd::Image& image, const char *path, bool no_progress, i
     return r;
 
   int fd;
-  int max_concurrent_ops;
+  // extents are written in order, so stdout gets the full read depth too
+  int max_concurrent_ops = max(g_conf->rbd_concurrent_management_ops, 1);
   bool to_stdout = (strcmp(path, "-") == 0);
   if (to_stdout) {
     fd = STDOUT_FILENO;
-    max_concurrent_ops = 1;
   } else {
-    max_concurrent_ops = max(g_conf->rbd_concurrent_management_ops, 1);
     fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
     if (fd < 0) {
       return -errno;
@@ -36,8 +36,8 @@ struct ImportDiffContext {
 
   ImportDiffContext(librbd::Image *image, int fd, size_t size, bool no_progress)
     : image(image), fd(fd), size(size), pc("Importing image diff", no_progress),
-      throttle((fd == STDIN_FILENO) ? 1 :
-               max(g_conf->rbd_concurrent_management_ops, 1), false), last_offset(0) {
+      throttle(max(g_conf->rbd_concurrent_management_ops, 1), false),
+      last_offset(0) {
   }
 
   void update_size(size_t new_size)
@@ -118,6 +118,9 @@ public:
 
   void finish(int r) override
   {
+    if (r >= 0 && !m_discard) {
+      m_idiffctx->pc.add_bytes(m_length);
+    }
     m_idiffctx->update_progress(m_prog_offset);
     m_idiffctx->throttle.end_op(r);
   }
@@ -647,14 +650,10 @@ static int do_import_v1(int fd, librbd::Image &image, uint64_t size,
   char *p = new char[imgblklen];
   uint64_t image_pos = 0;
   bool from_stdin = (fd == STDIN_FILENO);
-  boost::scoped_ptr<SimpleThrottle> throttle;
-
-  if (from_stdin) {
-    throttle.reset(new SimpleThrottle(1, false));
-  } else {
-    throttle.reset(new SimpleThrottle(
-                     max(g_conf->rbd_concurrent_management_ops, 1), false));
-  }
+  // every block is copied out of the read buffer before it is queued, so
+  // a pipe can be drained into the image at the full write depth as well
+  boost::scoped_ptr<SimpleThrottle> throttle(new SimpleThrottle(
+    max(g_conf->rbd_concurrent_management_ops, 1), false));
 
   reqlen = min<uint64_t>(reqlen, size);
   // loop body handles 0 return, as we may have a block to flush
@@ -669,6 +668,7 @@ static int do_import_v1(int fd, librbd::Image &image, uint64_t size,
       reqlen -= readlen;
       continue;
     }
+    pc.add_bytes(blklen);
     if (!from_stdin)
       pc.update_progress(image_pos, size);
 
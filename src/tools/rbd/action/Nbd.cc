@@ -103,7 +103,9 @@ void get_map_arguments(po::options_description *positional,
     ("exclusive", po::bool_switch(), "forbid writes by other clients")
     ("device", po::value<std::string>(), "specify nbd device")
     ("nbds_max", po::value<std::string>(), "override module param nbds_max")
-    ("max_part", po::value<std::string>(), "override module param max_part");
+    ("max_part", po::value<std::string>(), "override module param max_part")
+    ("connections", po::value<std::string>(),
+     "number of nbd connections (queues) per device");
 }
 
 int execute_map(const po::variables_map &vm)
@@ -151,6 +153,10 @@ int execute_map(const po::variables_map &vm)
     args.push_back("--max_part");
     args.push_back(vm["max_part"].as<std::string>().c_str());
   }
+  if (vm.count("connections")) {
+    args.push_back("--connections");
+    args.push_back(vm["connections"].as<std::string>().c_str());
+  }
 
   return call_nbd_cmd(vm, args);
 }
@@ -6,8 +6,11 @@
 #include "include/stringify.h"
 #include "common/errno.h"
 #include "common/Timer.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "include/rbd/object_map_types.h"
 #include "journal/Journaler.h"
 #include "librbd/Utils.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "tools/rbd_mirror/ProgressContext.h"
 
 #define dout_context g_ceph_context
@@ -21,6 +24,7 @@ namespace mirror {
 namespace image_sync {
 
 using librbd::util::create_context_callback;
+using librbd::util::create_rados_callback;
 using librbd::util::unique_lock_name;
 
 template <typename I>
@@ -77,7 +81,7 @@ void ImageCopyRequest<I>::send_update_max_object_count() {
   }
 
   if (max_objects <= m_client_meta->sync_object_count) {
-    send_object_copies();
+    send_load_extent_maps();
     return;
   }
 
@@ -121,7 +125,95 @@ void ImageCopyRequest<I>::handle_update_max_object_count(int r) {
   // update provided meta structure to reflect reality
   m_client_meta->sync_object_count = m_client_meta_copy.sync_object_count;
 
-  send_object_copies();
+  send_load_extent_maps();
+}
+
+template <typename I>
+void ImageCopyRequest<I>::send_load_extent_maps() {
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    if ((m_remote_image_ctx->features & RBD_FEATURE_EXTENT_MAP) != 0) {
+      // the map of a snapshot holds the chunks written since the one before
+      librados::snap_t start_snap_id = m_snap_map.begin()->first;
+      librados::snap_t end_snap_id = m_snap_map.rbegin()->first;
+      for (auto it = m_remote_image_ctx->snap_info.upper_bound(start_snap_id);
+           it != m_remote_image_ctx->snap_info.end() &&
+             it->first <= end_snap_id; ++it) {
+        m_extent_map_snap_ids.insert(it->first);
+      }
+    }
+  }
+
+  if (!m_extent_map_snap_ids.empty()) {
+    update_progress("LOAD_EXTENT_MAP");
+  }
+  send_load_extent_map();
+}
+
+template <typename I>
+void ImageCopyRequest<I>::send_load_extent_map() {
+  auto it = m_extent_map_snap_ids.upper_bound(m_extent_map_snap_id);
+  {
+    RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+    for (; it != m_extent_map_snap_ids.end(); ++it) {
+      auto snap_it = m_remote_image_ctx->snap_info.find(*it);
+      if (snap_it != m_remote_image_ctx->snap_info.end() &&
+          (snap_it->second.flags & RBD_FLAG_EXTENT_MAP_INVALID) == 0) {
+        break;
+      }
+    }
+  }
+
+  if (it == m_extent_map_snap_ids.end()) {
+    compute_extent_diffs();
+    send_object_copies();
+    return;
+  }
+
+  m_extent_map_snap_id = *it;
+  std::string oid(librbd::object_map::ExtentMap<>::extent_map_name(
+    m_remote_image_ctx->id, m_extent_map_snap_id));
+  dout(20) << ": extent_map_oid=" << oid << dendl;
+
+  librados::ObjectReadOperation op;
+  librbd::cls_client::object_map_load_start(&op);
+
+  m_extent_map_bl.clear();
+  librados::AioCompletion *comp = create_rados_callback<
+    ImageCopyRequest<I>, &ImageCopyRequest<I>::handle_load_extent_map>(this);
+  int r = m_remote_image_ctx->md_ctx.aio_operate(oid, comp, &op,
+                                                 &m_extent_map_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ImageCopyRequest<I>::handle_load_extent_map(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  ceph::BitVector<2> extent_map;
+  if (r == 0) {
+    bufferlist::iterator it = m_extent_map_bl.begin();
+    r = librbd::cls_client::object_map_load_finish(&it, &extent_map);
+  }
+
+  if (r < 0) {
+    // objects are diffed by listing their snapshots across this one
+    dout(5) << ": failed to load extent map: " << cpp_strerror(r) << dendl;
+  } else {
+    m_extent_maps[m_extent_map_snap_id] = std::move(extent_map);
+  }
+
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_canceled) {
+      dout(10) << ": image copy canceled" << dendl;
+      finish(-ECANCELED);
+      return;
+    }
+  }
+
+  send_load_extent_map();
 }
 
 template <typename I>
@@ -134,8 +226,15 @@ void ImageCopyRequest<I>::send_object_copies() {
   }
   m_end_object_no = m_client_meta->sync_object_count;
 
+  // objects past the last recorded sync point might have already been
+  // copied by an interrupted sync -- verify them before re-copying
+  m_skip_matching_objects = (
+    m_sync_point->object_number &&
+    cct->_conf->rbd_mirror_sync_skip_matching_objects);
+
   dout(20) << ": start_object=" << m_object_no << ", "
-           << "end_object=" << m_end_object_no << dendl;
+           << "end_object=" << m_end_object_no << ", "
+           << "skip_matching_objects=" << m_skip_matching_objects << dendl;
 
   update_progress("COPY_OBJECT");
 
@@ -188,17 +287,20 @@ void ImageCopyRequest<I>::send_next_object_copy() {
   dout(20) << ": object_num=" << ono << dendl;
 
   ++m_current_ops;
+  m_in_flight_object_nos.insert(ono);
 
-  Context *ctx = create_context_callback<
-    ImageCopyRequest<I>, &ImageCopyRequest<I>::handle_object_copy>(this);
+  Context *ctx = new FunctionContext([this, ono](int r) {
+      handle_object_copy(ono, r);
+    });
   ObjectCopyRequest<I> *req = ObjectCopyRequest<I>::create(
-    m_local_image_ctx, m_remote_image_ctx, &m_snap_map, ono, ctx);
+    m_local_image_ctx, m_remote_image_ctx, &m_snap_map, &m_extent_diffs, ono,
+    m_skip_matching_objects, ctx);
   req->send();
 }
 
 template <typename I>
-void ImageCopyRequest<I>::handle_object_copy(int r) {
-  dout(20) << ": r=" << r << dendl;
+void ImageCopyRequest<I>::handle_object_copy(uint64_t object_no, int r) {
+  dout(20) << ": object_num=" << object_no << ", r=" << r << dendl;
 
   int percent;
   bool complete;
@@ -206,6 +308,7 @@ void ImageCopyRequest<I>::handle_object_copy(int r) {
     Mutex::Locker locker(m_lock);
     assert(m_current_ops > 0);
     --m_current_ops;
+    m_in_flight_object_nos.erase(object_no);
 
     percent = 100 * m_object_no / m_end_object_no;
 
@@ -253,8 +356,9 @@ void ImageCopyRequest<I>::send_update_sync_point() {
     return;
   }
 
-  if (m_sync_point->object_number &&
-      (m_object_no-1) == m_sync_point->object_number.get()) {
+  // only record objects that (along with all lower objects) are copied
+  boost::optional<uint64_t> object_number = get_sync_object_number();
+  if (!object_number || object_number == m_sync_point->object_number) {
     // update sync point did not progress since last sync
     return;
   }
@@ -262,7 +366,7 @@ void ImageCopyRequest<I>::send_update_sync_point() {
   m_updating_sync_point = true;
 
   m_client_meta_copy = *m_client_meta;
-  m_sync_point->object_number = m_object_no - 1;
+  m_sync_point->object_number = object_number;
 
   CephContext *cct = m_local_image_ctx->cct;
   ldout(cct, 20) << ": sync_point=" << *m_sync_point << dendl;
@@ -323,11 +427,7 @@ void ImageCopyRequest<I>::send_flush_sync_point() {
   update_progress("FLUSH_SYNC_POINT");
 
   m_client_meta_copy = *m_client_meta;
-  if (m_object_no > 0) {
-    m_sync_point->object_number = m_object_no - 1;
-  } else {
-    m_sync_point->object_number = boost::none;
-  }
+  m_sync_point->object_number = get_sync_object_number();
 
   dout(20) << ": sync_point=" << *m_sync_point << dendl;
 
@@ -404,6 +504,80 @@ int ImageCopyRequest<I>::compute_snap_map() {
   return 0;
 }
 
+template <typename I>
+void ImageCopyRequest<I>::compute_extent_diffs() {
+  m_extent_diffs.clear();
+
+  // the chunks changed between two mapped snapshots are the union of the
+  // maps in between. a missing or invalid map disables this for the range.
+  RWLock::RLocker snap_locker(m_remote_image_ctx->snap_lock);
+  librados::snap_t start_snap_id = 0;
+  for (auto &pair : m_snap_map) {
+    librados::snap_t end_snap_id = pair.first;
+    if (start_snap_id == 0) {
+      start_snap_id = end_snap_id;
+      continue;
+    }
+
+    ceph::BitVector<2> extent_diff;
+    bool first = true;
+    bool valid = true;
+    for (auto it = m_extent_map_snap_ids.upper_bound(start_snap_id);
+         it != m_extent_map_snap_ids.end() && *it <= end_snap_id; ++it) {
+      auto snap_it = m_remote_image_ctx->snap_info.find(*it);
+      auto map_it = m_extent_maps.find(*it);
+      if (snap_it == m_remote_image_ctx->snap_info.end() ||
+          (snap_it->second.flags & RBD_FLAG_EXTENT_MAP_INVALID) != 0 ||
+          map_it == m_extent_maps.end()) {
+        valid = false;
+        break;
+      }
+
+      auto &extent_map = map_it->second;
+      uint64_t size = extent_diff.size();
+      if (first) {
+        extent_diff.resize(extent_map.size());
+        first = false;
+      } else if (extent_map.size() > size) {
+        extent_diff.resize(extent_map.size());
+        for (uint64_t i = size; i < extent_map.size(); ++i) {
+          extent_diff[i] = EXTENT_CHANGED;
+        }
+      }
+      for (uint64_t i = 0; i < extent_diff.size(); ++i) {
+        if (i >= extent_map.size() || extent_map[i] == EXTENT_CHANGED) {
+          extent_diff[i] = EXTENT_CHANGED;
+        }
+      }
+    }
+
+    dout(20) << ": start_snap_id=" << start_snap_id << ", "
+             << "end_snap_id=" << end_snap_id << ", "
+             << "valid=" << (valid && !first) << dendl;
+    if (valid && !first) {
+      m_extent_diffs[end_snap_id] = std::move(extent_diff);
+    }
+    start_snap_id = end_snap_id;
+  }
+
+  m_extent_maps.clear();
+}
+
+template <typename I>
+boost::optional<uint64_t> ImageCopyRequest<I>::get_sync_object_number() const {
+  // object copies can complete out-of-order -- the sync point can only
+  // advance up to the lowest object copy still in-flight
+  uint64_t object_no = m_object_no;
+  if (!m_in_flight_object_nos.empty()) {
+    object_no = *m_in_flight_object_nos.begin();
+  }
+
+  if (object_no == 0) {
+    return boost::none;
+  }
+  return object_no - 1;
+}
+
 template <typename I>
 void ImageCopyRequest<I>::update_progress(const std::string &description,
 					  bool flush) {
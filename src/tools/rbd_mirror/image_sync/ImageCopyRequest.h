@@ -6,11 +6,13 @@
 
 #include "include/int_types.h"
 #include "include/rados/librados.hpp"
+#include "common/bit_vector.hpp"
 #include "common/Mutex.h"
 #include "librbd/journal/Types.h"
 #include "librbd/journal/TypeTraits.h"
 #include "tools/rbd_mirror/BaseRequest.h"
 #include <map>
+#include <set>
 #include <vector>
 
 class Context;
@@ -30,6 +32,7 @@ class ImageCopyRequest : public BaseRequest {
 public:
   typedef std::vector<librados::snap_t> SnapIds;
   typedef std::map<librados::snap_t, SnapIds> SnapMap;
+  typedef std::map<librados::snap_t, ceph::BitVector<2> > SnapExtentMaps;
   typedef librbd::journal::TypeTraits<ImageCtxT> TypeTraits;
   typedef typename TypeTraits::Journaler Journaler;
   typedef librbd::journal::MirrorPeerSyncPoint MirrorPeerSyncPoint;
@@ -67,6 +70,11 @@ private:
    *    v
    * UPDATE_MAX_OBJECT_COUNT
    *    |
+   *    |     /-----------\
+   *    |     |           | (repeat for each snapshot,
+   *    v     v           |  skip if extent map disabled)
+   * LOAD_EXTENT_MAP -----/
+   *    |
    *    |   . . . . .
    *    |   .       .  (parallel execution of
    *    v   v       .   multiple objects at once)
@@ -92,12 +100,20 @@ private:
 
   SnapMap m_snap_map;
 
+  std::set<librados::snap_t> m_extent_map_snap_ids;
+  librados::snap_t m_extent_map_snap_id = 0;
+  bufferlist m_extent_map_bl;
+  SnapExtentMaps m_extent_maps;
+  SnapExtentMaps m_extent_diffs;
+
   Mutex m_lock;
   bool m_canceled = false;
 
   uint64_t m_object_no = 0;
   uint64_t m_end_object_no;
   uint64_t m_current_ops = 0;
+  std::set<uint64_t> m_in_flight_object_nos;
+  bool m_skip_matching_objects = false;
   int m_ret_val = 0;
 
   bool m_updating_sync_point;
@@ -109,9 +125,13 @@ private:
   void send_update_max_object_count();
   void handle_update_max_object_count(int r);
 
+  void send_load_extent_maps();
+  void send_load_extent_map();
+  void handle_load_extent_map(int r);
+
   void send_object_copies();
   void send_next_object_copy();
-  void handle_object_copy(int r);
+  void handle_object_copy(uint64_t object_no, int r);
 
   void send_update_sync_point();
   void handle_update_sync_point(int r);
@@ -120,6 +140,8 @@ private:
   void handle_flush_sync_point(int r);
 
   int compute_snap_map();
+  void compute_extent_diffs();
+  boost::optional<uint64_t> get_sync_object_number() const;
 
   void update_progress(const std::string &description, bool flush = true);
 };
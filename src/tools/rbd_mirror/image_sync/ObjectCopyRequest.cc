@@ -3,8 +3,10 @@
 
 #include "ObjectCopyRequest.h"
 #include "librados/snap_set_diff.h"
+#include "include/rbd/object_map_types.h"
 #include "librbd/ObjectMap.h"
 #include "librbd/Utils.h"
+#include "librbd/object_map/ExtentMap.h"
 #include "common/errno.h"
 
 #define dout_context g_ceph_context
@@ -39,11 +41,14 @@ using librbd::util::create_rados_callback;
 template <typename I>
 ObjectCopyRequest<I>::ObjectCopyRequest(I *local_image_ctx, I *remote_image_ctx,
                                         const SnapMap *snap_map,
+                                        const SnapExtentMaps *extent_diffs,
                                         uint64_t object_number,
+                                        bool skip_matching_object,
                                         Context *on_finish)
   : m_local_image_ctx(local_image_ctx), m_remote_image_ctx(remote_image_ctx),
-    m_snap_map(snap_map), m_object_number(object_number),
-    m_on_finish(on_finish) {
+    m_snap_map(snap_map), m_extent_diffs(extent_diffs),
+    m_object_number(object_number),
+    m_skip_matching_object(skip_matching_object), m_on_finish(on_finish) {
   assert(!snap_map->empty());
 
   m_local_io_ctx.dup(m_local_image_ctx->data_ctx);
@@ -114,9 +119,103 @@ void ObjectCopyRequest<I>::handle_list_snaps(int r) {
   }
 
   compute_diffs();
+  if (m_skip_matching_object && is_checksum_comparable()) {
+    send_local_checksum();
+    return;
+  }
+
   send_read_object();
 }
 
+template <typename I>
+void ObjectCopyRequest<I>::send_local_checksum() {
+  uint64_t object_size = m_snap_object_sizes[
+    m_snap_sync_ops.begin()->first.first];
+  dout(20) << ": object_size=" << object_size << dendl;
+
+  bufferlist init_value_bl;
+  ::encode(static_cast<uint32_t>(-1), init_value_bl);
+
+  librados::ObjectReadOperation op;
+  m_local_object_size = 0;
+  m_local_checksum_bl.clear();
+  op.stat(&m_local_object_size, nullptr, nullptr);
+  op.checksum(LIBRADOS_CHECKSUM_TYPE_CRC32C, init_value_bl, 0, object_size, 0,
+              &m_local_checksum_bl, nullptr);
+
+  librados::AioCompletion *comp = create_rados_callback<
+    ObjectCopyRequest<I>, &ObjectCopyRequest<I>::handle_local_checksum>(this);
+  int r = m_local_io_ctx.aio_operate(m_local_oid, comp, &op, nullptr);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ObjectCopyRequest<I>::handle_local_checksum(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  uint64_t object_size = m_snap_object_sizes[
+    m_snap_sync_ops.begin()->first.first];
+  if (r < 0 || m_local_object_size != object_size) {
+    // local object missing or incomplete -- copy from the remote
+    if (r < 0 && r != -ENOENT) {
+      dout(5) << ": failed to checksum local object: " << cpp_strerror(r)
+              << dendl;
+    }
+    send_read_object();
+    return;
+  }
+
+  send_remote_checksum();
+}
+
+template <typename I>
+void ObjectCopyRequest<I>::send_remote_checksum() {
+  librados::snap_t remote_snap_seq = m_snap_sync_ops.begin()->first.second;
+  uint64_t object_size = m_snap_object_sizes[
+    m_snap_sync_ops.begin()->first.first];
+  dout(20) << ": remote_snap_seq=" << remote_snap_seq << dendl;
+
+  bufferlist init_value_bl;
+  ::encode(static_cast<uint32_t>(-1), init_value_bl);
+
+  librados::ObjectReadOperation op;
+  m_remote_checksum_bl.clear();
+  op.checksum(LIBRADOS_CHECKSUM_TYPE_CRC32C, init_value_bl, 0, object_size, 0,
+              &m_remote_checksum_bl, nullptr);
+
+  m_remote_io_ctx.snap_set_read(remote_snap_seq);
+
+  librados::AioCompletion *comp = create_rados_callback<
+    ObjectCopyRequest<I>, &ObjectCopyRequest<I>::handle_remote_checksum>(this);
+  int r = m_remote_io_ctx.aio_operate(m_remote_oid, comp, &op, nullptr);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void ObjectCopyRequest<I>::handle_remote_checksum(int r) {
+  dout(20) << ": r=" << r << dendl;
+
+  if (r < 0) {
+    // let the read path handle missing objects and report errors
+    dout(5) << ": failed to checksum remote object: " << cpp_strerror(r)
+            << dendl;
+    send_read_object();
+    return;
+  }
+
+  if (!m_remote_checksum_bl.contents_equal(m_local_checksum_bl)) {
+    send_read_object();
+    return;
+  }
+
+  dout(20) << ": local object matches remote object -- skipping copy"
+           << dendl;
+  m_snap_sync_ops.clear();
+  send_update_object_map();
+}
+
 template <typename I>
 void ObjectCopyRequest<I>::send_read_object() {
   if (m_snap_sync_ops.empty()) {
@@ -394,6 +493,19 @@ void ObjectCopyRequest<I>::compute_diffs() {
         dout(20) << ": clearing truncate diff: " << trunc << dendl;
       }
 
+      // only the chunks recorded in the remote extent maps can differ from
+      // the previous snapshot. objects that did not exist before might have
+      // been copied up from the parent and are copied in full.
+      auto extent_diff_it = m_extent_diffs->find(end_remote_snap_id);
+      if (prev_exists && !diff.empty() &&
+          extent_diff_it != m_extent_diffs->end()) {
+        interval_set<uint64_t> changed;
+        get_changed_extents(extent_diff_it->second, &changed);
+        diff.intersection_of(changed);
+        dout(20) << ": changed extents: " << changed << ", "
+                 << "diff=" << diff << dendl;
+      }
+
       // prepare the object map state
       {
         RWLock::RLocker snap_locker(m_local_image_ctx->snap_lock);
@@ -447,6 +559,45 @@ void ObjectCopyRequest<I>::compute_diffs() {
   }
 }
 
+template <typename I>
+void ObjectCopyRequest<I>::get_changed_extents(
+    const ceph::BitVector<2> &extent_diff, interval_set<uint64_t> *changed) {
+  uint64_t object_size = m_remote_image_ctx->layout.object_size;
+  uint64_t chunk_size =
+    librbd::object_map::ExtentMap<>::get_chunk_size(object_size);
+  uint64_t chunks_per_object = std::max<uint64_t>(object_size / chunk_size, 1);
+
+  // chunks past the end of the map are considered changed
+  uint64_t start_chunk_no = m_object_number * chunks_per_object;
+  for (uint64_t i = 0; i < chunks_per_object; ++i) {
+    if (start_chunk_no + i >= extent_diff.size() ||
+        extent_diff[start_chunk_no + i] == EXTENT_CHANGED) {
+      changed->insert(i * chunk_size, chunk_size);
+    }
+  }
+}
+
+template <typename I>
+bool ObjectCopyRequest<I>::is_checksum_comparable() {
+  // the HEAD revision of the local object can only be compared when a single
+  // full revision of the remote object would be written without a snapshot
+  // context (i.e. no local clones would be created)
+  if (m_snap_sync_ops.size() != 1) {
+    return false;
+  }
+
+  auto &pair = *m_snap_sync_ops.begin();
+  if (pair.first.first != m_snap_map->begin()->first) {
+    return false;
+  }
+  for (auto &sync_op : pair.second) {
+    if (sync_op.type != SYNC_OP_TYPE_WRITE) {
+      return false;
+    }
+  }
+  return m_snap_object_sizes[pair.first.first] > 0;
+}
+
 template <typename I>
 void ObjectCopyRequest<I>::finish(int r) {
   dout(20) << ": r=" << r << dendl;
@@ -5,7 +5,9 @@
 #define RBD_MIRROR_IMAGE_SYNC_OBJECT_COPY_REQUEST_H
 
 #include "include/int_types.h"
+#include "include/interval_set.h"
 #include "include/rados/librados.hpp"
+#include "common/bit_vector.hpp"
 #include "common/snap_types.h"
 #include "librbd/ImageCtx.h"
 #include <list>
@@ -24,17 +26,24 @@ class ObjectCopyRequest {
 public:
   typedef std::vector<librados::snap_t> SnapIds;
   typedef std::map<librados::snap_t, SnapIds> SnapMap;
+  typedef std::map<librados::snap_t, ceph::BitVector<2> > SnapExtentMaps;
 
   static ObjectCopyRequest* create(ImageCtxT *local_image_ctx,
                                    ImageCtxT *remote_image_ctx,
                                    const SnapMap *snap_map,
-                                   uint64_t object_number, Context *on_finish) {
+                                   const SnapExtentMaps *extent_diffs,
+                                   uint64_t object_number,
+                                   bool skip_matching_object,
+                                   Context *on_finish) {
     return new ObjectCopyRequest(local_image_ctx, remote_image_ctx, snap_map,
-                                 object_number, on_finish);
+                                 extent_diffs, object_number,
+                                 skip_matching_object, on_finish);
   }
 
   ObjectCopyRequest(ImageCtxT *local_image_ctx, ImageCtxT *remote_image_ctx,
-                    const SnapMap *snap_map, uint64_t object_number,
+                    const SnapMap *snap_map,
+                    const SnapExtentMaps *extent_diffs,
+                    uint64_t object_number, bool skip_matching_object,
                     Context *on_finish);
 
   void send();
@@ -59,17 +68,23 @@ private:
    *    |   * * * * * *
    *    |   *
    *    v   *
-   * READ_OBJECT <--------\
-   *    |                 | (repeat for each snapshot)
-   *    v                 |
-   * WRITE_OBJECT --------/
-   *    |
-   *    |     /-----------\
-   *    |     |           | (repeat for each snapshot)
-   *    v     v           |
-   * UPDATE_OBJECT_MAP ---/ (skip if object
-   *    |                    map disabled)
-   *    |
+   * LOCAL_CHECKSUM     (skip unless verifying a
+   *    |   *            single object revision)
+   *    v   *
+   * REMOTE_CHECKSUM  . . . . . . . . . . . . .
+   *    |   *                                   .
+   *    v   *                                   .
+   * READ_OBJECT <--------\                     .
+   *    |                 | (repeat for each    .
+   *    v                 |  snapshot)          .
+   * WRITE_OBJECT --------/                     .
+   *    |                                       .
+   *    |     /-----------\                     .
+   *    |     |           | (repeat for each    .
+   *    v     v           |  snapshot)          .
+   * UPDATE_OBJECT_MAP ---/ < . . . . . . . . . .
+   *    |                   (checksums match)
+   *    |                   (skip if object map disabled)
    *    v
    * <finish>
    *
@@ -106,7 +121,9 @@ private:
   ImageCtxT *m_local_image_ctx;
   ImageCtxT *m_remote_image_ctx;
   const SnapMap *m_snap_map;
+  const SnapExtentMaps *m_extent_diffs;
   uint64_t m_object_number;
+  bool m_skip_matching_object;
   Context *m_on_finish;
 
   decltype(m_local_image_ctx->data_ctx) m_local_io_ctx;
@@ -120,6 +137,10 @@ private:
   bool m_retry_missing_read = false;
   librados::snap_set_t m_retry_snap_set;
 
+  uint64_t m_local_object_size = 0;
+  bufferlist m_local_checksum_bl;
+  bufferlist m_remote_checksum_bl;
+
   SnapSyncOps m_snap_sync_ops;
   SnapObjectStates m_snap_object_states;
   SnapObjectSizes m_snap_object_sizes;
@@ -127,6 +148,12 @@ private:
   void send_list_snaps();
   void handle_list_snaps(int r);
 
+  void send_local_checksum();
+  void handle_local_checksum(int r);
+
+  void send_remote_checksum();
+  void handle_remote_checksum(int r);
+
   void send_read_object();
   void handle_read_object(int r);
 
@@ -137,6 +164,9 @@ private:
   void handle_update_object_map(int r);
 
   void compute_diffs();
+  void get_changed_extents(const ceph::BitVector<2> &extent_diff,
+                           interval_set<uint64_t> *changed);
+  bool is_checksum_comparable();
   void finish(int r);
 
 };
@@ -34,6 +34,9 @@
 
 #include <iostream>
 #include <fstream>
+#include <list>
+#include <memory>
+#include <vector>
 #include <boost/regex.hpp>
 
 #include "mon/MonClient.h"
@@ -69,6 +72,7 @@ static void usage()
             << "  --nbds_max <limit>      Override for module param nbds_max\n"
             << "  --max_part <limit>      Override for module param max_part\n"
             << "  --exclusive             Forbid writes by other clients\n"
+            << "  --connections <num>     Number of nbd connections (queues) per device\n"
             << std::endl;
   generic_server_usage();
 }
@@ -79,9 +83,15 @@ static int nbds_max = 0;
 static int max_part = 255;
 static bool set_max_part = false;
 static bool exclusive = false;
+static int connections = 1;
 static int nbd = -1;
 
 #define RBD_NBD_BLKSIZE 512UL
+#define RBD_NBD_MAX_CONNECTIONS 64
+
+#ifndef NBD_FLAG_CAN_MULTI_CONN
+#define NBD_FLAG_CAN_MULTI_CONN (1 << 8)
+#endif
 
 #ifdef CEPH_BIG_ENDIAN
 #define ntohll(a) (a)
@@ -170,19 +180,21 @@ private:
     cond.Signal();
   }
 
-  IOContext *wait_io_finish()
+  // grab every finished request so their replies go out in one writev
+  bool wait_io_finish(std::list<IOContext*> *ctxs)
   {
     Mutex::Locker l(lock);
     while(io_finished.empty() && !terminated)
       cond.Wait(lock);
 
     if (io_finished.empty())
-      return NULL;
+      return false;
 
-    IOContext *ret = io_finished.front();
-    io_finished.pop_front();
-
-    return ret;
+    while (!io_finished.empty()) {
+      ctxs->push_back(io_finished.front());
+      io_finished.pop_front();
+    }
+    return true;
   }
 
   void wait_clean()
@@ -271,7 +283,8 @@ private:
 	  dout(0) << "disconnect request received" << dendl;
           return;
         case NBD_CMD_WRITE:
-          bufferptr ptr(ctx->request.len);
+          // read the payload straight into the buffer handed to librbd
+          bufferptr ptr(buffer::create_page_aligned(ctx->request.len));
 	  r = safe_read_exact(fd, ptr.c_str(), ctx->request.len);
           if (r < 0) {
 	    derr << *ctx << ": failed to read nbd request data: "
@@ -312,29 +325,36 @@ private:
   {
     while (!terminated) {
       dout(20) << __func__ << ": waiting for io request" << dendl;
-      ceph::unique_ptr<IOContext> ctx(wait_io_finish());
-      if (!ctx) {
+      std::list<IOContext*> ctxs;
+      if (!wait_io_finish(&ctxs)) {
 	dout(20) << __func__ << ": no io requests, terminating" << dendl;
         return;
       }
 
-      dout(20) << __func__ << ": got: " << *ctx << dendl;
+      // reply headers and the librbd read buffers are chained without
+      // copying and sent with a single vectored write
+      bufferlist bl;
+      for (auto ctx : ctxs) {
+        dout(20) << __func__ << ": got: " << *ctx << dendl;
+        bl.append(reinterpret_cast<char *>(&ctx->reply),
+                  sizeof(struct nbd_reply));
+        if (ctx->command == NBD_CMD_READ && ctx->reply.error == htonl(0)) {
+          bl.claim_append(ctx->data);
+        }
+      }
 
-      int r = safe_write(fd, &ctx->reply, sizeof(struct nbd_reply));
+      int r = bl.write_fd(fd);
+      for (auto ctx : ctxs) {
+        if (r >= 0) {
+          dout(20) << *ctx << ": finish" << dendl;
+        }
+        delete ctx;
+      }
       if (r < 0) {
-	derr << *ctx << ": failed to write reply header: " << cpp_strerror(r)
-	     << dendl;
+	derr << "failed to write " << ctxs.size() << " replies: "
+	     << cpp_strerror(r) << dendl;
         return;
       }
-      if (ctx->command == NBD_CMD_READ && ctx->reply.error == htonl(0)) {
-	r = ctx->data.write_fd(fd);
-        if (r < 0) {
-	  derr << *ctx << ": failed to write replay data: " << cpp_strerror(r)
-	       << dendl;
-          return;
-	}
-      }
-      dout(20) << *ctx << ": finish" << dendl;
     }
     dout(20) << __func__ << ": terminated" << dendl;
   }
@@ -546,6 +566,8 @@ static int do_map(int argc, const char *argv[])
 
   int index = 0;
   int fd[2];
+  // extra socket pairs, one per additional nbd connection
+  std::vector<std::pair<int, int> > extra_fds;
 
   librbd::image_info_t info;
 
@@ -585,6 +607,15 @@ static int do_map(int argc, const char *argv[])
     goto close_ret;
   }
 
+  for (int i = 1; i < connections; ++i) {
+    int extra_fd[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, extra_fd) == -1) {
+      r = -errno;
+      goto close_fd;
+    }
+    extra_fds.push_back(std::make_pair(extra_fd[0], extra_fd[1]));
+  }
+
   if (devpath.empty()) {
     char dev[64];
     bool try_load_module = true;
@@ -632,7 +663,27 @@ static int do_map(int argc, const char *argv[])
     }
   }
 
+  // kernels without multi-connection support refuse the second socket
+  for (size_t i = 0; i < extra_fds.size(); ++i) {
+    r = ioctl(nbd, NBD_SET_SOCK, extra_fds[i].first);
+    if (r < 0) {
+      cerr << "rbd-nbd: kernel does not support multiple connections, "
+           << "using " << i + 1 << std::endl;
+      for (size_t j = i; j < extra_fds.size(); ++j) {
+        close(extra_fds[j].first);
+        close(extra_fds[j].second);
+      }
+      extra_fds.resize(i);
+      break;
+    }
+  }
+
   flags = NBD_FLAG_SEND_FLUSH | NBD_FLAG_SEND_TRIM | NBD_FLAG_HAS_FLAGS;
+  if (!extra_fds.empty()) {
+    // a flush on any connection covers the writes completed on all of
+    // them since they share the same image
+    flags |= NBD_FLAG_CAN_MULTI_CONN;
+  }
   if (!snapname.empty() || readonly) {
     flags |= NBD_FLAG_READ_ONLY;
     read_only = 1;
@@ -724,9 +775,15 @@ static int do_map(int argc, const char *argv[])
     }
 
     {
-      NBDServer server(fd[1], image);
+      std::vector<std::unique_ptr<NBDServer> > servers;
+      servers.emplace_back(new NBDServer(fd[1], image));
+      for (auto &extra_fd : extra_fds) {
+        servers.emplace_back(new NBDServer(extra_fd.second, image));
+      }
 
-      server.start();
+      for (auto &server : servers) {
+        server->start();
+      }
       
       init_async_signal_handler();
       register_async_signal_handler(SIGHUP, sighup_handler);
@@ -740,7 +797,9 @@ static int do_map(int argc, const char *argv[])
       unregister_async_signal_handler(SIGTERM, handle_signal);
       shutdown_async_signal_handler();
       
-      server.stop();
+      for (auto &server : servers) {
+        server->stop();
+      }
     }
 
     r = image.update_unwatch(handle);
@@ -756,6 +815,10 @@ close_nbd:
 close_fd:
   close(fd[0]);
   close(fd[1]);
+  for (auto &extra_fd : extra_fds) {
+    close(extra_fd.first);
+    close(extra_fd.second);
+  }
 close_ret:
   image.close();
   io_ctx.close();
@@ -880,6 +943,16 @@ static int rbd_nbd(int argc, const char *argv[])
       readonly = true;
     } else if (ceph_argparse_flag(args, i, "--exclusive", (char *)NULL)) {
       exclusive = true;
+    } else if (ceph_argparse_witharg(args, i, &connections, err, "--connections", (char *)NULL)) {
+      if (!err.str().empty()) {
+        cerr << err.str() << std::endl;
+        return EXIT_FAILURE;
+      }
+      if ((connections < 1) || (connections > RBD_NBD_MAX_CONNECTIONS)) {
+        cerr << "rbd-nbd: Invalid argument for connections(1~"
+             << RBD_NBD_MAX_CONNECTIONS << ")!" << std::endl;
+        return EXIT_FAILURE;
+      }
     } else {
       ++i;
     }